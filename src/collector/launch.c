@@ -100,7 +100,9 @@ static void cmd_execute(char **args);
 
 static void processMessage(message_t *message, launcher_args_t *launcher_args);
 
-static void launcher(messageQueue_t *messageQueue, char *launch_process, int expire);
+static int launch_command(char *launch_process, launcher_args_t *launcher_args);
+
+static void launcher(messageQueue_t *messageQueue, char *launch_process, char *rollup_process, int expire);
 
 static void do_expire(char *datadir);
 
@@ -348,7 +350,27 @@ void processMessage(message_t *message, launcher_args_t *launcher_args) {
 
 }  // End of processMessage
 
-static void launcher(messageQueue_t *messageQueue, char *launch_process, int expire) {
+// expand and execute the command for the current message
+static int launch_command(char *launch_process, launcher_args_t *launcher_args) {
+    // check valid command expansion
+    char *cmd = cmd_expand(launch_process, launcher_args);
+    if (cmd == NULL) {
+        LogError("Launcher: ident: %s, Unable to expand command: '%s'", launcher_args->ident, launch_process);
+        return 0;
+    }
+    LogVerbose("Launcher: ident: %s run command: '%s'", launcher_args->ident, cmd);
+
+    // prepare args array
+    char *args[MAXARGS];
+    cmd_parse(cmd, args);
+    if (args[0]) cmd_execute(args);
+
+    free(cmd);
+    return 1;
+
+}  // End of launch_command
+
+static void launcher(messageQueue_t *messageQueue, char *launch_process, char *rollup_process, int expire) {
     while (!done) {
         message_t *message = getMessage(messageQueue);
         if (message == (message_t *)-1) {
@@ -361,24 +383,15 @@ static void launcher(messageQueue_t *messageQueue, char *launch_process, int exp
         processMessage(message, &launcher_args);
 
         // may be NULL, if we only expire data files
-        if (launch_process) {
-            char *cmd = NULL;
-
-            // check valid command expansion
-            cmd = cmd_expand(launch_process, &launcher_args);
-            if (cmd == NULL) {
-                LogError("Launcher: ident: %s, Unable to expand command: '%s'", launcher_args.ident, launch_process);
-                done = 1;
-                return;
-            }
-            LogVerbose("Launcher: ident: %s run command: '%s'", launcher_args.ident, cmd);
-
-            // prepare args array
-            char *args[MAXARGS];
-            cmd_parse(cmd, args);
-            if (args[0]) cmd_execute(args);
+        if (launch_process && !launch_command(launch_process, &launcher_args)) {
+            done = 1;
+            return;
+        }
 
-            free(cmd);
+        // create the rollup of the new file
+        if (rollup_process && !launch_command(rollup_process, &launcher_args)) {
+            done = 1;
+            return;
         }
         if (expire) do_expire(launcher_args.flowdir);
 
@@ -473,8 +486,8 @@ int SendLauncherMessage(int pfd, time_t t_start, char *subdir, char *fmt, char *
     return ret;
 }
 
-int StartupLauncher(char *launch_process, int expire) {
-    LogInfo("StartupLauncher(): %s, expire: %d", launch_process, expire);
+int StartupLauncher(char *launch_process, char *rollup_process, int expire) {
+    LogInfo("StartupLauncher(): %s, rollup: %s, expire: %d", launch_process, rollup_process ? rollup_process : "none", expire);
 
     messageQueue_t *messageQueue = NewMessageQueue();
     if (!messageQueue) return 0;
@@ -499,7 +512,7 @@ int StartupLauncher(char *launch_process, int expire) {
     }
     tid = killtid;
 
-    launcher(messageQueue, launch_process, expire);
+    launcher(messageQueue, launch_process, rollup_process, expire);
     err = pthread_join(tid, NULL);
     if (err) {
         LogError("pthread_join() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
@@ -45,6 +45,8 @@
 #define __FAVOR_BSD 1
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
@@ -57,7 +59,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -81,10 +85,47 @@
 #define PROTO_ERSPAN 0x88be
 #define PROTO_ERSPANIII 0x22be
 
+// classic pcap file format
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+#define LINKTYPE_RAW 101
+
+typedef struct pcapFileHeader_s {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcapFileHeader_t;
+
+typedef struct pcapRecordHeader_s {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t caplen;
+    uint32_t len;
+} pcapRecordHeader_t;
+
 static pcap_t *pcap_handle;
 static int linktype = 0;
 static int linkoffset = 0;
 
+// mmapped pcap file, walked without libpcap
+static struct pcapMap_s {
+    uint8_t *data;
+    size_t size;
+    size_t offset;
+    int swapped;
+    int nsec;
+} pcapMap = {0};
+
+// time stamp of the last packet read
+static struct timeval packetTime = {0};
+static int hasPacketTime = 0;
+
 typedef struct vlan_hdr_s {
     uint16_t vlan_id;
     uint16_t type;
@@ -101,6 +142,10 @@ typedef struct gre_hdr_s {
 
 static int setup_pcap(char *filter);
 
+static int setup_linktype(int type);
+
+static int open_pcap_map(char *fname);
+
 static ssize_t decode_packet(struct pcap_pkthdr *hdr, u_char *pcap_pkgdata, void *buffer, size_t buffer_size, struct sockaddr *sock);
 
 /*
@@ -131,11 +176,21 @@ static int setup_pcap(char *filter) {
         }
     }
 
+    if (!setup_linktype(pcap_datalink(pcap_handle))) {
+        pcap_close(pcap_handle);
+        return 0;
+    }
+    return 1;
+
+} /* setup_pcap */
+
+// set linktype and offset
+static int setup_linktype(int type) {
     /*
      *  We need to make sure this is Ethernet.  The DLTEN10MB specifies
      *  standard 10MB and higher Ethernet.
      */
-    linktype = pcap_datalink(pcap_handle);
+    linktype = type;
     switch (linktype) {
         case DLT_RAW:
             linkoffset = 0;
@@ -169,12 +224,76 @@ static int setup_pcap(char *filter) {
             break;
         default:
             LogError("Unknown pcap linktype: %u", linktype);
-            pcap_close(pcap_handle);
             return 0;
     }
     return 1;
 
-} /* setup_pcap */
+} /* setup_linktype */
+
+// map a classic pcap file into memory to read it without libpcap
+// returns 1 on success, 0 if not a classic pcap file, -1 on error
+static int open_pcap_map(char *fname) {
+    struct stat stat_buf;
+    pcapFileHeader_t *fileHeader;
+
+    // release a previous file
+    if (pcapMap.data) munmap(pcapMap.data, pcapMap.size);
+    memset((void *)&pcapMap, 0, sizeof(pcapMap));
+    hasPacketTime = 0;
+
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        LogError("open() error for %s: %s", fname, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &stat_buf) < 0 || stat_buf.st_size < (off_t)sizeof(pcapFileHeader_t)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogError("mmap() error for %s: %s", fname, strerror(errno));
+        return 0;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, stat_buf.st_size, MADV_SEQUENTIAL);
+#endif
+
+    fileHeader = (pcapFileHeader_t *)data;
+    switch (fileHeader->magic) {
+        case PCAP_MAGIC:
+            break;
+        case PCAP_MAGIC_NSEC:
+            pcapMap.nsec = 1;
+            break;
+        case PCAP_MAGIC_SWAPPED:
+            pcapMap.swapped = 1;
+            break;
+        case PCAP_MAGIC_NSEC_SWAPPED:
+            pcapMap.swapped = 1;
+            pcapMap.nsec = 1;
+            break;
+        default:
+            // pcapng or unknown - leave it to libpcap
+            munmap(data, stat_buf.st_size);
+            return 0;
+    }
+
+    uint32_t type = pcapMap.swapped ? __builtin_bswap32(fileHeader->linktype) : fileHeader->linktype;
+    if (type == LINKTYPE_RAW) type = DLT_RAW;
+    if (!setup_linktype(type)) {
+        munmap(data, stat_buf.st_size);
+        return -1;
+    }
+
+    pcapMap.data = (uint8_t *)data;
+    pcapMap.size = stat_buf.st_size;
+    pcapMap.offset = sizeof(pcapFileHeader_t);
+    return 1;
+
+}  // End of open_pcap_map
 
 static ssize_t decode_packet(struct pcap_pkthdr *hdr, u_char *pcap_pkgdata, void *buffer, size_t buffer_size, struct sockaddr *sock) {
     struct sockaddr_in *in_sock = (struct sockaddr_in *)sock;
@@ -423,6 +542,12 @@ int setup_pcap_live(char *device, char *filter, int bufflen) {
 int setup_pcap_offline(char *fname, char *filter) {
     char errbuf[PCAP_ERRBUF_SIZE];
 
+    // classic pcap files without filter are read directly from memory
+    if (!filter) {
+        int ret = open_pcap_map(fname);
+        if (ret != 0) return ret > 0;
+    }
+
     /*
      *  Open the packet capturing file
      */
@@ -442,9 +567,48 @@ ssize_t NextPacket(int fill1, void *buffer, size_t buffer_size, int fill2, struc
     u_char *pkt_data;
     int i;
 
-    i = pcap_next_ex(pcap_handle, &header, (const u_char **)&pkt_data);
-    if (i != 1) return -2;
+    if (pcapMap.data) {
+        struct pcap_pkthdr hdr;
+        pcapRecordHeader_t recordHeader;
+        if ((pcapMap.offset + sizeof(pcapRecordHeader_t)) > pcapMap.size) return -2;
+
+        // records are not aligned in the file
+        memcpy((void *)&recordHeader, pcapMap.data + pcapMap.offset, sizeof(pcapRecordHeader_t));
+        if (pcapMap.swapped) {
+            recordHeader.ts_sec = __builtin_bswap32(recordHeader.ts_sec);
+            recordHeader.ts_frac = __builtin_bswap32(recordHeader.ts_frac);
+            recordHeader.caplen = __builtin_bswap32(recordHeader.caplen);
+            recordHeader.len = __builtin_bswap32(recordHeader.len);
+        }
+        hdr.ts.tv_sec = recordHeader.ts_sec;
+        hdr.ts.tv_usec = recordHeader.ts_frac;
+        hdr.caplen = recordHeader.caplen;
+        hdr.len = recordHeader.len;
+        if (pcapMap.nsec) hdr.ts.tv_usec /= 1000;
+
+        pkt_data = pcapMap.data + pcapMap.offset + sizeof(pcapRecordHeader_t);
+        if ((pcapMap.offset + sizeof(pcapRecordHeader_t) + hdr.caplen) > pcapMap.size) {
+            LogError("Truncated pcap file - packet at offset %zu", pcapMap.offset);
+            return -2;
+        }
+        pcapMap.offset += sizeof(pcapRecordHeader_t) + hdr.caplen;
+        header = &hdr;
+    } else {
+        i = pcap_next_ex(pcap_handle, &header, (const u_char **)&pkt_data);
+        if (i != 1) return -2;
+    }
+
+    packetTime = header->ts;
+    hasPacketTime = 1;
 
     *size = sizeof(struct sockaddr_in);
     return decode_packet(header, pkt_data, buffer, buffer_size, sock);
-}
\ No newline at end of file
+}
+
+// time stamp of the last packet read - returns 0 if no packet was read yet
+int PcapPacketTime(struct timeval *tv) {
+    if (!hasPacketTime) return 0;
+    *tv = packetTime;
+    return 1;
+
+}  // End of PcapPacketTime
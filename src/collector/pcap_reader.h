@@ -34,6 +34,7 @@
 
 #include <stdint.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 #include "config.h"
@@ -44,4 +45,6 @@ int setup_pcap_live(char *device, char *filter, int bufflen);
 
 ssize_t NextPacket(int fill1, void *buffer, size_t buffer_size, int fill2, struct sockaddr *sock, socklen_t *size);
 
+int PcapPacketTime(struct timeval *tv);
+
 #endif  //_PCAP_READER_H
\ No newline at end of file
@@ -0,0 +1,587 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "streamstat.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "nfxV3.h"
+#include "util.h"
+
+#define DEFAULTSTREAMKEYS "srcip dstip dstport proto"
+#define DEFAULTBUCKET 10
+#define DEFAULTWINDOW 300
+#define DEFAULTCAPACITY 1024
+#define MAXREQUEST 256
+
+enum { KEY_SRCIP = 0, KEY_DSTIP, KEY_SRCPORT, KEY_DSTPORT, KEY_PROTO };
+
+static struct streamKeyDef_s {
+    char *name;
+    int type;
+} streamKeyDef[] = {{"srcip", KEY_SRCIP}, {"dstip", KEY_DSTIP}, {"srcport", KEY_SRCPORT}, {"dstport", KEY_DSTPORT}, {"proto", KEY_PROTO}, {NULL, 0}};
+
+// IPv4 addresses are stored as IPv4 mapped IPv6 addresses
+typedef struct streamKey_s {
+    uint64_t v[2];
+} streamKey_t;
+
+typedef struct streamItem_s {
+    streamKey_t key;
+    uint64_t bytes;  // Space-Saving weight
+    uint64_t packets;
+    uint64_t flows;
+    uint64_t error;  // max over estimation of bytes
+    uint32_t slot;   // hash slot of this item
+} streamItem_t;
+
+// Space-Saving sketch: min heap on bytes and a hash index into the heap
+typedef struct topSketch_s {
+    uint32_t numItems;
+    streamItem_t *heap;
+    uint32_t *index;  // heap position + 1, 0 = empty
+} topSketch_t;
+
+typedef struct streamBucket_s {
+    uint64_t timeSlot;  // time slot of this bucket
+    uint64_t flows;
+    uint64_t packets;
+    uint64_t bytes;
+    topSketch_t sketch[MAXSTREAMKEYS];
+} streamBucket_t;
+
+int streamStatEnabled = 0;
+
+static char *socketPath = NULL;
+static int listenFD = -1;
+static int numKeys = 0;
+static int keyType[MAXSTREAMKEYS];
+static char *keyName[MAXSTREAMKEYS];
+static uint32_t capacity = 0;
+static uint32_t indexMask = 0;
+static uint32_t bucketSecs = 0;
+static uint32_t numBuckets = 0;
+static streamBucket_t *buckets = NULL;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t tid;
+static volatile int done = 0;
+
+static void *StreamThread(void *arg);
+
+static inline uint32_t HashKey(streamKey_t *key) {
+    uint64_t hash = (key->v[0] * 0x9E3779B97F4A7C15ULL) ^ key->v[1];
+    hash *= 0xff51afd7ed558ccdULL;
+    return (uint32_t)(hash >> 32);
+
+}  // End of HashKey
+
+static inline void HeapSwap(topSketch_t *sketch, uint32_t a, uint32_t b) {
+    streamItem_t tmp = sketch->heap[a];
+    sketch->heap[a] = sketch->heap[b];
+    sketch->heap[b] = tmp;
+    sketch->index[sketch->heap[a].slot] = a + 1;
+    sketch->index[sketch->heap[b].slot] = b + 1;
+
+}  // End of HeapSwap
+
+static void SiftDown(topSketch_t *sketch, uint32_t pos) {
+    streamItem_t *heap = sketch->heap;
+    while (1) {
+        uint32_t min = pos;
+        uint32_t left = 2 * pos + 1;
+        uint32_t right = left + 1;
+        if (left < sketch->numItems && heap[left].bytes < heap[min].bytes) min = left;
+        if (right < sketch->numItems && heap[right].bytes < heap[min].bytes) min = right;
+        if (min == pos) return;
+        HeapSwap(sketch, pos, min);
+        pos = min;
+    }
+
+}  // End of SiftDown
+
+static void SiftUp(topSketch_t *sketch, uint32_t pos) {
+    while (pos) {
+        uint32_t parent = (pos - 1) / 2;
+        if (sketch->heap[parent].bytes <= sketch->heap[pos].bytes) return;
+        HeapSwap(sketch, pos, parent);
+        pos = parent;
+    }
+
+}  // End of SiftUp
+
+// linear probing - returns the slot of key or the empty slot to insert key
+static inline uint32_t FindSlot(topSketch_t *sketch, streamKey_t *key) {
+    uint32_t slot = HashKey(key) & indexMask;
+    while (sketch->index[slot]) {
+        streamItem_t *item = &sketch->heap[sketch->index[slot] - 1];
+        if (item->key.v[0] == key->v[0] && item->key.v[1] == key->v[1]) return slot;
+        slot = (slot + 1) & indexMask;
+    }
+    return slot;
+
+}  // End of FindSlot
+
+// backward shift deletion keeps the probe sequences intact
+static void RemoveSlot(topSketch_t *sketch, uint32_t slot) {
+    uint32_t next = slot;
+    while (1) {
+        next = (next + 1) & indexMask;
+        if (sketch->index[next] == 0) break;
+        uint32_t home = HashKey(&sketch->heap[sketch->index[next] - 1].key) & indexMask;
+        // move the entry, unless its home slot is within (slot, next]
+        if (((next - home) & indexMask) >= ((next - slot) & indexMask)) {
+            sketch->index[slot] = sketch->index[next];
+            sketch->heap[sketch->index[slot] - 1].slot = slot;
+            slot = next;
+        }
+    }
+    sketch->index[slot] = 0;
+
+}  // End of RemoveSlot
+
+static void SketchAdd(topSketch_t *sketch, streamKey_t *key, uint64_t bytes, uint64_t packets) {
+    uint32_t slot = FindSlot(sketch, key);
+    if (sketch->index[slot]) {
+        uint32_t pos = sketch->index[slot] - 1;
+        sketch->heap[pos].bytes += bytes;
+        sketch->heap[pos].packets += packets;
+        sketch->heap[pos].flows++;
+        SiftDown(sketch, pos);
+        return;
+    }
+
+    if (sketch->numItems < capacity) {
+        uint32_t pos = sketch->numItems++;
+        sketch->heap[pos] = (streamItem_t){.key = *key, .bytes = bytes, .packets = packets, .flows = 1, .error = 0, .slot = slot};
+        sketch->index[slot] = pos + 1;
+        SiftUp(sketch, pos);
+        return;
+    }
+
+    // sketch is full - the new key replaces the key with the smallest count
+    streamItem_t *min = &sketch->heap[0];
+    RemoveSlot(sketch, min->slot);
+    slot = FindSlot(sketch, key);
+    min->key = *key;
+    min->error = min->bytes;
+    min->bytes += bytes;
+    min->packets = packets;
+    min->flows = 1;
+    min->slot = slot;
+    sketch->index[slot] = 1;
+    SiftDown(sketch, 0);
+
+}  // End of SketchAdd
+
+static void ClearBucket(streamBucket_t *bucket, uint64_t timeSlot) {
+    bucket->timeSlot = timeSlot;
+    bucket->flows = bucket->packets = bucket->bytes = 0;
+    for (int i = 0; i < numKeys; i++) {
+        bucket->sketch[i].numItems = 0;
+        memset(bucket->sketch[i].index, 0, (indexMask + 1) * sizeof(uint32_t));
+    }
+
+}  // End of ClearBucket
+
+int OpenStreamStat(void) {
+    socketPath = ConfGetString("stream.socket");
+    if (!socketPath) return 1;
+
+    char *keys = ConfGetString("stream.keys");
+    if (!keys) keys = strdup(DEFAULTSTREAMKEYS);
+
+    char *saveptr;
+    char *key = strtok_r(keys, " ,\t", &saveptr);
+    while (key) {
+        int i = 0;
+        while (streamKeyDef[i].name && strcasecmp(streamKeyDef[i].name, key) != 0) i++;
+        if (!streamKeyDef[i].name) {
+            LogError("Unknown stream key '%s'", key);
+            return 0;
+        }
+        if (numKeys == MAXSTREAMKEYS) {
+            LogError("Too many stream keys. Max %d keys allowed", MAXSTREAMKEYS);
+            return 0;
+        }
+        keyType[numKeys] = streamKeyDef[i].type;
+        keyName[numKeys] = streamKeyDef[i].name;
+        numKeys++;
+        key = strtok_r(NULL, " ,\t", &saveptr);
+    }
+    free(keys);
+
+    int value = ConfGetValue("stream.bucket");
+    bucketSecs = value > 0 ? value : DEFAULTBUCKET;
+    value = ConfGetValue("stream.window");
+    uint32_t window = value > 0 ? value : DEFAULTWINDOW;
+    if (window < bucketSecs) window = bucketSecs;
+    // one more bucket for the current, incomplete bucket
+    numBuckets = (window + bucketSecs - 1) / bucketSecs + 1;
+    value = ConfGetValue("stream.capacity");
+    capacity = value > 0 ? value : DEFAULTCAPACITY;
+
+    // hash index at most half full
+    uint32_t indexSize = 1;
+    while (indexSize < 2 * capacity) indexSize <<= 1;
+    indexMask = indexSize - 1;
+
+    buckets = calloc(numBuckets, sizeof(streamBucket_t));
+    if (!buckets) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    for (int b = 0; b < numBuckets; b++) {
+        for (int i = 0; i < numKeys; i++) {
+            buckets[b].sketch[i].heap = malloc(capacity * sizeof(streamItem_t));
+            buckets[b].sketch[i].index = calloc(indexSize, sizeof(uint32_t));
+            if (!buckets[b].sketch[i].heap || !buckets[b].sketch[i].index) {
+                LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                return 0;
+            }
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        LogError("Stream socket path too long: %s", socketPath);
+        return 0;
+    }
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+    // the socket must not leak into the commands run by the launcher
+#ifdef SOCK_CLOEXEC
+    listenFD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    listenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFD >= 0) fcntl(listenFD, F_SETFD, FD_CLOEXEC);
+#endif
+    if (listenFD < 0) {
+        LogError("socket() failed on %s: %s", socketPath, strerror(errno));
+        return 0;
+    }
+    unlink(socketPath);
+    if (bind(listenFD, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFD, 8) < 0) {
+        LogError("bind() failed on %s: %s", socketPath, strerror(errno));
+        close(listenFD);
+        return 0;
+    }
+
+    streamStatEnabled = 1;
+    int err = pthread_create(&tid, NULL, StreamThread, NULL);
+    if (err) {
+        LogError("pthread_create() error in %s line %d: %s", __FILE__, __LINE__, strerror(err));
+        streamStatEnabled = 0;
+        return 0;
+    }
+    LogInfo("Stream stat on %s, buckets: %u x %us, capacity: %u", socketPath, numBuckets, bucketSecs, capacity);
+
+    return 1;
+
+}  // End of OpenStreamStat
+
+void CloseStreamStat(void) {
+    if (!streamStatEnabled) return;
+
+    streamStatEnabled = 0;
+    done = 1;
+    pthread_join(tid, NULL);
+    close(listenFD);
+    unlink(socketPath);
+
+    for (int b = 0; b < numBuckets; b++) {
+        for (int i = 0; i < numKeys; i++) {
+            free(buckets[b].sketch[i].heap);
+            free(buckets[b].sketch[i].index);
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+
+}  // End of CloseStreamStat
+
+void AddStreamStat(recordHeaderV3_t *recordHeaderV3) {
+    EXgenericFlow_t *genericFlow = NULL;
+    EXipv4Flow_t *ipv4Flow = NULL;
+    EXipv6Flow_t *ipv6Flow = NULL;
+
+    elementHeader_t *elementHeader = (elementHeader_t *)((void *)recordHeaderV3 + sizeof(recordHeaderV3_t));
+    for (int i = 0; i < recordHeaderV3->numElements; i++) {
+        void *data = (void *)elementHeader + sizeof(elementHeader_t);
+        switch (elementHeader->type) {
+            case EXgenericFlowID:
+                genericFlow = (EXgenericFlow_t *)data;
+                break;
+            case EXipv4FlowID:
+                ipv4Flow = (EXipv4Flow_t *)data;
+                break;
+            case EXipv6FlowID:
+                ipv6Flow = (EXipv6Flow_t *)data;
+                break;
+        }
+        elementHeader = (elementHeader_t *)((void *)elementHeader + elementHeader->length);
+    }
+    if (!genericFlow) return;
+
+    uint64_t timeSlot = genericFlow->msecReceived / (1000LL * bucketSecs);
+
+    pthread_mutex_lock(&mutex);
+    streamBucket_t *bucket = &buckets[timeSlot % numBuckets];
+    if (bucket->timeSlot != timeSlot) ClearBucket(bucket, timeSlot);
+
+    bucket->flows++;
+    bucket->packets += genericFlow->inPackets;
+    bucket->bytes += genericFlow->inBytes;
+
+    for (int i = 0; i < numKeys; i++) {
+        streamKey_t key = {{0, 0}};
+        switch (keyType[i]) {
+            case KEY_SRCIP:
+            case KEY_DSTIP:
+                if (ipv4Flow) {
+                    key.v[1] = 0xffff00000000ULL | (keyType[i] == KEY_SRCIP ? ipv4Flow->srcAddr : ipv4Flow->dstAddr);
+                } else if (ipv6Flow) {
+                    uint64_t *addr = keyType[i] == KEY_SRCIP ? ipv6Flow->srcAddr : ipv6Flow->dstAddr;
+                    key.v[0] = addr[0];
+                    key.v[1] = addr[1];
+                } else {
+                    continue;
+                }
+                break;
+            case KEY_SRCPORT:
+                key.v[1] = genericFlow->srcPort;
+                break;
+            case KEY_DSTPORT:
+                key.v[1] = genericFlow->dstPort;
+                break;
+            case KEY_PROTO:
+                key.v[1] = genericFlow->proto;
+                break;
+        }
+        SketchAdd(&bucket->sketch[i], &key, genericFlow->inBytes, genericFlow->inPackets);
+    }
+    pthread_mutex_unlock(&mutex);
+
+}  // End of AddStreamStat
+
+static int CompareKey(const void *p1, const void *p2) {
+    const streamItem_t *i1 = (const streamItem_t *)p1;
+    const streamItem_t *i2 = (const streamItem_t *)p2;
+    if (i1->key.v[0] != i2->key.v[0]) return i1->key.v[0] < i2->key.v[0] ? -1 : 1;
+    if (i1->key.v[1] != i2->key.v[1]) return i1->key.v[1] < i2->key.v[1] ? -1 : 1;
+    return 0;
+
+}  // End of CompareKey
+
+static int CompareBytes(const void *p1, const void *p2) {
+    const streamItem_t *i1 = (const streamItem_t *)p1;
+    const streamItem_t *i2 = (const streamItem_t *)p2;
+    if (i1->bytes == i2->bytes) return 0;
+    return i1->bytes > i2->bytes ? -1 : 1;
+
+}  // End of CompareBytes
+
+static void FormatKey(char *s, size_t len, int type, streamKey_t *key) {
+    switch (type) {
+        case KEY_SRCIP:
+        case KEY_DSTIP:
+            if (key->v[0] == 0 && (key->v[1] >> 32) == 0xffff) {
+                uint32_t addr = htonl((uint32_t)key->v[1]);
+                inet_ntop(AF_INET, &addr, s, len);
+            } else {
+                uint64_t addr[2] = {htonll(key->v[0]), htonll(key->v[1])};
+                inet_ntop(AF_INET6, addr, s, len);
+            }
+            break;
+        default:
+            snprintf(s, len, "%llu", (unsigned long long)key->v[1]);
+    }
+
+}  // End of FormatKey
+
+// first time slot of the last seconds
+static uint64_t FirstSlot(uint32_t seconds) {
+    uint32_t window = (numBuckets - 1) * bucketSecs;
+    if (seconds == 0 || seconds > window) seconds = window;
+    uint64_t now = time(NULL) / bucketSecs;
+    uint32_t span = (seconds + bucketSecs - 1) / bucketSecs;
+    return now - span + 1;
+
+}  // End of FirstSlot
+
+static void QueryTotal(FILE *fp, uint32_t seconds) {
+    uint64_t firstSlot = FirstSlot(seconds);
+    uint64_t flows = 0, packets = 0, bytes = 0;
+
+    pthread_mutex_lock(&mutex);
+    for (int b = 0; b < numBuckets; b++) {
+        if (buckets[b].timeSlot < firstSlot) continue;
+        flows += buckets[b].flows;
+        packets += buckets[b].packets;
+        bytes += buckets[b].bytes;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    fprintf(fp, "flows: %llu, packets: %llu, bytes: %llu\n", (unsigned long long)flows, (unsigned long long)packets, (unsigned long long)bytes);
+
+}  // End of QueryTotal
+
+static void QueryTop(FILE *fp, char *name, uint32_t seconds, uint32_t topN) {
+    int k = 0;
+    while (k < numKeys && strcasecmp(keyName[k], name) != 0) k++;
+    if (k == numKeys) {
+        fprintf(fp, "ERR key %s not configured\n", name);
+        return;
+    }
+
+    uint64_t firstSlot = FirstSlot(seconds);
+    streamItem_t *items = malloc((size_t)numBuckets * capacity * sizeof(streamItem_t));
+    if (!items) {
+        fprintf(fp, "ERR out of memory\n");
+        return;
+    }
+
+    // copy the sketches of the time span
+    size_t numItems = 0;
+    pthread_mutex_lock(&mutex);
+    for (int b = 0; b < numBuckets; b++) {
+        if (buckets[b].timeSlot < firstSlot) continue;
+        topSketch_t *sketch = &buckets[b].sketch[k];
+        memcpy(items + numItems, sketch->heap, sketch->numItems * sizeof(streamItem_t));
+        numItems += sketch->numItems;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // merge the same keys of different buckets
+    qsort(items, numItems, sizeof(streamItem_t), CompareKey);
+    size_t merged = 0;
+    for (size_t i = 0; i < numItems; i++) {
+        if (merged && CompareKey(&items[merged - 1], &items[i]) == 0) {
+            items[merged - 1].bytes += items[i].bytes;
+            items[merged - 1].packets += items[i].packets;
+            items[merged - 1].flows += items[i].flows;
+            items[merged - 1].error += items[i].error;
+        } else {
+            items[merged++] = items[i];
+        }
+    }
+    qsort(items, merged, sizeof(streamItem_t), CompareBytes);
+
+    if (topN == 0 || topN > merged) topN = merged;
+    fprintf(fp, "%-39s %20s %16s %12s %20s\n", name, "bytes", "packets", "flows", "max error");
+    for (uint32_t i = 0; i < topN; i++) {
+        char s[64];
+        FormatKey(s, sizeof(s), keyType[k], &items[i].key);
+        fprintf(fp, "%-39s %20llu %16llu %12llu %20llu\n", s, (unsigned long long)items[i].bytes, (unsigned long long)items[i].packets,
+                (unsigned long long)items[i].flows, (unsigned long long)items[i].error);
+    }
+    free(items);
+
+}  // End of QueryTop
+
+/*
+ * process a single text request:
+ * top <key> [seconds [num]] - top num keys ordered by bytes of the last seconds
+ * total [seconds]           - flows, packets and bytes of the last seconds
+ */
+static void ProcessRequest(int fd) {
+    struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char request[MAXREQUEST];
+    size_t len = 0;
+    while (len < MAXREQUEST - 1) {
+        ssize_t ret = read(fd, request + len, MAXREQUEST - 1 - len);
+        if (ret <= 0) break;
+        len += ret;
+        if (memchr(request, '\n', len)) break;
+    }
+    request[len] = '\0';
+
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        return;
+    }
+
+    char *saveptr;
+    char *cmd = strtok_r(request, " \t\r\n", &saveptr);
+    if (cmd && strcasecmp(cmd, "top") == 0) {
+        char *key = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *seconds = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *num = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (key) {
+            QueryTop(fp, key, seconds ? atoi(seconds) : 0, num ? atoi(num) : 10);
+        } else {
+            fprintf(fp, "ERR missing key\n");
+        }
+    } else if (cmd && strcasecmp(cmd, "total") == 0) {
+        char *seconds = strtok_r(NULL, " \t\r\n", &saveptr);
+        QueryTotal(fp, seconds ? atoi(seconds) : 0);
+    } else {
+        fprintf(fp, "ERR unknown request\n");
+    }
+    fclose(fp);
+
+}  // End of ProcessRequest
+
+static void *StreamThread(void *arg) {
+    while (!done) {
+        struct pollfd pfd = {.fd = listenFD, .events = POLLIN};
+        if (poll(&pfd, 1, 1000) <= 0) continue;
+
+        int fd = accept(listenFD, NULL, NULL);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ProcessRequest(fd);
+    }
+
+    return NULL;
+
+}  // End of StreamThread
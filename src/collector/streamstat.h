@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _STREAMSTAT_H
+#define _STREAMSTAT_H 1
+
+#include <stdint.h>
+
+#include "nfxV3.h"
+
+/*
+ * Streaming top N of the collector. Each decoded flow is added to the current
+ * time bucket of a ring of buckets. Each bucket holds a bounded Space-Saving
+ * sketch per configured key, so memory does not grow with the number of
+ * distinct keys. Queries merge the buckets of the requested time span.
+ */
+
+#define MAXSTREAMKEYS 8
+
+// set, if the stream stat is enabled
+extern int streamStatEnabled;
+
+int OpenStreamStat(void);
+
+void CloseStreamStat(void);
+
+void AddStreamStat(recordHeaderV3_t *recordHeaderV3);
+
+// no function call in the write path, if disabled
+#define UpdateStreamStat(r)              \
+    do {                                 \
+        if (streamStatEnabled) AddStreamStat(r); \
+    } while (0)
+
+#endif  //_STREAMSTAT_H
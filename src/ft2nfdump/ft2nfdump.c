@@ -40,10 +40,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -65,8 +69,7 @@
 
 /* Global defines */
 #define MAXRECORDS 30
-
-static bool HasFlows = false;
+#define MAXWORKERS 64
 
 typedef struct v5_block_s {
     uint32_t srcaddr;
@@ -76,13 +79,68 @@ typedef struct v5_block_s {
     uint8_t data[4];  // link to next record
 } v5_block_t;
 
+// offset pair of a field in the flow-tools record and in the nfdump record
+typedef struct ftCopy_s {
+    uint16_t src;
+    uint16_t dst;
+} ftCopy_t;
+
+#define FTMAXCOPY 16
+typedef struct ftCopyList_s {
+    uint32_t num;
+    ftCopy_t copy[FTMAXCOPY];
+} ftCopyList_t;
+
+/*
+ * record template built once per flow-tools file. Each record is a copy of the
+ * template, followed by the field copies grouped by source and destination size.
+ */
+typedef struct ftTemplate_s {
+    void *record;
+    uint32_t recordSize;
+    uint32_t genericFlow;  // offset of EXgenericFlow in record, 0 if none
+    ftCopyList_t copy8;
+    ftCopyList_t copy16;
+    ftCopyList_t copy16to32;
+    ftCopyList_t copy32;
+    ftCopyList_t copy32to64;
+} ftTemplate_t;
+
+// output of a converter
+typedef struct ftOutput_s {
+    nffile_t *nffile;
+    int compress;
+    int extended;
+    uint32_t limitflows;
+    // time slice merge
+    time_t twin;
+    time_t slot;
+    char *dir;
+    char tmpName[MAXPATHLEN];
+} ftOutput_t;
+
+typedef struct ftWorker_s {
+    pthread_t tid;
+    int id;
+    int ret;
+    ftOutput_t output;
+} ftWorker_t;
+
+static char **ftFiles = NULL;
+static uint32_t numFtFiles = 0;
+static _Atomic uint32_t nextFtFile = 0;
+static char *time_extension = "%Y%m%d%H%M";
+
+static pthread_mutex_t printMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t renameMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* externals */
 extern uint32_t Max_num_extensions;
 
 /* prototypes */
 void usage(char *name);
 
-static int flows2nfdump(struct ftio *ftio, char *wfile, int compress, int extended, uint32_t limitflows);
+static int flows2nfdump(struct ftio *ftio, ftOutput_t *output);
 
 #include "nffile_inline.c"
 
@@ -93,14 +151,17 @@ void usage(char *name) {
         "-E\t\tDump records in ASCII extended format to stdout.\n"
         "-c\t\tLimit number of records to convert.\n"
         "-V\t\tPrint version and exit.\n"
-        "-r <file>\tread flow-tools records from file\n"
-        "-w <file>\twrite nfdump records to file\n"
+        "-r <file>\tread flow-tools records from file. Repeat -r for multiple files.\n"
+        "-w <file>\twrite nfdump records to file or to directory with -t\n"
+        "-t <interval>\tmerge records into nfcapd files of <interval> seconds by export time.\n"
+        "-W <num>\tconvert <num> input files in parallel. Default: number of cores.\n"
         "-z=lzo\t\tLZO compress flows in output file.\n"
         "-z=bz2\t\tBZIP2 compress flows in output file.\n"
         "-z=lz4[:level]\tLZ4 compress flows in output file.\n"
         "-z=zstd[:level]\tZSTD compress flows in output file.\n"
         "Convert flow-tools format to nfdump format:\n"
-        "ft2nfdump -r <flow-tools-data-file> -w <nfdump-file> [-z]\n",
+        "ft2nfdump -r <flow-tools-data-file> -w <nfdump-file> [-z]\n"
+        "ft2nfdump -r <ftfile> -r <ftfile> .. -w <dir> -t 300 [-W <num>]\n",
         name);
 
 }  // End of usage
@@ -135,9 +196,6 @@ static uint16_t *GenExtensionList(struct ftio *ftio, uint32_t *extensionSize, ui
         *extensionSize += EXflowMiscSize;
         (*numExtensions)++;
     }
-    if (!ftio_check_xfield(ftio, FT_XFIELD_DFLOWS)) {
-        HasFlows = true;
-    }
     if (!ftio_check_xfield(ftio, FT_XFIELD_SRC_AS | FT_XFIELD_DST_AS)) {
         extensionList[i++] = EXasRoutingID;
         *extensionSize += EXasRoutingSize;
@@ -159,153 +217,356 @@ static uint16_t *GenExtensionList(struct ftio *ftio, uint32_t *extensionSize, ui
 
 }  // End of GenExtensionList
 
-static int flows2nfdump(struct ftio *ftio, char *wfile, int compress, int extended, uint32_t limitflows) {
+static void AddCopy(ftCopyList_t *copyList, uint16_t src, size_t dst) {
+    dbg_assert(copyList->num < FTMAXCOPY);
+    copyList->copy[copyList->num].src = src;
+    copyList->copy[copyList->num].dst = dst;
+    copyList->num++;
+}  // End of AddCopy
+
+#define ElementOffset(h, p, type, field) (((void *)(p) - (void *)(h)) + offsetof(type, field))
+
+static int BuildTemplate(struct ftio *ftio, struct fts3rec_offsets *fo, ftTemplate_t *template) {
+    memset((void *)template, 0, sizeof(ftTemplate_t));
+
+    uint32_t recordSize = 0;
+    uint32_t numElements = 0;
+    uint16_t *extensionInfo = GenExtensionList(ftio, &recordSize, &numElements);
+    if (!extensionInfo) return 0;
+
+    dbg_printf("GenExtensionList: numElements: %u, recordSize: %u\n", numElements, recordSize);
+    if (numElements == 0) {
+        LogError("No usable fields found it flowtools file");
+        free(extensionInfo);
+        return 0;
+    }
+    recordSize += sizeof(recordHeaderV3_t) + numElements * sizeof(elementHeader_t);
+
+    template->record = malloc(recordSize);
+    if (!template->record) {
+        LogError("malloc() error in %s:%d: %s\n", __FILE__, __LINE__, strerror(errno));
+        free(extensionInfo);
+        return 0;
+    }
+
+    AddV3Header(template->record, recordHeader);
+
+    // header data
+    if (fo->engine_type != 0xFFFF) AddCopy(&template->copy8, fo->engine_type, offsetof(recordHeaderV3_t, engineType));
+    if (fo->engine_id != 0xFFFF) AddCopy(&template->copy8, fo->engine_id, offsetof(recordHeaderV3_t, engineID));
+
+    int i = 0;
+    int exID;
+    while ((exID = extensionInfo[i]) != EXnull) {
+        dbg_printf("Template slot %i extension %u - %s\n", i, exID, extensionTable[exID].name);
+        switch (exID) {
+            case EXgenericFlowID: {
+                PushExtension(recordHeader, EXgenericFlow, genericFlow);
+                template->genericFlow = (void *)genericFlow - (void *)recordHeader;
+                // msecFirst and msecLast are calculated per record
+                AddCopy(&template->copy32to64, fo->dPkts, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, inPackets));
+                AddCopy(&template->copy32to64, fo->dOctets, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, inBytes));
+                AddCopy(&template->copy16, fo->srcport, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, srcPort));
+                AddCopy(&template->copy16, fo->dstport, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, dstPort));
+                AddCopy(&template->copy8, fo->prot, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, proto));
+                AddCopy(&template->copy8, fo->tcp_flags, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, tcpFlags));
+                AddCopy(&template->copy8, fo->tos, ElementOffset(recordHeader, genericFlow, EXgenericFlow_t, srcTos));
+            } break;
+            case EXipv4FlowID: {
+                PushExtension(recordHeader, EXipv4Flow, ipv4Flow);
+                AddCopy(&template->copy32, fo->srcaddr, ElementOffset(recordHeader, ipv4Flow, EXipv4Flow_t, srcAddr));
+                AddCopy(&template->copy32, fo->dstaddr, ElementOffset(recordHeader, ipv4Flow, EXipv4Flow_t, dstAddr));
+            } break;
+            case EXflowMiscID: {
+                PushExtension(recordHeader, EXflowMisc, flowMisc);
+                AddCopy(&template->copy16to32, fo->input, ElementOffset(recordHeader, flowMisc, EXflowMisc_t, input));
+                AddCopy(&template->copy16to32, fo->output, ElementOffset(recordHeader, flowMisc, EXflowMisc_t, output));
+                AddCopy(&template->copy8, fo->src_mask, ElementOffset(recordHeader, flowMisc, EXflowMisc_t, srcMask));
+                AddCopy(&template->copy8, fo->dst_mask, ElementOffset(recordHeader, flowMisc, EXflowMisc_t, dstMask));
+            } break;
+            case EXasRoutingID: {
+                PushExtension(recordHeader, EXasRouting, asRouting);
+                AddCopy(&template->copy16to32, fo->src_as, ElementOffset(recordHeader, asRouting, EXasRouting_t, srcAS));
+                AddCopy(&template->copy16to32, fo->dst_as, ElementOffset(recordHeader, asRouting, EXasRouting_t, dstAS));
+            } break;
+            case EXipNextHopV4ID: {
+                PushExtension(recordHeader, EXipNextHopV4, ipNextHopV4);
+                AddCopy(&template->copy32, fo->peer_nexthop, ElementOffset(recordHeader, ipNextHopV4, EXipNextHopV4_t, ip));
+            } break;
+            case EXipReceivedV4ID: {
+                PushExtension(recordHeader, EXipReceivedV4, received);
+                AddCopy(&template->copy32, fo->exaddr, ElementOffset(recordHeader, received, EXipReceivedV4_t, ip));
+            } break;
+        }
+        i++;
+    }
+    free(extensionInfo);
+
+    template->recordSize = recordHeader->size;
+    dbg_assert(template->recordSize == recordSize);
+
+    return 1;
+
+}  // End of BuildTemplate
+
+// close the current time slice and merge it into the nfcapd file of this slot
+static int CloseSlot(ftOutput_t *output) {
+    char fmt[32];
+    char slotName[MAXPATHLEN];
+    struct tm when;
+
+    SetIdent(output->nffile, "flow-tools");
+    CloseUpdateFile(output->nffile);
+    DisposeFile(output->nffile);
+    output->nffile = NULL;
+
+    localtime_r(&output->slot, &when);
+    strftime(fmt, sizeof(fmt), time_extension, &when);
+    snprintf(slotName, MAXPATHLEN - 1, "%s/nfcapd.%s", output->dir, fmt);
+    slotName[MAXPATHLEN - 1] = '\0';
+
+    // several workers may append to the same slot
+    pthread_mutex_lock(&renameMutex);
+    int ret = RenameAppend(output->tmpName, slotName);
+    pthread_mutex_unlock(&renameMutex);
+    if (ret < 0) {
+        LogError("Failed to merge '%s' into '%s'", output->tmpName, slotName);
+        return 0;
+    }
+
+    return 1;
+
+}  // End of CloseSlot
+
+static int OpenSlot(ftOutput_t *output, time_t slot) {
+    if (output->nffile && !CloseSlot(output)) return 0;
+
+    output->nffile = OpenNewFile(output->tmpName, NULL, CREATOR_FT2NFDUMP, output->compress, NOT_ENCRYPTED);
+    if (!output->nffile) {
+        LogError("OpenNewFile() failed.");
+        return 0;
+    }
+    output->slot = slot;
+
+    return 1;
+
+}  // End of OpenSlot
+
+static inline void UpdateFtStat(stat_record_t *stat_record, EXgenericFlow_t *genericFlow) {
+    switch (genericFlow->proto) {
+        case IPPROTO_ICMP:
+            stat_record->numflows_icmp++;
+            stat_record->numpackets_icmp += genericFlow->inPackets;
+            stat_record->numbytes_icmp += genericFlow->inBytes;
+            break;
+        case IPPROTO_TCP:
+            stat_record->numflows_tcp++;
+            stat_record->numpackets_tcp += genericFlow->inPackets;
+            stat_record->numbytes_tcp += genericFlow->inBytes;
+            break;
+        case IPPROTO_UDP:
+            stat_record->numflows_udp++;
+            stat_record->numpackets_udp += genericFlow->inPackets;
+            stat_record->numbytes_udp += genericFlow->inBytes;
+            break;
+        default:
+            stat_record->numflows_other++;
+            stat_record->numpackets_other += genericFlow->inPackets;
+            stat_record->numbytes_other += genericFlow->inBytes;
+    }
+    stat_record->numpackets += genericFlow->inPackets;
+    stat_record->numbytes += genericFlow->inBytes;
+
+    if (genericFlow->msecFirst < stat_record->firstseen) stat_record->firstseen = genericFlow->msecFirst;
+    if (genericFlow->msecLast > stat_record->lastseen) stat_record->lastseen = genericFlow->msecLast;
+
+}  // End of UpdateFtStat
+
+#define CopyFields(list, rec, out, stype, dtype)                                            \
+    for (int _i = 0; _i < (list).num; _i++) {                                               \
+        *((dtype *)((out) + (list).copy[_i].dst)) = *((stype *)((rec) + (list).copy[_i].src)); \
+    }
+
+static int flows2nfdump(struct ftio *ftio, ftOutput_t *output) {
     // required flow tools variables
     struct fttime ftt;
     struct fts3rec_offsets fo;
     struct ftver ftv;
     char *rec;
-    // nfdump variables
-    nffile_t *nffile;
-
-    char *ident = "flow-tools";
-    nffile = OpenNewFile(wfile, NULL, CREATOR_FT2NFDUMP, compress, NOT_ENCRYPTED);
-    if (!nffile) {
-        LogError("OpenNewFile() failed.");
-        return 1;
-    }
+    ftTemplate_t template;
 
     ftio_get_ver(ftio, &ftv);
     memset((void *)&fo, 0xFF, sizeof(fo));
     fts3rec_compute_offsets(&fo, &ftv);
 
-    uint32_t recordSize = 0;
-    uint32_t numElements = 0;
-    uint16_t *extensionInfo = GenExtensionList(ftio, &recordSize, &numElements);
-    dbg_printf("GenExtensionList: numElements: %u, recordSize: %u\n", numElements, recordSize);
-    if (numElements == 0) {
-        LogError("No usable fields found it flowtools file");
+    if (!BuildTemplate(ftio, &fo, &template)) return 1;
+
+    if (output->twin && template.genericFlow == 0) {
+        LogError("No time fields found in flowtools file - can not merge into time slices");
+        free(template.record);
         return 1;
     }
-    recordSize += sizeof(recordHeaderV3_t);
 
-    int cnt = 0;
+    uint32_t recordSize = template.recordSize;
+    uint32_t cnt = 0;
     while ((rec = ftio_read(ftio))) {
-        int i, exID;
         dbg_printf("FT record %u\n", cnt);
+        uint32_t unix_secs = 0;
+        if (template.genericFlow) unix_secs = *((uint32_t *)(rec + fo.unix_secs));
+
+        if (output->twin) {
+            time_t slot = unix_secs - (unix_secs % output->twin);
+            if (output->nffile == NULL || slot != output->slot) {
+                if (!OpenSlot(output, slot)) {
+                    free(template.record);
+                    return 1;
+                }
+            }
+        }
+        nffile_t *nffile = output->nffile;
+
         if (!CheckBufferSpace(nffile, recordSize)) {
             // fishy! - should never happen. maybe disk full?
             LogError("ft2nfdump: output buffer size error. Abort record processing");
-            CloseFile(nffile);
+            free(template.record);
             return 1;
         }
 
-        AddV3Header(nffile->buff_ptr, recordHeader);
-
-        // header data
-        recordHeader->engineType = *((uint8_t *)(rec + fo.engine_type));
-        recordHeader->engineID = *((uint8_t *)(rec + fo.engine_id));
-
-        i = 0;
-        while ((exID = extensionInfo[i]) != EXnull) {
-            dbg_printf("Process slot %i extension %u - %s\n", i, exID, extensionTable[exID].name);
-            switch (exID) {
-                case EXgenericFlowID: {
-                    uint32_t when, unix_secs, unix_nsecs, sysUpTime;
-                    unix_secs = *((uint32_t *)(rec + fo.unix_secs));
-                    unix_nsecs = *((uint32_t *)(rec + fo.unix_nsecs));
-                    sysUpTime = *((uint32_t *)(rec + fo.sysUpTime));
-
-                    PushExtension(recordHeader, EXgenericFlow, genericFlow);
-                    when = *((uint32_t *)(rec + fo.First));
-                    ftt = ftltime(sysUpTime, unix_secs, unix_nsecs, when);
-                    genericFlow->msecFirst = (1000LL * (uint64_t)ftt.secs) + (uint64_t)ftt.msecs;
-
-                    when = *((uint32_t *)(rec + fo.Last));
-                    ftt = ftltime(sysUpTime, unix_secs, unix_nsecs, when);
-                    genericFlow->msecLast = (1000LL * (uint64_t)ftt.secs) + (uint64_t)ftt.msecs;
-
-                    genericFlow->inPackets = *((uint32_t *)(rec + fo.dPkts));
-                    genericFlow->inBytes = *((uint32_t *)(rec + fo.dOctets));
-                    genericFlow->srcPort = *((uint16_t *)(rec + fo.srcport));
-                    genericFlow->dstPort = *((uint16_t *)(rec + fo.dstport));
-                    genericFlow->proto = *((uint8_t *)(rec + fo.prot));
-                    genericFlow->tcpFlags = *((uint8_t *)(rec + fo.tcp_flags));
-                    genericFlow->srcTos = *((uint8_t *)(rec + fo.tos));
-                    genericFlow->fwdStatus = 0;
-                } break;
-                case EXipv4FlowID:
-                    PushExtension(recordHeader, EXipv4Flow, ipv4Flow);
-                    ipv4Flow->srcAddr = *((uint32_t *)(rec + fo.srcaddr));
-                    ipv4Flow->dstAddr = *((uint32_t *)(rec + fo.dstaddr));
-                    break;
-                case EXflowMiscID:
-                    PushExtension(recordHeader, EXflowMisc, flowMisc);
-                    flowMisc->input = *((uint16_t *)(rec + fo.input));
-                    flowMisc->output = *((uint16_t *)(rec + fo.output));
-                    flowMisc->srcMask = *((uint8_t *)(rec + fo.src_mask));
-                    flowMisc->dstMask = *((uint8_t *)(rec + fo.dst_mask));
-                    flowMisc->dir = 0;
-                    flowMisc->dstTos = 0;
-                    break;
-                case EXasRoutingID:
-                    PushExtension(recordHeader, EXasRouting, asRouting);
-                    asRouting->srcAS = *((uint16_t *)(rec + fo.src_as));
-                    asRouting->dstAS = *((uint16_t *)(rec + fo.dst_as));
-                    break;
-                case EXipNextHopV4ID:
-                    PushExtension(recordHeader, EXipNextHopV4, ipNextHopV4);
-                    ipNextHopV4->ip = *((uint32_t *)(rec + fo.peer_nexthop));
-                    break;
-                case EXipReceivedV4ID:
-                    PushExtension(recordHeader, EXipReceivedV4, received);
-                    received->ip = *((uint32_t *)(rec + fo.exaddr));
-                    break;
-            }
-            i++;
+        void *out = nffile->buff_ptr;
+        memcpy(out, template.record, recordSize);
+
+        CopyFields(template.copy8, rec, out, uint8_t, uint8_t);
+        CopyFields(template.copy16, rec, out, uint16_t, uint16_t);
+        CopyFields(template.copy16to32, rec, out, uint16_t, uint32_t);
+        CopyFields(template.copy32, rec, out, uint32_t, uint32_t);
+        CopyFields(template.copy32to64, rec, out, uint32_t, uint64_t);
+
+        if (template.genericFlow) {
+            EXgenericFlow_t *genericFlow = (EXgenericFlow_t *)(out + template.genericFlow);
+            uint32_t when, unix_nsecs, sysUpTime;
+            unix_nsecs = *((uint32_t *)(rec + fo.unix_nsecs));
+            sysUpTime = *((uint32_t *)(rec + fo.sysUpTime));
+
+            when = *((uint32_t *)(rec + fo.First));
+            ftt = ftltime(sysUpTime, unix_secs, unix_nsecs, when);
+            genericFlow->msecFirst = (1000LL * (uint64_t)ftt.secs) + (uint64_t)ftt.msecs;
+
+            when = *((uint32_t *)(rec + fo.Last));
+            ftt = ftltime(sysUpTime, unix_secs, unix_nsecs, when);
+            genericFlow->msecLast = (1000LL * (uint64_t)ftt.secs) + (uint64_t)ftt.msecs;
+
+            UpdateFtStat(nffile->stat_record, genericFlow);
         }
+        nffile->stat_record->numflows++;
 
         // update file record size ( -> output buffer size )
         nffile->block_header->NumRecords++;
         nffile->block_header->size += recordSize;
-
-        dbg_assert(recordHeader->size == recordSize);
-
         nffile->buff_ptr += recordSize;
 
-        if (extended) {
-            flow_record_short(stdout, recordHeader);
+        if (output->extended) {
+            pthread_mutex_lock(&printMutex);
+            flow_record_short(stdout, (recordHeaderV3_t *)out);
+            pthread_mutex_unlock(&printMutex);
         }
 
         cnt++;
-        if (cnt == limitflows) break;
+        if (cnt == output->limitflows) break;
 
     } /* while */
 
-    SetIdent(nffile, ident);
-    CloseUpdateFile(nffile);
+    free(template.record);
     return 0;
 
 }  // End of flows2nfdump
 
+// convert input files until all files are taken
+__attribute__((noreturn)) static void *ftWorker(void *arg) {
+    ftWorker_t *worker = (ftWorker_t *)arg;
+
+    uint32_t index;
+    while ((index = atomic_fetch_add(&nextFtFile, 1)) < numFtFiles) {
+        char *ftfile = ftFiles[index];
+        int fd = open(ftfile, O_RDONLY, 0);
+        if (fd < 0) {
+            LogError("Can't open file '%s': %s.", ftfile, strerror(errno));
+            worker->ret = 255;
+            continue;
+        }
+
+        struct ftio ftio;
+        if (ftio_init(&ftio, fd, FT_IO_FLAG_READ) < 0) {
+            LogError("ftio_init() failed for file '%s'", ftfile);
+            worker->ret = 255;
+            close(fd);
+            continue;
+        }
+
+        if (flows2nfdump(&ftio, &worker->output) != 0) worker->ret = 255;
+
+        ftio_close(&ftio);
+        close(fd);
+    }
+
+    if (worker->output.nffile && !CloseSlot(&worker->output)) worker->ret = 255;
+
+    pthread_exit(NULL);
+
+}  // End of ftWorker
+
+static int ConvertParallel(ftOutput_t *output, int numWorkers) {
+    if (numWorkers > numFtFiles) numWorkers = numFtFiles;
+    if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
+
+    ftWorker_t *workers = calloc(numWorkers, sizeof(ftWorker_t));
+    if (!workers) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 255;
+    }
+
+    int started = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].id = i;
+        workers[i].output = *output;
+        snprintf(workers[i].output.tmpName, MAXPATHLEN - 1, "%s/ft2nfdump.%d.%d", output->dir, (int)getpid(), i);
+        int err = pthread_create(&workers[i].tid, NULL, ftWorker, (void *)&workers[i]);
+        if (err) {
+            LogError("pthread_create() error in %s line %d: %s", __FILE__, __LINE__, strerror(err));
+            break;
+        }
+        started++;
+    }
+
+    int ret = started ? 0 : 255;
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+        if (workers[i].ret) ret = workers[i].ret;
+    }
+    free(workers);
+
+    return ret;
+
+}  // End of ConvertParallel
+
 int main(int argc, char **argv) {
     struct ftio ftio;
     struct stat statbuf;
     uint32_t limitflows;
-    int i, extended, ret, fd, compress;
-    ;
-    char *ftfile, *wfile;
+    int i, extended, ret, fd, compress, numWorkers;
+    time_t twin;
+    char *wfile;
 
     /* init fterr */
     fterr_setid(argv[0]);
 
     extended = 0;
     limitflows = 0;
-    ftfile = NULL;
     wfile = "-";
     compress = LZ4_COMPRESSED;
+    twin = 0;
+    numWorkers = 0;
 
-    while ((i = getopt(argc, argv, "jyzEVc:hr:w:?")) != -1) switch (i) {
+    while ((i = getopt(argc, argv, "jyzEVc:hr:t:w:W:?")) != -1) switch (i) {
             case 'h': /* help */
             case '?':
                 usage(argv[0]);
@@ -355,15 +616,37 @@ int main(int argc, char **argv) {
                 }
                 break;
             case 'r':
-                ftfile = optarg;
-                if ((stat(ftfile, &statbuf) < 0) || !(statbuf.st_mode & S_IFREG)) {
-                    fprintf(stderr, "No such file: '%s'\n", ftfile);
+                if ((stat(optarg, &statbuf) < 0) || !(statbuf.st_mode & S_IFREG)) {
+                    fprintf(stderr, "No such file: '%s'\n", optarg);
+                    exit(255);
+                }
+                ftFiles = realloc(ftFiles, (numFtFiles + 1) * sizeof(char *));
+                if (!ftFiles) {
+                    LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
                     exit(255);
                 }
+                ftFiles[numFtFiles++] = optarg;
+                break;
+            case 't':
+                twin = atoi(optarg);
+                if (twin < 2) {
+                    LogError("time interval < 2s not allowed");
+                    exit(255);
+                }
+                if (twin < 60) {
+                    time_extension = "%Y%m%d%H%M%S";
+                }
                 break;
             case 'w':
                 wfile = optarg;
                 break;
+            case 'W':
+                numWorkers = atoi(optarg);
+                if (numWorkers < 1 || numWorkers > MAXWORKERS) {
+                    LogError("Number of workers must be between 1 and %d", MAXWORKERS);
+                    exit(255);
+                }
+                break;
 
             default:
                 usage(argv[0]);
@@ -375,10 +658,43 @@ int main(int argc, char **argv) {
 
     if (argc - optind) fterr_errx(1, "Extra arguments starting with %s.", argv[optind]);
 
-    if (ftfile) {
-        fd = open(ftfile, O_RDONLY, 0);
+    if (numFtFiles > 1 && twin == 0) {
+        LogError("Multiple input files need -t <interval> to merge the records into time slices");
+        exit(255);
+    }
+
+    ftOutput_t output = {
+        .compress = compress,
+        .extended = extended,
+        .limitflows = limitflows,
+        .twin = twin,
+    };
+
+    if (twin) {
+        if (numFtFiles == 0) {
+            LogError("Option -t needs input files -r <ftfile>");
+            exit(255);
+        }
+        if ((stat(wfile, &statbuf) < 0) || !S_ISDIR(statbuf.st_mode)) {
+            LogError("Option -t needs an existing output directory -w <dir>");
+            exit(255);
+        }
+        output.dir = wfile;
+
+        if (numWorkers == 0) {
+            numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+            if (numWorkers < 1) numWorkers = 1;
+        }
+
+        if (!Init_nffile(0, NULL)) exit(254);
+
+        return ConvertParallel(&output, numWorkers);
+    }
+
+    if (numFtFiles) {
+        fd = open(ftFiles[0], O_RDONLY, 0);
         if (fd < 0) {
-            fprintf(stderr, "Can't open file '%s': %s.", ftfile, strerror(errno));
+            fprintf(stderr, "Can't open file '%s': %s.", ftFiles[0], strerror(errno));
             exit(255);
         }
     } else {
@@ -390,7 +706,16 @@ int main(int argc, char **argv) {
     /* read from fd */
     if (ftio_init(&ftio, fd, FT_IO_FLAG_READ) < 0) fterr_errx(1, "ftio_init(): failed");
 
-    ret = flows2nfdump(&ftio, wfile, compress, extended, limitflows);
+    output.nffile = OpenNewFile(wfile, NULL, CREATOR_FT2NFDUMP, compress, NOT_ENCRYPTED);
+    if (!output.nffile) {
+        LogError("OpenNewFile() failed.");
+        return 1;
+    }
+
+    ret = flows2nfdump(&ftio, &output);
+
+    SetIdent(output.nffile, "flow-tools");
+    CloseUpdateFile(output.nffile);
 
     return ret;
 
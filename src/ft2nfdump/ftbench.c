@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark of the flow-tools conversion of ft2nfdump
+ * ftbench [-n num] [-f files] [-W workers] [-p ft2nfdump]
+ * writes flow-tools v5 files of num synthetic flows each, converts the first
+ * file with ft2nfdump into a single file and all files into nfcapd files of
+ * 5 minute slots with 1, 2, 4 .. workers
+ * default: 4 files of 10^6 flows, up to the number of cpus online
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ftlib.h"
+
+#define MAXFILES 64
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+
+}  // End of now
+
+static void usage(char *name) {
+    printf(
+        "usage %s [options] \n"
+        "-h\t\tthis text you see right here.\n"
+        "-n <num>\tnumber of flows per file. Default 1000000.\n"
+        "-f <num>\tnumber of flow-tools files. Default 4.\n"
+        "-W <num>\tmax number of workers. Default: number of cores.\n"
+        "-p <path>\tpath of ft2nfdump. Default ./ft2nfdump.\n",
+        name);
+
+}  // End of usage
+
+// write a flow-tools v5 file with len synthetic flows, 1000 flows per second from start
+static int write_ftfile(char *fileName, size_t len, uint32_t start) {
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open() failed");
+        return 0;
+    }
+
+    struct ftio ftio;
+    if (ftio_init(&ftio, fd, FT_IO_FLAG_WRITE) < 0) {
+        printf("ftio_init() failed for %s\n", fileName);
+        close(fd);
+        return 0;
+    }
+
+    struct ftver ftv;
+    memset((void *)&ftv, 0, sizeof(ftv));
+    ftv.s_version = FT_IO_SVERSION;
+    ftv.d_version = 5;
+#if BYTE_ORDER == BIG_ENDIAN
+    ftio_set_byte_order(&ftio, FT_HEADER_BIG_ENDIAN);
+#else
+    ftio_set_byte_order(&ftio, FT_HEADER_LITTLE_ENDIAN);
+#endif
+    ftio_set_z_level(&ftio, 0);
+    ftio_set_flows_count(&ftio, len);
+    ftio_set_cap_time(&ftio, start, start + len / 1000);
+    if (ftio_set_ver(&ftio, &ftv) < 0 || ftio_write_header(&ftio) < 0) {
+        printf("Failed to write flow-tools header to %s\n", fileName);
+        ftio_close(&ftio);
+        return 0;
+    }
+
+    struct fts3rec_v5 rec;
+    memset((void *)&rec, 0, sizeof(rec));
+    rec.sysUpTime = 3600000;
+    rec.exaddr = 0x0a000001;
+    rec.nexthop = 0x0a0000fe;
+    rec.tcp_flags = 0x1b;
+    rec.engine_type = 1;
+    rec.engine_id = 2;
+    rec.src_mask = 24;
+    rec.dst_mask = 16;
+    rec.dst_as = 3303;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t n = i;
+        rec.unix_secs = start + n / 1000;
+        rec.unix_nsecs = (n % 1000) * 1000000;
+        rec.srcaddr = 0xc0a80000 + (n & 0xffff);
+        rec.dstaddr = 0x0a010000 + ((n * 7) & 0xffff);
+        rec.input = n % 7;
+        rec.output = n % 5;
+        rec.dPkts = 1 + n % 100;
+        rec.dOctets = 40 + n % 1500;
+        rec.First = rec.sysUpTime - 2000;
+        rec.Last = rec.sysUpTime - 10;
+        rec.srcport = 1024 + n % 50000;
+        rec.dstport = 80;
+        rec.prot = n % 3 ? 6 : 17;
+        rec.src_as = 65000 + n % 10;
+        if (ftio_write(&ftio, &rec) < 0) {
+            printf("ftio_write() failed for %s\n", fileName);
+            ftio_close(&ftio);
+            return 0;
+        }
+    }
+
+    if (ftio_close(&ftio) < 0) {
+        printf("ftio_close() failed for %s\n", fileName);
+        return 0;
+    }
+    return 1;
+
+}  // End of write_ftfile
+
+// remove the nfcapd files of a run
+static void cleanup(char *dir) {
+    DIR *dirp = opendir(dir);
+    if (!dirp) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dirp)) != NULL) {
+        if (strncmp(entry->d_name, "nfcapd.", 7) != 0) continue;
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(dirp);
+
+}  // End of cleanup
+
+// run ft2nfdump with args - returns the wall time or -1 on error
+static double run(char **args) {
+    double t0 = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork() failed");
+        return -1;
+    }
+    if (pid == 0) {
+        execv(args[0], args);
+        perror("execv() failed");
+        _exit(255);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("%s failed\n", args[0]);
+        return -1;
+    }
+    return now() - t0;
+
+}  // End of run
+
+int main(int argc, char **argv) {
+    char *ft2nfdump = "./ft2nfdump";
+    size_t len = 1000000;
+    long numFiles = 4;
+    long maxWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int c;
+    while ((c = getopt(argc, argv, "hn:f:W:p:")) != EOF) {
+        switch (c) {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            case 'n':
+                len = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                numFiles = atol(optarg);
+                break;
+            case 'W':
+                maxWorkers = atol(optarg);
+                break;
+            case 'p':
+                ft2nfdump = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(255);
+        }
+    }
+    if (len == 0 || numFiles < 1 || numFiles > MAXFILES || maxWorkers < 1) {
+        printf("Invalid number of flows, files or workers\n");
+        exit(255);
+    }
+
+    char dir[] = "ftbench.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp() failed");
+        exit(255);
+    }
+
+    // files overlap in time, as files of different exporters do
+    char ftFiles[MAXFILES][MAXPATHLEN];
+    for (long i = 0; i < numFiles; i++) {
+        snprintf(ftFiles[i], MAXPATHLEN, "%s/flows.%ld.ft", dir, i);
+        if (!write_ftfile(ftFiles[i], len, 1562833800 + i * 60)) exit(255);
+    }
+
+    char outFile[MAXPATHLEN];
+    snprintf(outFile, MAXPATHLEN, "%s/flows.nf", dir);
+    char *args[2 * MAXFILES + 10];
+    int numArgs = 0;
+    args[numArgs++] = ft2nfdump;
+    args[numArgs++] = "-r";
+    args[numArgs++] = ftFiles[0];
+    args[numArgs++] = "-w";
+    args[numArgs++] = outFile;
+    args[numArgs] = NULL;
+
+    printf("ft2nfdump benchmark with %ld cpus online, %ld files of %zu flows\n", sysconf(_SC_NPROCESSORS_ONLN), numFiles, len);
+    double t = run(args);
+    if (t < 0) exit(255);
+    printf("single file    : %8.3fs, %12.0f flows/s\n", t, t > 0 ? len / t : 0);
+    unlink(outFile);
+
+    // all files into nfcapd files of 5 minute slots
+    char workers[32];
+    numArgs = 1;
+    for (long i = 0; i < numFiles; i++) {
+        args[numArgs++] = "-r";
+        args[numArgs++] = ftFiles[i];
+    }
+    args[numArgs++] = "-w";
+    args[numArgs++] = dir;
+    args[numArgs++] = "-t";
+    args[numArgs++] = "300";
+    args[numArgs++] = "-W";
+    args[numArgs++] = workers;
+    args[numArgs] = NULL;
+
+    int ok = 1;
+    for (long w = 1; ok; w *= 2) {
+        if (w > maxWorkers) w = maxWorkers;
+        snprintf(workers, sizeof(workers), "%ld", w);
+        t = run(args);
+        if (t < 0) {
+            ok = 0;
+        } else {
+            printf("%3ld workers    : %8.3fs, %12.0f flows/s\n", w, t, t > 0 ? numFiles * len / t : 0);
+        }
+        cleanup(dir);
+        if (w == maxWorkers) break;
+    }
+
+    for (long i = 0; i < numFiles; i++) unlink(ftFiles[i]);
+    rmdir(dir);
+
+    return ok ? 0 : 255;
+
+}  // End of main
@@ -780,6 +780,33 @@ typedef struct master_record_s {
 #define OffsetJA3 (offsetof(master_record_t, ja3) >> 3)
 #define MaskJA3 0xffffffffffffffff
 
+    // dns from payload
+    uint64_t dnsQname;  // interned id of the query name
+#define OffsetDNSQname (offsetof(master_record_t, dnsQname) >> 3)
+#define MaskDNSQname 0xffffffffffffffff
+    uint16_t dnsQtype;
+    uint8_t dnsRcode;
+    uint8_t dnsFlags;
+#define DNS_DECODED 0x1
+#define DNS_RESPONSE 0x2
+    uint32_t dnsAlign;
+#define OffsetDNSInfo (offsetof(master_record_t, dnsQtype) >> 3)
+#ifdef WORDS_BIGENDIAN
+#define MaskDNSQtype 0xffff000000000000LL
+#define ShiftDNSQtype 48
+#define MaskDNSRcode 0x0000ff0000000000LL
+#define ShiftDNSRcode 40
+#define MaskDNSResponse 0x0000000200000000LL
+#define ShiftDNSResponse 33
+#else
+#define MaskDNSQtype 0x000000000000ffffLL
+#define ShiftDNSQtype 0
+#define MaskDNSRcode 0x0000000000ff0000LL
+#define ShiftDNSRcode 16
+#define MaskDNSResponse 0x0000000002000000LL
+#define ShiftDNSResponse 25
+#endif
+
     // pflog
     uint8_t pfAction;
     uint8_t pfReason;
@@ -0,0 +1,298 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Swiss table - open addressing hash table with 7 bit tag metadata
+ *
+ * Slots are organised in groups of 16. Each slot has a control byte, which is
+ * either empty (0x80) or holds the low 7 bits of the hash of its entry. A lookup
+ * compares the tag against all 16 control bytes of a group at once with SSE2 or
+ * NEON and compares only the keys of matching slots. The remaining hash bits
+ * select the first group, followed by triangular probing over the groups.
+ * Entries are stored inline and there is no deletion, as required for aggregation.
+ *
+ * SWISS_INIT(name, entry_t, key_t, entry_hash, entry_equal)
+ *   entry_hash(entry_t *e)            - hash of an entry, used to rehash the table
+ *   entry_equal(entry_t *e, key_t *k) - 1, if the entry matches the key
+ *
+ * swiss_put_name(h, key, hash, &ret) returns the slot of key. ret is 1, if the slot is new
+ * and the caller must fill the entry, 0 if the key already exists.
+ */
+
+#ifndef _SWISSTABLE_H
+#define _SWISSTABLE_H 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define SWISS_GROUP 16
+#define SWISS_EMPTY 0x80
+
+// strong 64bit hash - murmur3 finalizer
+static inline uint64_t swiss_hash64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// 64bit hash over a byte sequence
+static inline uint64_t swiss_hash_bytes(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        hash = swiss_hash64(hash + word);
+        p += 8;
+        len -= 8;
+    }
+    if (len) {
+        uint64_t word = 0;
+        memcpy(&word, p, len);
+        hash = swiss_hash64(hash + word);
+    }
+    return hash;
+}
+
+/*
+ * match masks of a group: one bit per matching slot
+ * NEON sets a nibble per slot, reduced to its top bit
+ */
+#if defined(__SSE2__)
+typedef uint32_t swiss_mask_t;
+#define SWISS_SHIFT 0
+
+static inline swiss_mask_t swiss_match(const uint8_t *group, uint8_t tag) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (swiss_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+}
+
+static inline swiss_mask_t swiss_match_empty(const uint8_t *group) {
+    return (swiss_mask_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+typedef uint64_t swiss_mask_t;
+#define SWISS_SHIFT 2
+
+static inline swiss_mask_t swiss_bitmask(uint8x16_t v) {
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ULL;
+}
+
+static inline swiss_mask_t swiss_match(const uint8_t *group, uint8_t tag) {
+    return swiss_bitmask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(tag)));
+}
+
+static inline swiss_mask_t swiss_match_empty(const uint8_t *group) {
+    return swiss_bitmask(vtstq_u8(vld1q_u8(group), vdupq_n_u8(SWISS_EMPTY)));
+}
+
+#else
+typedef uint32_t swiss_mask_t;
+#define SWISS_SHIFT 0
+
+static inline swiss_mask_t swiss_match(const uint8_t *group, uint8_t tag) {
+    swiss_mask_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++) mask |= (swiss_mask_t)(group[i] == tag) << i;
+    return mask;
+}
+
+static inline swiss_mask_t swiss_match_empty(const uint8_t *group) {
+    swiss_mask_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++) mask |= (swiss_mask_t)(group[i] >> 7) << i;
+    return mask;
+}
+#endif
+
+#define swiss_first(mask) ((size_t)__builtin_ctzll(mask) >> SWISS_SHIFT)
+
+#define swiss_end(h) ((h)->numGroups * SWISS_GROUP)
+#define swiss_exist(h, i) ((h)->ctrl[i] < SWISS_EMPTY)
+#define swiss_entry(h, i) ((h)->entries[i])
+#define swiss_size(h) ((h)->size)
+// the next new key resizes the table
+#define swiss_grows(h) ((h)->growthLeft == 0)
+
+// load and probe lengths of a table - see swiss_stat_name()
+typedef struct swiss_stat_s {
+    size_t size;      // number of entries
+    size_t slots;     // number of slots
+    size_t probes;    // sum of the groups probed to find each entry
+    size_t maxProbe;  // max groups probed to find an entry
+} swiss_stat_t;
+
+#define SWISS_INIT(name, entry_t, key_t, entry_hash, entry_equal)                                         \
+    typedef struct swiss_##name##_s {                                                                    \
+        uint8_t *ctrl;                                                                                   \
+        entry_t *entries;                                                                                \
+        size_t numGroups;                                                                                \
+        size_t size;                                                                                     \
+        size_t growthLeft;                                                                               \
+    } swiss_##name##_t;                                                                                  \
+                                                                                                         \
+    static inline swiss_##name##_t *swiss_init_##name(void) { return calloc(1, sizeof(swiss_##name##_t)); } \
+                                                                                                         \
+    static inline void swiss_destroy_##name(swiss_##name##_t *h) {                                       \
+        if (!h) return;                                                                                  \
+        free(h->ctrl);                                                                                   \
+        free(h->entries);                                                                                \
+        free(h);                                                                                         \
+    }                                                                                                    \
+                                                                                                         \
+    /* first empty slot in the probe sequence of hash */                                                 \
+    static inline size_t swiss_empty_##name(swiss_##name##_t *h, uint64_t hash) {                        \
+        size_t groupMask = h->numGroups - 1;                                                             \
+        size_t group = (hash >> 7) & groupMask;                                                          \
+        for (size_t step = 1;; step++) {                                                                 \
+            swiss_mask_t mask = swiss_match_empty(h->ctrl + group * SWISS_GROUP);                        \
+            if (mask) return group * SWISS_GROUP + swiss_first(mask);                                    \
+            group = (group + step) & groupMask;                                                          \
+        }                                                                                                \
+    }                                                                                                    \
+                                                                                                         \
+    static int swiss_resize_##name(swiss_##name##_t *h, size_t numGroups) {                              \
+        size_t slots = numGroups * SWISS_GROUP;                                                          \
+        uint8_t *ctrl = malloc(slots);                                                                   \
+        entry_t *entries = malloc(slots * sizeof(entry_t));                                              \
+        if (!ctrl || !entries) {                                                                         \
+            free(ctrl);                                                                                  \
+            free(entries);                                                                               \
+            return 0;                                                                                    \
+        }                                                                                                \
+        memset(ctrl, SWISS_EMPTY, slots);                                                                \
+                                                                                                         \
+        swiss_##name##_t old = *h;                                                                       \
+        h->ctrl = ctrl;                                                                                  \
+        h->entries = entries;                                                                            \
+        h->numGroups = numGroups;                                                                        \
+        h->growthLeft = slots - slots / 8 - old.size;                                                    \
+        for (size_t i = 0; i < old.numGroups * SWISS_GROUP; i++) {                                       \
+            if (old.ctrl[i] & SWISS_EMPTY) continue;                                                     \
+            size_t slot = swiss_empty_##name(h, entry_hash((&old.entries[i])));                          \
+            ctrl[slot] = old.ctrl[i];                                                                    \
+            entries[slot] = old.entries[i];                                                              \
+        }                                                                                                \
+        free(old.ctrl);                                                                                  \
+        free(old.entries);                                                                               \
+        return 1;                                                                                        \
+    }                                                                                                    \
+                                                                                                         \
+    /* returns the slot of key or swiss_end(h), if not found */                                          \
+    static inline size_t swiss_get_##name(swiss_##name##_t *h, key_t *key, uint64_t hash) {             \
+        if (h->numGroups == 0) return 0;                                                                 \
+        uint8_t tag = hash & 0x7f;                                                                       \
+        size_t groupMask = h->numGroups - 1;                                                             \
+        size_t group = (hash >> 7) & groupMask;                                                          \
+        for (size_t step = 1;; step++) {                                                                 \
+            uint8_t *ctrl = h->ctrl + group * SWISS_GROUP;                                               \
+            swiss_mask_t mask = swiss_match(ctrl, tag);                                                  \
+            while (mask) {                                                                               \
+                size_t slot = group * SWISS_GROUP + swiss_first(mask);                                   \
+                if (entry_equal((&h->entries[slot]), key)) return slot;                                  \
+                mask &= mask - 1;                                                                        \
+            }                                                                                            \
+            if (swiss_match_empty(ctrl)) return swiss_end(h);                                            \
+            group = (group + step) & groupMask;                                                          \
+        }                                                                                                \
+    }                                                                                                    \
+                                                                                                         \
+    /* returns the slot of key - a new slot, if ret is 1 or swiss_end(h) if out of memory */             \
+    static inline size_t swiss_put_##name(swiss_##name##_t *h, key_t *key, uint64_t hash, int *ret) {  \
+        *ret = 0;                                                                                        \
+        if (h->growthLeft == 0) {                                                                        \
+            /* grow first - the probe below ends at the insert position */                               \
+            size_t slot = swiss_get_##name(h, key, hash);                                                \
+            if (slot != swiss_end(h)) return slot;                                                       \
+            if (!swiss_resize_##name(h, h->numGroups ? 2 * h->numGroups : 1)) {                          \
+                *ret = -1;                                                                               \
+                return swiss_end(h);                                                                     \
+            }                                                                                            \
+        }                                                                                                \
+        uint8_t tag = hash & 0x7f;                                                                       \
+        size_t groupMask = h->numGroups - 1;                                                             \
+        size_t group = (hash >> 7) & groupMask;                                                          \
+        for (size_t step = 1;; step++) {                                                                 \
+            uint8_t *ctrl = h->ctrl + group * SWISS_GROUP;                                               \
+            swiss_mask_t mask = swiss_match(ctrl, tag);                                                  \
+            while (mask) {                                                                               \
+                size_t slot = group * SWISS_GROUP + swiss_first(mask);                                   \
+                if (entry_equal((&h->entries[slot]), key)) return slot;                                  \
+                mask &= mask - 1;                                                                        \
+            }                                                                                            \
+            /* without deletions the key is not in the table, if the group has an empty slot */          \
+            mask = swiss_match_empty(ctrl);                                                              \
+            if (mask) {                                                                                  \
+                size_t slot = group * SWISS_GROUP + swiss_first(mask);                                   \
+                ctrl[slot - group * SWISS_GROUP] = tag;                                                  \
+                h->size++;                                                                               \
+                h->growthLeft--;                                                                         \
+                *ret = 1;                                                                                \
+                return slot;                                                                             \
+            }                                                                                            \
+            group = (group + step) & groupMask;                                                          \
+        }                                                                                                \
+    }                                                                                                    \
+                                                                                                         \
+    /* prefetch the first group of hash */                                                               \
+    static inline void swiss_prefetch_##name(swiss_##name##_t *h, uint64_t hash) {                       \
+        if (h->numGroups == 0) return;                                                                   \
+        size_t group = (hash >> 7) & (h->numGroups - 1);                                                 \
+        __builtin_prefetch(h->ctrl + group * SWISS_GROUP, 0, 1);                                         \
+        __builtin_prefetch(&h->entries[group * SWISS_GROUP], 0, 1);                                      \
+    }                                                                                                         \
+                                                                                                         \
+    /* add the load and probe lengths of h to stat - walks the whole table */                            \
+    static inline void swiss_stat_##name(swiss_##name##_t *h, swiss_stat_t *stat) {                      \
+        size_t groupMask = h->numGroups - 1;                                                             \
+        for (size_t i = 0; i < swiss_end(h); i++) {                                                      \
+            if (!swiss_exist(h, i)) continue;                                                            \
+            size_t group = (entry_hash((&h->entries[i])) >> 7) & groupMask;                              \
+            size_t probe = 1;                                                                            \
+            for (size_t step = 1; group != i / SWISS_GROUP; step++, probe++)                             \
+                group = (group + step) & groupMask;                                                      \
+            stat->probes += probe;                                                                       \
+            if (probe > stat->maxProbe) stat->maxProbe = probe;                                          \
+        }                                                                                                \
+        stat->size += h->size;                                                                           \
+        stat->slots += swiss_end(h);                                                                     \
+    }
+
+#endif  // _SWISSTABLE_H
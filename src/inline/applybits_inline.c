@@ -41,7 +41,7 @@ static inline void ApplyNetMaskBits(master_record_t *flow_record, int apply_netb
                 mask = 0xffffffffffffffffLL << (128 - mask_bits);
                 flow_record->V6.srcaddr[1] &= mask;
             } else {
-                mask = 0xffffffffffffffffLL << (64 - mask_bits);
+                mask = mask_bits ? 0xffffffffffffffffLL << (64 - mask_bits) : 0;
                 flow_record->V6.srcaddr[0] &= mask;
                 flow_record->V6.srcaddr[1] = 0;
             }
@@ -54,18 +54,18 @@ static inline void ApplyNetMaskBits(master_record_t *flow_record, int apply_netb
                 mask = 0xffffffffffffffffLL << (128 - mask_bits);
                 flow_record->V6.dstaddr[1] &= mask;
             } else {
-                mask = 0xffffffffffffffffLL << (64 - mask_bits);
+                mask = mask_bits ? 0xffffffffffffffffLL << (64 - mask_bits) : 0;
                 flow_record->V6.dstaddr[0] &= mask;
                 flow_record->V6.dstaddr[1] = 0;
             }
         }
     } else {  // IPv4
         if (apply_netbits & 1) {
-            uint32_t srcmask = 0xffffffff << (32 - flow_record->src_mask);
+            uint32_t srcmask = flow_record->src_mask ? 0xffffffff << (32 - flow_record->src_mask) : 0;
             flow_record->V4.srcaddr &= srcmask;
         }
         if (apply_netbits & 2) {
-            uint32_t dstmask = 0xffffffff << (32 - flow_record->dst_mask);
+            uint32_t dstmask = flow_record->dst_mask ? 0xffffffff << (32 - flow_record->dst_mask) : 0;
             flow_record->V4.dstaddr &= dstmask;
         }
     }
@@ -83,7 +83,7 @@ static inline void SetNetMaskBits(EXipv4Flow_t *EXipv4Flow, EXipv6Flow_t *EXipv6
                 mask = 0xffffffffffffffffLL << (128 - mask_bits);
                 EXipv6Flow->srcAddr[1] &= mask;
             } else {
-                mask = 0xffffffffffffffffLL << (64 - mask_bits);
+                mask = mask_bits ? 0xffffffffffffffffLL << (64 - mask_bits) : 0;
                 EXipv6Flow->srcAddr[0] &= mask;
                 EXipv6Flow->srcAddr[1] = 0;
             }
@@ -96,18 +96,18 @@ static inline void SetNetMaskBits(EXipv4Flow_t *EXipv4Flow, EXipv6Flow_t *EXipv6
                 mask = 0xffffffffffffffffLL << (128 - mask_bits);
                 EXipv6Flow->dstAddr[1] &= mask;
             } else {
-                mask = 0xffffffffffffffffLL << (64 - mask_bits);
+                mask = mask_bits ? 0xffffffffffffffffLL << (64 - mask_bits) : 0;
                 EXipv6Flow->dstAddr[0] &= mask;
                 EXipv6Flow->dstAddr[1] = 0;
             }
         }
     } else if (EXipv4Flow) {  // IPv4
         if (apply_netbits & 1) {
-            uint32_t srcmask = 0xffffffff << (32 - EXflowMisc->srcMask);
+            uint32_t srcmask = EXflowMisc->srcMask ? 0xffffffff << (32 - EXflowMisc->srcMask) : 0;
             EXipv4Flow->srcAddr &= srcmask;
         }
         if (apply_netbits & 2) {
-            uint32_t dstmask = 0xffffffff << (32 - EXflowMisc->dstMask);
+            uint32_t dstmask = EXflowMisc->dstMask ? 0xffffffff << (32 - EXflowMisc->dstMask) : 0;
             EXipv4Flow->dstAddr &= dstmask;
         }
     }
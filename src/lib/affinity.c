@@ -0,0 +1,256 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// for cpu_set_t and pthread_setaffinity_np()
+#define _GNU_SOURCE
+
+#include "affinity.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "util.h"
+
+#define NODEPATH "/sys/devices/system/node"
+
+static char *className[AFFINITY_CLASSES] = {"receiver", "reader", "writer", "worker"};
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+
+typedef struct affinity_s {
+    int valid;
+    char *cpuList;   // cpu list as configured
+    cpu_set_t cpus;  // cpus of this class
+} affinity_t;
+
+static affinity_t affinity[AFFINITY_CLASSES] = {0};
+
+// threads inherit the cpu set of their creator - unpinned classes get the cpus of the process
+static int pinned = 0;
+static cpu_set_t processCPUs;
+
+// parse a cpu list such as "0-3,8,10-11" into a cpu set
+static int ParseCPUList(char *cpuList, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+
+    char *s = cpuList;
+    while (*s) {
+        while (isspace((int)*s)) s++;
+        if (!isdigit((int)*s)) return 0;
+
+        char *end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        s = end;
+        if (*s == '-') {
+            s++;
+            if (!isdigit((int)*s)) return 0;
+            last = strtol(s, &end, 10);
+            s = end;
+        }
+        while (isspace((int)*s)) s++;
+
+        if (first > last || last >= CPU_SETSIZE) return 0;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+
+        if (*s == ',') {
+            s++;
+        } else if (*s != '\0') {
+            return 0;
+        }
+    }
+
+    return CPU_COUNT(cpus) > 0;
+
+}  // End of ParseCPUList
+
+static int AddAffinity(int threadClass, char *cpuList) {
+    cpu_set_t cpus;
+    if (!ParseCPUList(cpuList, &cpus)) {
+        LogError("Invalid cpu list for %s threads: '%s'", className[threadClass], cpuList);
+        return 0;
+    }
+
+    // all cpus must be online and usable by this process
+    cpu_set_t usable;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &usable) == 0) {
+        CPU_AND(&usable, &usable, &cpus);
+        if (!CPU_EQUAL(&usable, &cpus)) {
+            LogError("Cpu list for %s threads '%s' contains cpus not available", className[threadClass], cpuList);
+            return 0;
+        }
+    }
+
+    if (affinity[threadClass].cpuList) free(affinity[threadClass].cpuList);
+    affinity[threadClass].cpuList = strdup(cpuList);
+    affinity[threadClass].cpus = cpus;
+    affinity[threadClass].valid = 1;
+    return 1;
+
+}  // End of AddAffinity
+
+// print the numa nodes of the cpu set into buff
+static void NodeString(cpu_set_t *cpus, char *buff, size_t len) {
+    buff[0] = '\0';
+
+    DIR *dir = opendir(NODEPATH);
+    if (!dir) return;
+
+    size_t offset = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) != 0 || !isdigit((int)entry->d_name[4])) continue;
+
+        char path[MAXPATHLEN];
+        snprintf(path, sizeof(path), NODEPATH "/%s/cpulist", entry->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp) continue;
+        char nodeList[1024];
+        char *line = fgets(nodeList, sizeof(nodeList), fp);
+        fclose(fp);
+        if (!line) continue;
+        nodeList[strcspn(nodeList, "\n")] = '\0';
+
+        cpu_set_t nodeCPUs;
+        if (!ParseCPUList(nodeList, &nodeCPUs)) continue;
+        CPU_AND(&nodeCPUs, &nodeCPUs, cpus);
+        if (CPU_COUNT(&nodeCPUs) == 0) continue;
+
+        int ret = snprintf(buff + offset, len - offset, "%s%s", offset ? "," : "", entry->d_name + 4);
+        if (ret < 0 || (size_t)ret >= len - offset) break;
+        offset += ret;
+    }
+    closedir(dir);
+
+}  // End of NodeString
+
+int SetAffinity(char *arg) {
+    char *sep = strchr(arg, ':');
+    if (sep) {
+        for (int i = 0; i < AFFINITY_CLASSES; i++) {
+            size_t len = strlen(className[i]);
+            if ((size_t)(sep - arg) == len && strncmp(arg, className[i], len) == 0) return AddAffinity(i, sep + 1);
+        }
+    }
+
+    LogError("Invalid affinity '%s'. Expected <class>:<cpulist> with class receiver, reader, writer or worker", arg);
+    return 0;
+
+}  // End of SetAffinity
+
+int InitAffinity(int verbose) {
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &processCPUs) < 0) {
+        LogError("sched_getaffinity() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    for (int i = 0; i < AFFINITY_CLASSES; i++) {
+        // command line overwrites nfdump.conf
+        if (!affinity[i].valid) {
+            char key[32];
+            snprintf(key, sizeof(key), "cpu.%s", className[i]);
+            char *cpuList = ConfGetString(key);
+            if (cpuList && !AddAffinity(i, cpuList)) return 0;
+        }
+
+        if (verbose && affinity[i].valid) {
+            char nodes[128];
+            NodeString(&affinity[i].cpus, nodes, sizeof(nodes));
+            LogInfo("Pin %s threads to cpus %s, numa node %s", className[i], affinity[i].cpuList, nodes[0] ? nodes : "unknown");
+        }
+        pinned |= affinity[i].valid;
+    }
+    return 1;
+
+}  // End of InitAffinity
+
+void PinThread(int threadClass) {
+    if (!pinned || threadClass < 0 || threadClass >= AFFINITY_CLASSES) return;
+
+    cpu_set_t *cpus = affinity[threadClass].valid ? &affinity[threadClass].cpus : &processCPUs;
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), cpus);
+    if (err) {
+        LogError("pthread_setaffinity_np() error in %s line %d: %s", __FILE__, __LINE__, strerror(err));
+    }
+
+}  // End of PinThread
+
+int AffinityString(char *buff, size_t len) {
+    size_t offset = 0;
+    buff[0] = '\0';
+    for (int i = 0; i < AFFINITY_CLASSES; i++) {
+        if (!affinity[i].valid) continue;
+        char nodes[128];
+        NodeString(&affinity[i].cpus, nodes, sizeof(nodes));
+        int ret = snprintf(buff + offset, len - offset, "%s%s: %s (node %s)", offset ? ", " : "", className[i], affinity[i].cpuList,
+                           nodes[0] ? nodes : "unknown");
+        if (ret < 0 || (size_t)ret >= len - offset) break;
+        offset += ret;
+    }
+    return offset > 0;
+
+}  // End of AffinityString
+
+#else
+
+int SetAffinity(char *arg) {
+    LogError("Thread affinity not supported on this platform");
+    return 0;
+
+}  // End of SetAffinity
+
+int InitAffinity(int verbose) {
+    for (int i = 0; i < AFFINITY_CLASSES; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "cpu.%s", className[i]);
+        if (ConfGetString(key)) LogError("Thread affinity not supported on this platform - ignore %s", key);
+    }
+    return 1;
+
+}  // End of InitAffinity
+
+void PinThread(int threadClass) {}  // End of PinThread
+
+int AffinityString(char *buff, size_t len) {
+    buff[0] = '\0';
+    return 0;
+
+}  // End of AffinityString
+
+#endif
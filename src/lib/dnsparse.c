@@ -0,0 +1,356 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Fast DNS payload decoder
+ * Extracts the query name, type and the response code from a DNS message
+ * in the flow payload. The parser works on the payload buffer only, checks
+ * every access against the payload length and does not allocate memory.
+ * Decoded query names are lower case and interned: a name is identified by
+ * its 64bit hash, which is used by the filter and stat engines, and the
+ * text is stored only once per name for printing.
+ */
+
+#include "dnsparse.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "config.h"
+#include "swisstable.h"
+#include "util.h"
+
+#define DNSHEADERSIZE 12
+#define DNSMAXWIRENAME 255
+
+// name interning
+#define INTERNINITSIZE 4096
+#define INTERNPOOLSIZE (1024 * 1024)
+#define INTERNSEENSIZE 1024
+
+typedef struct internEntry_s {
+    uint64_t id;
+    char *name;
+} internEntry_t;
+
+static struct nameTable_s {
+    pthread_mutex_t lock;
+    internEntry_t *table;
+    uint32_t mask;
+    uint32_t count;
+    char *pool;
+    size_t poolFree;
+} nameTable = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// ids already interned by this thread - skips the lock for repeated names
+static _Thread_local uint64_t internSeen[INTERNSEENSIZE];
+
+static struct dnsType_s {
+    uint16_t type;
+    char *name;
+} dnsTypeList[] = {{1, "A"},       {2, "NS"},      {5, "CNAME"},  {6, "SOA"},    {12, "PTR"},   {13, "HINFO"}, {15, "MX"},   {16, "TXT"},
+                   {28, "AAAA"},   {29, "LOC"},    {33, "SRV"},   {35, "NAPTR"}, {43, "DS"},    {46, "RRSIG"}, {47, "NSEC"}, {48, "DNSKEY"},
+                   {52, "TLSA"},   {64, "SVCB"},   {65, "HTTPS"}, {99, "SPF"},   {252, "AXFR"}, {255, "ANY"},  {257, "CAA"}, {0, NULL}};
+
+static char *dnsRcodeList[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP",  "REFUSED",
+                               "YXDOMAIN", "YXRRSET", "NXRRSET",  "NOTAUTH",  "NOTZONE", NULL};
+
+/*
+ * decode the name at offset into name as lower case text. Compression
+ * pointers must point backwards, which also prevents pointer loops.
+ * Returns the number of bytes used by the name at offset or 0 on error.
+ */
+static size_t dnsDecodeName(const uint8_t *msg, size_t msgLen, size_t offset, char *name, uint16_t *nameLength) {
+    size_t ptr = offset;
+    size_t consumed = 0;
+    size_t wireLength = 0;
+    size_t out = 0;
+
+    while (1) {
+        if (ptr >= msgLen) return 0;
+        uint8_t b = msg[ptr];
+        if ((b & 0xC0) == 0xC0) {
+            if (ptr + 1 >= msgLen) return 0;
+            size_t target = ((b & 0x3F) << 8) | msg[ptr + 1];
+            if (target >= ptr) return 0;
+            if (consumed == 0) consumed = ptr + 2 - offset;
+            ptr = target;
+            continue;
+        }
+        // extended label types are not supported
+        if (b & 0xC0) return 0;
+
+        if (b == 0) {
+            if (consumed == 0) consumed = ptr + 1 - offset;
+            break;
+        }
+
+        wireLength += b + 1;
+        if (wireLength > DNSMAXWIRENAME || ptr + 1 + b > msgLen) return 0;
+        if (out) name[out++] = '.';
+        for (size_t i = ptr + 1; i <= ptr + b; i++) {
+            uint8_t c = msg[i];
+            if (out + 5 >= MAXDNSNAME) return 0;
+            if (c >= 'A' && c <= 'Z') {
+                name[out++] = c + ('a' - 'A');
+            } else if (c == '.' || c == '\\') {
+                name[out++] = '\\';
+                name[out++] = c;
+            } else if (c < 0x21 || c > 0x7e) {
+                name[out++] = '\\';
+                name[out++] = '0' + c / 100;
+                name[out++] = '0' + (c / 10) % 10;
+                name[out++] = '0' + c % 10;
+            } else {
+                name[out++] = c;
+            }
+        }
+        ptr += b + 1;
+    }
+
+    // root
+    if (out == 0) name[out++] = '.';
+    name[out] = '\0';
+    *nameLength = out;
+
+    return consumed;
+
+}  // End of dnsDecodeName
+
+int dnsParse(dnsInfo_t *dns, uint8_t proto, const uint8_t *payload, size_t len) {
+    // DNS over TCP has a 2 byte length prefix
+    if (proto == IPPROTO_TCP) {
+        if (len < 2) return 0;
+        payload += 2;
+        len -= 2;
+    }
+
+    if (len < DNSHEADERSIZE) return 0;
+
+    uint16_t qdcount = (payload[4] << 8) | payload[5];
+    if (qdcount == 0) return 0;
+
+    dns->response = (payload[2] & 0x80) != 0;
+    dns->rcode = payload[3] & 0x0F;
+
+    // only the first question is decoded
+    size_t used = dnsDecodeName(payload, len, DNSHEADERSIZE, dns->name, &dns->nameLength);
+    if (used == 0) return 0;
+
+    size_t ptr = DNSHEADERSIZE + used;
+    if (ptr + 4 > len) return 0;
+    dns->qtype = (payload[ptr] << 8) | payload[ptr + 1];
+    dns->qclass = (payload[ptr + 2] << 8) | payload[ptr + 3];
+    dns->qname = dnsNameIntern(dns->name, dns->nameLength);
+
+    return 1;
+
+}  // End of dnsParse
+
+void AddDNSInfo(master_record_t *record) {
+    if (record->dnsFlags & DNS_DECODED) return;
+    record->dnsFlags |= DNS_DECODED;
+
+    if (record->srcPort != 53 && record->dstPort != 53) return;
+
+    dnsInfo_t dns;
+    if (record->inPayloadLength && dnsParse(&dns, record->proto, (uint8_t *)record->inPayload, record->inPayloadLength)) {
+        record->dnsQname = dns.qname;
+        record->dnsQtype = dns.qtype;
+        if (dns.response) {
+            record->dnsRcode = dns.rcode;
+            record->dnsFlags |= DNS_RESPONSE;
+        }
+    }
+
+    // the response of a bidirectional flow
+    if (record->outPayloadLength && dnsParse(&dns, record->proto, (uint8_t *)record->outPayload, record->outPayloadLength) && dns.response) {
+        if (record->dnsQname == 0) {
+            record->dnsQname = dns.qname;
+            record->dnsQtype = dns.qtype;
+        }
+        record->dnsRcode = dns.rcode;
+        record->dnsFlags |= DNS_RESPONSE;
+    }
+
+}  // End of AddDNSInfo
+
+// case insensitive hash of a name. A trailing dot is ignored.
+uint64_t dnsNameHash(const char *name) {
+    char lower[MAXDNSNAME];
+    size_t len = 0;
+
+    while (name[len] && len < (MAXDNSNAME - 1)) {
+        char c = name[len];
+        lower[len++] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    if (len > 1 && lower[len - 1] == '.' && lower[len - 2] != '\\') len--;
+
+    uint64_t hash = swiss_hash_bytes(lower, len);
+    return hash ? hash : 1;
+
+}  // End of dnsNameHash
+
+static int InternInsert(uint64_t id, const char *name, size_t len) {
+    if (nameTable.table == NULL || (nameTable.count << 1) > nameTable.mask) {
+        uint32_t size = nameTable.table ? (nameTable.mask + 1) << 1 : INTERNINITSIZE;
+        internEntry_t *table = calloc(size, sizeof(internEntry_t));
+        if (!table) {
+            LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        if (nameTable.table) {
+            for (uint32_t i = 0; i <= nameTable.mask; i++) {
+                if (nameTable.table[i].id == 0) continue;
+                uint32_t slot = nameTable.table[i].id & (size - 1);
+                while (table[slot].id) slot = (slot + 1) & (size - 1);
+                table[slot] = nameTable.table[i];
+            }
+            free(nameTable.table);
+        }
+        nameTable.table = table;
+        nameTable.mask = size - 1;
+    }
+
+    uint32_t slot = id & nameTable.mask;
+    while (nameTable.table[slot].id) {
+        if (nameTable.table[slot].id == id) return 1;
+        slot = (slot + 1) & nameTable.mask;
+    }
+
+    if (nameTable.poolFree < (len + 1)) {
+        nameTable.pool = malloc(INTERNPOOLSIZE);
+        if (!nameTable.pool) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            nameTable.poolFree = 0;
+            return 0;
+        }
+        nameTable.poolFree = INTERNPOOLSIZE;
+    }
+    char *s = nameTable.pool;
+    memcpy(s, name, len);
+    s[len] = '\0';
+    nameTable.pool += len + 1;
+    nameTable.poolFree -= len + 1;
+
+    nameTable.table[slot].id = id;
+    nameTable.table[slot].name = s;
+    nameTable.count++;
+
+    return 1;
+
+}  // End of InternInsert
+
+// intern a decoded, lower case name and return its id
+uint64_t dnsNameIntern(const char *name, size_t len) {
+    uint64_t id = swiss_hash_bytes(name, len);
+    if (id == 0) id = 1;
+
+    uint32_t seen = id & (INTERNSEENSIZE - 1);
+    if (internSeen[seen] == id) return id;
+
+    pthread_mutex_lock(&nameTable.lock);
+    int ok = InternInsert(id, name, len);
+    pthread_mutex_unlock(&nameTable.lock);
+    if (ok) internSeen[seen] = id;
+
+    return id;
+
+}  // End of dnsNameIntern
+
+// return the name of an interned id or NULL if unknown
+const char *dnsNameString(uint64_t id) {
+    const char *name = NULL;
+
+    pthread_mutex_lock(&nameTable.lock);
+    if (nameTable.table) {
+        uint32_t slot = id & nameTable.mask;
+        while (nameTable.table[slot].id) {
+            if (nameTable.table[slot].id == id) {
+                name = nameTable.table[slot].name;
+                break;
+            }
+            slot = (slot + 1) & nameTable.mask;
+        }
+    }
+    pthread_mutex_unlock(&nameTable.lock);
+
+    return name;
+
+}  // End of dnsNameString
+
+int dnsTypeNum(const char *s) {
+    for (int i = 0; dnsTypeList[i].name != NULL; i++) {
+        if (strcasecmp(s, dnsTypeList[i].name) == 0) return dnsTypeList[i].type;
+    }
+
+    char *end;
+    long num = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || num < 0 || num > 65535) return -1;
+    return (int)num;
+
+}  // End of dnsTypeNum
+
+void dnsTypeString(uint16_t type, char *s, size_t len) {
+    for (int i = 0; dnsTypeList[i].name != NULL; i++) {
+        if (dnsTypeList[i].type == type) {
+            snprintf(s, len, "%s", dnsTypeList[i].name);
+            return;
+        }
+    }
+    snprintf(s, len, "%u", type);
+
+}  // End of dnsTypeString
+
+int dnsRcodeNum(const char *s) {
+    for (int i = 0; dnsRcodeList[i] != NULL; i++) {
+        if (strcasecmp(s, dnsRcodeList[i]) == 0) return i;
+    }
+
+    char *end;
+    long num = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || num < 0 || num > 15) return -1;
+    return (int)num;
+
+}  // End of dnsRcodeNum
+
+void dnsRcodeString(uint8_t rcode, char *s, size_t len) {
+    if (rcode < (sizeof(dnsRcodeList) / sizeof(char *)) - 1)
+        snprintf(s, len, "%s", dnsRcodeList[rcode]);
+    else
+        snprintf(s, len, "%u", rcode);
+
+}  // End of dnsRcodeString
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _DNSPARSE_H
+#define _DNSPARSE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "nfdump.h"
+
+// max length of a decoded name incl. escapes and '\0'
+#define MAXDNSNAME 1025
+
+typedef struct dnsInfo_s {
+    uint64_t qname;  // interned id of the query name
+    uint16_t qtype;
+    uint16_t qclass;
+    uint8_t rcode;
+    uint8_t response;
+    uint16_t nameLength;
+    char name[MAXDNSNAME];
+} dnsInfo_t;
+
+int dnsParse(dnsInfo_t *dns, uint8_t proto, const uint8_t *payload, size_t len);
+
+void AddDNSInfo(master_record_t *record);
+
+uint64_t dnsNameHash(const char *name);
+
+uint64_t dnsNameIntern(const char *name, size_t len);
+
+const char *dnsNameString(uint64_t id);
+
+int dnsTypeNum(const char *s);
+
+void dnsTypeString(uint16_t type, char *s, size_t len);
+
+int dnsRcodeNum(const char *s);
+
+void dnsRcodeString(uint8_t rcode, char *s, size_t len);
+
+#endif
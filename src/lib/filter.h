@@ -100,6 +100,21 @@ typedef RB_HEAD(IPtree, IPListNode) IPlist_t;
 /* Port/AS tree type */
 typedef RB_HEAD(ULongtree, ULongListNode) ULongtree_t;
 
+/*
+ * Compiled port/AS list: a bitmap, if all values fit into 16 bits,
+ * otherwise a sorted array of the values. The tree holds the values
+ * shifted into their master record word, the bitmap and the array
+ * hold them shifted back by the shift of the block mask.
+ */
+typedef struct ULongList_s {
+    ULongtree_t *tree;   // source tree of the list
+    uint64_t *bitmap;    // one bit per value 0 .. maxValue
+    uint64_t maxValue;   // largest value of the list
+    uint64_t *array;     // sorted values, if no bitmap
+    uint32_t numValues;  // number of values
+    uint32_t shift;      // bit shift of the block mask
+} ULongList_t;
+
 // Insert the RB prototypes here
 RB_PROTOTYPE(IPtree, IPListNode, entry, IPNodeCMP);
 
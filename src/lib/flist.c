@@ -58,6 +58,7 @@
 #define fts_set fts_set_compat
 #endif
 
+#include "affinity.h"
 #include "flist.h"
 #include "nfdump.h"
 #include "nffile.h"
@@ -930,6 +931,8 @@ static void *FileLister_thr(void *arg) {
     flist_t *flist = (flist_t *)arg;
     char *single_file = flist->single_file;
 
+    PinThread(AFFINITY_READER);
+
     first_file = NULL;
     last_file = NULL;
 
@@ -51,6 +51,7 @@
 #include "nffile.h"
 #include "nftree.h"
 #include "ipconv.h"
+#include "dnsparse.h"
 #include "sgregex/sgregex.h"
 
 #define AnyMask 0xffffffffffffffffLL
@@ -87,6 +88,7 @@ extern uint64_t		*IPstack;
 extern uint32_t	StartNode;
 extern uint8_t	geoFilter;
 extern uint8_t	ja3Filter;
+extern uint8_t	dnsFilter;
 extern int (*FilterEngine)(uint32_t *);
 extern char	*FilterFilename;
 
@@ -144,7 +146,7 @@ char yyerror_buff[256];
 %token ASA DENIED XEVENT XNET XPORT INGRESS EGRESS ACL ACE XACE
 %token NAT ADD EVENT VRF NPORT NIP
 %token PBLOCK START END STEP SIZE
-%token PAYLOAD CONTENT REGEX JA3
+%token PAYLOAD CONTENT REGEX JA3 DNS
 %token OBSERVATION DOMAIN POINT ID
 %token PF PFACTION PFREASON RULE INTERFACE
 %token <s> STRING 
@@ -1391,6 +1393,78 @@ term:	ANY { /* this is an unconditionally true expression, as a filter applies i
 		ja3Filter = 1;
 	}
 
+	| PAYLOAD DNS STRING {
+		if ( strcasecmp($3, "defined") == 0) {
+			$$.self = Invert(NewBlock(OffsetDNSQname, MaskDNSQname, 0, CMP_EQ, FUNC_NONE, NULL ));
+		} else if ( strcasecmp($3, "response") == 0) {
+			$$.self = NewBlock(OffsetDNSInfo, MaskDNSResponse, 1LL << ShiftDNSResponse, CMP_EQ, FUNC_NONE, NULL );
+		} else {
+			yyerror("expected 'defined' or 'response'");
+			YYABORT;
+		}
+		dnsFilter = 1;
+	}
+
+	| PAYLOAD DNS STRING STRING {
+		if ( strcasecmp($3, "qname") == 0) {
+			if (strlen($4) >= MAXDNSNAME) {
+				yyerror("name too long");
+				YYABORT;
+			}
+			$$.self = NewBlock(OffsetDNSQname, MaskDNSQname, dnsNameHash($4), CMP_EQ, FUNC_NONE, NULL );
+		} else if ( strcasecmp($3, "qtype") == 0) {
+			int type = dnsTypeNum($4);
+			if (type < 0) {
+				yyerror("unknown dns query type");
+				YYABORT;
+			}
+			$$.self = Connect_AND(
+				Invert(NewBlock(OffsetDNSQname, MaskDNSQname, 0, CMP_EQ, FUNC_NONE, NULL )),
+				NewBlock(OffsetDNSInfo, MaskDNSQtype, (uint64_t)type << ShiftDNSQtype, CMP_EQ, FUNC_NONE, NULL )
+			);
+		} else if ( strcasecmp($3, "rcode") == 0) {
+			int rcode = dnsRcodeNum($4);
+			if (rcode < 0) {
+				yyerror("unknown dns rcode");
+				YYABORT;
+			}
+			$$.self = Connect_AND(
+				NewBlock(OffsetDNSInfo, MaskDNSResponse, 1LL << ShiftDNSResponse, CMP_EQ, FUNC_NONE, NULL ),
+				NewBlock(OffsetDNSInfo, MaskDNSRcode, (uint64_t)rcode << ShiftDNSRcode, CMP_EQ, FUNC_NONE, NULL )
+			);
+		} else {
+			yyerror("expected qname, qtype or rcode");
+			YYABORT;
+		}
+		dnsFilter = 1;
+	}
+
+	| PAYLOAD DNS STRING NUMBER {
+		if ( strcasecmp($3, "qtype") == 0) {
+			if ($4 > 65535) {
+				yyerror("dns query type out of range");
+				YYABORT;
+			}
+			$$.self = Connect_AND(
+				Invert(NewBlock(OffsetDNSQname, MaskDNSQname, 0, CMP_EQ, FUNC_NONE, NULL )),
+				NewBlock(OffsetDNSInfo, MaskDNSQtype, $4 << ShiftDNSQtype, CMP_EQ, FUNC_NONE, NULL )
+			);
+		} else if ( strcasecmp($3, "rcode") == 0) {
+			if ($4 > 15) {
+				yyerror("dns rcode out of range");
+				YYABORT;
+			}
+			$$.self = Connect_AND(
+				NewBlock(OffsetDNSInfo, MaskDNSResponse, 1LL << ShiftDNSResponse, CMP_EQ, FUNC_NONE, NULL ),
+				NewBlock(OffsetDNSInfo, MaskDNSRcode, $4 << ShiftDNSRcode, CMP_EQ, FUNC_NONE, NULL )
+			);
+		} else {
+			yyerror("expected qtype or rcode");
+			YYABORT;
+		}
+		dnsFilter = 1;
+	}
+
 	| dqual NIP IN '[' iplist ']' { 	
 #ifdef NSEL
 		switch ( $1.direction ) {
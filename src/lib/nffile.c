@@ -27,6 +27,10 @@
  *  POSSIBILITY OF SUCH DAMAGE.
  *
  */
+
+// for fallocate() and sync_file_range() prototypes
+#define _GNU_SOURCE
+
 #include "nffile.h"
 
 #include <arpa/inet.h>
@@ -61,6 +65,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "flist.h"
 #ifndef HAVE_LZ4
 #include "lz4.h"
@@ -116,10 +121,22 @@ static void FreeDataBlock(dataBlock_t *dataBlock);
 
 static nffile_t *NewFile(nffile_t *nffile);
 
-static dataBlock_t *nfread(nffile_t *nffile);
+static dataBlock_t *nfread(nffile_t *nffile, readStat_t *stat);
+
+static dataBlock_t *UncompressBlock(nffile_t *nffile, dataBlock_t *buff);
+
+static void *nffollower(void *arg);
 
 static int nfwrite(nffile_t *nffile, dataBlock_t *block_header);
 
+static void PreallocFile(nffile_t *nffile);
+
+static void ReleasePrealloc(nffile_t *nffile);
+
+static void SyncRange(nffile_t *nffile);
+
+static off_t DropCache(nffile_t *nffile, off_t dropOffset, int final);
+
 static int ReadAppendix(nffile_t *nffile);
 
 static int WriteAppendix(nffile_t *nffile);
@@ -134,10 +151,30 @@ static void UpdateStat(stat_record_t *s, stat_recordV1_t *sv1);
 
 static queue_t *fileQueue = NULL;
 
+// follow files while they are written - see SetFollowMode()
+static int followMode = 0;
+
+// page cache and preallocation settings - see nfdump.conf
+static off_t preallocSize = 0;   // reserve disk space for new files in chunks of this size
+static off_t syncRangeSize = 0;  // start writeback of new files every syncRangeSize bytes
+static int readAhead = 0;        // advise kernel of sequential reads
+static int dropCache = 0;        // drop consumed blocks of read files from the page cache
+
+// reader statistics - see EnableReadStat()
+static int readStatEnabled = 0;
+static readStat_t readStat = {0};
+static pthread_mutex_t readStatLock = PTHREAD_MUTEX_INITIALIZER;
+
 /* function definitions */
 
 #define QueueSize 4
 
+// poll interval in usec for files in follow mode
+#define FOLLOWINTERVAL 100000
+
+// chunk size to release consumed file data from page cache
+#define DROPCACHESIZE (8 * ONEMB)
+
 static _Atomic unsigned blocksInUse;
 
 int Init_nffile(int workers, queue_t *fileList) {
@@ -187,10 +224,35 @@ int Init_nffile(int workers, queue_t *fileList) {
     }
 
     NumWorkers = workers;
+
+    // page cache and preallocation settings - all off by default
+    int confValue = ConfGetValue("file.prealloc");
+    preallocSize = confValue > 0 ? (off_t)confValue * ONEMB : 0;
+    confValue = ConfGetValue("file.syncrange");
+    syncRangeSize = confValue > 0 ? (off_t)confValue * ONEMB : 0;
+    readAhead = ConfGetValue("file.readahead") > 0;
+    dropCache = ConfGetValue("file.dropcache") > 0;
+
     return 1;
 
 }  // End of Init_nffile
 
+// read files while they are written and follow them across collector rotations
+void SetFollowMode(int follow) {
+    followMode = follow;
+}  // End of SetFollowMode
+
+// collect the read statistics of all following reader threads
+void EnableReadStat(void) {
+    readStatEnabled = 1;
+}  // End of EnableReadStat
+
+void GetReadStat(readStat_t *stat) {
+    pthread_mutex_lock(&readStatLock);
+    *stat = readStat;
+    pthread_mutex_unlock(&readStatLock);
+}  // End of GetReadStat
+
 int ParseCompression(char *arg) {
     if (arg == NULL) {
         return LZO_COMPRESSED;
@@ -566,7 +628,7 @@ static int ReadAppendix(nffile_t *nffile) {
     dbg_printf("Num of appendix records: %u\n", nffile->file_header->appendixBlocks);
     for (int i = 0; i < nffile->file_header->appendixBlocks; i++) {
         size_t processed = 0;
-        dataBlock_t *block_header = nfread(nffile);
+        dataBlock_t *block_header = nfread(nffile, NULL);
         if (!block_header) {
             LogError("Unable to read appendix block of file: %s", nffile->fileName);
             lseek(nffile->fd, currentPos, SEEK_SET);
@@ -728,6 +790,10 @@ static nffile_t *NewFile(nffile_t *nffile) {
     nffile->block_header = NULL;
     nffile->buff_ptr = NULL;
 
+    nffile->writeOffset = 0;
+    nffile->syncOffset = 0;
+    nffile->allocOffset = 0;
+
     for (int i = 0; i < MAXWORKERS; i++) nffile->worker[i] = 0;
     atomic_store(&nffile->terminate, 0);
     pthread_mutex_init(&nffile->wlock, NULL);
@@ -898,12 +964,20 @@ nffile_t *OpenFile(char *filename, nffile_t *nffile) {
         return NULL;
     }
 
+#ifdef HAVE_POSIX_FADVISE
+    // followed files grow while reading - advise only complete files
+    if (readAhead && !followMode) {
+        posix_fadvise(nffile->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(nffile->fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+#endif
+
     // kick off nfreader
     // there is only 1 reader thread -> slot 0
     pthread_t tid;
     atomic_store(&nffile->terminate, 0);
     queue_open(nffile->processQueue);
-    int err = pthread_create(&tid, NULL, nfreader, (void *)nffile);
+    int err = pthread_create(&tid, NULL, followMode ? nffollower : nfreader, (void *)nffile);
     if (err) {
         nffile->worker[0] = 0;
         LogError("pthread_create() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
@@ -974,6 +1048,10 @@ nffile_t *OpenNewFile(char *filename, nffile_t *nffile, int creator, int compres
         nffile->fd = 0;
         return NULL;
     }
+    nffile->writeOffset = sizeof(fileHeaderV2_t);
+    nffile->syncOffset = nffile->writeOffset;
+    nffile->allocOffset = 0;
+    PreallocFile(nffile);
 
     // prepare buffer to write to
     nffile->block_header = NewDataBlock();
@@ -1041,6 +1119,10 @@ nffile_t *AppendFile(char *filename) {
     // appending needs no block header
     nffile->block_header = NULL;
 
+    nffile->writeOffset = lseek(nffile->fd, 0, SEEK_CUR);
+    nffile->syncOffset = nffile->writeOffset;
+    nffile->allocOffset = nffile->writeOffset;
+
     // kick off NumWorkers nfwriter threads
     atomic_store(&nffile->terminate, 0);
     queue_open(nffile->processQueue);
@@ -1196,6 +1278,7 @@ int CloseUpdateFile(nffile_t *nffile) {
         close(nffile->fd);
         return 0;
     }
+    ReleasePrealloc(nffile);
     fsync(nffile->fd);
     CloseFile(nffile);
 
@@ -1272,8 +1355,57 @@ int ReadBlock(nffile_t *nffile) {
 
 }  // End of ReadBlock
 
+// uncompress a data block according file compression. buff is consumed
+static dataBlock_t *UncompressBlock(nffile_t *nffile, dataBlock_t *buff) {
+    dataBlock_t *block_header = NULL;
+    int failed = 0;
+    switch (nffile->file_header->compression) {
+        case NOT_COMPRESSED:
+            block_header = buff;
+            break;
+        case LZO_COMPRESSED:
+            block_header = NewDataBlock();
+            if (Uncompress_Block_LZO(buff, block_header, nffile->buff_size) < 0) failed = 1;
+            FreeDataBlock(buff);
+            break;
+        case LZ4_COMPRESSED:
+            block_header = NewDataBlock();
+            if (Uncompress_Block_LZ4(buff, block_header, nffile->buff_size) < 0) failed = 1;
+            FreeDataBlock(buff);
+            break;
+        case BZ2_COMPRESSED:
+            block_header = NewDataBlock();
+            if (Uncompress_Block_BZ2(buff, block_header, nffile->buff_size) < 0) failed = 1;
+            FreeDataBlock(buff);
+            break;
+        case ZSTD_COMPRESSED:
+            block_header = NewDataBlock();
+            if (Uncompress_Block_ZSTD(buff, block_header, nffile->buff_size) < 0) failed = 1;
+            FreeDataBlock(buff);
+            break;
+        default:
+            LogError("Unknown compression ID: %u", nffile->file_header->compression);
+            FreeDataBlock(buff);
+            return NULL;
+    }
+
+    if (failed) {
+        FreeDataBlock(block_header);
+        return NULL;
+    }
+    return block_header;
+
+}  // End of UncompressBlock
+
 // generic read und uncompress a data block from current position
-static dataBlock_t *nfread(nffile_t *nffile) {
+// stat, if not NULL, collects the read statistics
+static dataBlock_t *nfread(nffile_t *nffile, readStat_t *stat) {
+    uint64_t wall = 0, cpu = 0;
+    if (stat) {
+        wall = nsecTime(CLOCK_MONOTONIC);
+        cpu = nsecTime(CLOCK_THREAD_CPUTIME_ID);
+    }
+
     dataBlock_t *buff = NewDataBlock();
     ssize_t ret = read(nffile->fd, buff, sizeof(dataBlock_t));
     if (ret == 0) {  // EOF
@@ -1304,46 +1436,26 @@ static dataBlock_t *nfread(nffile_t *nffile) {
         return NULL;
     }
 
-    int compression = nffile->file_header->compression;
-
     void *p = (void *)((void *)buff + sizeof(dataBlock_t));
     dbg_printf("ReadBlock - read: %u\n", buff->size);
     ret = read(nffile->fd, p, buff->size);
     if (ret == buff->size) {
-        dataBlock_t *block_header = NULL;
-        int failed = 0;
         // we have the whole record and are done for now
-        switch (compression) {
-            case NOT_COMPRESSED:
-                block_header = buff;
-                break;
-            case LZO_COMPRESSED:
-                block_header = NewDataBlock();
-                if (Uncompress_Block_LZO(buff, block_header, nffile->buff_size) < 0) failed = 1;
-                FreeDataBlock(buff);
-                break;
-            case LZ4_COMPRESSED:
-                block_header = NewDataBlock();
-                if (Uncompress_Block_LZ4(buff, block_header, nffile->buff_size) < 0) failed = 1;
-                FreeDataBlock(buff);
-                break;
-            case BZ2_COMPRESSED:
-                block_header = NewDataBlock();
-                if (Uncompress_Block_BZ2(buff, block_header, nffile->buff_size) < 0) failed = 1;
-                FreeDataBlock(buff);
-                break;
-            case ZSTD_COMPRESSED:
-                block_header = NewDataBlock();
-                if (Uncompress_Block_ZSTD(buff, block_header, nffile->buff_size) < 0) failed = 1;
-                FreeDataBlock(buff);
-                break;
-        }
+        if (stat == NULL) return UncompressBlock(nffile, buff);
 
-        if (failed) {
-            FreeDataBlock(block_header);
-            return NULL;
+        uint64_t ioWall = nsecTime(CLOCK_MONOTONIC);
+        uint64_t ioCPU = nsecTime(CLOCK_THREAD_CPUTIME_ID);
+        stat->ioWall += ioWall - wall;
+        stat->ioCPU += ioCPU - cpu;
+        stat->diskBytes += sizeof(dataBlock_t) + buff->size;
+
+        dataBlock_t *block_header = UncompressBlock(nffile, buff);
+        stat->decompressWall += nsecTime(CLOCK_MONOTONIC) - ioWall;
+        stat->decompressCPU += nsecTime(CLOCK_THREAD_CPUTIME_ID) - ioCPU;
+        if (block_header) {
+            stat->blocks++;
+            stat->bytes += block_header->size;
         }
-        // success - done
         return block_header;
 
     } else if (ret == 0) {
@@ -1359,6 +1471,28 @@ static dataBlock_t *nfread(nffile_t *nffile) {
 
 }  // End of nfread
 
+// release consumed file data from the page cache in chunks of DROPCACHESIZE
+// returns the new offset, up to which the data is released
+static off_t DropCache(nffile_t *nffile, off_t dropOffset, int final) {
+#ifdef HAVE_POSIX_FADVISE
+    off_t offset = lseek(nffile->fd, 0, SEEK_CUR);
+    if (offset < 0) return dropOffset;
+
+    if (final) {
+        // release the entire file, incl. header and appendix
+        posix_fadvise(nffile->fd, 0, 0, POSIX_FADV_DONTNEED);
+        return offset;
+    }
+
+    if ((offset - dropOffset) < DROPCACHESIZE) return dropOffset;
+    posix_fadvise(nffile->fd, dropOffset, offset - dropOffset, POSIX_FADV_DONTNEED);
+    return offset;
+#else
+    return dropOffset;
+#endif
+
+}  // End of DropCache
+
 __attribute__((noreturn)) void *nfreader(void *arg) {
     nffile_t *nffile = (nffile_t *)arg;
 
@@ -1366,18 +1500,29 @@ __attribute__((noreturn)) void *nfreader(void *arg) {
     sigset_t set = {0};
     sigfillset(&set);
     pthread_sigmask(SIG_SETMASK, &set, NULL);
+    PinThread(AFFINITY_READER);
+
+    readStat_t stat = {0};
+    readStat_t *statPtr = readStatEnabled ? &stat : NULL;
+    uint64_t cpuStart = statPtr ? nsecTime(CLOCK_THREAD_CPUTIME_ID) : 0;
 
     int terminate = atomic_load(&nffile->terminate);
     int blockCount = 0;
+    off_t dropOffset = 0;
     dataBlock_t *block_header = NULL;
     while (!terminate && blockCount < nffile->file_header->NumBlocks) {
-        block_header = nfread(nffile);
+        block_header = nfread(nffile, statPtr);
         if (!block_header) {
             dbg_printf("block_header == NULL\n");
             break;
         }
 
-        if (queue_push(nffile->processQueue, (void *)block_header) == QUEUE_CLOSED) {
+        if (dropCache) dropOffset = DropCache(nffile, dropOffset, 0);
+
+        uint64_t pushStart = statPtr ? nsecTime(CLOCK_MONOTONIC) : 0;
+        int closed = queue_push(nffile->processQueue, (void *)block_header) == QUEUE_CLOSED;
+        if (statPtr) stat.pushWait += nsecTime(CLOCK_MONOTONIC) - pushStart;
+        if (closed) {
             FreeDataBlock(block_header);
             dbg_printf("nfreader - processQueue closed\n");
             terminate = 1;
@@ -1397,6 +1542,21 @@ __attribute__((noreturn)) void *nfreader(void *arg) {
 
     // eof or error ends processing
     queue_close(nffile->processQueue);
+    if (dropCache) DropCache(nffile, dropOffset, 1);
+
+    if (statPtr) {
+        pthread_mutex_lock(&readStatLock);
+        readStat.blocks += stat.blocks;
+        readStat.diskBytes += stat.diskBytes;
+        readStat.bytes += stat.bytes;
+        readStat.ioWall += stat.ioWall;
+        readStat.ioCPU += stat.ioCPU;
+        readStat.decompressWall += stat.decompressWall;
+        readStat.decompressCPU += stat.decompressCPU;
+        readStat.pushWait += stat.pushWait;
+        readStat.readerCPU += nsecTime(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+        pthread_mutex_unlock(&readStatLock);
+    }
 
     dbg_printf("nfreader done - read %u blocks\n", blockCount);
     dbg_printf("nfreader exit\n");
@@ -1406,6 +1566,154 @@ __attribute__((noreturn)) void *nfreader(void *arg) {
 
 }  // End of nfreader
 
+/*
+ * read the next complete data block at offset of a file, which may still be
+ * written. Returns 1 with the block, 0 if no complete block is available yet
+ * and -1 on error
+ */
+static int nfreadFollow(nffile_t *nffile, off_t *offset, dataBlock_t **block) {
+    dataBlock_t header;
+    ssize_t ret = pread(nffile->fd, (void *)&header, sizeof(dataBlock_t), *offset);
+    if (ret < 0) {
+        LogError("pread() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return -1;
+    }
+    if (ret != sizeof(dataBlock_t)) return 0;
+
+    if (header.size > (BUFFSIZE - sizeof(dataBlock_t)) || header.size == 0 || header.NumRecords == 0) {
+        LogError("Corrupt data file: Error buffer size %u", header.size);
+        return -1;
+    }
+
+    dataBlock_t *buff = NewDataBlock();
+    if (!buff) return -1;
+    memcpy((void *)buff, (void *)&header, sizeof(dataBlock_t));
+    ret = pread(nffile->fd, (void *)buff + sizeof(dataBlock_t), header.size, *offset + sizeof(dataBlock_t));
+    if (ret != header.size) {
+        FreeDataBlock(buff);
+        if (ret < 0) {
+            LogError("pread() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return -1;
+        }
+        // block not yet completely written
+        return 0;
+    }
+
+    *offset += sizeof(dataBlock_t) + header.size;
+    *block = UncompressBlock(nffile, buff);
+    return *block ? 1 : -1;
+
+}  // End of nfreadFollow
+
+// wait for a new file with a valid header at the path of the followed file
+static int FollowNextFile(nffile_t *nffile, struct stat *lastStat) {
+    while (atomic_load(&nffile->terminate) == 0) {
+        struct stat stat_buf;
+        if (stat(nffile->fileName, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) && stat_buf.st_size >= (off_t)sizeof(fileHeaderV2_t) &&
+            (stat_buf.st_ino != lastStat->st_ino || stat_buf.st_dev != lastStat->st_dev)) {
+            int fd = open(nffile->fileName, O_RDONLY);
+            if (fd < 0) {
+                LogError("Error open file: %s", strerror(errno));
+                return 0;
+            }
+            fileHeaderV2_t fileHeader;
+            if (read(fd, (void *)&fileHeader, sizeof(fileHeaderV2_t)) != sizeof(fileHeaderV2_t) || fileHeader.magic != MAGIC ||
+                fileHeader.version != LAYOUT_VERSION_2) {
+                LogError("Follow file %s: bad file header", nffile->fileName);
+                close(fd);
+                return 0;
+            }
+            close(nffile->fd);
+            nffile->fd = fd;
+            memcpy((void *)nffile->file_header, (void *)&fileHeader, sizeof(fileHeaderV2_t));
+            dbg_printf("Follow next file: %s\n", nffile->fileName);
+            return 1;
+        }
+        xsleep(FOLLOWINTERVAL);
+    }
+    return 0;
+
+}  // End of FollowNextFile
+
+/*
+ * reader thread for a file, which is still being written, such as the
+ * nfcapd.current file of a collector. New blocks are processed as soon as they
+ * are flushed. After the collector renamed the file at rotation, the remaining
+ * blocks are read and the reader continues with the new file at the same path.
+ */
+__attribute__((noreturn)) static void *nffollower(void *arg) {
+    nffile_t *nffile = (nffile_t *)arg;
+
+    /* Signal handling */
+    sigset_t set = {0};
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, NULL);
+    PinThread(AFFINITY_READER);
+
+    off_t offset = sizeof(fileHeaderV2_t);
+    // a closed file ends with the appendix
+    off_t end = nffile->file_header->appendixBlocks ? nffile->file_header->offAppendix : 0;
+    int rotated = 0;
+    while (atomic_load(&nffile->terminate) == 0) {
+        dataBlock_t *block_header = NULL;
+        off_t blockOffset = offset;
+        int ret = 0;
+        if (end == 0 || offset < end) ret = nfreadFollow(nffile, &offset, &block_header);
+        if (ret < 0) break;
+
+        if (ret == 1) {
+            recordHeader_t *recordHeader = (recordHeader_t *)((void *)block_header + sizeof(dataBlock_t));
+            if (recordHeader->type == TYPE_IDENT) {
+                // the appendix is written, before the header is updated - file is closed
+                FreeDataBlock(block_header);
+                end = blockOffset;
+                continue;
+            }
+            if (queue_push(nffile->processQueue, (void *)block_header) == QUEUE_CLOSED) {
+                FreeDataBlock(block_header);
+                break;
+            }
+            continue;
+        }
+
+        // no more data available
+        struct stat fdStat, pathStat;
+        if (fstat(nffile->fd, &fdStat) < 0) {
+            LogError("fstat() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            break;
+        }
+        if (rotated == 0 && stat(nffile->fileName, &pathStat) == 0 && pathStat.st_ino == fdStat.st_ino && pathStat.st_dev == fdStat.st_dev) {
+            // file is still written
+            xsleep(FOLLOWINTERVAL);
+            continue;
+        }
+
+        if (rotated == 0) {
+            // the file was closed before it was renamed - read the final header and the remaining blocks
+            fileHeaderV2_t fileHeader;
+            if (pread(nffile->fd, (void *)&fileHeader, sizeof(fileHeaderV2_t), 0) != sizeof(fileHeaderV2_t)) break;
+            end = fileHeader.appendixBlocks ? fileHeader.offAppendix : fdStat.st_size;
+            rotated = 1;
+            continue;
+        }
+
+        // all blocks read - continue with the next file
+        if (!FollowNextFile(nffile, &fdStat)) break;
+        offset = sizeof(fileHeaderV2_t);
+        end = 0;
+        rotated = 0;
+    }
+
+    // terminate or error ends processing
+    queue_close(nffile->processQueue);
+
+    dbg_printf("nffollower exit\n");
+
+    atomic_store(&nffile->terminate, 2);
+    pthread_exit(NULL);
+
+}  // End of nffollower
+
 int WriteBlock(nffile_t *nffile) {
     // empty blocks need not to be written
     if (nffile->block_header->size != 0) {
@@ -1423,6 +1731,51 @@ int WriteBlock(nffile_t *nffile) {
 
 }  // End of WriteBlock
 
+// reserve disk space ahead of the written data in chunks of preallocSize
+// the file size is not changed, therefore readers following the file are not affected
+static void PreallocFile(nffile_t *nffile) {
+#ifdef HAVE_FALLOCATE
+    if (preallocSize == 0 || (nffile->writeOffset + (off_t)WRITE_BUFFSIZE) < nffile->allocOffset) return;
+
+    off_t offset = nffile->allocOffset > nffile->writeOffset ? nffile->allocOffset : nffile->writeOffset;
+    if (fallocate(nffile->fd, FALLOC_FL_KEEP_SIZE, offset, preallocSize) < 0) {
+        // not supported by the filesystem or disk full - write without preallocation
+        LogError("fallocate() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        nffile->allocOffset = 0;
+        preallocSize = 0;
+        return;
+    }
+    nffile->allocOffset = offset + preallocSize;
+#endif
+}  // End of PreallocFile
+
+// release the unused preallocated disk space beyond the end of file
+static void ReleasePrealloc(nffile_t *nffile) {
+#ifdef HAVE_FALLOCATE
+    off_t fileSize = lseek(nffile->fd, 0, SEEK_END);
+    if (fileSize < 0 || nffile->allocOffset <= fileSize) return;
+
+    // truncating to the current size frees the blocks beyond end of file
+    if (ftruncate(nffile->fd, fileSize) < 0) {
+        LogError("ftruncate() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+    }
+    nffile->allocOffset = 0;
+#endif
+}  // End of ReleasePrealloc
+
+// start asynchronous writeback of the data written every syncRangeSize bytes
+// this spreads the disk IO over the file lifetime instead of a large burst at rotation
+static void SyncRange(nffile_t *nffile) {
+#ifdef HAVE_SYNC_FILE_RANGE
+    if (syncRangeSize == 0 || (nffile->writeOffset - nffile->syncOffset) < syncRangeSize) return;
+
+    if (sync_file_range(nffile->fd, nffile->syncOffset, nffile->writeOffset - nffile->syncOffset, SYNC_FILE_RANGE_WRITE) < 0) {
+        LogError("sync_file_range() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+    }
+    nffile->syncOffset = nffile->writeOffset;
+#endif
+}  // End of SyncRange
+
 static int nfwrite(nffile_t *nffile, dataBlock_t *block_header) {
     if (block_header->size == 0) {
         return 1;
@@ -1481,6 +1834,9 @@ static int nfwrite(nffile_t *nffile, dataBlock_t *block_header) {
     }
 
     nffile->file_header->NumBlocks++;
+    nffile->writeOffset += ret;
+    PreallocFile(nffile);
+    SyncRange(nffile);
     pthread_mutex_unlock(&nffile->wlock);
     return 1;
 
@@ -1494,6 +1850,7 @@ __attribute__((noreturn)) void *nfwriter(void *arg) {
     sigset_t set = {0};
     sigfillset(&set);
     pthread_sigmask(SIG_SETMASK, &set, NULL);
+    PinThread(AFFINITY_WRITER);
 
     dataBlock_t *block_header;
     while (1) {
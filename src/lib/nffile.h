@@ -212,8 +212,25 @@ typedef struct nffile_s {
     char *ident;                 // source identifier
     char *fileName;              // file name
     uint16_t compression_level;  // compression level, if available.
+
+    off_t writeOffset;  // end of written data
+    off_t syncOffset;   // end of data, already scheduled for writeback
+    off_t allocOffset;  // end of preallocated disk space
 } nffile_t;
 
+// statistics of the reader threads, if enabled by EnableReadStat() - times in nsec
+typedef struct readStat_s {
+    uint64_t blocks;          // data blocks read
+    uint64_t diskBytes;       // bytes read from disk
+    uint64_t bytes;           // uncompressed bytes
+    uint64_t ioWall;          // time in read()
+    uint64_t ioCPU;           // cpu time in read()
+    uint64_t decompressWall;  // time to uncompress blocks
+    uint64_t decompressCPU;   // cpu time to uncompress blocks
+    uint64_t pushWait;        // time blocked on a full process queue
+    uint64_t readerCPU;       // total cpu time of the reader threads
+} readStat_t;
+
 #define FILE_IDENT(n) ((n)->ident)
 
 /*
@@ -250,8 +267,14 @@ int Init_nffile(int workers, queue_t *fileList);
 
 int ParseCompression(char *arg);
 
+void SetFollowMode(int follow);
+
 unsigned ReportBlocks(void);
 
+void EnableReadStat(void);
+
+void GetReadStat(readStat_t *stat);
+
 void SumStatRecords(stat_record_t *s1, stat_record_t *s2);
 
 nffile_t *OpenFile(char *filename, nffile_t *nffile);
@@ -45,6 +45,7 @@
 #include "nffile.h"
 #include "rbtree.h"
 #include "sgregex/sgregex.h"
+#include "util.h"
 
 /*
  * netflow filter engine
@@ -96,6 +97,7 @@ uint32_t StartNode;
 uint16_t Extended;
 uint8_t geoFilter = 0;
 uint8_t ja3Filter = 0;
+uint8_t dnsFilter = 0;
 
 // 128bit compare for IPv6
 static int IPNodeCMP(struct IPListNode *e1, struct IPListNode *e2) {
@@ -133,6 +135,68 @@ RB_GENERATE(IPtree, IPListNode, entry, IPNodeCMP);
 // Insert the Ulong RB tree code here
 RB_GENERATE(ULongtree, ULongListNode, entry, ULNodeCMP);
 
+// values below this limit are compiled into a bitmap - ports, protocols, interfaces, vlans
+#define ULBITMAPLIMIT 65536
+
+// compile the tree of a port/AS list into a bitmap or a sorted array
+static ULongList_t *CompileULongList(ULongtree_t *tree, uint64_t mask) {
+    ULongList_t *list = calloc(1, sizeof(ULongList_t));
+    if (!list) {
+        fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
+    list->tree = tree;
+    // the values are shifted into their master record word - e.g. dst port
+    list->shift = mask ? __builtin_ctzll(mask) : 0;
+
+    struct ULongListNode *node;
+    RB_FOREACH(node, ULongtree, tree) {
+        list->numValues++;
+        // tree is sorted - the last value is the largest
+        list->maxValue = node->value >> list->shift;
+    }
+
+    if (list->maxValue < ULBITMAPLIMIT) {
+        list->bitmap = calloc((list->maxValue >> 6) + 1, sizeof(uint64_t));
+        if (!list->bitmap) {
+            fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
+            exit(255);
+        }
+        RB_FOREACH(node, ULongtree, tree) {
+            uint64_t value = node->value >> list->shift;
+            list->bitmap[value >> 6] |= 1ULL << (value & 0x3F);
+        }
+    } else {
+        list->array = malloc(list->numValues * sizeof(uint64_t));
+        if (!list->array) {
+            fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
+            exit(255);
+        }
+        int i = 0;
+        RB_FOREACH(node, ULongtree, tree) { list->array[i++] = node->value >> list->shift; }
+    }
+
+    return list;
+
+}  // End of CompileULongList
+
+// branchless binary search in the sorted array of a list
+static inline int ULongListFind(ULongList_t *list, uint64_t value) {
+    value >>= list->shift;
+    if (list->bitmap) return value <= list->maxValue && ((list->bitmap[value >> 6] >> (value & 0x3F)) & 1);
+
+    const uint64_t *base = list->array;
+    uint32_t n = list->numValues;
+    if (n == 0) return 0;
+    while (n > 1) {
+        uint32_t half = n >> 1;
+        base = base[half] <= value ? base + half : base;
+        n -= half;
+    }
+    return *base == value;
+
+}  // End of ULongListFind
+
 void InitTree(void) {
     memblocks = 1;
     FilterTree = (FilterBlock_t *)malloc(MAXBLOCKS * sizeof(FilterBlock_t));
@@ -149,6 +213,9 @@ void InitTree(void) {
 void ClearFilter(void) {
     NumBlocks = 1;
     Extended = 0;
+    geoFilter = 0;
+    ja3Filter = 0;
+    dnsFilter = 0;
     MaxIdents = 0;
     NumIdents = 0;
     IdentList = NULL;
@@ -177,6 +244,11 @@ FilterEngine_t *CompileFilter(char *FilterSyntax) {
     lex_cleanup();
     free(IPstack);
 
+    // compile port/AS lists for fast lookups
+    for (int i = 1; i < NumBlocks; i++) {
+        if (FilterTree[i].comp == CMP_ULLIST) FilterTree[i].data = (void *)CompileULongList((ULongtree_t *)FilterTree[i].data, FilterTree[i].mask);
+    }
+
     engine = malloc(sizeof(FilterEngine_t));
     if (!engine) {
         fprintf(stderr, "Memory allocation error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
@@ -185,10 +257,14 @@ FilterEngine_t *CompileFilter(char *FilterSyntax) {
     engine->nfrecord = NULL;
     engine->label = NULL;
     engine->ident = NULL;
+    engine->evalCount = NULL;
+    engine->hitCount = NULL;
     engine->StartNode = StartNode;
+    engine->numBlocks = NumBlocks - 1;
     engine->Extended = Extended;
     engine->geoFilter = geoFilter;
     engine->ja3Filter = ja3Filter;
+    engine->dnsFilter = dnsFilter;
     engine->IdentList = IdentList;
     engine->filter = FilterTree;
     if (Extended)
@@ -390,8 +466,10 @@ void DumpEngine(FilterEngine_t *engine) {
                            (unsigned long long)node->mask[0], (unsigned long long)node->mask[1]);
                 }
             } else if (engine->filter[i].comp == CMP_ULLIST) {
+                ULongList_t *list = (ULongList_t *)engine->filter[i].data;
                 struct ULongListNode *node;
-                RB_FOREACH(node, ULongtree, engine->filter[i].data) { printf("%.16llx \n", (unsigned long long)node->value); }
+                RB_FOREACH(node, ULongtree, list->tree) { printf("%.16llx \n", (unsigned long long)node->value); }
+                printf("%u values as %s\n", list->numValues, list->bitmap ? "bitmap" : "sorted array");
             } else
                 printf("Error comp: %i\n", engine->filter[i].comp);
         }
@@ -424,10 +502,110 @@ int RunFilter(FilterEngine_t *engine) {
 
 } /* End of RunFilter */
 
+/* compare a single filter block against the current record */
+static inline __attribute__((always_inline)) int EvaluateBlock(FilterEngine_t *engine, uint32_t index, int invert) {
+    uint32_t offset = engine->filter[index].offset;
+    uint64_t comp_value[2];
+    int evaluate = 0;
+
+    comp_value[0] = engine->nfrecord[offset] & engine->filter[index].mask;
+    comp_value[1] = engine->filter[index].value;
+
+    if (engine->filter[index].function != NULL) engine->filter[index].function(engine->nfrecord, comp_value);
+
+    switch (engine->filter[index].comp) {
+        case CMP_EQ:
+            evaluate = comp_value[0] == comp_value[1];
+            break;
+        case CMP_GT:
+            evaluate = comp_value[0] > comp_value[1];
+            break;
+        case CMP_LT:
+            evaluate = comp_value[0] < comp_value[1];
+            break;
+        case CMP_GE:
+            evaluate = comp_value[0] >= comp_value[1];
+            break;
+        case CMP_LE:
+            evaluate = comp_value[0] <= comp_value[1];
+            break;
+        case CMP_IDENT:
+            evaluate = engine->ident ? strncmp(engine->ident, engine->IdentList[comp_value[1]], IDENTLEN) == 0 : 0;
+            break;
+        case CMP_FLOWLABEL: {
+            master_record_t *r = (master_record_t *)engine->nfrecord;
+            char *string = (char *)engine->filter[index].data;
+            if (r->label == NULL)
+                evaluate = 0;
+            else
+                evaluate = strncasecmp(r->label, string, 16) == 0 ? 1 : 0;
+        } break;
+        case CMP_FLAGS:
+            if (invert)
+                evaluate = comp_value[0] > 0;
+            else
+                evaluate = comp_value[0] == comp_value[1];
+            break;
+        case CMP_IPLIST: {
+            struct IPListNode find;
+            find.ip[0] = engine->nfrecord[offset];
+            find.ip[1] = engine->nfrecord[offset + 1];
+            find.mask[0] = 0xffffffffffffffffLL;
+            find.mask[1] = 0xffffffffffffffffLL;
+            evaluate = RB_FIND(IPtree, engine->filter[index].data, &find) != NULL;
+        } break;
+        case CMP_ULLIST:
+            evaluate = ULongListFind((ULongList_t *)engine->filter[index].data, comp_value[0]);
+            break;
+        case CMP_PAYLOAD: {
+            master_record_t *r = (master_record_t *)engine->nfrecord;
+            char *data = r->inPayload;
+            char *string = (char *)engine->filter[index].data;
+            uint32_t len = r->inPayloadLength;
+
+            evaluate = 0;
+            if (r->inPayload != NULL && string != NULL) {
+                // find any string in data, even beyond '\0' bytes
+                int m = 0;
+                for (int i = 0; i < len; i++) {
+                    if (data[i] == string[m]) {
+                        m++;
+                        if (string[m] == '\0') {
+                            evaluate = 1;
+                            break;
+                        }
+                    } else {
+                        m = 0;
+                    }
+                }
+            }
+        } break;
+        case CMP_REGEX: {
+            master_record_t *r = (master_record_t *)engine->nfrecord;
+            srx_Context *program = (srx_Context *)engine->filter[index].data;
+            if (r->inPayload != NULL && program != NULL) {
+                evaluate = srx_Find(program, r->inPayload, r->inPayloadLength);
+                if (evaluate < 0) {
+                    // backtracking step limit exceeded - count as no match
+                    static int warned = 0;
+                    if (!warned) {
+                        LogInfo("payload regex: step limit exceeded - record does not match");
+                        warned = 1;
+                    }
+                    evaluate = 0;
+                }
+            } else {
+                evaluate = 0;
+            }
+        } break;
+    }
+    return evaluate;
+
+} /* End of EvaluateBlock */
+
 /* extended filter engine */
 int RunExtendedFilter(FilterEngine_t *engine) {
-    uint32_t index, offset;
-    uint64_t comp_value[2];
+    uint32_t index;
     int evaluate, invert;
 
     engine->label = NULL;
@@ -435,93 +613,8 @@ int RunExtendedFilter(FilterEngine_t *engine) {
     evaluate = 0;
     invert = 0;
     while (index) {
-        offset = engine->filter[index].offset;
         invert = engine->filter[index].invert;
-
-        comp_value[0] = engine->nfrecord[offset] & engine->filter[index].mask;
-        comp_value[1] = engine->filter[index].value;
-
-        if (engine->filter[index].function != NULL) engine->filter[index].function(engine->nfrecord, comp_value);
-
-        switch (engine->filter[index].comp) {
-            case CMP_EQ:
-                evaluate = comp_value[0] == comp_value[1];
-                break;
-            case CMP_GT:
-                evaluate = comp_value[0] > comp_value[1];
-                break;
-            case CMP_LT:
-                evaluate = comp_value[0] < comp_value[1];
-                break;
-            case CMP_GE:
-                evaluate = comp_value[0] >= comp_value[1];
-                break;
-            case CMP_LE:
-                evaluate = comp_value[0] <= comp_value[1];
-                break;
-            case CMP_IDENT:
-                evaluate = engine->ident ? strncmp(engine->ident, engine->IdentList[comp_value[1]], IDENTLEN) == 0 : 0;
-                break;
-            case CMP_FLOWLABEL: {
-                master_record_t *r = (master_record_t *)engine->nfrecord;
-                char *string = (char *)engine->filter[index].data;
-                if (r->label == NULL)
-                    evaluate = 0;
-                else
-                    evaluate = strncasecmp(r->label, string, 16) == 0 ? 1 : 0;
-            } break;
-            case CMP_FLAGS:
-                if (invert)
-                    evaluate = comp_value[0] > 0;
-                else
-                    evaluate = comp_value[0] == comp_value[1];
-                break;
-            case CMP_IPLIST: {
-                struct IPListNode find;
-                find.ip[0] = engine->nfrecord[offset];
-                find.ip[1] = engine->nfrecord[offset + 1];
-                find.mask[0] = 0xffffffffffffffffLL;
-                find.mask[1] = 0xffffffffffffffffLL;
-                evaluate = RB_FIND(IPtree, engine->filter[index].data, &find) != NULL;
-            } break;
-            case CMP_ULLIST: {
-                struct ULongListNode find;
-                find.value = comp_value[0];
-                evaluate = RB_FIND(ULongtree, engine->filter[index].data, &find) != NULL;
-            } break;
-            case CMP_PAYLOAD: {
-                master_record_t *r = (master_record_t *)engine->nfrecord;
-                char *data = r->inPayload;
-                char *string = (char *)engine->filter[index].data;
-                uint32_t len = r->inPayloadLength;
-
-                evaluate = 0;
-                if (r->inPayload != NULL && string != NULL) {
-                    // find any string in data, even beyond '\0' bytes
-                    int m = 0;
-                    for (int i = 0; i < len; i++) {
-                        if (data[i] == string[m]) {
-                            m++;
-                            if (string[m] == '\0') {
-                                evaluate = 1;
-                                break;
-                            }
-                        } else {
-                            m = 0;
-                        }
-                    }
-                }
-            } break;
-            case CMP_REGEX: {
-                master_record_t *r = (master_record_t *)engine->nfrecord;
-                srx_Context *program = (srx_Context *)engine->filter[index].data;
-                if (r->inPayload != NULL && program != NULL) {
-                    evaluate = srx_MatchExt(program, r->inPayload, r->inPayloadLength, 0);
-                } else {
-                    evaluate = 0;
-                }
-            } break;
-        }
+        evaluate = EvaluateBlock(engine, index, invert);
 
         /*
          * Label evaluation:
@@ -548,6 +641,55 @@ int RunExtendedFilter(FilterEngine_t *engine) {
 
 } /* End of RunExtendedFilter */
 
+/* extended filter engine, which counts the evaluations and matches of each block */
+int RunFilterStat(FilterEngine_t *engine) {
+    uint32_t index;
+    int evaluate, invert;
+
+    engine->label = NULL;
+    index = engine->StartNode;
+    evaluate = 0;
+    invert = 0;
+    while (index) {
+        invert = engine->filter[index].invert;
+        evaluate = EvaluateBlock(engine, index, invert);
+        engine->evalCount[index]++;
+
+        // same label evaluation as RunExtendedFilter
+        if (evaluate) {
+            engine->hitCount[index]++;
+            if (engine->filter[index].label) {
+                engine->label = engine->filter[index].label;
+            }
+            index = engine->filter[index].OnTrue;
+        } else {
+            if (engine->label) engine->label = NULL;
+            index = engine->filter[index].OnFalse;
+        }
+    }
+    return invert ? !evaluate : evaluate;
+
+} /* End of RunFilterStat */
+
+/*
+ * switch the engine to RunFilterStat
+ * the counters of block i are evalCount[i] and hitCount[i] for i = 1..engine->numBlocks
+ */
+int EnableFilterStat(FilterEngine_t *engine) {
+    engine->evalCount = calloc(engine->numBlocks + 1, sizeof(uint64_t));
+    engine->hitCount = calloc(engine->numBlocks + 1, sizeof(uint64_t));
+    if (!engine->evalCount || !engine->hitCount) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        free(engine->evalCount);
+        free(engine->hitCount);
+        engine->evalCount = engine->hitCount = NULL;
+        return 0;
+    }
+    engine->FilterEngine = RunFilterStat;
+    return 1;
+
+} /* End of EnableFilterStat */
+
 void AddLabel(uint32_t index, char *label) {
     char *l = strdup(label);
 
@@ -66,13 +66,17 @@ typedef struct FilterBlock {
 typedef struct FilterEngine_data_s {
     FilterBlock_t *filter;
     uint32_t StartNode;
+    uint32_t numBlocks;  // blocks 1..numBlocks of filter
     uint16_t Extended;
     uint8_t geoFilter;
     uint8_t ja3Filter;
+    uint8_t dnsFilter;
     char **IdentList;
     uint64_t *nfrecord;
     char *label;
     char *ident;
+    uint64_t *evalCount;  // per block evaluations - see EnableFilterStat()
+    uint64_t *hitCount;   // per block matches
     int (*FilterEngine)(struct FilterEngine_data_s *);
 } FilterEngine_t;
 
@@ -87,6 +91,10 @@ int RunFilter(FilterEngine_t *engine);
 
 int RunExtendedFilter(FilterEngine_t *engine);
 
+int RunFilterStat(FilterEngine_t *engine);
+
+int EnableFilterStat(FilterEngine_t *engine);
+
 void ClearFilter(void);
 
 void DumpEngine(FilterEngine_t *engine);
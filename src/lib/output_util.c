@@ -30,11 +30,15 @@
 
 #include "output_util.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "config.h"
 #include "nfdump.h"
@@ -289,6 +293,224 @@ void CondenseV6(char *s) {
 
 }  // End of CondenseV6
 
+/*
+ * cached local time formatting
+ * Flows are mostly printed in time order, so the same second is formatted
+ * over and over again. The last formatted second is kept and returned as is.
+ * On a miss, the local time is calculated from the UTC offset of the current
+ * 15min slot, which avoids the expensive localtime() for every new second.
+ * A slot with a DST change in it is not cached and goes the slow path.
+ */
+#define TZSLOT 900
+
+typedef struct timeCache_s {
+    time_t lastSecond;
+    time_t slotStart;
+    long utcOffset;
+    int slotValid;
+    char timeString[TIMESTRINGLEN];
+} timeCache_t;
+
+static _Thread_local timeCache_t timeCache = {.lastSecond = -1};
+
+static int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+
+}  // End of DaysFromCivil
+
+static void CivilFromDays(int64_t z, int64_t *y, unsigned *m, unsigned *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int64_t)yoe + era * 400 + (*m <= 2);
+
+}  // End of CivilFromDays
+
+// UTC offset of a given time in seconds
+static long UTCOffset(time_t when) {
+    struct tm ts;
+    if (localtime_r(&when, &ts) == NULL) return 0;
+    int64_t local = DaysFromCivil((int64_t)ts.tm_year + 1900, ts.tm_mon + 1, ts.tm_mday) * 86400LL + ts.tm_hour * 3600 + ts.tm_min * 60 + ts.tm_sec;
+    return (long)(local - (int64_t)when);
+
+}  // End of UTCOffset
+
+static inline void put2(char *s, unsigned v) {
+    s[0] = '0' + v / 10;
+    s[1] = '0' + v % 10;
+}  // End of put2
+
+void LocalTimeString(time_t when, char *s) {
+    timeCache_t *cache = &timeCache;
+
+    if (when == cache->lastSecond) {
+        memcpy(s, cache->timeString, TIMESTRINGLEN);
+        return;
+    }
+
+    time_t slotStart = when - (((when % TZSLOT) + TZSLOT) % TZSLOT);
+    if (slotStart != cache->slotStart || cache->lastSecond == -1) {
+        long offset = UTCOffset(slotStart);
+        cache->slotStart = slotStart;
+        cache->utcOffset = offset;
+        cache->slotValid = offset == UTCOffset(slotStart + TZSLOT - 1);
+    }
+
+    int64_t y = 0;
+    unsigned m = 0, d = 0;
+    int64_t local = (int64_t)when + cache->utcOffset;
+    int64_t days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+    int64_t secs = local - days * 86400;
+    if (cache->slotValid) CivilFromDays(days, &y, &m, &d);
+
+    if (y < 1000 || y > 9999) {
+        // DST change in this slot or out of range - let libc do the job
+        struct tm ts;
+        if (localtime_r(&when, &ts) == NULL || strftime(cache->timeString, TIMESTRINGLEN, "%Y-%m-%d %H:%M:%S", &ts) == 0)
+            cache->timeString[0] = '\0';
+    } else {
+        char *p = cache->timeString;
+        unsigned yy = (unsigned)y;
+        put2(p, yy / 100);
+        put2(p + 2, yy % 100);
+        p[4] = '-';
+        put2(p + 5, m);
+        p[7] = '-';
+        put2(p + 8, d);
+        p[10] = ' ';
+        put2(p + 11, (unsigned)(secs / 3600));
+        p[13] = ':';
+        put2(p + 14, (unsigned)((secs / 60) % 60));
+        p[16] = ':';
+        put2(p + 17, (unsigned)(secs % 60));
+        p[19] = '\0';
+    }
+    cache->lastSecond = when;
+    memcpy(s, cache->timeString, TIMESTRINGLEN);
+
+}  // End of LocalTimeString
+
+/*
+ * IP address formatting
+ * IPv4 is formatted directly. IPv6 addresses are formatted following the
+ * RFC 5952 rules of inet_ntop() and remembered in a small direct mapped cache,
+ * as the same addresses show up again and again in the output.
+ * Addresses with the first 80 bits zero may contain an embedded IPv4 address,
+ * which is printed differently by the various libc - these go to inet_ntop().
+ */
+#define IP6CACHESIZE 64
+
+typedef struct ip6Cache_s {
+    uint64_t addr[2];
+    int valid;
+    char ipString[INET6_ADDRSTRLEN];
+} ip6Cache_t;
+
+static _Thread_local ip6Cache_t ip6Cache[IP6CACHESIZE];
+
+static char *ip4_ntop(const uint8_t *a, char *dst) {
+    char *p = dst;
+    for (int i = 0; i < 4; i++) {
+        unsigned v = a[i];
+        if (v >= 100) {
+            *p++ = '0' + v / 100;
+            v %= 100;
+            *p++ = '0' + v / 10;
+        } else if (v >= 10) {
+            *p++ = '0' + v / 10;
+        }
+        *p++ = '0' + v % 10;
+        *p++ = '.';
+    }
+    p[-1] = '\0';
+    return dst;
+
+}  // End of ip4_ntop
+
+static void ip6_ntop(const uint8_t *a, char *dst) {
+    static const char hex[] = "0123456789abcdef";
+    uint16_t words[8];
+    int bestBase = -1, bestLen = 0, curBase = -1, curLen = 0;
+
+    for (int i = 0; i < 8; i++) {
+        words[i] = (a[2 * i] << 8) | a[2 * i + 1];
+        if (words[i] == 0) {
+            if (curBase == -1) {
+                curBase = i;
+                curLen = 1;
+            } else {
+                curLen++;
+            }
+        } else if (curBase != -1) {
+            if (curLen > bestLen) {
+                bestBase = curBase;
+                bestLen = curLen;
+            }
+            curBase = -1;
+        }
+    }
+    if (curBase != -1 && curLen > bestLen) {
+        bestBase = curBase;
+        bestLen = curLen;
+    }
+    if (bestLen < 2) bestBase = -1;
+
+    char *p = dst;
+    for (int i = 0; i < 8; i++) {
+        if (bestBase != -1 && i >= bestBase && i < (bestBase + bestLen)) {
+            if (i == bestBase) *p++ = ':';
+            continue;
+        }
+        if (i != 0) *p++ = ':';
+        unsigned w = words[i];
+        int started = 0;
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            unsigned nibble = (w >> shift) & 0xF;
+            if (nibble || started || shift == 0) {
+                *p++ = hex[nibble];
+                started = 1;
+            }
+        }
+    }
+    if (bestBase != -1 && (bestBase + bestLen) == 8) *p++ = ':';
+    *p = '\0';
+
+}  // End of ip6_ntop
+
+const char *nf_inet_ntop(int af, const void *src, char *dst, socklen_t size) {
+    if (af == AF_INET && size >= INET_ADDRSTRLEN) {
+        return ip4_ntop((const uint8_t *)src, dst);
+    }
+    if (af != AF_INET6 || size < INET6_ADDRSTRLEN) return inet_ntop(af, src, dst, size);
+
+    uint64_t addr[2];
+    memcpy(addr, src, 16);
+    const uint8_t *a = (const uint8_t *)src;
+    if (addr[0] == 0 && a[8] == 0 && a[9] == 0) return inet_ntop(af, src, dst, size);
+
+    uint64_t h = (addr[0] ^ addr[1]) * 0x9E3779B97F4A7C15ULL;
+    ip6Cache_t *entry = &ip6Cache[h >> 58];
+    if (!entry->valid || entry->addr[0] != addr[0] || entry->addr[1] != addr[1]) {
+        ip6_ntop(a, entry->ipString);
+        entry->addr[0] = addr[0];
+        entry->addr[1] = addr[1];
+        entry->valid = 1;
+    }
+    strcpy(dst, entry->ipString);
+    return dst;
+
+}  // End of nf_inet_ntop
+
 char *FwEventString(int event) {
     switch (event) {
 #ifdef JUNOS
@@ -32,6 +32,11 @@
 #define _OUTPUT_UTIL_H 1
 
 #include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+// length of a "%Y-%m-%d %H:%M:%S" string incl. \0
+#define TIMESTRINGLEN 20
 
 char *ProtoString(uint8_t protoNum, uint32_t plainNumbers);
 
@@ -45,6 +50,10 @@ char *FlowEndString(uint8_t biFlow);
 
 void CondenseV6(char *s);
 
+void LocalTimeString(time_t when, char *s);
+
+const char *nf_inet_ntop(int af, const void *src, char *dst, socklen_t size);
+
 char *FwEventString(int event);
 
 char *EventString(int event);
@@ -37,6 +37,10 @@
 #define RX_MAX_REPEATS 0xffffffff
 #define RX_NULL_OFFSET 0xffffffff
 #define RX_NULL_INSTROFF 0x0fffffff
+#define RX_MAX_LITERAL 16    /* max length of the prefilter literal */
+#define RX_AST_MAXNODES 4096 /* patterns exceeding the limits use the backtracking matcher */
+#define RX_NFA_MAXNODES 8192
+#define RX_NFA_MAXSETS 1024
 
 #define RCF_MULTILINE 0x01 /* ^/$ matches beginning/end of line too */
 #define RCF_CASELESS 0x02  /* pre-equalized case for match/range */
@@ -103,6 +107,8 @@ typedef struct rxCompiler {
 #define RX_LAST_CHAR(c) ((c)->chars[(c)->chars_count - 1])
 #define RX_LAST_SUBEXPR(c) ((c)->subexprs[(c)->subexprs_count - 1])
 
+typedef struct rxNFA rxNFA;
+
 struct rxExecute {
     srx_MemFunc memfn;
     void* memctx;
@@ -113,7 +119,14 @@ struct rxExecute {
     uint8_t flags;
     uint8_t capture_count;
 
+    /* linear matcher and prefilter, see rxCompileLinear() */
+    rxNFA* nfa;
+    rxChar literal[RX_MAX_LITERAL];
+    size_t literal_len;
+
     /* runtime data */
+    size_t steps;
+    size_t maxsteps;
     rxState* states;
     size_t states_count;
     size_t states_mem;
@@ -360,26 +373,37 @@ static void rxPushChar(rxCompiler* c, rxChar ch) {
     c->chars[c->chars_count++] = ch;
 }
 
-static uint32_t rxPushCharClassData(rxCompiler* c, rxChar cch) {
-    uint32_t cc = c->chars_count;
+static const rxChar* rxCharClassData(rxChar cch, size_t* len) {
+    const rxChar* data;
     switch (cch) {
         case 'd':
-            rxPushChars(c, RX_STRLITBUF("09"));
+            data = "09";
             break;
         case 'h':
-            rxPushChars(c, RX_STRLITBUF("\t\t  "));
+            data = "\t\t  ";
             break;
         case 'v':
-            rxPushChars(c, RX_STRLITBUF("\x0A\x0D"));
+            data = "\x0A\x0D";
             break;
         case 's':
-            rxPushChars(c, RX_STRLITBUF("\x09\x0D  "));
+            data = "\x09\x0D  ";
             break;
         case 'w':
-            rxPushChars(c, RX_STRLITBUF("azAZ09__"));
+            data = "azAZ09__";
             break;
+        default:
+            *len = 0;
+            return NULL;
     }
-    return c->chars_count - cc;
+    *len = strlen(data);
+    return data;
+}
+
+static uint32_t rxPushCharClassData(rxCompiler* c, rxChar cch) {
+    size_t len;
+    const rxChar* data = rxCharClassData(cch, &len);
+    if (data) rxPushChars(c, data, len);
+    return (uint32_t)len;
 }
 
 static void rxCompile(rxCompiler* c, const rxChar* str, size_t strsize) {
@@ -715,6 +739,11 @@ static void rxInitExecute(rxExecute* e, srx_MemFunc memfn, void* memctx, rxInstr
     e->flags = 0;
     e->capture_count = 0;
 
+    e->nfa = NULL;
+    e->literal_len = 0;
+
+    e->steps = 0;
+    e->maxsteps = RX_DEFAULT_MAXSTEPS;
     e->states = NULL;
     e->states_count = 0;
     e->states_mem = 0;
@@ -725,7 +754,13 @@ static void rxInitExecute(rxExecute* e, srx_MemFunc memfn, void* memctx, rxInstr
     rxResetCaptures(e);
 }
 
+static void rxFreeNFA(srx_MemFunc memfn, void* memctx, rxNFA* nfa);
+
 static void rxFreeExecute(rxExecute* e) {
+    if (e->nfa) {
+        rxFreeNFA(e->memfn, e->memctx, e->nfa);
+        e->nfa = NULL;
+    }
     if (e->instrs) {
         e->memfn(e->memctx, e->instrs, 0);
         e->instrs = NULL;
@@ -780,7 +815,8 @@ static void rxPushIterCnt(rxExecute* e, uint32_t it) {
 #define RX_POP_ITER_CNT(e) assert((e)->iternum_count-- < 0xffffffff)
 #endif
 
-static int rxExecDo(rxExecute* e, const rxChar* str, const rxChar* soff, size_t str_size) {
+/* returns 1 on match, 0 on no match and -1, if maxsteps is set and exceeded */
+static int rxExecDo(rxExecute* e, const rxChar* str, const rxChar* soff, size_t str_size, size_t maxsteps) {
     const rxInstr* instrs = e->instrs;
     const rxChar* chars = e->chars;
 
@@ -791,6 +827,12 @@ static int rxExecDo(rxExecute* e, const rxChar* str, const rxChar* soff, size_t
         rxState* s = &RX_LAST_STATE(e);
         const rxInstr* op = &instrs[s->instr];
 
+        if (maxsteps && ++e->steps > maxsteps) {
+            e->states_count = 0;
+            e->iternum_count = 0;
+            return -1;
+        }
+
         RX_LOG(printf("[%d]", s->instr));
         switch (op->op) {
             case RX_OP_MATCH_DONE:
@@ -993,6 +1035,633 @@ static int rxExecDo(rxExecute* e, const rxChar* str, const rxChar* soff, size_t
     return 0;
 }
 
+/*
+ * linear matcher
+ * Patterns without back references are additionally compiled into a Thompson NFA,
+ * which is simulated with one state list per string position. This needs
+ * O(pattern * string) time for any pattern and input, but does not track captures,
+ * so it is used for boolean matching only. The parser mirrors the syntax of rxCompile()
+ * and runs only on patterns rxCompile() accepted.
+ */
+
+#define RX_AST_SET 0 /* single char out of a char set */
+#define RX_AST_BOL 1
+#define RX_AST_EOL 2
+#define RX_AST_CAT 3
+#define RX_AST_ALT 4
+#define RX_AST_REPEAT 5
+#define RX_AST_BACKREF 6
+
+typedef struct rxAstNode {
+    uint8_t type;
+    int16_t lit; /* literal char, if the set is a single char, else -1 */
+    uint32_t set;
+    uint32_t min, max;
+    struct rxAstNode *left, *right;
+} rxAstNode;
+
+#define RX_NFA_SET 0   /* consume a char of the set */
+#define RX_NFA_SPLIT 1 /* continue at out and out1 */
+#define RX_NFA_BOL 2   /* string start */
+#define RX_NFA_BOLML 3 /* string start or consume a line break */
+#define RX_NFA_EOL 4   /* string end */
+#define RX_NFA_EOLML 5 /* string end or before a line break */
+#define RX_NFA_MATCH 6
+
+typedef struct rxNFANode {
+    uint32_t type;
+    uint32_t set;
+    uint32_t out, out1;
+} rxNFANode;
+
+struct rxNFA {
+    rxNFANode* nodes;
+    uint32_t num_nodes;
+    uint32_t start;
+    uint32_t (*sets)[8]; /* 256 bit char sets */
+    uint32_t num_sets;
+
+    /* runtime data */
+    uint32_t* lists[2];
+    uint32_t* mark;
+    uint32_t listid;
+    int matched;
+};
+
+typedef struct rxNFACompiler {
+    const rxChar* s;
+    const rxChar* end;
+    uint8_t flags;
+    int error;
+    int has_backref;
+    int groups;
+    rxAstNode* ast;
+    uint32_t num_ast;
+    rxNFA* nfa;
+} rxNFACompiler;
+
+#define RX_SET_ADD(set, ch) ((set)[(rxUChar)(ch) >> 5] |= 1U << ((rxUChar)(ch)&31))
+#define RX_SET_HAS(set, ch) (((set)[(rxUChar)(ch) >> 5] >> ((rxUChar)(ch)&31)) & 1)
+
+static rxAstNode* rxAstNew(rxNFACompiler* c, uint8_t type) {
+    rxAstNode* n;
+    if (c->num_ast == RX_AST_MAXNODES) {
+        c->error = 1;
+        return NULL;
+    }
+    n = &c->ast[c->num_ast++];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->lit = -1;
+    return n;
+}
+
+static rxAstNode* rxAstSet(rxNFACompiler* c, uint32_t** set) {
+    rxNFA* nfa = c->nfa;
+    rxAstNode* n = rxAstNew(c, RX_AST_SET);
+    if (!n) return NULL;
+    if (nfa->num_sets == RX_NFA_MAXSETS) {
+        c->error = 1;
+        return NULL;
+    }
+    n->set = nfa->num_sets++;
+    *set = nfa->sets[n->set];
+    memset(*set, 0, sizeof(nfa->sets[0]));
+    return n;
+}
+
+static void rxSetAddRange(uint32_t* set, rxUChar from, rxUChar to) {
+    unsigned ch;
+    for (ch = from; ch <= to; ++ch) RX_SET_ADD(set, ch);
+}
+
+/* apply case folding and inversion the same way as rxMatchCharset() and the charset ops */
+static void rxSetFinish(rxNFACompiler* c, uint32_t* set, int invert) {
+    int i;
+    if (c->flags & RCF_CASELESS) {
+        unsigned ch;
+        for (ch = 'A'; ch <= 'Z'; ++ch) {
+            if (RX_SET_HAS(set, ch) || RX_SET_HAS(set, ch - 'A' + 'a')) {
+                RX_SET_ADD(set, ch);
+                RX_SET_ADD(set, ch - 'A' + 'a');
+            }
+        }
+    }
+    if (invert) {
+        for (i = 0; i < 8; ++i) set[i] = ~set[i];
+    }
+}
+
+static rxAstNode* rxAstChar(rxNFACompiler* c, rxChar ch) {
+    uint32_t* set;
+    rxAstNode* n = rxAstSet(c, &set);
+    if (!n) return NULL;
+    RX_SET_ADD(set, ch);
+    rxSetFinish(c, set, 0);
+    n->lit = (rxUChar)ch;
+    return n;
+}
+
+static rxAstNode* rxParseAlt(rxNFACompiler* c);
+
+static rxAstNode* rxParseClass(rxNFACompiler* c) {
+    const rxChar* sc;
+    uint32_t* set;
+    rxAstNode* n;
+    int invert = 0, pending = 0;
+    rxUChar lo = 0, hi = 0;
+
+    /* a '-' extends the last pair pushed, so the last pair is kept pending */
+#define RX_CLASS_PAIR(a, b)                                  \
+    {                                                        \
+        if (pending && lo <= hi) rxSetAddRange(set, lo, hi); \
+        lo = (rxUChar)(a);                                   \
+        hi = (rxUChar)(b);                                   \
+        pending = 1;                                         \
+    }
+
+    n = rxAstSet(c, &set);
+    if (!n) return NULL;
+
+    if (++c->s == c->end) goto fail;
+    if (*c->s == '^') {
+        invert = 1;
+        if (++c->s == c->end) goto fail;
+    }
+    sc = c->s;
+    if (*c->s == ']') {
+        if (++c->s == c->end) goto fail;
+        RX_CLASS_PAIR(*c->s, *c->s);
+    }
+    while (c->s != c->end && *c->s != ']') {
+        if (*c->s == '-' && c->s > sc && c->s + 1 != c->end && c->s[1] != ']') {
+            if (pending) hi = (rxUChar)c->s[1];
+            c->s++;
+        } else if (*c->s == '\\') {
+            size_t len, i;
+            const rxChar* data;
+            if (++c->s == c->end) goto fail;
+            data = rxCharClassData(*c->s, &len);
+            if (data) {
+                for (i = 0; i < len; i += 2) RX_CLASS_PAIR(data[i], data[i + 1]);
+            } else {
+                RX_CLASS_PAIR(*c->s, *c->s);
+            }
+        } else {
+            RX_CLASS_PAIR(*c->s, *c->s);
+        }
+        if (++c->s == c->end) goto fail;
+    }
+    c->s++;
+    if (pending && lo <= hi) rxSetAddRange(set, lo, hi);
+#undef RX_CLASS_PAIR
+
+    rxSetFinish(c, set, invert);
+    return n;
+
+fail:
+    c->error = 1;
+    return NULL;
+}
+
+static rxAstNode* rxParseAtom(rxNFACompiler* c) {
+    rxAstNode* n;
+    uint32_t* set;
+
+    switch (*c->s) {
+        case '(':
+            c->s++;
+            c->groups++;
+            n = rxParseAlt(c);
+            if (!n || c->s == c->end || *c->s != ')') break;
+            c->s++;
+            return n;
+        case '[':
+            return rxParseClass(c);
+        case '^':
+            c->s++;
+            return rxAstNew(c, RX_AST_BOL);
+        case '$':
+            c->s++;
+            return rxAstNew(c, RX_AST_EOL);
+        case '.':
+            c->s++;
+            n = rxAstSet(c, &set);
+            if (!n) return NULL;
+            if ((c->flags & RCF_DOTALL) == 0) {
+                RX_SET_ADD(set, '\n');
+                RX_SET_ADD(set, '\r');
+            }
+            rxSetFinish(c, set, 1);
+            return n;
+        case '\\':
+            if (++c->s == c->end) break;
+            if (rxIsDigit(*c->s)) {
+                c->s++;
+                c->has_backref = 1;
+                return rxAstNew(c, RX_AST_BACKREF);
+            }
+            if (*c->s != '.') {
+                size_t len, i;
+                const rxChar* data = rxCharClassData(rxToLower(*c->s), &len);
+                if (data) {
+                    int invert = !(*c->s >= 'a' && *c->s <= 'z');
+                    c->s++;
+                    n = rxAstSet(c, &set);
+                    if (!n) return NULL;
+                    for (i = 0; i < len; i += 2) rxSetAddRange(set, (rxUChar)data[i], (rxUChar)data[i + 1]);
+                    rxSetFinish(c, set, invert);
+                    return n;
+                }
+            }
+            return rxAstChar(c, *c->s++);
+        case ')':
+        case ']':
+        case '}':
+        case '|':
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            break;
+        default:
+            return rxAstChar(c, *c->s++);
+    }
+    c->error = 1;
+    return NULL;
+}
+
+static rxAstNode* rxParseRepeat(rxNFACompiler* c, rxAstNode* atom) {
+    uint32_t min = 0, max = RX_MAX_REPEATS;
+    rxAstNode* n;
+
+    if (c->s == c->end) return atom;
+    switch (*c->s) {
+        case '*':
+            break;
+        case '+':
+            min = 1;
+            break;
+        case '?':
+            max = 1;
+            break;
+        case '{':
+            c->s++;
+            while (c->s != c->end && rxIsDigit(*c->s)) min = min * 10 + (uint32_t)(*c->s++ - '0');
+            if (c->s != c->end && *c->s == ',') {
+                c->s++;
+                if (c->s != c->end && *c->s != '}') {
+                    max = 0;
+                    while (c->s != c->end && rxIsDigit(*c->s)) max = max * 10 + (uint32_t)(*c->s++ - '0');
+                }
+            } else {
+                max = min;
+            }
+            if (c->s == c->end || *c->s != '}') {
+                c->error = 1;
+                return NULL;
+            }
+            break;
+        default:
+            return atom;
+    }
+    c->s++;
+    /* lazy repeats match the same strings */
+    if (c->s != c->end && *c->s == '?') c->s++;
+
+    n = rxAstNew(c, RX_AST_REPEAT);
+    if (!n) return NULL;
+    n->left = atom;
+    n->min = min;
+    n->max = max;
+    return n;
+}
+
+static rxAstNode* rxParseCat(rxNFACompiler* c) {
+    rxAstNode* n = NULL;
+    while (c->s != c->end && *c->s != '|' && *c->s != ')') {
+        rxAstNode* atom = rxParseAtom(c);
+        if (atom) atom = rxParseRepeat(c, atom);
+        if (!atom) return NULL;
+        if (n) {
+            rxAstNode* cat = rxAstNew(c, RX_AST_CAT);
+            if (!cat) return NULL;
+            cat->left = n;
+            cat->right = atom;
+            n = cat;
+        } else {
+            n = atom;
+        }
+    }
+    if (!n) c->error = 1;
+    return n;
+}
+
+static rxAstNode* rxParseAlt(rxNFACompiler* c) {
+    rxAstNode* n = rxParseCat(c);
+    while (n && c->s != c->end && *c->s == '|') {
+        rxAstNode* alt = rxAstNew(c, RX_AST_ALT);
+        if (!alt) return NULL;
+        c->s++;
+        alt->left = n;
+        alt->right = rxParseCat(c);
+        if (!alt->right) return NULL;
+        n = alt;
+    }
+    return n;
+}
+
+static uint32_t rxNFANew(rxNFACompiler* c, uint32_t type, uint32_t out) {
+    rxNFA* nfa = c->nfa;
+    rxNFANode* node;
+    if (nfa->num_nodes == RX_NFA_MAXNODES) {
+        c->error = 1;
+        return 0;
+    }
+    node = &nfa->nodes[nfa->num_nodes];
+    node->type = type;
+    node->set = 0;
+    node->out = out;
+    node->out1 = out;
+    return nfa->num_nodes++;
+}
+
+/* emit the nodes of n, which continue at out. Returns the entry node */
+static uint32_t rxNFAEmit(rxNFACompiler* c, rxAstNode* n, uint32_t out) {
+    uint32_t i, entry, node;
+
+    if (c->error) return 0;
+    switch (n->type) {
+        case RX_AST_SET:
+            node = rxNFANew(c, RX_NFA_SET, out);
+            c->nfa->nodes[node].set = n->set;
+            return node;
+        case RX_AST_BOL:
+            if (c->flags & RCF_MULTILINE) {
+                /* "\r\n" is consumed as one line break */
+                rxAstNode* lf = rxAstChar(c, '\n');
+                if (!lf) return 0;
+                entry = rxNFAEmit(c, lf, out);
+                node = rxNFANew(c, RX_NFA_BOLML, out);
+                c->nfa->nodes[node].out1 = entry;
+                return node;
+            }
+            return rxNFANew(c, RX_NFA_BOL, out);
+        case RX_AST_EOL:
+            return rxNFANew(c, c->flags & RCF_MULTILINE ? RX_NFA_EOLML : RX_NFA_EOL, out);
+        case RX_AST_CAT:
+            return rxNFAEmit(c, n->left, rxNFAEmit(c, n->right, out));
+        case RX_AST_ALT:
+            entry = rxNFANew(c, RX_NFA_SPLIT, out);
+            node = rxNFAEmit(c, n->left, out);
+            if (c->error) return 0;
+            c->nfa->nodes[entry].out = node;
+            node = rxNFAEmit(c, n->right, out);
+            if (c->error) return 0;
+            c->nfa->nodes[entry].out1 = node;
+            return entry;
+        case RX_AST_REPEAT:
+            entry = out;
+            if (n->max == RX_MAX_REPEATS) {
+                node = rxNFANew(c, RX_NFA_SPLIT, out);
+                entry = rxNFAEmit(c, n->left, node);
+                if (c->error) return 0;
+                c->nfa->nodes[node].out = entry;
+                entry = node;
+            } else {
+                for (i = n->min; i < n->max && !c->error; ++i) {
+                    node = rxNFANew(c, RX_NFA_SPLIT, out);
+                    entry = rxNFAEmit(c, n->left, entry);
+                    if (c->error) return 0;
+                    c->nfa->nodes[node].out = entry;
+                    entry = node;
+                }
+            }
+            for (i = 0; i < n->min && !c->error; ++i) entry = rxNFAEmit(c, n->left, entry);
+            return entry;
+    }
+    /* back references */
+    c->error = 1;
+    return 0;
+}
+
+/* collect the sequence of top level items, groups do not change the sequence */
+static void rxAstSequence(rxAstNode* n, rxAstNode** items, size_t* num) {
+    if (n->type == RX_AST_CAT) {
+        rxAstSequence(n->left, items, num);
+        rxAstSequence(n->right, items, num);
+    } else {
+        items[(*num)++] = n;
+    }
+}
+
+/* find the longest run of literal chars, which every match must contain */
+static void rxFindLiteral(rxExecute* e, rxAstNode* root, uint32_t num_ast) {
+    rxAstNode** items;
+    size_t num = 0, i, run = 0, best = 0, best_end = 0;
+
+    e->literal_len = 0;
+    items = (rxAstNode**)e->memfn(e->memctx, NULL, sizeof(rxAstNode*) * num_ast);
+    if (!items) return;
+    rxAstSequence(root, items, &num);
+
+    for (i = 0; i < num; ++i) {
+        rxAstNode* item = items[i];
+        if (item->type == RX_AST_SET && item->lit >= 0) {
+            run++;
+        } else if (item->type == RX_AST_REPEAT && item->min && item->left->type == RX_AST_SET && item->left->lit >= 0) {
+            /* the first char of "a+" joins the current run, but ends it */
+            run++;
+            if (run > best) {
+                best = run;
+                best_end = i + 1;
+            }
+            run = 0;
+            continue;
+        } else {
+            run = 0;
+        }
+        if (run > best) {
+            best = run;
+            best_end = i + 1;
+        }
+    }
+
+    if (best > RX_MAX_LITERAL) best = RX_MAX_LITERAL;
+    for (i = 0; i < best; ++i) {
+        rxAstNode* item = items[best_end - best + i];
+        if (item->type == RX_AST_REPEAT) item = item->left;
+        e->literal[i] = (rxChar)item->lit;
+    }
+    e->literal_len = best;
+    e->memfn(e->memctx, items, 0);
+}
+
+static void rxFreeNFA(srx_MemFunc memfn, void* memctx, rxNFA* nfa) {
+    if (nfa->nodes) memfn(memctx, nfa->nodes, 0);
+    if (nfa->sets) memfn(memctx, nfa->sets, 0);
+    if (nfa->lists[0]) memfn(memctx, nfa->lists[0], 0);
+    if (nfa->lists[1]) memfn(memctx, nfa->lists[1], 0);
+    if (nfa->mark) memfn(memctx, nfa->mark, 0);
+    memfn(memctx, nfa, 0);
+}
+
+/* build the literal prefilter and the NFA of an already compiled pattern */
+static void rxCompileLinear(rxExecute* e, const rxChar* str, size_t strsize) {
+    rxNFACompiler c;
+    rxAstNode* root;
+    rxNFA* nfa;
+    uint32_t match;
+
+    memset(&c, 0, sizeof(c));
+    c.s = str;
+    c.end = str + strsize;
+    c.flags = e->flags;
+
+    c.ast = (rxAstNode*)e->memfn(e->memctx, NULL, sizeof(rxAstNode) * RX_AST_MAXNODES);
+    nfa = (rxNFA*)e->memfn(e->memctx, NULL, sizeof(rxNFA));
+    if (!c.ast || !nfa) goto fail;
+    memset(nfa, 0, sizeof(*nfa));
+    c.nfa = nfa;
+    nfa->nodes = (rxNFANode*)e->memfn(e->memctx, NULL, sizeof(rxNFANode) * RX_NFA_MAXNODES);
+    nfa->sets = (uint32_t(*)[8])e->memfn(e->memctx, NULL, sizeof(nfa->sets[0]) * RX_NFA_MAXSETS);
+    if (!nfa->nodes || !nfa->sets) goto fail;
+
+    root = rxParseAlt(&c);
+    /* with more groups than capture slots, rxCompile() may assign repeats differently */
+    if (!root || c.error || c.s != c.end || c.groups >= RX_MAX_CAPTURES) goto fail;
+
+    rxFindLiteral(e, root, c.num_ast);
+    if (c.has_backref) goto fail;
+
+    match = rxNFANew(&c, RX_NFA_MATCH, 0);
+    nfa->start = rxNFAEmit(&c, root, match);
+    if (c.error) goto fail;
+
+    nfa->lists[0] = (uint32_t*)e->memfn(e->memctx, NULL, sizeof(uint32_t) * nfa->num_nodes);
+    nfa->lists[1] = (uint32_t*)e->memfn(e->memctx, NULL, sizeof(uint32_t) * nfa->num_nodes);
+    nfa->mark = (uint32_t*)e->memfn(e->memctx, NULL, sizeof(uint32_t) * nfa->num_nodes);
+    if (!nfa->lists[0] || !nfa->lists[1] || !nfa->mark) goto fail;
+    memset(nfa->mark, 0, sizeof(uint32_t) * nfa->num_nodes);
+
+    e->nfa = nfa;
+    e->memfn(e->memctx, c.ast, 0);
+    return;
+
+fail:
+    if (nfa) rxFreeNFA(e->memfn, e->memctx, nfa);
+    if (c.ast) e->memfn(e->memctx, c.ast, 0);
+}
+
+static void rxNFAAdd(rxNFA* nfa, uint32_t* list, uint32_t* count, uint32_t n, const rxChar* str, size_t off, size_t size) {
+    for (;;) {
+        rxNFANode* node = &nfa->nodes[n];
+        if (nfa->mark[n] == nfa->listid) return;
+        nfa->mark[n] = nfa->listid;
+
+        switch (node->type) {
+            case RX_NFA_SET:
+                list[(*count)++] = n;
+                return;
+            case RX_NFA_MATCH:
+                nfa->matched = 1;
+                return;
+            case RX_NFA_SPLIT:
+                rxNFAAdd(nfa, list, count, node->out, str, off, size);
+                n = node->out1;
+                break;
+            case RX_NFA_BOL:
+                if (off != 0) return;
+                n = node->out;
+                break;
+            case RX_NFA_BOLML:
+                if (off < size && (str[off] == '\n' || str[off] == '\r')) {
+                    /* line break is consumed by the step */
+                    list[(*count)++] = n;
+                    return;
+                }
+                if (off != 0) return;
+                n = node->out;
+                break;
+            case RX_NFA_EOL:
+                if (off != size) return;
+                n = node->out;
+                break;
+            case RX_NFA_EOLML:
+                if (off != size && str[off] != '\n' && str[off] != '\r') return;
+                n = node->out;
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+static void rxNFANextList(rxNFA* nfa) {
+    if (++nfa->listid == 0) {
+        memset(nfa->mark, 0, sizeof(uint32_t) * nfa->num_nodes);
+        nfa->listid = 1;
+    }
+}
+
+static int rxNFAMatch(rxNFA* nfa, const rxChar* str, size_t size) {
+    uint32_t *clist = nfa->lists[0], *nlist = nfa->lists[1], *tmp;
+    uint32_t ccount = 0, ncount, i;
+    size_t off;
+
+    nfa->matched = 0;
+    rxNFANextList(nfa);
+    for (off = 0; off < size; ++off) {
+        /* a match may start at any position */
+        rxNFAAdd(nfa, clist, &ccount, nfa->start, str, off, size);
+        if (nfa->matched) return 1;
+
+        rxNFANextList(nfa);
+        ncount = 0;
+        for (i = 0; i < ccount; ++i) {
+            rxNFANode* node = &nfa->nodes[clist[i]];
+            if (node->type == RX_NFA_BOLML) {
+                if (str[off] == '\r' && off + 1 < size && str[off + 1] == '\n')
+                    rxNFAAdd(nfa, nlist, &ncount, node->out1, str, off + 1, size);
+                else
+                    rxNFAAdd(nfa, nlist, &ncount, node->out, str, off + 1, size);
+            } else if (RX_SET_HAS(nfa->sets[node->set], str[off])) {
+                rxNFAAdd(nfa, nlist, &ncount, node->out, str, off + 1, size);
+            }
+        }
+        if (nfa->matched) return 1;
+
+        tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+        ccount = ncount;
+    }
+
+    return 0;
+}
+
+/* check for the required literal */
+static int rxHasLiteral(rxExecute* e, const rxChar* str, size_t size) {
+    const rxChar* lit = e->literal;
+    size_t len = e->literal_len;
+    const rxChar *p, *end;
+
+    if (size < len) return 0;
+    end = str + size - len + 1;
+    if (e->flags & RCF_CASELESS) {
+        for (p = str; p < end; ++p) {
+            if (rxMemCaseEq(p, lit, len)) return 1;
+        }
+        return 0;
+    }
+    for (p = str; p < end; ++p) {
+        p = (const rxChar*)memchr(p, lit[0], (size_t)(end - p));
+        if (!p) return 0;
+        if (memcmp(p, lit, len) == 0) return 1;
+    }
+    return 0;
+}
+
 srx_Context* srx_CreateExt(const rxChar* str, size_t strsize, const rxChar* mods, int* errnpos, srx_MemFunc memfn, void* memctx) {
     rxCompiler c;
     srx_Context* R = NULL;
@@ -1035,6 +1704,8 @@ srx_Context* srx_CreateExt(const rxChar* str, size_t strsize, const rxChar* mods
     c.instrs = NULL;
     c.chars = NULL;
 
+    rxCompileLinear(R, str, strsize);
+
     RX_LOG(srx_DumpToStdout(R));
 
 fail:
@@ -1063,7 +1734,7 @@ int srx_MatchExt(srx_Context* R, const rxChar* str, size_t size, size_t offset)
     str += offset;
     rxResetCaptures(R);
     while (str < strend) {
-        if (rxExecDo(R, strstart, str, size)) {
+        if (rxExecDo(R, strstart, str, size, 0)) {
             assert(R->captures[0][0] != RX_NULL_OFFSET);
             assert(R->captures[0][1] != RX_NULL_OFFSET);
             return 1;
@@ -1073,6 +1744,28 @@ int srx_MatchExt(srx_Context* R, const rxChar* str, size_t size, size_t offset)
     return 0;
 }
 
+int srx_Find(srx_Context* R, const rxChar* str, size_t size) {
+    const rxChar* soff;
+    int ret;
+
+    if (size == 0) return 0;
+    if (R->literal_len && !rxHasLiteral(R, str, size)) return 0;
+    if (R->nfa) return rxNFAMatch(R->nfa, str, size);
+
+    R->str = str;
+    R->steps = 0;
+    rxResetCaptures(R);
+    for (soff = str; soff < str + size; soff++) {
+        ret = rxExecDo(R, str, soff, size, R->maxsteps);
+        if (ret) return ret;
+    }
+    return 0;
+}
+
+void srx_SetStepLimit(srx_Context* R, size_t maxsteps) { R->maxsteps = maxsteps; }
+
+int srx_IsLinear(srx_Context* R) { return R->nfa != NULL; }
+
 int srx_GetCaptureCount(srx_Context* R) { return R->capture_count; }
 
 int srx_GetCaptured(srx_Context* R, int which, size_t* pbeg, size_t* pend) {
@@ -40,6 +40,9 @@ extern "C" {
 
 #define RX_ALLMODS "mis"
 
+/* default step limit of srx_Find() for patterns, which need backtracking */
+#define RX_DEFAULT_MAXSTEPS 1000000
+
 #ifndef RX_STRLENGTHFUNC
 #define RX_STRLENGTHFUNC(str) strlen(str)
 #endif
@@ -68,6 +71,11 @@ void srx_DumpToFile(srx_Context* R, FILE* fp);
 
 int srx_MatchExt(srx_Context* R, const rxChar* str, size_t size, size_t offset);
 #define srx_Match(R, str, off) srx_MatchExt(R, str, RX_STRLENGTHFUNC(str), off)
+/* boolean match without captures, linear time for patterns without back references
+ * returns 1 on match, 0 on no match, -1 if the step limit was exceeded */
+int srx_Find(srx_Context* R, const rxChar* str, size_t size);
+void srx_SetStepLimit(srx_Context* R, size_t maxsteps);
+int srx_IsLinear(srx_Context* R);
 int srx_GetCaptureCount(srx_Context* R);
 int srx_GetCaptured(srx_Context* R, int which, size_t* pbeg, size_t* pend);
 int srx_GetCapturedPtrs(srx_Context* R, int which, const rxChar** pbeg, const rxChar** pend);
@@ -53,6 +53,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "output_util.h"
+
 /* Global vars */
 
 static int verbose = 4;
@@ -604,6 +606,14 @@ long getTick(void) {
     return theTick;
 }
 
+// time of clock clockId in nsec
+uint64_t nsecTime(clockid_t clockId) {
+    struct timespec ts;
+    clock_gettime(clockId, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+}  // End of nsecTime
+
 char *DurationString(double duration) {
     static char s[128];
     int days = duration / 86400;
@@ -687,7 +697,7 @@ void inet_ntop_mask(uint32_t ipv4, int mask, char *s, socklen_t sSize) {
     if (mask) {
         ipv4 &= 0xffffffffL << (32 - mask);
         ipv4 = htonl(ipv4);
-        inet_ntop(AF_INET, &ipv4, s, sSize);
+        nf_inet_ntop(AF_INET, &ipv4, s, sSize);
     } else {
         s[0] = '\0';
     }
@@ -708,7 +718,7 @@ void inet6_ntop_mask(uint64_t ipv6[2], int mask, char *s, socklen_t sSize) {
         }
         ip[0] = htonll(ip[0]);
         ip[1] = htonll(ip[1]);
-        inet_ntop(AF_INET6, ip, s, sSize);
+        nf_inet_ntop(AF_INET6, ip, s, sSize);
 
     } else {
         s[0] = '\0';
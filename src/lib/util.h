@@ -137,6 +137,8 @@ time_t ISO2UNIX(char *timestring);
 
 long getTick(void);
 
+uint64_t nsecTime(clockid_t clockId);
+
 char *DurationString(double duration);
 
 #define NUMBER_STRING_SIZE 32
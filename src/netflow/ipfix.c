@@ -54,6 +54,7 @@
 #include "nfnet.h"
 #include "nfxV3.h"
 #include "output_short.h"
+#include "streamstat.h"
 #include "util.h"
 
 // define stack slots
@@ -1454,6 +1455,7 @@ static void Process_ipfix_data(exporterDomain_t *exporter, uint32_t ExportTime,
 
             uint32_t exporterIdent = MetricExpporterID(recordHeaderV3);
             UpdateMetric(fs->nffile->ident, exporterIdent, genericFlow);
+            UpdateStreamStat(recordHeaderV3);
         }
 
         EXcntFlow_t *cntFlow = sequencer->offsetCache[EXcntFlowID];
@@ -55,6 +55,7 @@
 #include "nfnet.h"
 #include "nfxV3.h"
 #include "output_short.h"
+#include "streamstat.h"
 #include "util.h"
 
 #define NETFLOW_V1_HEADER_LENGTH 16
@@ -342,6 +343,7 @@ void Process_v1(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs) {
 
             uint32_t exporterIdent = MetricExpporterID(recordHeader);
             UpdateMetric(fs->nffile->ident, exporterIdent, genericFlow);
+            UpdateStreamStat(recordHeader);
 
             if (printRecord) {
                 flow_record_short(stdout, recordHeader);
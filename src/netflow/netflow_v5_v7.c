@@ -52,6 +52,7 @@
 #include "nfnet.h"
 #include "nfxV3.h"
 #include "output_short.h"
+#include "streamstat.h"
 #include "util.h"
 
 #define NETFLOW_V5_HEADER_LENGTH 24
@@ -496,6 +497,7 @@ void Process_v5_v7(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs) {
 
             uint32_t exporterIdent = MetricExpporterID(recordHeader);
             UpdateMetric(fs->nffile->ident, exporterIdent, genericFlow);
+            UpdateStreamStat(recordHeader);
 
             if (printRecord) {
                 flow_record_short(stdout, recordHeader);
@@ -55,6 +55,7 @@
 #include "nfnet.h"
 #include "nfxV3.h"
 #include "output_short.h"
+#include "streamstat.h"
 #include "util.h"
 
 // Get_valxx, a  macros
@@ -1232,6 +1233,7 @@ static inline void Process_v9_data(exporterDomain_t *exporter, void *data_flowse
 
             uint32_t exporterIdent = MetricExpporterID(recordHeaderV3);
             UpdateMetric(fs->nffile->ident, exporterIdent, genericFlow);
+            UpdateStreamStat(recordHeaderV3);
         }
 
         EXcntFlow_t *cntFlow = sequencer->offsetCache[EXcntFlowID];
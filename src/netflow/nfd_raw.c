@@ -52,6 +52,7 @@
 #include "nfnet.h"
 #include "nfxV3.h"
 #include "output_short.h"
+#include "streamstat.h"
 #include "util.h"
 
 typedef struct exporter_nfd_s {
@@ -283,6 +284,7 @@ void Process_nfd(void *in_buff, ssize_t in_buff_cnt, FlowSource_t *fs) {
 
             uint32_t exporterIdent = MetricExpporterID(recordHeaderV3);
             UpdateMetric(fs->nffile->ident, exporterIdent, genericFlow);
+            UpdateStreamStat(recordHeaderV3);
         }
 
         numRecords++;
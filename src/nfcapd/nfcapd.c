@@ -56,6 +56,7 @@
 #include "pcap_reader.h"
 #endif
 
+#include "affinity.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "daemon.h"
@@ -76,6 +77,7 @@
 #include "pidfile.h"
 #include "privsep.h"
 #include "repeater.h"
+#include "streamstat.h"
 #include "util.h"
 #include "version.h"
 
@@ -103,6 +105,8 @@ typedef ssize_t (*packet_function_t)(int, void *, size_t, int, struct sockaddr *
 static FlowSource_t *FlowSource;
 
 static int done = 0;
+// rotate files by the packet time stamps, when reading a pcap file
+static int usePacketTime = 0;
 static int gotSIGCHLD = 0;
 static int periodic_trigger;
 
@@ -130,7 +134,7 @@ static void usage(char *name) {
         "-J mcastgroup\tJoin multicast group <mcastgroup>\n"
         "-p portnum\tlisten on port portnum\n"
 #ifdef PCAP
-        "-f pcapfile\tRead network data from pcap file.\n"
+        "-f pcapfile\tRead network data from pcap file. Files rotate by packet time.\n"
         "-d device\tRead network data from device (interface).\n"
 #endif
         "-w flowdir \tset the output directory to store the flows.\n"
@@ -147,6 +151,7 @@ static void usage(char *name) {
         "-s rate\tset default sampling rate (default 1)\n"
         "-x process\tlaunch process after a new file becomes available\n"
         "-W workers\toptionally set the number of workers to compress flows\n"
+        "-k class:cpus\tPin receiver, reader, writer or worker threads to cpus.\n"
         "-z=lzo\t\tLZO compress flows in output file.\n"
         "-z=bz2\t\tBZIP2 compress flows in output file.\n"
         "-z=lz4[:level]\tLZ4 compress flows in output file.\n"
@@ -234,6 +239,23 @@ static void ChildDied(void) {
 
 }  // End of ChildDied
 
+// nfdump command to create the rollup of a closed file, if enabled in the config
+static char *RollupProcess(char *configFile) {
+    if (!ConfGetValue("rollup")) return NULL;
+
+    char *cmd = malloc(MAXPATHLEN + 64);
+    if (!cmd) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    if (configFile)
+        snprintf(cmd, MAXPATHLEN + 64, "%s -Y -r %%d/%%f -C %s", NFDUMP_BIN, configFile);
+    else
+        snprintf(cmd, MAXPATHLEN + 64, "%s -Y -r %%d/%%f", NFDUMP_BIN);
+    return cmd;
+
+}  // End of RollupProcess
+
 static void format_file_block_header(dataBlock_t *header) {
     printf("File Block Header: type: %u, size: %u, NumRecords: %u\n", header->type, header->size, header->NumRecords);
 }  // End of format_file_block_header
@@ -288,6 +310,8 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
     ssize_t cnt;
     void *in_buff;
 
+    // pin the receive loop before allocating its buffer, so it is placed on the local numa node
+    PinThread(AFFINITY_RECEIVER);
     in_buff = malloc(NETWORK_INPUT_BUFF_SIZE);
     if (!in_buff) {
         LogError("malloc() allocation error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
@@ -320,9 +344,12 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
     cnt = 0;
     periodic_trigger = 0;
     ignored_packets = 0;
+#ifdef PCAP
+    int firstPacket = 1;
+#endif
 
     // wake up at least at next time slot (twin) + 1s
-    alarm(t_start + twin + 1 - time(NULL));
+    if (!usePacketTime) alarm(t_start + twin + 1 - time(NULL));
     /*
      * Main processing loop:
      * this loop, continues until done = 1, set by the signal handler
@@ -352,7 +379,19 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
 
         /* Periodic file renaming, if time limit reached or if we are done.  */
         // t_now = time(NULL);
-        gettimeofday(&tv, NULL);
+#ifdef PCAP
+        if (usePacketTime) {
+            // the clock runs with the packet time stamps
+            if (PcapPacketTime(&tv)) {
+                if (firstPacket) t_start = tv.tv_sec - (tv.tv_sec % twin);
+                firstPacket = 0;
+            } else {
+                tv.tv_sec = t_start;
+                tv.tv_usec = 0;
+            }
+        } else
+#endif
+            gettimeofday(&tv, NULL);
         t_now = tv.tv_sec;
 
         if (((t_now - t_start) >= twin) || done) {
@@ -476,12 +515,14 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
 
             // update alarm for next cycle
             t_start += twin;
+            // skip gaps in the packet capture
+            if (usePacketTime && (t_now - t_start) >= twin) t_start = t_now - (t_now % twin);
             /* t_start = filename time stamp: begin of slot
              * + twin = end of next time interval
              * + 1 = act at least 1s after time window expired
              * - t_now = difference value to now
              */
-            alarm(t_start + twin + 1 - t_now);
+            if (!usePacketTime) alarm(t_start + twin + 1 - t_now);
         }
 
         /* check for error condition or done . errno may only be EINTR */
@@ -634,7 +675,7 @@ int main(int argc, char **argv) {
     workers = 0;
 
     int c;
-    while ((c = getopt(argc, argv, "46AB:b:C:d:DeEf:g:hI:i:jJ:l:m:M:n:p:P:R:s:S:t:T:u:vVW:w:x:X:yz::Z")) != EOF) {
+    while ((c = getopt(argc, argv, "46AB:b:C:d:DeEf:g:hI:i:jJ:k:l:m:M:n:p:P:R:s:S:t:T:u:vVW:w:x:X:yz::Z")) != EOF) {
         switch (c) {
             case 'h':
                 usage(argv[0]);
@@ -830,6 +871,10 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'k':
+                CheckArgLen(optarg, 256);
+                if (!SetAffinity(optarg)) exit(EXIT_FAILURE);
+                break;
             case 'j':
                 if (compress) {
                     LogError("Use one compression: -z for LZO, -j for BZ2 or -y for LZ4 compression");
@@ -898,7 +943,8 @@ int main(int argc, char **argv) {
         if (strcmp(argv[optind], "privsep") == 0) {
             if (strcmp(argv[optind + 1], "launcher") == 0) {
                 dbg_printf("nfcapd privsep launched\n");
-                int ret = StartupLauncher(launch_process, expire);
+                if (ConfOpen(configFile, "nfcapd") < 0) exit(EXIT_FAILURE);
+                int ret = StartupLauncher(launch_process, RollupProcess(configFile), expire);
                 exit(ret);
             } else if (strcmp(argv[optind + 1], "repeater") == 0) {
                 dbg_printf("nfcapd repeater launched\n");
@@ -916,6 +962,8 @@ int main(int argc, char **argv) {
 
     if (ConfOpen(configFile, "nfcapd") < 0) exit(EXIT_FAILURE);
 
+    if (!InitAffinity(verbose)) exit(EXIT_FAILURE);
+
     if (datadir && !AddFlowSource(&FlowSource, Ident, ANYIP, datadir)) {
         LogError("Failed to add default data collector directory");
         exit(EXIT_FAILURE);
@@ -953,6 +1001,7 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
         receive_packet = NextPacket;
+        usePacketTime = 1;
     } else if (pcap_device) {
         printf("Setup pcap device reader\n");
         if (!setup_pcap_live(pcap_device, NULL, bufflen)) {
@@ -1007,9 +1056,14 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (!OpenStreamStat()) {
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+
     int launcher_pid = 0;
     int pfd = 0;
-    if (launch_process || expire) {
+    if (launch_process || expire || ConfGetValue("rollup")) {
         pfd = PrivsepFork(argc, argv, &launcher_pid, "launcher");
     }
 
@@ -1055,6 +1109,7 @@ int main(int argc, char **argv) {
     signalPrivsepChild(launcher_pid, pfd);
     signalPrivsepChild(repeater_pid, rfd);
     CloseMetric();
+    CloseStreamStat();
 
     fs = FlowSource;
     while (fs && fs->bookkeeper) {
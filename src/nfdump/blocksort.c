@@ -1,17 +1,15 @@
+#include "blocksort.h"
+
 #include <fcntl.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
 
-typedef struct SortRecord {
-    void *record;
-    uint64_t count;
-} SortRecord_t;
-
-void blocksort(SortRecord_t *data, int len);
+#include "affinity.h"
 
 #define swap(a, b)             \
     {                          \
@@ -64,6 +62,8 @@ static void partition(SortRecord_t *left0, SortRecord_t *right0, SortRecord_t **
 
 static void *sort_thr(void *arg);
 
+static void *radix_thr(void *arg);
+
 void insert_sort(SortRecord_t *left, SortRecord_t *right) {
     // put minimum to left position, so we can save
     // one inner loop comparison for insert sort
@@ -196,6 +196,7 @@ static void partition(SortRecord_t *left0, SortRecord_t *right0,
 
 static void *sort_thr(void *arg) {
     SortRecord_t **par = (SortRecord_t **)arg;
+    PinThread(AFFINITY_WORKER);
     qusort(par[0], par[1]);
     free(arg);
     pthread_mutex_lock(&mutex);
@@ -240,7 +241,7 @@ static void qusort(SortRecord_t *left, SortRecord_t *right) {
     insert_sort(left, right);
 }
 
-void blocksort(SortRecord_t *data, int len) {
+void quicksort(SortRecord_t *data, size_t len) {
     // shortcut for few entries
     if (len < 50) {
         SortRecord_t *left = data;
@@ -268,48 +269,412 @@ void blocksort(SortRecord_t *data, int len) {
 }
 
 /*
-static double t(void) {
-
-    static double t0;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    double h = t0;
-    t0 = tv.tv_sec + tv.tv_usec / 1000000.0;
-    return t0 - h;
+ * parallel LSD radix sort on the 64bit count
+ * Each worker owns a fixed chunk of the array and counts the digits of its chunk.
+ * The prefix sum over all digits and workers gives each worker its own
+ * output positions, which keeps the sort stable. Digits, which are equal
+ * for all records are skipped.
+ */
+#define RADIXBITS 8
+#define RADIXSIZE (1 << RADIXBITS)
+#define RADIXPASSES (64 / RADIXBITS)
+// min number of records per worker
+#define RADIXCHUNK (1 << 16)
+#define MAXRADIXWORKERS 64
+
+typedef struct radixSort_s radixSort_t;
+
+typedef struct radixWorker_s {
+    radixSort_t *sort;
+    int id;
+    size_t start;
+    size_t end;
+    uint64_t orKey;
+    uint64_t andKey;
+    // double buffered - the next pass counts, while others may still read
+    size_t hist[2][RADIXSIZE];
+} radixWorker_t;
+
+struct radixSort_s {
+    SortRecord_t *data;
+    SortRecord_t *buff;
+    int numWorkers;
+    radixWorker_t *workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int waiting;
+    unsigned generation;
+};
+
+// persistent pool of radix sort threads - the calling thread is worker 0
+// the pool is started with the first parallel sort and grows on demand
+static int radixPoolSize = 0;
+static pid_t radixPoolPid = 0;
+static pthread_t radixPool[MAXRADIXWORKERS];
+static pthread_mutex_t radixPoolBusy = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t radixMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t radixStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t radixDone = PTHREAD_COND_INITIALIZER;
+static unsigned radixGeneration = 0;
+static int radixPending = 0;
+static radixSort_t *radixCurrent = NULL;
+
+static void radix_barrier(radixSort_t *sort) {
+    pthread_mutex_lock(&sort->mutex);
+    unsigned generation = sort->generation;
+    if (++sort->waiting == sort->numWorkers) {
+        sort->waiting = 0;
+        sort->generation++;
+        pthread_cond_broadcast(&sort->cond);
+    } else {
+        while (generation == sort->generation) pthread_cond_wait(&sort->cond, &sort->mutex);
+    }
+    pthread_mutex_unlock(&sort->mutex);
 }
 
-static void init(SortRecord_t *data, int len) {
-    for (int i = 0; i < len; i++) {
-        data[i].count = rand();
+static void radix_worker(radixWorker_t *worker) {
+    radixSort_t *sort = worker->sort;
+    SortRecord_t *src = sort->data;
+    SortRecord_t *dst = sort->buff;
+
+    // find the bits, which differ in any of the records
+    uint64_t orKey = 0;
+    uint64_t andKey = ~0ULL;
+    for (size_t i = worker->start; i < worker->end; i++) {
+        orKey |= src[i].count;
+        andKey &= src[i].count;
     }
-}
+    worker->orKey = orKey;
+    worker->andKey = andKey;
+    radix_barrier(sort);
+
+    for (int i = 0; i < sort->numWorkers; i++) {
+        orKey |= sort->workers[i].orKey;
+        andKey &= sort->workers[i].andKey;
+    }
+    uint64_t diffBits = orKey ^ andKey;
+
+    int pass = 0;
+    for (int shift = 0; shift < 64; shift += RADIXBITS) {
+        if (((diffBits >> shift) & (RADIXSIZE - 1)) == 0) continue;
+
+        size_t *hist = worker->hist[pass & 1];
+        memset(hist, 0, RADIXSIZE * sizeof(size_t));
+        for (size_t i = worker->start; i < worker->end; i++) hist[(src[i].count >> shift) & (RADIXSIZE - 1)]++;
+        radix_barrier(sort);
+
+        // output position of each digit: all records with smaller digits
+        // plus the records with the same digit of the preceding workers
+        size_t offset[RADIXSIZE];
+        size_t sum = 0;
+        for (int digit = 0; digit < RADIXSIZE; digit++) {
+            for (int i = 0; i < sort->numWorkers; i++) {
+                if (i == worker->id) offset[digit] = sum;
+                sum += sort->workers[i].hist[pass & 1][digit];
+            }
+        }
 
-static void test(SortRecord_t *data, int len) {
-    for (int i = 1; i < len; i++) {
-        if (data[i].count < data[i - 1].count) {
-            printf("ERROR\n");
-            break;
+        for (size_t i = worker->start; i < worker->end; i++) {
+            dst[offset[(src[i].count >> shift) & (RADIXSIZE - 1)]++] = src[i];
         }
+        radix_barrier(sort);
+
+        SortRecord_t *tmp = src;
+        src = dst;
+        dst = tmp;
+        pass++;
+    }
+
+    // odd number of passes - sorted records are in the buffer
+    if (src != sort->data) {
+        memcpy(sort->data + worker->start, src + worker->start, (worker->end - worker->start) * sizeof(SortRecord_t));
+    }
+}
+
+static void *radix_thr(void *arg) {
+    int id = (int)(long)arg;
+    unsigned generation = 0;
+
+    PinThread(AFFINITY_WORKER);
+
+    pthread_mutex_lock(&radixMutex);
+    while (1) {
+        while (generation == radixGeneration) pthread_cond_wait(&radixStart, &radixMutex);
+        generation = radixGeneration;
+        radixSort_t *sort = radixCurrent;
+        // smaller sorts need not all pool threads
+        if (id >= sort->numWorkers) continue;
+        pthread_mutex_unlock(&radixMutex);
+
+        radix_worker(&sort->workers[id]);
+
+        pthread_mutex_lock(&radixMutex);
+        if (--radixPending == 0) pthread_cond_signal(&radixDone);
     }
+
+    // not reached - the pool lives as long as the process
+    return NULL;
 }
 
+// make sure the pool has numThreads threads - returns the number of threads available
+static int radix_pool(int numThreads) {
+    // threads do not survive a fork() - a forked child starts its own pool
+    if (radixPoolPid != getpid()) {
+        pthread_mutex_init(&radixMutex, NULL);
+        pthread_cond_init(&radixStart, NULL);
+        pthread_cond_init(&radixDone, NULL);
+        radixGeneration = 0;
+        radixPending = 0;
+        radixPoolSize = 0;
+        radixPoolPid = getpid();
+    }
 
-int main(void) {
+    while (radixPoolSize < numThreads) {
+        // worker ids start at 1
+        if (pthread_create(&radixPool[radixPoolSize], NULL, radix_thr, (void *)(long)(radixPoolSize + 1)) != 0) break;
+        radixPoolSize++;
+    }
 
-        size_t size = 50 * 1000000;
+    return radixPoolSize < numThreads ? radixPoolSize : numThreads;
+}
+
+int radixsort(SortRecord_t *data, size_t len) {
+    radixSort_t sort = {0};
+
+    sort.buff = malloc(len * sizeof(SortRecord_t));
+    if (!sort.buff) return 0;
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus <= 0) n_cpus = 1;
+    size_t numWorkers = len / RADIXCHUNK;
+    if (numWorkers > (size_t)n_cpus) numWorkers = n_cpus;
+    if (numWorkers > MAXRADIXWORKERS) numWorkers = MAXRADIXWORKERS;
+    if (numWorkers == 0) numWorkers = 1;
+
+    radixWorker_t *workers = calloc(numWorkers, sizeof(radixWorker_t));
+    if (!workers) {
+        free(sort.buff);
+        return 0;
+    }
+
+    // the pool serves one sort at a time - a concurrent sort runs single threaded
+    int usePool = numWorkers > 1 && pthread_mutex_trylock(&radixPoolBusy) == 0;
+    if (usePool) {
+        numWorkers = 1 + radix_pool(numWorkers - 1);
+    } else {
+        numWorkers = 1;
+    }
+
+    sort.data = data;
+    sort.workers = workers;
+    sort.numWorkers = numWorkers;
+    pthread_mutex_init(&sort.mutex, NULL);
+    pthread_cond_init(&sort.cond, NULL);
+
+    size_t chunk = len / numWorkers;
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].sort = &sort;
+        workers[i].id = i;
+        workers[i].start = i * chunk;
+        workers[i].end = i == (numWorkers - 1) ? len : (i + 1) * chunk;
+    }
+
+    if (numWorkers > 1) {
+        pthread_mutex_lock(&radixMutex);
+        radixCurrent = &sort;
+        radixPending = numWorkers - 1;
+        radixGeneration++;
+        pthread_cond_broadcast(&radixStart);
+        pthread_mutex_unlock(&radixMutex);
+
+        radix_worker(&workers[0]);
+
+        pthread_mutex_lock(&radixMutex);
+        while (radixPending) pthread_cond_wait(&radixDone, &radixMutex);
+        pthread_mutex_unlock(&radixMutex);
+    } else {
+        radix_worker(&workers[0]);
+    }
+    if (usePool) pthread_mutex_unlock(&radixPoolBusy);
 
-        SortRecord_t *data = malloc(size * sizeof(SortRecord_t));
-        if ( !data ) {
-                perror("malloc() failed: ");
-                exit(255);
+    pthread_mutex_destroy(&sort.mutex);
+    pthread_cond_destroy(&sort.cond);
+    free(workers);
+    free(sort.buff);
+
+    return 1;
+}
+
+void blocksort(SortRecord_t *data, int len) {
+    if (len < RADIXTHRESHOLD || !radixsort(data, len)) quicksort(data, len);
+}
+
+/*
+ * natural merge sort for nearly sorted records, such as flows in time order
+ * Ascending runs are detected and merged pairwise. Already ordered runs
+ * are merged without moving any record, so sorted input takes linear time.
+ */
+#define MINRUN 32
+// min number of records to merge a level in parallel
+#define PARALLELMERGE (1 << 16)
+
+typedef struct sortRun_s {
+    size_t start;
+    size_t len;
+} sortRun_t;
+
+typedef struct mergeLevel_s {
+    SortRecord_t *data;
+    SortRecord_t *buff;
+    sortRun_t *runs;
+    size_t pairs;
+    size_t next;
+    pthread_mutex_t mutex;
+} mergeLevel_t;
+
+static void reverse_run(SortRecord_t *left, SortRecord_t *right) {
+    while (left < right) {
+        swap(*left, *right);
+        left++;
+        right--;
+    }
+}
+
+// stable merge of the adjacent runs a and b
+static void merge_runs(SortRecord_t *data, SortRecord_t *buff, size_t start, size_t la, size_t lb) {
+    SortRecord_t *a = data + start;
+    SortRecord_t *b = a + la;
+
+    // runs already in order
+    if (a[la - 1].count <= b[0].count) return;
+
+    // records of a smaller or equal than the first of b stay in place
+    size_t lo = 0, hi = la;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid].count <= b[0].count)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    a += lo;
+    la -= lo;
+
+    // records of b greater or equal than the last of a stay in place
+    uint64_t last = a[la - 1].count;
+    lo = 0;
+    hi = lb;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (b[mid].count < last)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    lb = lo;
+
+    SortRecord_t *tmp = buff + (a - data);
+    memcpy(tmp, a, la * sizeof(SortRecord_t));
+    SortRecord_t *out = a;
+    size_t i = 0, j = 0;
+    while (i < la && j < lb) {
+        if (b[j].count < tmp[i].count)
+            *out++ = b[j++];
+        else
+            *out++ = tmp[i++];
+    }
+    // remaining records of b are already in place
+    memcpy(out, tmp + i, (la - i) * sizeof(SortRecord_t));
+}
+
+// merge pairs of runs, until all pairs of the level are taken
+static void merge_pairs(mergeLevel_t *level) {
+    while (1) {
+        pthread_mutex_lock(&level->mutex);
+        size_t pair = level->next++;
+        pthread_mutex_unlock(&level->mutex);
+        if (pair >= level->pairs) break;
+
+        sortRun_t *run = &level->runs[2 * pair];
+        merge_runs(level->data, level->buff, run[0].start, run[0].len, run[1].len);
+    }
+}
+
+// entry of the merge threads - the calling thread merges unpinned
+static void *merge_thr(void *arg) {
+    PinThread(AFFINITY_WORKER);
+    merge_pairs((mergeLevel_t *)arg);
+    return NULL;
+}
+
+void runsort(SortRecord_t *data, size_t len) {
+    // count the descents - mostly unsorted records are better sorted by blocksort
+    size_t descents = 0;
+    for (size_t i = 1; i < len; i++) descents += data[i].count < data[i - 1].count;
+    if (descents > len / MINRUN || len > INT32_MAX) {
+        blocksort(data, len);
+        return;
+    }
+
+    sortRun_t *runs = malloc((len / MINRUN + 2) * sizeof(sortRun_t));
+    SortRecord_t *buff = malloc(len * sizeof(SortRecord_t));
+    if (!runs || !buff) {
+        free(runs);
+        free(buff);
+        blocksort(data, len);
+        return;
+    }
+
+    // find the natural runs - strictly descending runs are reversed
+    size_t numRuns = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t start = i++;
+        if (i < len && data[i].count < data[start].count) {
+            while (i < len && data[i].count < data[i - 1].count) i++;
+            reverse_run(data + start, data + i - 1);
+        } else {
+            while (i < len && data[i].count >= data[i - 1].count) i++;
         }
-    init(data, size);
-    printf("Sorting %lu million numbers with Quicksort ...\n", size / 1000000);
-    t();
-
-    blocksort(data, size);
-    printf("%.2fs\n", t());
-    test(data, size);
-    return 0;
+        // extend short runs
+        if ((i - start) < MINRUN && i < len) {
+            i = (start + MINRUN) < len ? start + MINRUN : len;
+            insert_sort(data + start, data + i - 1);
+        }
+        runs[numRuns++] = (sortRun_t){.start = start, .len = i - start};
+    }
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus <= 0) n_cpus = 1;
+    pthread_t *tid = calloc(n_cpus, sizeof(pthread_t));
+
+    mergeLevel_t level = {.data = data, .buff = buff, .runs = runs};
+    pthread_mutex_init(&level.mutex, NULL);
+    while (numRuns > 1) {
+        level.pairs = numRuns / 2;
+        level.next = 0;
+
+        // merge the pairs of runs in parallel
+        int started = 0;
+        if (tid && len >= PARALLELMERGE) {
+            size_t numThreads = level.pairs < (size_t)n_cpus ? level.pairs : (size_t)n_cpus;
+            for (int t = 1; t < numThreads; t++) {
+                if (pthread_create(&tid[started], NULL, merge_thr, &level) != 0) break;
+                started++;
+            }
+        }
+        merge_pairs(&level);
+        for (int t = 0; t < started; t++) pthread_join(tid[t], NULL);
+
+        for (size_t p = 0; p < level.pairs; p++) {
+            runs[p] = (sortRun_t){.start = runs[2 * p].start, .len = runs[2 * p].len + runs[2 * p + 1].len};
+        }
+        if (numRuns & 1) runs[level.pairs] = runs[numRuns - 1];
+        numRuns = level.pairs + (numRuns & 1);
+    }
+    pthread_mutex_destroy(&level.mutex);
+
+    free(tid);
+    free(runs);
+    free(buff);
 }
-*/
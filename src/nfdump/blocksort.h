@@ -43,6 +43,15 @@ typedef struct SortRecord {
     uint64_t count;
 } SortRecord_t;
 
+// use radix sort for at least this number of records
+#define RADIXTHRESHOLD 4096
+
 void blocksort(SortRecord_t *data, int len);
 
+void quicksort(SortRecord_t *data, size_t len);
+
+int radixsort(SortRecord_t *data, size_t len);
+
+void runsort(SortRecord_t *data, size_t len);
+
 #endif  //_BLOCKSORT_H
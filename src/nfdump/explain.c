@@ -0,0 +1,309 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * nfdump -e: explain a query
+ * Reports the wall and cpu time, records and bytes of each stage of the query:
+ * the reader threads, the record stages of the scan loop in process_data() and
+ * the final print stage. Further the evaluations and matches of each block of
+ * the filter engine, the load and probe lengths of the hash tables and the peak memory.
+ */
+
+#include "explain.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "config.h"
+#include "filter.h"
+#include "nffile.h"
+#include "nflowcache.h"
+#include "nfstat.h"
+#include "nftree.h"
+#include "swisstable.h"
+#include "util.h"
+
+static const char *stageName[MAXSTAGES] = {"scan", "queue wait", "expand", "filter", "aggregate", "element stat", "sort", "output", "print"};
+
+static const char *compName[] = {"==", ">", "<", ">=", "<=", "ident", "flowlabel", "flags", "iplist", "list", "payload", "regex"};
+
+#define NSEC2MSEC(t) ((double)(t) / 1000000.0)
+
+// -e or -e=json
+explain_t *ExplainInit(char *format) {
+    int mode = EXPLAIN_TEXT;
+    if (format) {
+        if (*format == '=') format++;
+        if (strcasecmp(format, "text") == 0) {
+            mode = EXPLAIN_TEXT;
+        } else if (strcasecmp(format, "json") == 0) {
+            mode = EXPLAIN_JSON;
+        } else {
+            LogError("Unknown explain format '%s'. Use -e or -e=json", format);
+            return NULL;
+        }
+    }
+
+    explain_t *explain = calloc(1, sizeof(explain_t));
+    if (!explain) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    explain->format = mode;
+
+    return explain;
+
+}  // End of ExplainInit
+
+// enable the read statistics and count the evaluations and matches of each filter block
+void ExplainEnable(explain_t *explain, FilterEngine_t *engine) {
+    EnableReadStat();
+    if (EnableFilterStat(engine)) explain->engine = engine;
+
+}  // End of ExplainEnable
+
+void ExplainBegin(explain_t *explain, int stage) {
+    explainStage_t *s = &explain->stage[stage];
+    s->wallStart = nsecTime(CLOCK_MONOTONIC);
+    s->cpuStart = nsecTime(CLOCK_PROCESS_CPUTIME_ID);
+    s->threadStart = nsecTime(CLOCK_THREAD_CPUTIME_ID);
+
+}  // End of ExplainBegin
+
+void ExplainEnd(explain_t *explain, int stage) {
+    explainStage_t *s = &explain->stage[stage];
+    s->wall += nsecTime(CLOCK_MONOTONIC) - s->wallStart;
+    s->cpu += nsecTime(CLOCK_PROCESS_CPUTIME_ID) - s->cpuStart;
+    s->threadCPU += nsecTime(CLOCK_THREAD_CPUTIME_ID) - s->threadStart;
+
+}  // End of ExplainEnd
+
+// readable expression of a filter block
+static char *BlockString(FilterBlock_t *block, char *s, size_t len) {
+    const char *comp = block->comp < sizeof(compName) / sizeof(char *) ? compName[block->comp] : "?";
+    if (block->function)
+        snprintf(s, len, "%s%s(offset %u) %s 0x%llx", block->invert ? "!" : "", block->fname, block->offset, comp,
+                 (unsigned long long)block->value);
+    else
+        snprintf(s, len, "%s(offset %u & 0x%llx) %s 0x%llx", block->invert ? "!" : "", block->offset, (unsigned long long)block->mask, comp,
+                 (unsigned long long)block->value);
+    return s;
+
+}  // End of BlockString
+
+static double Percent(uint64_t part, uint64_t total) { return total ? 100.0 * (double)part / (double)total : 0; }
+
+static double AvgProbe(swiss_stat_t *stat) { return stat->size ? (double)stat->probes / (double)stat->size : 0; }
+
+static void PrintStageText(FILE *stream, const char *name, uint64_t wall, uint64_t cpu, uint64_t count, uint64_t bytes, uint64_t total) {
+    char cpuString[32];
+    if (cpu)
+        snprintf(cpuString, sizeof(cpuString), "%.1f", NSEC2MSEC(cpu));
+    else
+        snprintf(cpuString, sizeof(cpuString), "-");
+    fprintf(stream, "%-22s %10.1f %6.1f%% %10s %12llu %14llu %10.1f\n", name, NSEC2MSEC(wall), Percent(wall, total), cpuString,
+            (unsigned long long)count, (unsigned long long)bytes, count ? (double)wall / (double)count : 0);
+
+}  // End of PrintStageText
+
+static void PrintStageJSON(FILE *stream, const char *name, const char *thread, uint64_t wall, uint64_t cpu, uint64_t count, uint64_t bytes,
+                           int last) {
+    fprintf(stream,
+            "\t\t{\n"
+            "\t\t\t\"stage\" : \"%s\",\n"
+            "\t\t\t\"thread\" : \"%s\",\n"
+            "\t\t\t\"wall_ms\" : %.3f,\n"
+            "\t\t\t\"cpu_ms\" : %.3f,\n"
+            "\t\t\t\"count\" : %llu,\n"
+            "\t\t\t\"bytes\" : %llu\n"
+            "\t\t}%s\n",
+            name, thread, NSEC2MSEC(wall), NSEC2MSEC(cpu), (unsigned long long)count, (unsigned long long)bytes, last ? "" : ",");
+
+}  // End of PrintStageJSON
+
+static void PrintHashJSON(FILE *stream, const char *name, swiss_stat_t *stat, int last) {
+    fprintf(stream,
+            "\t\t\"%s\" : {\n"
+            "\t\t\t\"entries\" : %zu,\n"
+            "\t\t\t\"slots\" : %zu,\n"
+            "\t\t\t\"load\" : %.3f,\n"
+            "\t\t\t\"avg_probe\" : %.3f,\n"
+            "\t\t\t\"max_probe\" : %zu\n"
+            "\t\t}%s\n",
+            name, stat->size, stat->slots, stat->slots ? (double)stat->size / (double)stat->slots : 0, AvgProbe(stat), stat->maxProbe,
+            last ? "" : ",");
+
+}  // End of PrintHashJSON
+
+static void ExplainText(FILE *stream, explain_t *explain, readStat_t *readStat, swiss_stat_t *flowHash, swiss_stat_t *elementHash,
+                        size_t arenaPeak, long maxRSS) {
+    explainStage_t *stage = explain->stage;
+    uint64_t total = stage[STAGE_SCAN].wall + stage[STAGE_PRINT].wall;
+
+    fprintf(stream, "\nExplain query: %llu records processed, %llu passed (%.2f%%)\n", (unsigned long long)explain->processed,
+            (unsigned long long)explain->passed, Percent(explain->passed, explain->processed));
+    fprintf(stream, "%-22s %10s %7s %10s %12s %14s %10s\n", "Stage", "wall ms", "wall", "cpu ms", "count", "bytes", "ns/count");
+
+    fprintf(stream, "reader threads:\n");
+    PrintStageText(stream, "  read", readStat->ioWall, readStat->ioCPU, readStat->blocks, readStat->diskBytes, total);
+    PrintStageText(stream, "  decompress", readStat->decompressWall, readStat->decompressCPU, readStat->blocks, readStat->bytes, total);
+    PrintStageText(stream, "  queue wait", readStat->pushWait, 0, readStat->blocks, 0, total);
+
+    fprintf(stream, "main thread:\n");
+    PrintStageText(stream, stageName[STAGE_SCAN], stage[STAGE_SCAN].wall, stage[STAGE_SCAN].threadCPU, explain->processed,
+                   stage[STAGE_WAIT].bytes, total);
+    uint64_t stages = 0;
+    for (int i = STAGE_WAIT; i < STAGE_PRINT; i++) {
+        if (stage[i].count == 0) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "  %s", stageName[i]);
+        PrintStageText(stream, name, stage[i].wall, 0, stage[i].count, stage[i].bytes, total);
+        stages += stage[i].wall;
+    }
+    if (stage[STAGE_SCAN].wall > stages) PrintStageText(stream, "  other", stage[STAGE_SCAN].wall - stages, 0, 0, 0, total);
+    PrintStageText(stream, stageName[STAGE_PRINT], stage[STAGE_PRINT].wall, stage[STAGE_PRINT].threadCPU, stage[STAGE_PRINT].count, 0, total);
+
+    fprintf(stream, "process cpu: scan %.1f ms, print %.1f ms, reader threads %.1f ms\n", NSEC2MSEC(stage[STAGE_SCAN].cpu),
+            NSEC2MSEC(stage[STAGE_PRINT].cpu), NSEC2MSEC(readStat->readerCPU));
+
+    FilterEngine_t *engine = explain->engine;
+    if (engine) {
+        fprintf(stream, "\nFilter engine: %u blocks, start block %u\n", engine->numBlocks, engine->StartNode);
+        fprintf(stream, "%6s %12s %12s %7s  %s\n", "block", "evaluations", "matches", "match", "expression");
+        for (uint32_t i = 1; i <= engine->numBlocks; i++) {
+            char s[256];
+            fprintf(stream, "%6u %12llu %12llu %6.1f%%  %s%s%s\n", i, (unsigned long long)engine->evalCount[i], (unsigned long long)engine->hitCount[i],
+                    Percent(engine->hitCount[i], engine->evalCount[i]), BlockString(&engine->filter[i], s, sizeof(s)),
+                    engine->filter[i].label ? " label " : "", engine->filter[i].label ? engine->filter[i].label : "");
+        }
+    }
+
+    fprintf(stream, "\n");
+    if (flowHash->slots)
+        fprintf(stream, "Flow cache hash: %zu entries, %zu slots, load %.1f%%, avg probe %.2f groups, max probe %zu groups\n", flowHash->size,
+                flowHash->slots, Percent(flowHash->size, flowHash->slots), AvgProbe(flowHash), flowHash->maxProbe);
+    if (elementHash->slots)
+        fprintf(stream, "Element stat hash: %zu entries, %zu slots, load %.1f%%, avg probe %.2f groups, max probe %zu groups\n",
+                elementHash->size, elementHash->slots, Percent(elementHash->size, elementHash->slots), AvgProbe(elementHash),
+                elementHash->maxProbe);
+    fprintf(stream, "Peak memory: max RSS %.1f MB, flow cache arena %.1f MB\n", (double)maxRSS / 1024.0, (double)arenaPeak / (1024.0 * 1024.0));
+    PrintFlowCacheStat(stream);
+
+}  // End of ExplainText
+
+static void ExplainJSON(FILE *stream, explain_t *explain, readStat_t *readStat, swiss_stat_t *flowHash, swiss_stat_t *elementHash,
+                        size_t arenaPeak, long maxRSS) {
+    explainStage_t *stage = explain->stage;
+
+    fprintf(stream,
+            "{\n"
+            "\t\"processed\" : %llu,\n"
+            "\t\"passed\" : %llu,\n"
+            "\t\"stages\" : [\n",
+            (unsigned long long)explain->processed, (unsigned long long)explain->passed);
+    PrintStageJSON(stream, "read", "reader", readStat->ioWall, readStat->ioCPU, readStat->blocks, readStat->diskBytes, 0);
+    PrintStageJSON(stream, "decompress", "reader", readStat->decompressWall, readStat->decompressCPU, readStat->blocks, readStat->bytes, 0);
+    PrintStageJSON(stream, "queue wait", "reader", readStat->pushWait, 0, readStat->blocks, 0, 0);
+    for (int i = STAGE_SCAN; i < MAXSTAGES; i++) {
+        uint64_t count = i == STAGE_SCAN ? explain->processed : stage[i].count;
+        uint64_t bytes = i == STAGE_SCAN ? stage[STAGE_WAIT].bytes : stage[i].bytes;
+        PrintStageJSON(stream, stageName[i], "main", stage[i].wall, stage[i].threadCPU, count, bytes, i == MAXSTAGES - 1);
+    }
+    fprintf(stream,
+            "\t],\n"
+            "\t\"cpu_ms\" : {\n"
+            "\t\t\"scan\" : %.3f,\n"
+            "\t\t\"print\" : %.3f,\n"
+            "\t\t\"reader\" : %.3f\n"
+            "\t},\n",
+            NSEC2MSEC(stage[STAGE_SCAN].cpu), NSEC2MSEC(stage[STAGE_PRINT].cpu), NSEC2MSEC(readStat->readerCPU));
+
+    fprintf(stream, "\t\"filter\" : [\n");
+    FilterEngine_t *engine = explain->engine;
+    if (engine) {
+        for (uint32_t i = 1; i <= engine->numBlocks; i++) {
+            char s[256];
+            fprintf(stream,
+                    "\t\t{\n"
+                    "\t\t\t\"block\" : %u,\n"
+                    "\t\t\t\"expression\" : \"%s\",\n"
+                    "\t\t\t\"evaluations\" : %llu,\n"
+                    "\t\t\t\"matches\" : %llu\n"
+                    "\t\t}%s\n",
+                    i, BlockString(&engine->filter[i], s, sizeof(s)), (unsigned long long)engine->evalCount[i],
+                    (unsigned long long)engine->hitCount[i], i == engine->numBlocks ? "" : ",");
+        }
+    }
+    fprintf(stream, "\t],\n");
+
+    fprintf(stream, "\t\"hash\" : {\n");
+    PrintHashJSON(stream, "flowcache", flowHash, 0);
+    PrintHashJSON(stream, "elementstat", elementHash, 1);
+    fprintf(stream,
+            "\t},\n"
+            "\t\"memory\" : {\n"
+            "\t\t\"max_rss\" : %llu,\n"
+            "\t\t\"flowcache_arena\" : %zu\n"
+            "\t}\n"
+            "}\n",
+            (unsigned long long)maxRSS * 1024, arenaPeak);
+
+}  // End of ExplainJSON
+
+// print the explain report - the flow cache and element stat must still exist
+void ExplainPrint(explain_t *explain, FILE *stream) {
+    readStat_t readStat;
+    GetReadStat(&readStat);
+
+    swiss_stat_t flowHash = {0};
+    swiss_stat_t elementHash = {0};
+    size_t arenaPeak = 0;
+    FlowCacheHashStat(&flowHash, &arenaPeak);
+    ElementHashStat(&elementHash);
+
+    struct rusage usage;
+    long maxRSS = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    // keep the report after the query output
+    fflush(stdout);
+
+    if (explain->format == EXPLAIN_JSON)
+        ExplainJSON(stream, explain, &readStat, &flowHash, &elementHash, arenaPeak, maxRSS);
+    else
+        ExplainText(stream, explain, &readStat, &flowHash, &elementHash, arenaPeak, maxRSS);
+    fflush(stream);
+
+}  // End of ExplainPrint
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _EXPLAIN_H
+#define _EXPLAIN_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "nftree.h"
+#include "util.h"
+
+enum { EXPLAIN_TEXT = 1, EXPLAIN_JSON };
+
+/*
+ * stages of a query
+ * STAGE_SCAN and STAGE_PRINT are timed as a whole with wall and cpu time,
+ * the record stages within the scan loop with wall time only
+ */
+enum {
+    STAGE_SCAN = 0,   // process_data() - the scan of all files
+    STAGE_WAIT,       // wait for the next data block of the reader
+    STAGE_EXPAND,     // expand the records into the master record
+    STAGE_FILTER,     // time window, enrichment and filter engine
+    STAGE_AGGREGATE,  // flow cache
+    STAGE_STAT,       // element stat
+    STAGE_SORT,       // insert flows for -O sorting
+    STAGE_OUTPUT,     // print or write the flows
+    STAGE_PRINT,      // sort, print or write the flow cache and element stat
+    MAXSTAGES
+};
+
+typedef struct explainStage_s {
+    uint64_t wall;       // nsec
+    uint64_t cpu;        // nsec process cpu time - STAGE_SCAN and STAGE_PRINT
+    uint64_t threadCPU;  // nsec main thread cpu time - STAGE_SCAN and STAGE_PRINT
+    uint64_t count;      // records or blocks of a record stage
+    uint64_t bytes;      // bytes processed
+    uint64_t wallStart;
+    uint64_t cpuStart;
+    uint64_t threadStart;
+} explainStage_t;
+
+typedef struct explain_s {
+    int format;
+    uint64_t processed;
+    uint64_t passed;
+    FilterEngine_t *engine;
+    explainStage_t stage[MAXSTAGES];
+} explain_t;
+
+explain_t *ExplainInit(char *format);
+
+void ExplainEnable(explain_t *explain, FilterEngine_t *engine);
+
+void ExplainBegin(explain_t *explain, int stage);
+
+void ExplainEnd(explain_t *explain, int stage);
+
+void ExplainPrint(explain_t *explain, FILE *stream);
+
+// add the time since start to a record stage - returns the start time of the next stage
+static inline uint64_t ExplainStage(explain_t *explain, int stage, uint64_t start, uint64_t bytes) {
+    uint64_t now = nsecTime(CLOCK_MONOTONIC);
+    explain->stage[stage].wall += now - start;
+    explain->stage[stage].count++;
+    explain->stage[stage].bytes += bytes;
+    return now;
+
+}  // End of ExplainStage
+
+#endif  //_EXPLAIN_H
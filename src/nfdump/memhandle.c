@@ -28,16 +28,10 @@
  *
  */
 
-#ifdef __x86_64
-#define ALIGN_MASK 0xFFFFFFF8
-#else
-#define ALIGN_MASK 0xFFFFFFFC
-#endif
-
-#include "spin_lock.h"
+#include <stdatomic.h>
+#include <sys/mman.h>
 
-#define GetLock(a) spin_lock(((a)->lock))
-#define ReleaseLock(a) spin_unlock(((a)->lock))
+#include "nfconf.h"
 
 #define ALIGN_BYTES      \
     (offsetof(           \
@@ -48,119 +42,237 @@
          y) -            \
      1)
 
-// Each pre-allocated memory block is 10M
+/*
+ * Arena allocator for flow records and keys. Each thread allocates from its own
+ * bump arena without any lock. An exhausted arena is refilled with a chunk from
+ * the pool of spare chunks or with a newly mapped chunk. Both lists are lock-free
+ * stacks. Chunks are first touched by the allocating thread, therefore the kernel
+ * places them on the NUMA node of that thread. Memory is released as a whole only.
+ */
+
+// Each chunk is 10M - rounded up to the page size with hugepages
 #define DefaultMemBlockSize 10 * 1024 * 1024
 
-typedef struct MemHandler_s {
-    size_t BlockSize; /* max size of each pre-allocated memblock */
+typedef struct memChunk_s {
+    struct memChunk_s *next;
+    size_t size;  // mapped size of this chunk
+} memChunk_t;
 
-    /* memory blocks - containing the flow records and keys */
-    void **memblock;     /* array holding all NumBlocks allocated memory blocks */
-    size_t MaxBlocks;    /* Size of memblock array */
-    size_t NumBlocks;    /* number of allocated flow blocks in memblock array */
-    size_t CurrentBlock; /* Index of current memblock to allocate memory from */
-    size_t Allocted;     /* Number of bytes already allocated in memblock */
+#define CHUNKHEADER ((sizeof(memChunk_t) + ALIGN_BYTES) & ~ALIGN_BYTES)
 
-    atomic_int lock;
+// thread local bump arena
+typedef struct memArena_s {
+    void *ptr;            // next free byte
+    size_t left;          // bytes left in current chunk
+    size_t size;          // usable size of current chunk
+    unsigned generation;  // arena is valid for this generation of the handler only
+} memArena_t;
 
+typedef struct MemHandler_s {
+    size_t BlockSize;  // size of each chunk
+    int hugePages;     // 0 - no, 1 - transparent, 2 - 2MB or 1024 - 1GB pages
+
+    _Atomic(memChunk_t *) chunks;      // chunks in use
+    _Atomic(memChunk_t *) freeChunks;  // pool of spare chunks
+    atomic_uint generation;            // incremented with each reset of the handler
+    atomic_size_t retired;             // bytes used of all chunks, which are no longer in an arena
+
+    // statistics
+    atomic_size_t mapped;
+    atomic_uint numChunks;
+    atomic_uint numArenas;
+    size_t peak;
+    unsigned maxArenas;
 } MemHandler_t;
 
-static MemHandler_t *MemHandler = NULL;
+static MemHandler_t MemHandler = {0};
 
-#define MaxMemBlocks 256
+static _Thread_local memArena_t memArena = {0};
 
-static int nfalloc_Init(uint32_t memBlockSize) {
-    MemHandler = calloc(1, sizeof(MemHandler_t));
-    if (!MemHandler) {
-        LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
-        return 0;
+static void PushChunk(_Atomic(memChunk_t *) *stack, memChunk_t *chunk) {
+    memChunk_t *head = atomic_load(stack);
+    do {
+        chunk->next = head;
+    } while (!atomic_compare_exchange_weak(stack, &head, chunk));
+
+}  // End of PushChunk
+
+// chunks are popped concurrently, but pushed to the pool only while no thread allocates
+static memChunk_t *PopChunk(_Atomic(memChunk_t *) *stack) {
+    memChunk_t *head = atomic_load(stack);
+    while (head && !atomic_compare_exchange_weak(stack, &head, head->next))
+        ;
+    return head;
+
+}  // End of PopChunk
+
+static memChunk_t *MapChunk(size_t size) {
+    void *p = MAP_FAILED;
+
+    if (MemHandler.hugePages > 1) {
+        size_t pageSize = (size_t)MemHandler.hugePages * 1024 * 1024;
+        size = (size + pageSize - 1) & ~(pageSize - 1);
+#ifdef MAP_HUGETLB
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+        flags |= MemHandler.hugePages == 1024 ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+#endif
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED && atomic_load(&MemHandler.numChunks) == 0) {
+            LogError("mmap() hugepages of %d MB failed: %s - use normal pages", MemHandler.hugePages, strerror(errno));
+        }
+#endif
     }
 
-    MemHandler->memblock = (void **)calloc(MaxMemBlocks, sizeof(void *));
-    if (!MemHandler->memblock) {
-        LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
-        return 0;
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            LogError("mmap() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            exit(255);
+        }
+#ifdef MADV_HUGEPAGE
+        if (MemHandler.hugePages) madvise(p, size, MADV_HUGEPAGE);
+#endif
     }
 
-    if (memBlockSize == 0) memBlockSize = DefaultMemBlockSize;
+    memChunk_t *chunk = (memChunk_t *)p;
+    chunk->size = size;
+    atomic_fetch_add(&MemHandler.mapped, size);
+    atomic_fetch_add(&MemHandler.numChunks, 1);
 
-    MemHandler->BlockSize = memBlockSize;
+    return chunk;
 
-    MemHandler->memblock[0] = calloc(1, memBlockSize);
-    if (!MemHandler->memblock[0]) {
-        LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
-        return 0;
+}  // End of MapChunk
+
+static int nfalloc_Init(uint32_t memBlockSize) {
+    if (memBlockSize == 0) memBlockSize = DefaultMemBlockSize;
+    if (atomic_load(&MemHandler.numChunks)) nfalloc_free();
+    MemHandler.BlockSize = memBlockSize;
+
+    int hugePages = ConfGetValue("aggr.hugepages");
+    MemHandler.hugePages = hugePages == 1 || hugePages == 2 || hugePages == 1024 ? hugePages : 0;
+    if (MemHandler.hugePages > 1) {
+        size_t pageSize = (size_t)MemHandler.hugePages * 1024 * 1024;
+        MemHandler.BlockSize = (MemHandler.BlockSize + pageSize - 1) & ~(pageSize - 1);
     }
 
-    MemHandler->MaxBlocks = MaxMemBlocks;
-    MemHandler->NumBlocks = 1;
-    MemHandler->CurrentBlock = 0;
-    MemHandler->Allocted = 0;
-    MemHandler->lock = 0;
+    atomic_store(&MemHandler.retired, 0);
+    atomic_store(&MemHandler.numArenas, 0);
+    // invalidate all thread arenas
+    atomic_fetch_add(&MemHandler.generation, 1);
 
     return 1;
 
 }  // End of nfalloc_Init
 
+// update statistics and invalidate all arenas - no thread may allocate concurrently
+static void nfalloc_Retire(void) {
+    size_t used = atomic_load(&MemHandler.retired);
+    if (memArena.generation == atomic_load(&MemHandler.generation)) used += memArena.size - memArena.left;
+    if (used > MemHandler.peak) MemHandler.peak = used;
+    unsigned numArenas = atomic_load(&MemHandler.numArenas);
+    if (numArenas > MemHandler.maxArenas) MemHandler.maxArenas = numArenas;
+
+    atomic_store(&MemHandler.retired, 0);
+    atomic_store(&MemHandler.numArenas, 0);
+    atomic_fetch_add(&MemHandler.generation, 1);
+
+}  // End of nfalloc_Retire
+
+// release all allocations, but keep the chunks as spare chunks for later use
+static void nfalloc_Reset(void) {
+    nfalloc_Retire();
+
+    memChunk_t *chunk;
+    while ((chunk = PopChunk(&MemHandler.chunks)) != NULL) {
+        if (chunk->size == MemHandler.BlockSize) {
+            PushChunk(&MemHandler.freeChunks, chunk);
+        } else {
+            // dedicated chunk of a large allocation
+            atomic_fetch_sub(&MemHandler.mapped, chunk->size);
+            atomic_fetch_sub(&MemHandler.numChunks, 1);
+            munmap((void *)chunk, chunk->size);
+        }
+    }
+
+}  // End of nfalloc_Reset
+
 static void nfalloc_free(void) {
-    if (!MemHandler) return;
+    nfalloc_Reset();
 
-    for (int i = 0; i < MemHandler->NumBlocks; i++) {
-        free(MemHandler->memblock[i]);
+    memChunk_t *chunk;
+    while ((chunk = PopChunk(&MemHandler.freeChunks)) != NULL) {
+        atomic_fetch_sub(&MemHandler.mapped, chunk->size);
+        atomic_fetch_sub(&MemHandler.numChunks, 1);
+        munmap((void *)chunk, chunk->size);
     }
-    MemHandler->NumBlocks = 0;
-    MemHandler->CurrentBlock = 0;
-    MemHandler->Allocted = 0;
-
-    free((void *)MemHandler->memblock);
-    MemHandler->memblock = NULL;
-    MemHandler->MaxBlocks = 0;
-    free((void *)MemHandler);
 
 }  // End of nfalloc_free
 
-static inline void *nfmalloc(size_t size) {
-    void *p;
-    size_t aligned_size;
+// bytes allocated so far - the arena of the calling thread is counted exactly
+static inline size_t nfalloc_Size(void) {
+    size_t used = atomic_load(&MemHandler.retired);
+    if (memArena.generation == atomic_load(&MemHandler.generation)) used += memArena.size - memArena.left;
+    return used;
+
+}  // End of nfalloc_Size
+
+// arena statistics
+static void nfalloc_Stat(size_t *peak, size_t *mapped, unsigned *numChunks, unsigned *numArenas, int *hugePages) {
+    size_t used = nfalloc_Size();
+    *peak = used > MemHandler.peak ? used : MemHandler.peak;
+    *mapped = atomic_load(&MemHandler.mapped);
+    *numChunks = atomic_load(&MemHandler.numChunks);
+    unsigned arenas = atomic_load(&MemHandler.numArenas);
+    *numArenas = arenas > MemHandler.maxArenas ? arenas : MemHandler.maxArenas;
+    *hugePages = MemHandler.hugePages;
+
+}  // End of nfalloc_Stat
+
+// refill the arena of this thread with a new chunk
+static void *nfmalloc_Refill(size_t aligned_size) {
+    unsigned generation = atomic_load(&MemHandler.generation);
+    if (memArena.generation == generation) {
+        atomic_fetch_add(&MemHandler.retired, memArena.size - memArena.left);
+    } else {
+        atomic_fetch_add(&MemHandler.numArenas, 1);
+        memArena.generation = generation;
+        memArena.left = memArena.size = 0;
+    }
 
-    // make sure size of memory is aligned
-    aligned_size = (((size) + ALIGN_BYTES) & ~ALIGN_BYTES);
-
-    GetLock(MemHandler);
-    if ((MemHandler->Allocted + aligned_size) <= MemHandler->BlockSize) {
-        // enough space available in current memblock
-        p = MemHandler->memblock[MemHandler->CurrentBlock] + MemHandler->Allocted;
-        MemHandler->Allocted += aligned_size;
-        dbg_printf("Mem Handle: Requested: %zu, aligned: %zu, ptr: %lx\n", size, aligned_size, (long unsigned)p);
-        ReleaseLock(MemHandler);
-        return p;
+    if (aligned_size > MemHandler.BlockSize - CHUNKHEADER) {
+        // large allocation - dedicated chunk, keep current arena
+        memChunk_t *chunk = MapChunk(aligned_size + CHUNKHEADER);
+        PushChunk(&MemHandler.chunks, chunk);
+        atomic_fetch_add(&MemHandler.retired, aligned_size);
+        return (void *)chunk + CHUNKHEADER;
     }
 
-    // not enough space - allocate a new memblock
+    memChunk_t *chunk = PopChunk(&MemHandler.freeChunks);
+    if (!chunk) chunk = MapChunk(MemHandler.BlockSize);
+    PushChunk(&MemHandler.chunks, chunk);
 
-    MemHandler->CurrentBlock++;
-    if (MemHandler->CurrentBlock >= MemHandler->MaxBlocks) {
-        // we run out in memblock array - re-allocate memblock array
-        MemHandler->MaxBlocks += MaxMemBlocks;
-        MemHandler->memblock = (void **)realloc(MemHandler->memblock, MemHandler->MaxBlocks * sizeof(void *));
-        if (!MemHandler->memblock) {
-            LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
-            exit(255);
-        }
-    }
+    memArena.size = chunk->size - CHUNKHEADER;
+    memArena.ptr = (void *)chunk + CHUNKHEADER + aligned_size;
+    memArena.left = memArena.size - aligned_size;
+    dbg_printf("Mem Handle: new chunk %p, size: %zu\n", (void *)chunk, chunk->size);
+
+    return (void *)chunk + CHUNKHEADER;
+
+}  // End of nfmalloc_Refill
+
+static inline void *nfmalloc(size_t size) {
+    // make sure size of memory is aligned
+    size_t aligned_size = (((size) + ALIGN_BYTES) & ~ALIGN_BYTES);
 
-    // allocate new memblock
-    p = malloc(MemHandler->BlockSize);
-    if (!p) {
-        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
-        exit(255);
+    if (memArena.left >= aligned_size && memArena.generation == atomic_load_explicit(&MemHandler.generation, memory_order_relaxed)) {
+        void *p = memArena.ptr;
+        memArena.ptr += aligned_size;
+        memArena.left -= aligned_size;
+        return p;
     }
-    MemHandler->memblock[MemHandler->CurrentBlock] = p;
-    MemHandler->Allocted = aligned_size;
-    MemHandler->NumBlocks++;
-    ReleaseLock(MemHandler);
-    dbg_printf("Mem Handle: Requested: %zu, aligned: %zu, ptr: %lu\n", size, aligned_size, (long unsigned)p);
-    return p;
+
+    return nfmalloc_Refill(aligned_size);
 
 }  // End of nfmalloc
 
@@ -172,5 +284,5 @@ static inline void *nfcalloc(size_t count, size_t size) {
 }  // nfcalloc
 
 static inline void nffree(void *p) {
-    // not implemented
+    // not implemented - arena memory is released as a whole
 }
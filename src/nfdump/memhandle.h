@@ -33,8 +33,14 @@
 
 static int nfalloc_Init(uint32_t memBlockSize);
 
+static void nfalloc_Reset(void);
+
 static void nfalloc_free(void);
 
+static inline size_t nfalloc_Size(void);
+
+static void nfalloc_Stat(size_t *peak, size_t *mapped, unsigned *numChunks, unsigned *numArenas, int *hugePages);
+
 static inline void *nfmalloc(size_t size);
 
 static inline void *nfcalloc(size_t count, size_t size);
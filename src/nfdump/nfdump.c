@@ -47,10 +47,14 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "config.h"
+#include "dnsparse.h"
+#include "explain.h"
 #include "exporter.h"
 #include "flist.h"
 #include "ifvrf.h"
@@ -64,12 +68,16 @@
 #include "nffile.h"
 #include "nflowcache.h"
 #include "nfnet.h"
+#include "nfpartial.h"
 #include "nfprof.h"
 #include "nfstat.h"
 #include "nftree.h"
 #include "nfx.h"
 #include "nfxV3.h"
 #include "output.h"
+#include "output_fmt.h"
+#include "querycache.h"
+#include "queryserver.h"
 #include "util.h"
 #include "version.h"
 
@@ -77,11 +85,14 @@ extern char *FilterFilename;
 
 /* Local Variables */
 static FilterEngine_t *Engine;
+static explain_t *explain = NULL;  // -e explain the query
 
 static uint64_t total_bytes = 0;
 static uint32_t processed = 0;
 static uint32_t passed = 0;
 static bool HasGeoDB = false;
+static bool warmStart = false;
+static char *warmGeoFile = NULL;
 static uint32_t skipped_blocks = 0;
 static uint64_t t_first_flow, t_last_flow;
 
@@ -93,6 +104,8 @@ extern exporter_t **exporter_list;
 #define AggrPrependFmt "%ts %td "
 #define AggrAppendFmt "%pkt %byt %bps %bpp %fl"
 
+#define NFDUMP_OPTIONS "6aA:Bbc:C:d:D:e::E:G:s:ghn:i:jf:Fk:pP:qyz::r:uv:w:J:M:NImO:R:XYZt:TU:Vv:W:x:l:L:o:"
+
 /* Function Prototypes */
 static void usage(char *name);
 
@@ -121,8 +134,14 @@ static void usage(char *name) {
         "-r <file>\tread input from file\n"
         "-w <file>\twrite output to file\n"
         "-f\t\tread netflow filter from file\n"
+        "-F\t\tFollow the file given by -r while it is written, e.g. nfcapd.current, across rotations.\n"
         "-n\t\tDefine number of top N for stat or sorted output.\n"
+        "-p\t\tWrite partial aggregation state to stdout for a distributed query.\n"
+        "-P <worker>\tSend query to <worker> and merge all partial results. May be repeated.\n"
+        "\t\tunix:<socket> for a query server or a command such as 'ssh host nfdump -R /flows'.\n"
         "-c\t\tLimit number of matching records\n"
+        "-d <socket>\tRun as query server on UNIX socket <socket>.\n"
+        "-U <socket>\tSend all remaining arguments as query to the server on <socket>.\n"
         "-D <dns>\tUse nameserver <dns> for host lookup.\n"
         "-G <geoDB>\tUse this nfdump geoDB to lookup country/location.\n"
         "-N\t\tPrint plain numbers\n"
@@ -162,11 +181,15 @@ static void usage(char *name) {
         "\t\t pipe     '|' separated legacy machine parseable output format.\n"
         "\t\t null     no flow records, but statistics output.\n"
         "\t\t\tmode may be extended by '6' for full IPv6 listing. e.g.long6, extended6.\n"
+        "-e[=json]\tExplain the query: time, records and bytes of each stage, filter and hash stats.\n"
         "-E <file>\tPrint exporter and sampling info for collected flows.\n"
         "-v <file>\tverify netflow data file. Print version and blocks.\n"
         "-W <num>\tOptionally set the number of workers to compress flows\n"
+        "-k class:cpus\tPin reader, writer or worker threads to cpus.\n"
         "-x <file>\tverify extension records in netflow data file.\n"
         "-X\t\tDump Filtertable and exit (debug option).\n"
+        "-u\t\tMigrate nfdump 1.6 files given by -r or -R in place to the current file format.\n"
+        "-Y\t\tCreate rollups of the flow files for the stats in rollup.stats of the config file.\n"
         "-Z\t\tCheck filter syntax and exit.\n"
         "-t <time>\ttime window for filtering packets\n"
         "\t\tyyyy/MM/dd.hh:mm:ss[-yyyy/MM/dd.hh:mm:ss]\n",
@@ -254,6 +277,10 @@ static inline record_header_t *AddFlowLabel(record_header_t *record, char *label
     return (record_header_t *)tmpRecord;
 }
 
+// default stats of a rollup - ip, port, as and if stats are combined from src and dst
+#define DEFAULTROLLUPSTATS "srcip dstip srcport dstport proto srcas dstas inif outif router"
+#define MAXROLLUPSTATS 16
+
 static stat_record_t process_data(char *wfile, int element_stat, int flow_stat, int sort_flows, RecordPrinter_t print_record,
                                   timeWindow_t *timeWindow, uint64_t limitRecords, outputParams_t *outputParams, int compress) {
     nffile_t *nffile_w, *nffile_r;
@@ -321,11 +348,18 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
     }
 
     Engine->nfrecord = (uint64_t *)master_record;
+
+    // explain: start time of the current record stage
+    uint64_t tick = 0;
+    if (explain) ExplainBegin(explain, STAGE_SCAN);
+
     int done = 0;
     while (!done) {
         int i, ret;
         // get next data block from file
+        if (explain) tick = nsecTime(CLOCK_MONOTONIC);
         ret = ReadBlock(nffile_r);
+        if (explain) tick = ExplainStage(explain, STAGE_WAIT, tick, ret > 0 ? ret : 0);
 
         switch (ret) {
             case NF_CORRUPT:
@@ -394,6 +428,7 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
                     } else {
                         ExpandRecord_v3((recordHeaderV3_t *)record_ptr, master_record);
                     }
+                    if (explain) tick = ExplainStage(explain, STAGE_EXPAND, tick, record_ptr->size);
 
                     processed++;
                     master_record->flowCount = processed;
@@ -407,17 +442,21 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
                         }
 
                         if (master_record->inPayloadLength && Engine->ja3Filter) {
-                            ja3_t *ja3 = ja3Process((uint8_t *)master_record->inPayload, master_record->inPayloadLength);
-                            if (ja3) {
-                                memcpy((void *)master_record->ja3, ja3->md5Hash, 16);
-                                ja3Free(ja3);
+                            ja3_t ja3;
+                            if (ja3Parse(&ja3, (uint8_t *)master_record->inPayload, master_record->inPayloadLength)) {
+                                memcpy((void *)master_record->ja3, ja3.md5Hash, 16);
                             }
                         }
 
+                        if (Engine->dnsFilter) {
+                            AddDNSInfo(master_record);
+                        }
+
                         // filter netflow record with user supplied filter
                         match = (*Engine->FilterEngine)(Engine);
                         //						match = dofilter(master_record);
                     }
+                    if (explain) tick = ExplainStage(explain, STAGE_FILTER, tick, 0);
                     if (match == 0) {  // record failed to pass all filters
                         // go to next record
                         goto NEXT;
@@ -440,28 +479,34 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
 
                     if (flow_stat) {
                         AddFlowCache(process_ptr, master_record);
+                        if (explain) tick = ExplainStage(explain, STAGE_AGGREGATE, tick, process_ptr->size);
                         if (element_stat) {
+                            if (TestFlag(element_stat, FLAG_DNS)) AddDNSInfo(master_record);
                             if (TestFlag(element_stat, FLAG_GEO) && TestFlag(master_record->mflags, V3_FLAG_ENRICHED) == 0) {
                                 AddGeoInfo(master_record);
                             }
                             AddElementStat(master_record);
+                            if (explain) tick = ExplainStage(explain, STAGE_STAT, tick, 0);
                         }
                     } else if (element_stat) {
                         if (TestFlag(element_stat, FLAG_JA3) && master_record->ja3[0] == 0) {
                             // if we need ja3, calculate ja3 if payload exists and ja3 not yet set by filter
-                            ja3_t *ja3 = ja3Process((uint8_t *)master_record->inPayload, master_record->inPayloadLength);
-                            if (ja3) {
-                                memcpy((void *)master_record->ja3, ja3->md5Hash, 16);
-                                ja3Free(ja3);
+                            ja3_t ja3;
+                            if (ja3Parse(&ja3, (uint8_t *)master_record->inPayload, master_record->inPayloadLength)) {
+                                memcpy((void *)master_record->ja3, ja3.md5Hash, 16);
                             }
                         }
+                        // if we need dns, decode payload if not yet done by filter
+                        if (TestFlag(element_stat, FLAG_DNS)) AddDNSInfo(master_record);
                         // if we need geo, lookup geo if not yet set by filter
                         if (TestFlag(element_stat, FLAG_GEO) && TestFlag(master_record->mflags, V3_FLAG_ENRICHED) == 0) {
                             AddGeoInfo(master_record);
                         }
                         AddElementStat(master_record);
+                        if (explain) tick = ExplainStage(explain, STAGE_STAT, tick, 0);
                     } else if (sort_flows) {
                         InsertFlow(process_ptr, master_record);
+                        if (explain) tick = ExplainStage(explain, STAGE_SORT, tick, process_ptr->size);
                     } else {
                         if (write_file) {
                             AppendToBuffer(nffile_w, (void *)process_ptr, process_ptr->size);
@@ -474,6 +519,7 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
                             printf("Bug! - this code should never get executed in file %s line %d\n", __FILE__, __LINE__);
                             exit(EXIT_FAILURE);
                         }
+                        if (explain) tick = ExplainStage(explain, STAGE_OUTPUT, tick, process_ptr->size);
                     }  // sort_flows - else
                 } break;
                 case ExtensionMapType: {
@@ -538,6 +584,7 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
     }  // while
 
     CloseFile(nffile_r);
+    if (explain) ExplainEnd(explain, STAGE_SCAN);
 
     // flush output file
     if (write_file) {
@@ -559,6 +606,526 @@ static stat_record_t process_data(char *wfile, int element_stat, int flow_stat,
 
 }  // End of process_data
 
+// drain the file list and look up the cache entry of each file
+static int collect_cached(queue_t *fileList, char ***fileNames, cacheEntry_t ***cacheEntries) {
+    int numFiles = 0;
+    int maxFiles = 0;
+    char **files = NULL;
+    cacheEntry_t **entries = NULL;
+    char *fileName;
+    while ((fileName = queue_pop(fileList)) != QUEUE_CLOSED) {
+        if (numFiles == maxFiles) {
+            maxFiles = maxFiles ? 2 * maxFiles : 64;
+            files = realloc(files, maxFiles * sizeof(char *));
+            entries = realloc(entries, maxFiles * sizeof(cacheEntry_t *));
+            if (!files || !entries) {
+                LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        files[numFiles] = fileName;
+        entries[numFiles] = QueryCacheEntry(fileName);
+        numFiles++;
+    }
+
+    *fileNames = files;
+    *cacheEntries = entries;
+    return numFiles;
+
+}  // End of collect_cached
+
+/*
+ * files without cache entry are processed in parallel by child processes,
+ * each storing the partial result of its file in the cache.
+ */
+static void fill_cache(char **files, cacheEntry_t **entries, int numFiles, int element_stat, int flow_stat, timeWindow_t *timeWindow,
+                       outputParams_t *outputParams) {
+    long maxChilds = sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxChilds < 1) maxChilds = 1;
+
+    // nothing buffered must be duplicated by the childs
+    fflush(stdout);
+    fflush(stderr);
+
+    int running = 0;
+    for (int i = 0; i < numFiles; i++) {
+        if (!entries[i] || access(entries[i]->path, R_OK) == 0) continue;
+
+        if (running == maxChilds && wait(NULL) > 0) running--;
+        pid_t pid = fork();
+        if (pid < 0) {
+            // remaining files are processed directly
+            LogError("fork() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            // child - process this file only
+            queue_t *singleFile = queue_init(1);
+            if (!singleFile || !Init_nffile(1, singleFile)) exit(255);
+            queue_push(singleFile, files[i]);
+            queue_close(singleFile);
+
+            processed = passed = skipped_blocks = 0;
+            total_bytes = 0;
+            stat_record_t stat_record = process_data(NULL, element_stat, flow_stat, 0, NULL, timeWindow, 0, outputParams, 0);
+            partialStat_t fileStat = {.stat_record = stat_record,
+                                      .processed = processed,
+                                      .passed = passed,
+                                      .skippedBlocks = skipped_blocks,
+                                      .totalBytes = total_bytes,
+                                      .msecFirst = t_first_flow,
+                                      .msecLast = t_last_flow};
+            exit(StoreQueryCache(entries[i], &fileStat, element_stat, flow_stat) ? EXIT_SUCCESS : 255);
+        }
+        running++;
+    }
+    while (running > 0 && wait(NULL) > 0) running--;
+
+}  // End of fill_cache
+
+static void free_cached(char **files, cacheEntry_t **entries, int numFiles) {
+    for (int i = 0; i < numFiles; i++) {
+        free(files[i]);
+        if (entries[i]) {
+            free(entries[i]->path);
+            free(entries[i]->key);
+            free(entries[i]);
+        }
+    }
+    free(files);
+    free(entries);
+
+}  // End of free_cached
+
+// record counts and sums compared before and after a file migration
+typedef struct migrateSum_s {
+    uint64_t flows;
+    uint64_t records;
+    uint64_t inPackets;
+    uint64_t inBytes;
+    uint64_t outPackets;
+    uint64_t outBytes;
+    uint64_t aggrFlows;
+    uint64_t msecFirst;
+    uint64_t msecLast;
+} migrateSum_t;
+
+static inline void AddMigrateSum(migrateSum_t *sum, master_record_t *master_record) {
+    sum->flows++;
+    sum->inPackets += master_record->inPackets;
+    sum->inBytes += master_record->inBytes;
+    sum->outPackets += master_record->out_pkts;
+    sum->outBytes += master_record->out_bytes;
+    sum->aggrFlows += master_record->aggr_flows;
+    sum->msecFirst += master_record->msecFirst;
+    sum->msecLast += master_record->msecLast;
+
+}  // End of AddMigrateSum
+
+// copy a block of unknown type unmodified to the output file
+static int CopyBlock(nffile_t *nffile, dataBlock_t *block_header) {
+    if (block_header->size > (BUFFSIZE - sizeof(dataBlock_t))) {
+        LogError("Block size %u too big to copy", block_header->size);
+        return 0;
+    }
+    if (nffile->block_header->NumRecords && WriteBlock(nffile) <= 0) return 0;
+
+    nffile->block_header->type = block_header->type;
+    nffile->block_header->NumRecords = block_header->NumRecords;
+    nffile->block_header->size = block_header->size;
+    memcpy(nffile->buff_ptr, (void *)block_header + sizeof(dataBlock_t), block_header->size);
+
+    return WriteBlock(nffile);
+
+}  // End of CopyBlock
+
+// read back a migrated file. Returns 0 on error or if any legacy record is left
+static int verify_migrated(char *fileName, master_record_t *master_record, migrateSum_t *sum) {
+    nffile_t *nffile = OpenFile(fileName, NULL);
+    if (!nffile) return 0;
+
+    int ok = 1;
+    int ret = 0;
+    while (ok && (ret = ReadBlock(nffile)) > 0) {
+        if (nffile->block_header->type != DATA_BLOCK_TYPE_3) continue;
+
+        record_header_t *record_ptr = nffile->buff_ptr;
+        for (int i = 0; i < nffile->block_header->NumRecords; i++) {
+            switch (record_ptr->type) {
+                case V3Record:
+                    ClearMasterRecord(master_record);
+                    ExpandRecord_v3((recordHeaderV3_t *)record_ptr, master_record);
+                    AddMigrateSum(sum, master_record);
+                    break;
+                case CommonRecordType:
+                case ExtensionMapType:
+                    ok = 0;
+                    break;
+                default:
+                    sum->records++;
+            }
+            record_ptr = (record_header_t *)((pointer_addr_t)record_ptr + record_ptr->size);
+        }
+    }
+    if (ret < 0) ok = 0;
+
+    CloseFile(nffile);
+    DisposeFile(nffile);
+    return ok;
+
+}  // End of verify_migrated
+
+// check for legacy records. Returns 1 for a file with V2 records, 0 if none and -1 on error
+static int has_legacy(char *fileName) {
+    nffile_t *nffile = OpenFile(fileName, NULL);
+    if (!nffile) return -1;
+
+    int legacy = 0;
+    int ret = 0;
+    while (!legacy && (ret = ReadBlock(nffile)) > 0) {
+        dataBlock_t *block_header = nffile->block_header;
+        if (block_header->type != DATA_BLOCK_TYPE_2 && block_header->type != DATA_BLOCK_TYPE_3) continue;
+
+        uint32_t sumSize = 0;
+        record_header_t *record_ptr = nffile->buff_ptr;
+        for (int i = 0; i < block_header->NumRecords; i++) {
+            if ((sumSize + record_ptr->size) > block_header->size || (record_ptr->size < sizeof(record_header_t))) {
+                LogError("Corrupt data file. Inconsistent block size in %s line %d\n", __FILE__, __LINE__);
+                ret = -1;
+                break;
+            }
+            sumSize += record_ptr->size;
+            if (record_ptr->type == CommonRecordType || record_ptr->type == ExtensionMapType) {
+                legacy = 1;
+                break;
+            }
+            record_ptr = (record_header_t *)((pointer_addr_t)record_ptr + record_ptr->size);
+        }
+        if (ret < 0) break;
+    }
+
+    CloseFile(nffile);
+    DisposeFile(nffile);
+    return ret < 0 ? -1 : legacy;
+
+}  // End of has_legacy
+
+/*
+ * rewrite a nfdump 1.6 file or a file with V2 records into V3 records.
+ * The converted file is verified against the record counts and sums of the
+ * original file and replaces it by an atomic rename with the mode and owner
+ * of the original file. A file without legacy records is not touched.
+ * Returns 0 if migrated, 1 if the file has no legacy data and -1 on error
+ */
+static int migrate_file(char *fileName) {
+    char tmpFile[MAXPATHLEN];
+    struct stat stat_buf;
+
+    if (stat(fileName, &stat_buf) < 0) {
+        LogError("stat() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return -1;
+    }
+
+    int legacy = has_legacy(fileName);
+    if (legacy <= 0) return legacy < 0 ? -1 : 1;
+
+    nffile_t *nffile_r = OpenFile(fileName, NULL);
+    if (!nffile_r) return -1;
+
+    snprintf(tmpFile, MAXPATHLEN, "%s-tmp", fileName);
+    tmpFile[MAXPATHLEN - 1] = '\0';
+
+    nffile_t *nffile_w = OpenNewFile(tmpFile, NULL, FILE_CREATOR(nffile_r), FILE_COMPRESSION(nffile_r), NOT_ENCRYPTED);
+    master_record_t *master_record = calloc(1, sizeof(master_record_t));
+    if (!nffile_w || !master_record) {
+        if (nffile_w) {
+            CloseUpdateFile(nffile_w);
+            DisposeFile(nffile_w);
+            unlink(tmpFile);
+        }
+        free(master_record);
+        DisposeFile(nffile_r);
+        return -1;
+    }
+
+    // keep ident and stat record of the original file
+    SetIdent(nffile_w, nffile_r->ident);
+    memcpy((void *)nffile_w->stat_record, (void *)nffile_r->stat_record, sizeof(stat_record_t));
+
+    migrateSum_t sumIn = {0};
+    int ok = 1;
+    int ret = 0;
+    while (ok && (ret = ReadBlock(nffile_r)) > 0) {
+        dataBlock_t *block_header = nffile_r->block_header;
+        if (block_header->type != DATA_BLOCK_TYPE_2 && block_header->type != DATA_BLOCK_TYPE_3) {
+            ok = CopyBlock(nffile_w, block_header);
+            continue;
+        }
+
+        uint32_t sumSize = 0;
+        record_header_t *record_ptr = nffile_r->buff_ptr;
+        for (int i = 0; ok && i < block_header->NumRecords; i++) {
+            if ((sumSize + record_ptr->size) > block_header->size || (record_ptr->size < sizeof(record_header_t))) {
+                LogError("Corrupt data file. Inconsistent block size in %s line %d\n", __FILE__, __LINE__);
+                ok = 0;
+                break;
+            }
+            sumSize += record_ptr->size;
+
+            record_header_t *out_ptr = record_ptr;
+            switch (record_ptr->type) {
+                case CommonRecordType:
+                    ClearMasterRecord(master_record);
+                    if (!ExpandRecord_v2(record_ptr, master_record) || (out_ptr = ConvertRecordV2((common_record_t *)record_ptr)) == NULL) {
+                        ok = 0;
+                        break;
+                    }
+                    AddMigrateSum(&sumIn, master_record);
+                    break;
+                case V3Record:
+                    ClearMasterRecord(master_record);
+                    ExpandRecord_v3((recordHeaderV3_t *)record_ptr, master_record);
+                    AddMigrateSum(&sumIn, master_record);
+                    break;
+                case ExtensionMapType:
+                    // V3 records need no extension maps
+                    if (Insert_Extension_Map(extension_map_list, (extension_map_t *)record_ptr) < 0) ok = 0;
+                    out_ptr = NULL;
+                    break;
+                default:
+                    // exporter, sampler and name records are copied
+                    sumIn.records++;
+            }
+
+            if (ok && out_ptr) {
+                if (!CheckBufferSpace(nffile_w, out_ptr->size)) {
+                    ok = 0;
+                } else {
+                    AppendToBuffer(nffile_w, (void *)out_ptr, out_ptr->size);
+                }
+            }
+            record_ptr = (record_header_t *)((pointer_addr_t)record_ptr + record_ptr->size);
+        }
+    }
+    if (ret < 0) ok = 0;
+
+    CloseFile(nffile_r);
+    DisposeFile(nffile_r);
+
+    // keep owner and mode of the original file - the owner first, as fchown() may clear the mode bits
+    if (ok && fchown(nffile_w->fd, stat_buf.st_uid, stat_buf.st_gid) < 0)
+        LogError("fchown() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+    if (ok && fchmod(nffile_w->fd, stat_buf.st_mode & 07777) < 0) {
+        LogError("fchmod() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        ok = 0;
+    }
+
+    if (!CloseUpdateFile(nffile_w)) ok = 0;
+    DisposeFile(nffile_w);
+
+    if (!ok) {
+        LogError("Failed to migrate file '%s'", fileName);
+        unlink(tmpFile);
+        free(master_record);
+        return -1;
+    }
+
+    migrateSum_t sumOut = {0};
+    ok = verify_migrated(tmpFile, master_record, &sumOut);
+    free(master_record);
+    if (!ok || memcmp((void *)&sumIn, (void *)&sumOut, sizeof(migrateSum_t)) != 0) {
+        LogError("Verification of migrated file '%s' failed: flows %llu/%llu, packets %llu/%llu, bytes %llu/%llu, records %llu/%llu", fileName,
+                 (unsigned long long)sumIn.flows, (unsigned long long)sumOut.flows, (unsigned long long)sumIn.inPackets,
+                 (unsigned long long)sumOut.inPackets, (unsigned long long)sumIn.inBytes, (unsigned long long)sumOut.inBytes,
+                 (unsigned long long)sumIn.records, (unsigned long long)sumOut.records);
+        unlink(tmpFile);
+        return -1;
+    }
+
+    if (rename(tmpFile, fileName) < 0) {
+        LogError("rename() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        unlink(tmpFile);
+        return -1;
+    }
+
+    printf("File %s migrated: %llu flows, %llu packets, %llu bytes verified\n", fileName, (unsigned long long)sumOut.flows,
+           (unsigned long long)sumOut.inPackets, (unsigned long long)sumOut.inBytes);
+    return 0;
+
+}  // End of migrate_file
+
+/*
+ * migrate all files of the file list in parallel child processes. The V2
+ * record conversion uses the process wide extension map list, therefore each
+ * file is processed in its own child.
+ */
+static int migrate_files(queue_t *fileList) {
+    long maxChilds = sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxChilds < 1) maxChilds = 1;
+
+    // nothing buffered must be duplicated by the childs
+    fflush(stdout);
+    fflush(stderr);
+
+    uint32_t migrated = 0, current = 0, failed = 0;
+    int running = 0;
+    char *fileName;
+    while ((fileName = queue_pop(fileList)) != QUEUE_CLOSED) {
+        int status;
+        if (running == maxChilds && wait(&status) > 0) {
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) > 1)
+                failed++;
+            else if (WEXITSTATUS(status) == 1)
+                current++;
+            else
+                migrated++;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            LogError("fork() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            failed++;
+            free(fileName);
+            continue;
+        }
+        if (pid == 0) {
+            // child - migrate this file only
+            int ret = migrate_file(fileName);
+            fflush(stdout);
+            exit(ret < 0 ? 255 : ret);
+        }
+        running++;
+        free(fileName);
+    }
+
+    int status;
+    while (running > 0 && wait(&status) > 0) {
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) > 1)
+            failed++;
+        else if (WEXITSTATUS(status) == 1)
+            current++;
+        else
+            migrated++;
+    }
+
+    printf("Migrated files: %u, current files: %u, failed: %u\n", migrated, current, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}  // End of migrate_files
+
+/*
+ * get the stats of a rollup from the config. The spec identifies rollups
+ * created with the same list of stats.
+ */
+static int RollupStats(char **rollupStats, char **rollupSpec) {
+    char *stats = ConfGetString("rollup.stats");
+    if (!stats) stats = strdup(DEFAULTROLLUPSTATS);
+
+    char *spec = malloc(strlen(stats) + 8);
+    if (!stats || !spec) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    strcpy(spec, "rollup");
+
+    int numStats = 0;
+    char *saveptr;
+    char *stat = strtok_r(stats, " ,\t", &saveptr);
+    while (stat) {
+        if (numStats == MAXROLLUPSTATS) {
+            LogError("Too many rollup stats. Max %d stats allowed", MAXROLLUPSTATS);
+            break;
+        }
+        rollupStats[numStats++] = stat;
+        strcat(spec, " ");
+        strcat(spec, stat);
+        stat = strtok_r(NULL, " ,\t", &saveptr);
+    }
+
+    *rollupSpec = spec;
+    return numStats;
+
+}  // End of RollupStats
+
+/*
+ * process the file list with the query cache. If fillCache is set, missing
+ * entries are created first. All entries are merged afterwards. Files without
+ * cache entry are processed directly.
+ */
+static stat_record_t process_cached(queue_t *fileList, int element_stat, int flow_stat, timeWindow_t *timeWindow, outputParams_t *outputParams,
+                                    int fillCache) {
+    partialStat_t partialStat;
+    InitPartialStat(&partialStat);
+
+    char **files;
+    cacheEntry_t **entries;
+    int numFiles = collect_cached(fileList, &files, &entries);
+    if (fillCache) fill_cache(files, entries, numFiles, element_stat, flow_stat, timeWindow, outputParams);
+
+    // merge the cached results and collect the files not cached
+    size_t queueLen = 1;
+    while (queueLen < (size_t)numFiles) queueLen <<= 1;
+    queue_t *directList = queue_init(queueLen);
+    if (!directList) exit(EXIT_FAILURE);
+
+    int numDirect = 0;
+    for (int i = 0; i < numFiles; i++) {
+        if (!entries[i] || !LoadQueryCache(entries[i], &partialStat)) {
+            queue_push(directList, files[i]);
+            files[i] = NULL;
+            numDirect++;
+        }
+    }
+    queue_close(directList);
+    free_cached(files, entries, numFiles);
+
+    stat_record_t stat_record = partialStat.stat_record;
+    processed = partialStat.processed;
+    passed = partialStat.passed;
+    skipped_blocks = partialStat.skippedBlocks;
+    total_bytes = partialStat.totalBytes;
+
+    if (numDirect) {
+        if (!Init_nffile(1, directList)) exit(EXIT_FAILURE);
+        stat_record_t directStat = process_data(NULL, element_stat, flow_stat, 0, NULL, timeWindow, 0, outputParams, 0);
+        SumStatRecords(&stat_record, &directStat);
+        if (partialStat.msecFirst && partialStat.msecFirst < t_first_flow) t_first_flow = partialStat.msecFirst;
+        if (partialStat.msecLast > t_last_flow) t_last_flow = partialStat.msecLast;
+    } else {
+        t_first_flow = partialStat.msecFirst;
+        t_last_flow = partialStat.msecLast;
+    }
+    queue_free(directList);
+
+    if (fillCache) ExpireQueryCache();
+    return stat_record;
+
+}  // End of process_cached
+
+// add a parsed option to the query arguments for distributed queries
+// options with an optional argument need the argument in the same word
+static void AddQueryArg(char **queryArgv, int *queryArgc, int opt, char *arg) {
+    char *spec = strchr(NFDUMP_OPTIONS, opt);
+    int optional = spec && spec[1] == ':' && spec[2] == ':';
+
+    char option[3] = {'-', opt, '\0'};
+    if (arg && optional) {
+        char *word = malloc(strlen(arg) + 3);
+        if (!word) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        strcpy(word, option);
+        strcat(word, arg);
+        queryArgv[(*queryArgc)++] = word;
+    } else {
+        queryArgv[(*queryArgc)++] = strdup(option);
+        if (arg) queryArgv[(*queryArgc)++] = strdup(arg);
+    }
+
+}  // End of AddQueryArg
+
 int main(int argc, char **argv) {
     struct stat stat_buff;
     stat_record_t sum_stat;
@@ -571,10 +1138,13 @@ int main(int argc, char **argv) {
     int ffd, element_stat, fdump;
     int flow_stat, aggregate, aggregate_mask, bidir;
     int print_stat, gnuplot_stat, syntax_only, compress, worker;
-    int GuessDir, ModifyCompress;
+    int GuessDir, ModifyCompress, migrate, follow;
     uint32_t limitRecords;
     char Ident[IDENTLEN];
     flist_t flist;
+    char *partialWorkers[MAXPARTIALWORKERS];
+    int numPartialWorkers, partialOutput, queryCache, rollup, createRollup;
+    char statSpec[256];
 
     memset((void *)&flist, 0, sizeof(flist));
     wfile = ffile = filter = tstring = stat_type = NULL;
@@ -593,12 +1163,20 @@ int main(int argc, char **argv) {
     worker = 0;
     GuessDir = 0;
     nameserver = NULL;
+    numPartialWorkers = 0;
+    partialOutput = 0;
+    queryCache = 0;
+    rollup = 0;
+    createRollup = 0;
+    statSpec[0] = '\0';
 
     print_format = NULL;
     print_record = NULL;
     print_order = NULL;
     query_file = NULL;
     ModifyCompress = -1;
+    migrate = 0;
+    follow = 0;
     aggr_fmt = NULL;
 
     configFile = NULL;
@@ -611,9 +1189,23 @@ int main(int argc, char **argv) {
     }
     outputParams->topN = -1;
 
+    // query arguments for distributed queries - all parsed options but -P <worker>
+    // grouped options are split - each option takes at most 2 words and at least 1 char
+    size_t maxQueryArgs = argc;
+    for (int i = 1; i < argc; i++) maxQueryArgs += strlen(argv[i]);
+    char **queryArgv = calloc(maxQueryArgs, sizeof(char *));
+    int queryArgc = 0;
+    if (!queryArgv) {
+        LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
     Ident[0] = '\0';
     int c;
-    while ((c = getopt(argc, argv, "6aA:Bbc:C:D:E:G:s:ghn:i:jf:qyz::r:v:w:J:M:NImO:R:XZt:TVv:W:x:l:L:o:")) != EOF) {
+    char *queryServer = NULL;
+    while ((c = getopt(argc, argv, NFDUMP_OPTIONS)) != EOF) {
+        // option parsing may modify optarg - copy it first
+        if (c != 'P' && c != '?') AddQueryArg(queryArgv, &queryArgc, c, optarg);
         switch (c) {
             case 'h':
                 usage(argv[0]);
@@ -654,6 +1246,10 @@ int main(int argc, char **argv) {
                     configFile = optarg;
                 }
                 break;
+            case 'd':
+                CheckArgLen(optarg, MAXPATHLEN);
+                queryServer = optarg;
+                break;
             case 'D':
                 CheckArgLen(optarg, 64);
                 nameserver = optarg;
@@ -683,9 +1279,26 @@ int main(int argc, char **argv) {
             case 'X':
                 fdump = 1;
                 break;
+            case 'Y':
+                createRollup = 1;
+                break;
+            case 'u':
+                migrate = 1;
+                break;
             case 'Z':
                 syntax_only = 1;
                 break;
+            case 'p':
+                partialOutput = 1;
+                break;
+            case 'P':
+                CheckArgLen(optarg, 1024);
+                if (numPartialWorkers == MAXPARTIALWORKERS) {
+                    LogError("Too many workers. Max %d workers allowed", MAXPARTIALWORKERS);
+                    exit(EXIT_FAILURE);
+                }
+                partialWorkers[numPartialWorkers++] = optarg;
+                break;
             case 'q':
                 outputParams->quiet = 1;
                 break;
@@ -733,6 +1346,9 @@ int main(int argc, char **argv) {
                     ListStatTypes();
                     exit(EXIT_FAILURE);
                 }
+                // all stats requested are part of the query cache spec
+                strncat(statSpec, " ", sizeof(statSpec) - strlen(statSpec) - 1);
+                strncat(statSpec, stat_type, sizeof(statSpec) - strlen(statSpec) - 1);
                 break;
             case 'V': {
                 printf("%s: %s\n", argv[0], versionString());
@@ -753,6 +1369,9 @@ int main(int argc, char **argv) {
                 CheckArgLen(optarg, MAXPATHLEN);
                 ffile = optarg;
                 break;
+            case 'F':
+                follow = 1;
+                break;
             case 't':
                 CheckArgLen(optarg, 32);
                 tstring = optarg;
@@ -812,6 +1431,11 @@ int main(int argc, char **argv) {
             case 'T':
                 outputParams->doTag = 1;
                 break;
+            case 'U':
+                // send all remaining arguments to the query server
+                CheckArgLen(optarg, MAXPATHLEN);
+                exit(QueryClient(optarg, argc - optind, &argv[optind]));
+                break;
             case 'i':
                 CheckArgLen(optarg, IDENTLEN);
                 strncpy(Ident, optarg, IDENTLEN);
@@ -853,6 +1477,15 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'k':
+                CheckArgLen(optarg, 256);
+                if (!SetAffinity(optarg)) exit(EXIT_FAILURE);
+                break;
+            case 'e':
+                if (optarg) CheckArgLen(optarg, 16);
+                explain = ExplainInit(optarg);
+                if (!explain) exit(EXIT_FAILURE);
+                break;
             case '6':  // print long IPv6 addr
                 Setv6Mode(1);
                 break;
@@ -862,6 +1495,27 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (queryServer) {
+        if (ConfOpen(configFile, "nfdump") < 0) exit(EXIT_FAILURE);
+
+        // keep the geo DB resident for all queries
+        if (geo_file == NULL) geo_file = ConfGetString("geodb.path");
+        if (geo_file && strcmp(geo_file, "none") != 0) {
+            if (!CheckPath(geo_file, S_IFREG) || !Init_MaxMind() || !LoadMaxMind(geo_file)) {
+                LogError("Error reading geo location DB file %s", geo_file);
+                exit(EXIT_FAILURE);
+            }
+            warmGeoFile = geo_file;
+        }
+
+        // each query re-enters main() in a forked process
+        warmStart = true;
+        exit(QueryServer(queryServer, NFDUMP_OPTIONS, main));
+    }
+
+    // the filter words follow the options
+    for (int i = optind; i < argc; i++) queryArgv[queryArgc++] = strdup(argv[i]);
+
     if (argc - optind > 0) {
         filter = strdup(argv[optind++]);
         while (argc - optind > 0) {
@@ -907,7 +1561,8 @@ int main(int argc, char **argv) {
     // if no filter is given, set the default ip filter which passes through every flow
     if (!filter || strlen(filter) == 0) filter = "any";
 
-    Engine = CompileFilter(filter);
+    Engine = warmStart ? GetWarmFilter(filter) : NULL;
+    if (!Engine) Engine = CompileFilter(filter);
     if (!Engine) exit(254);
 
     if (fdump) {
@@ -918,7 +1573,11 @@ int main(int argc, char **argv) {
 
     if (syntax_only) exit(EXIT_SUCCESS);
 
-    if (ConfOpen(configFile, "nfdump") < 0) exit(EXIT_FAILURE);
+    // a query server has the config already loaded
+    if ((!warmStart || configFile) && ConfOpen(configFile, "nfdump") < 0) exit(EXIT_FAILURE);
+
+    // placement is reported in the summary
+    if (!InitAffinity(0)) exit(EXIT_FAILURE);
 
     if (outputParams->topN < 0) {
         if (flow_stat || element_stat) {
@@ -938,6 +1597,45 @@ int main(int argc, char **argv) {
         aggregate = 1;
     }
 
+    if (partialOutput || numPartialWorkers) {
+        // only aggregated flows and statistics can be merged
+        if (!(aggregate || flow_stat || element_stat) || (print_order && !aggregate)) {
+            LogError("Distributed queries require aggregation -a, -A or statistics -s");
+            exit(EXIT_FAILURE);
+        }
+        if (partialOutput && (wfile || numPartialWorkers)) {
+            LogError("Option -p can not be combined with -w or -P");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (createRollup) {
+        // rollups hold the stats of all flows of a file
+        if (aggregate || flow_stat || element_stat || wfile || partialOutput || numPartialWorkers || tstring || strcmp(filter, "any") != 0) {
+            LogError("Option -Y can not be combined with a filter or with -a, -A, -s, -t, -w, -p or -P");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (migrate) {
+        if (ModifyCompress >= 0 || aggregate || flow_stat || element_stat || wfile || partialOutput || numPartialWorkers || tstring ||
+            strcmp(filter, "any") != 0) {
+            LogError("Option -u can not be combined with a filter or with -a, -A, -s, -t, -w, -J, -p or -P");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (follow) {
+        // records are printed as they arrive - nothing must wait for the end of the file
+        if (!flist.single_file || flist.multiple_files || flist.multiple_dirs || aggregate || flow_stat || element_stat || wfile || print_order ||
+            partialOutput || numPartialWorkers || ModifyCompress >= 0 || migrate || createRollup) {
+            LogError("Option -F requires -r <file> and can not be combined with -a, -A, -s, -w, -O, -R, -M, -J, -u, -p, -P or -Y");
+            exit(EXIT_FAILURE);
+        }
+        SetFollowMode(1);
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    }
+
     extension_map_list = InitExtensionMaps(NEEDS_EXTENSION_LIST);
     if (!InitExporterList()) {
         exit(EXIT_FAILURE);
@@ -948,13 +1646,19 @@ int main(int argc, char **argv) {
         if (!flist.timeWindow) exit(EXIT_FAILURE);
     }
 
-    if (flist.multiple_dirs == NULL && flist.single_file == NULL && flist.multiple_files == NULL) {
-        usage(argv[0]);
-        exit(EXIT_SUCCESS);
-    }
+    queue_t *fileList = NULL;
+    if (numPartialWorkers) {
+        // the workers read the flow files
+        if (!Init_nffile(worker, NULL)) exit(EXIT_FAILURE);
+    } else {
+        if (flist.multiple_dirs == NULL && flist.single_file == NULL && flist.multiple_files == NULL) {
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        }
 
-    queue_t *fileList = SetupInputFileSequence(&flist);
-    if (!fileList || !Init_nffile(worker, fileList)) exit(EXIT_FAILURE);
+        fileList = SetupInputFileSequence(&flist);
+        if (!fileList || !Init_nffile(worker, fileList)) exit(EXIT_FAILURE);
+    }
 
     // Modify compression
     if (ModifyCompress >= 0) {
@@ -966,6 +1670,15 @@ int main(int argc, char **argv) {
         exit(EXIT_SUCCESS);
     }
 
+    // Migrate legacy files
+    if (migrate) {
+        if (!flist.single_file && !flist.multiple_files) {
+            LogError("Expected -r <file> or -R <dir> to migrate files\n");
+            exit(EXIT_FAILURE);
+        }
+        exit(migrate_files(fileList));
+    }
+
     // Change Ident only
     if (flist.single_file && strlen(Ident) > 0) {
         ChangeIdent(flist.single_file, Ident);
@@ -1006,7 +1719,9 @@ int main(int argc, char **argv) {
         geo_file = NULL;
     }
     if (geo_file) {
-        if (!CheckPath(geo_file, S_IFREG) || !Init_MaxMind() || !LoadMaxMind(geo_file)) {
+        if (warmGeoFile && strcmp(geo_file, warmGeoFile) == 0) {
+            // geo DB already resident in query server
+        } else if (!CheckPath(geo_file, S_IFREG) || !Init_MaxMind() || !LoadMaxMind(geo_file)) {
             LogError("Error reading geo location DB file %s", geo_file);
             exit(EXIT_FAILURE);
         }
@@ -1018,6 +1733,56 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (createRollup) {
+        char *rollupStats[MAXROLLUPSTATS];
+        char *rollupSpec;
+        int numRollup = RollupStats(rollupStats, &rollupSpec);
+        for (int i = 0; i < numRollup; i++) {
+            if (!SetStat(rollupStats[i], &element_stat, &flow_stat) || flow_stat) {
+                LogError("Invalid rollup stat '%s'", rollupStats[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!InitQueryCache("rollup", rollupSpec)) {
+            LogError("Rollups require a directory set by rollup.path in the config file");
+            exit(EXIT_FAILURE);
+        }
+        if (!Init_StatTable()) exit(250);
+
+        char **files;
+        cacheEntry_t **entries;
+        int numFiles = collect_cached(fileList, &files, &entries);
+        fill_cache(files, entries, numFiles, element_stat, 0, NULL, outputParams);
+        free_cached(files, entries, numFiles);
+        ExpireQueryCache();
+        exit(EXIT_SUCCESS);
+    }
+
+    // unfiltered statistics of complete files may be answered from rollups
+    if (element_stat && !flow_stat && !aggregate && !print_order && !wfile && !limitRecords && !numPartialWorkers && !tstring &&
+        strcmp(filter, "any") == 0) {
+        char *rollupStats[MAXROLLUPSTATS];
+        char *rollupSpec;
+        int numRollup = RollupStats(rollupStats, &rollupSpec);
+        rollup = InitQueryCache("rollup", rollupSpec) && MapRollupStat(rollupStats, numRollup);
+        free(rollupSpec);
+    }
+
+    // aggregations and statistics of complete files may be answered from the query cache
+    if (!rollup && (aggregate || flow_stat || element_stat) && !(print_order && !aggregate) && !wfile && !limitRecords && !numPartialWorkers) {
+        size_t len = strlen(filter) + strlen(statSpec) + (aggr_fmt ? strlen(aggr_fmt) : 0) + (tstring ? strlen(tstring) : 0) +
+                     (geo_file ? strlen(geo_file) : 0) + 64;
+        char *spec = malloc(len);
+        if (!spec) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        snprintf(spec, len, "a=%d b=%d B=%d A=%s s=%s t=%s geo=%s filter=%s", aggregate, bidir, GuessDir, aggr_fmt ? aggr_fmt : "", statSpec,
+                 tstring ? tstring : "", geo_file ? geo_file : "", filter);
+        queryCache = InitQueryCache("querycache", spec);
+        free(spec);
+    }
+
     if (aggr_fmt) {
         aggr_fmt = ParseAggregateMask(aggr_fmt, HasGeoDB);
         if (!aggr_fmt) {
@@ -1082,23 +1847,61 @@ int main(int argc, char **argv) {
 
     if ((aggregate || flow_stat || print_order) && !Init_FlowCache()) exit(250);
 
+    // printed custom aggregations need not to keep the flow records, if the output format allows it
+    if ((aggregate || flow_stat) && print_record == fmt_record && !wfile && !partialOutput && !numPartialWorkers && !queryCache)
+        SetCompactAggregation();
+
     if (element_stat && !Init_StatTable()) exit(250);
 
     SetLimits(element_stat || aggregate || flow_stat, packet_limit_string, byte_limit_string);
 
-    if (!(flow_stat || element_stat)) {
+    if (!(flow_stat || element_stat || partialOutput)) {
         PrintProlog(outputParams);
     }
 
+    if (explain && (numPartialWorkers || partialOutput || rollup || queryCache)) {
+        LogError("Option -e explains local file scans only - ignored");
+        free(explain);
+        explain = NULL;
+    }
+    if (explain) ExplainEnable(explain, Engine);
+
     nfprof_start(&profile_data);
-    sum_stat = process_data(wfile, element_stat, aggregate || flow_stat, print_order != NULL, print_record, flist.timeWindow, limitRecords,
-                            outputParams, compress);
+    if (numPartialWorkers) {
+        partialStat_t partialStat;
+        if (!GatherPartial(partialWorkers, numPartialWorkers, queryArgc, queryArgv, &partialStat)) exit(255);
+        sum_stat = partialStat.stat_record;
+        processed = partialStat.processed;
+        passed = partialStat.passed;
+        skipped_blocks = partialStat.skippedBlocks;
+        total_bytes = partialStat.totalBytes;
+        t_first_flow = partialStat.msecFirst;
+        t_last_flow = partialStat.msecLast;
+    } else if (rollup || queryCache) {
+        sum_stat = process_cached(fileList, element_stat, aggregate || flow_stat, flist.timeWindow, outputParams, queryCache);
+    } else {
+        sum_stat = process_data(wfile, element_stat, aggregate || flow_stat, print_order != NULL, print_record, flist.timeWindow, limitRecords,
+                                outputParams, compress);
+    }
     nfprof_end(&profile_data, processed);
 
+    if (partialOutput) {
+        partialStat_t partialStat = {.stat_record = sum_stat,
+                                     .processed = processed,
+                                     .passed = passed,
+                                     .skippedBlocks = skipped_blocks,
+                                     .totalBytes = total_bytes,
+                                     .msecFirst = t_first_flow,
+                                     .msecLast = t_last_flow};
+        if (!ExportPartial(stdout, &partialStat, element_stat, aggregate || flow_stat)) exit(255);
+        exit(EXIT_SUCCESS);
+    }
+
     if (passed == 0) {
         printf("No matching flows\n");
     }
 
+    if (explain) ExplainBegin(explain, STAGE_PRINT);
     if (aggregate || print_order) {
         if (wfile) {
             nffile_t *nffile = OpenNewFile(wfile, NULL, CREATOR_NFDUMP, compress, NOT_ENCRYPTED);
@@ -1122,6 +1925,7 @@ int main(int argc, char **argv) {
     if (element_stat) {
         PrintElementStat(&sum_stat, outputParams, print_record);
     }
+    if (explain) ExplainEnd(explain, STAGE_PRINT);
 
     PrintEpilog(outputParams);
 
@@ -1143,6 +1947,8 @@ int main(int argc, char **argv) {
                 printf("Total flows processed: %u, passed: %u, Blocks skipped: %u, Bytes read: %llu\n", processed, passed, skipped_blocks,
                        (unsigned long long)total_bytes);
                 nfprof_print(&profile_data, stdout);
+                char affinityString[256];
+                if (AffinityString(affinityString, sizeof(affinityString))) printf("Affinity: %s\n", affinityString);
                 break;
             case MODE_PIPE:
                 break;
@@ -1155,6 +1961,12 @@ int main(int argc, char **argv) {
 
     }  // else - no output
 
+    if (explain) {
+        explain->processed = processed;
+        explain->passed = passed;
+        ExplainPrint(explain, stderr);
+    }
+
 #ifdef DEVEL
     DumpNbarList();
 #endif
@@ -49,14 +49,17 @@
 #include "blocksort.h"
 #include "config.h"
 #include "exporter.h"
-#include "khash.h"
 #include "klist.h"
 #include "maxmind.h"
 #include "memhandle.h"
 #include "nfdump.h"
 #include "nffile.h"
+#include "nfpartial.h"
+#include "nfspill.h"
 #include "nfxV3.h"
 #include "output.h"
+#include "output_fmt.h"
+#include "swisstable.h"
 #include "util.h"
 
 typedef struct aggregate_param_s {
@@ -79,8 +82,10 @@ static struct aggregate_table_s {
                        {"srcip6", {8, OffsetSrcIPv6b, MaskIPv6, ShiftIPv6}, 1, 0, 0, NULL},
                        {"srcnet", {8, OffsetSrcIPv6a, MaskIPv6, ShiftIPv6}, -1, 0, 0, "%sn"},
                        {"srcnet", {8, OffsetSrcIPv6b, MaskIPv6, ShiftIPv6}, -1, 0, 0, NULL},
+                       {"srcnet", {1, OffsetMask, MaskSrcMask, ShiftSrcMask}, -1, 0, 0, NULL},
                        {"dstnet", {8, OffsetDstIPv6a, MaskIPv6, ShiftIPv6}, -1, 0, 0, "%dn"},
                        {"dstnet", {8, OffsetDstIPv6b, MaskIPv6, ShiftIPv6}, -1, 0, 0, NULL},
+                       {"dstnet", {1, OffsetMask, MaskDstMask, ShiftDstMask}, -1, 0, 0, NULL},
                        {"srcip", {8, OffsetSrcIPv6a, MaskIPv6, ShiftIPv6}, -1, 0, 0, "%sa"},
                        {"srcip", {8, OffsetSrcIPv6b, MaskIPv6, ShiftIPv6}, -1, 0, 0, NULL},
                        {"dstip", {8, OffsetDstIPv6a, MaskIPv6, ShiftIPv6}, -1, 0, 0, "%da"},
@@ -146,9 +151,11 @@ typedef struct FlowHashRecord {
         struct FlowHashRecord *next;
         uint8_t *hashkey;
     };
-    uint32_t hash;      // the full 32bit hash value - cached for khash resize
-    uint16_t inFlags;   // align
-    uint16_t outFlags;  // align
+    uint32_t hash;     // the 32bit hash value - cached for the flow hash resize
+    uint8_t inFlags;   // tcp flags
+    uint8_t outFlags;  // reverse tcp flags
+    uint8_t swapped;   // bidir: the flowrecord has the endpoints of the key swapped
+    uint8_t fill;
 
     // flow counter parameters for FLOWS, INPACKETS, INBYTES, OUTPACKETS, OUTBYTES
     uint64_t counter[5];
@@ -157,9 +164,36 @@ typedef struct FlowHashRecord {
     uint64_t msecFirst;
     uint64_t msecLast;
 
-    recordHeaderV3_t *flowrecord;
+    union {
+        recordHeaderV3_t *flowrecord;  // copy of the first flow record
+        uint64_t recordHead;           // compact aggregation: first word of the master record
+    };
 } FlowHashRecord_t;
 
+// partial aggregation entry of the flow cache - followed by the flow record
+typedef struct flowCounter_s {
+    uint64_t counter[5];
+    uint64_t msecFirst;
+    uint64_t msecLast;
+    uint16_t inFlags;
+    uint16_t outFlags;
+    uint32_t fill;
+} flowCounter_t;
+
+// flow cache entry in a spill file or sorted run - followed by the hash key and the flow record
+typedef struct spillRecord_s {
+    uint64_t counter[5];
+    uint64_t msecFirst;
+    uint64_t msecLast;
+    uint64_t recordHead;  // compact aggregation
+    uint32_t hash;
+    uint32_t size;  // size of the flow record - 0 for compact entries
+    uint8_t inFlags;
+    uint8_t outFlags;
+    uint8_t swapped;
+    uint8_t fill[5];
+} spillRecord_t;
+
 // printing order definitions
 enum CntIndices { FLOWS = 0, INPACKETS, INBYTES, OUTPACKETS, OUTBYTES };
 enum FlowDir { IN = 0, OUT, INOUT };
@@ -212,6 +246,7 @@ static uint32_t PrintOrder = 0;      // -O selected print order - index into ord
 static uint32_t PrintDirection = 0;
 static uint32_t GuessDirection = 0;
 static uint32_t doGeoLookup = 0;
+static uint32_t compactAggregation = 0;  // aggregated flows hold key and counters only
 
 typedef struct FlowKey_s {
     uint64_t srcAddr[2];
@@ -221,29 +256,26 @@ typedef struct FlowKey_s {
     uint32_t proto;
 } FlowKey_t;
 
-// definitions for khash flow cache
+// definitions for the flow cache
 typedef const uint8_t *hashkey_t;  // hash key - byte sequence
 static size_t hashKeyLen = 0;      // length of hash_key
 
-static inline uint32_t SuperFastHash(const char *data, int len);
+static inline uint32_t FlowKeyHash(const void *key, size_t len) { return (uint32_t)swiss_hash_bytes(key, len); }
 
-/*
-// hash func - reduce byte sequence to kh_int
-static kh_inline khint_t __HashFunc(const FlowHashRecord_t record) {
-        return SuperFastHash((char *)record.hashkey, hashKeyLen);
-}
-*/
-#define __HashFunc(k) (k).hash
+// compare func - compare the hash key of an entry
+#define FlowEntryHash(e) ((e)->hash)
+#define FlowEntryEqual(e, k) ((e)->hash == (k)->hash && memcmp((void *)(e)->hashkey, (void *)(k)->hashkey, hashKeyLen) == 0)
 
-// compare func - compare two hash keys
-static kh_inline khint_t __HashEqual(FlowHashRecord_t r1, FlowHashRecord_t r2) {
-    return r1.hash == r2.hash && memcmp((void *)r1.hashkey, (void *)r2.hashkey, hashKeyLen) == 0;
-}
 // insert FlowHash definitions/code
-KHASH_INIT(FlowHash, FlowHashRecord_t, char, 0, __HashFunc, __HashEqual)
+SWISS_INIT(FlowHash, FlowHashRecord_t, FlowHashRecord_t, FlowEntryHash, FlowEntryEqual)
 // FlowHash var
-static khash_t(FlowHash) *FlowHash = NULL;
+static swiss_FlowHash_t *FlowHash = NULL;
 sig_atomic_t lock = 0;
+static void *keymem = NULL;  // key of the next new entry
+
+// spill the flow cache to disk, if it exceeds the memory budget aggr.maxmem
+static size_t aggrBudget = 0;
+static spill_t *flowSpill = NULL;
 
 // linear FlowList
 static struct FlowList_s {
@@ -252,6 +284,10 @@ static struct FlowList_s {
     size_t NumRecords;
 } FlowList;
 
+// output tokens, which print the aggregated counters and times
+static char *counterTokens[] = {"%ts",  "%tfs",  "%tsr",  "%te",  "%ter", "%td",  "%tds",  "%pkt",  "%ipkt",
+                                "%opkt", "%byt", "%ibyt", "%obyt", "%fl", "%pps", "%bps", "%bpp", NULL};
+
 static struct aggregate_info_s {
     aggregate_param_t *stack;
     master_record_t *mask;
@@ -270,16 +306,11 @@ static uint32_t bidir_flows = 0;
 #include "nfdump_inline.c"
 #include "nffile_inline.c"
 
-#undef get16bits
-#if (defined(__GNUC__) && defined(__i386__)) || defined(__WATCOMC__) || defined(_MSC_VER) || defined(__BORLANDC__) || defined(__TURBOC__)
-#define get16bits(d) (*((const uint16_t *)(d)))
-#endif
+static inline void New_HashKey(void *keymem, master_record_t *flow_record);
 
-#if !defined(get16bits)
-#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8) + (uint32_t)(((const uint8_t *)(d))[0]))
-#endif
+static inline int New_BidirKey(FlowKey_t *key, master_record_t *flow_record);
 
-static inline void New_HashKey(void *keymem, master_record_t *flow_record, int swap_flow);
+static inline void RestoreHashKey(master_record_t *flow_record, FlowHashRecord_t *r);
 
 static SortElement_t *GetSortList(size_t *size);
 
@@ -288,55 +319,7 @@ static master_record_t *SetAggregateMask(void);
 static inline void PrintSortList(SortElement_t *SortList, uint32_t maxindex, outputParams_t *outputParams, int GuessFlowDirection,
                                  RecordPrinter_t print_record, int ascending);
 
-static inline uint32_t SuperFastHash(const char *data, int len) {
-    uint32_t hash = len;
-
-    if (len <= 0 || data == NULL) return 0;
-
-    int rem = len & 3;
-    len >>= 2;
-
-    /* Main loop */
-    uint32_t tmp;
-    for (; len > 0; len--) {
-        hash += get16bits(data);
-        tmp = (get16bits(data + 2) << 11) ^ hash;
-        hash = (hash << 16) ^ tmp;
-        data += 2 * sizeof(uint16_t);
-        hash += hash >> 11;
-    }
-
-    /* Handle end cases */
-    switch (rem) {
-        case 3:
-            hash += get16bits(data);
-            hash ^= hash << 16;
-            hash ^= data[sizeof(uint16_t)] << 18;
-            hash += hash >> 11;
-            break;
-        case 2:
-            hash += get16bits(data);
-            hash ^= hash << 11;
-            hash += hash >> 17;
-            break;
-        case 1:
-            hash += *data;
-            hash ^= hash << 10;
-            hash += hash >> 1;
-    }
-
-    /* Force "avalanching" of final 127 bits */
-    hash ^= hash << 3;
-    hash += hash >> 5;
-    hash ^= hash << 4;
-    hash += hash >> 17;
-    hash ^= hash << 25;
-    hash += hash >> 6;
-
-    return hash;
-}
-
-static inline void New_HashKey(void *keymem, master_record_t *flow_record, int swap_flow) {
+static inline void New_HashKey(void *keymem, master_record_t *flow_record) {
     uint64_t *record = (uint64_t *)flow_record;
     FlowKey_t *keyptr;
 
@@ -378,16 +361,6 @@ static inline void New_HashKey(void *keymem, master_record_t *flow_record, int s
             }  // switch
             aggr_param++;
         }  // while
-    } else if (swap_flow) {
-        // default 5-tuple aggregation for bidirectional flows
-        keyptr = (FlowKey_t *)keymem;
-        keyptr->srcAddr[0] = flow_record->V6.dstaddr[0];
-        keyptr->srcAddr[1] = flow_record->V6.dstaddr[1];
-        keyptr->dstAddr[0] = flow_record->V6.srcaddr[0];
-        keyptr->dstAddr[1] = flow_record->V6.srcaddr[1];
-        keyptr->srcPort = flow_record->dstPort;
-        keyptr->dstPort = flow_record->srcPort;
-        keyptr->proto = flow_record->proto;
     } else {
         // default 5-tuple aggregation
         keyptr = (FlowKey_t *)keymem;
@@ -402,6 +375,44 @@ static inline void New_HashKey(void *keymem, master_record_t *flow_record, int s
 
 }  // End of New_HashKey
 
+// canonical 5-tuple key for bidirectional flows: TCP/UDP endpoints are ordered,
+// so both directions of a connection map to the same key
+// returns 1, if the endpoints of the flow record were swapped
+static inline int New_BidirKey(FlowKey_t *key, master_record_t *flow_record) {
+    uint64_t *src = flow_record->V6.srcaddr;
+    uint64_t *dst = flow_record->V6.dstaddr;
+
+    int swapped = 0;
+    if (flow_record->proto == IPPROTO_TCP || flow_record->proto == IPPROTO_UDP) {
+        if (src[0] != dst[0])
+            swapped = src[0] > dst[0];
+        else if (src[1] != dst[1])
+            swapped = src[1] > dst[1];
+        else
+            swapped = flow_record->srcPort > flow_record->dstPort;
+    }
+
+    if (swapped) {
+        key->srcAddr[0] = dst[0];
+        key->srcAddr[1] = dst[1];
+        key->dstAddr[0] = src[0];
+        key->dstAddr[1] = src[1];
+        key->srcPort = flow_record->dstPort;
+        key->dstPort = flow_record->srcPort;
+    } else {
+        key->srcAddr[0] = src[0];
+        key->srcAddr[1] = src[1];
+        key->dstAddr[0] = dst[0];
+        key->dstAddr[1] = dst[1];
+        key->srcPort = flow_record->srcPort;
+        key->dstPort = flow_record->dstPort;
+    }
+    key->proto = flow_record->proto;
+
+    return swapped;
+
+}  // End of New_BidirKey
+
 static uint64_t null_record(FlowHashRecord_t *record, int inout) { return 0; }
 
 static uint64_t flows_record(FlowHashRecord_t *record, int inout) { return record->counter[FLOWS]; }
@@ -470,6 +481,41 @@ static uint64_t tend_record(FlowHashRecord_t *record, int inout) { return record
 
 static uint64_t duration_record(FlowHashRecord_t *record, int inout) { return record->msecLast - record->msecFirst; }  // End of duration_record
 
+// reverse of New_HashKey for custom aggregations - fill in the aggregated fields
+// of a cleared master record from the key of a compact flow cache entry
+static inline void RestoreHashKey(master_record_t *flow_record, FlowHashRecord_t *r) {
+    uint64_t *record = (uint64_t *)flow_record;
+    const uint8_t *keymem = r->hashkey;
+
+    record[0] = r->recordHead;
+
+    aggregate_param_t *aggr_param = aggregate_info.stack;
+    while (aggr_param->size) {
+        uint64_t val;
+        switch (aggr_param->size) {
+            case 8:
+                val = *((uint64_t *)keymem);
+                break;
+            case 4:
+                val = *((uint32_t *)keymem);
+                break;
+            case 2:
+                val = *((uint16_t *)keymem);
+                break;
+            case 1:
+                val = *keymem;
+                break;
+            default:
+                fprintf(stderr, "Panic: Software error in %s line %d\n", __FILE__, __LINE__);
+                exit(255);
+        }  // switch
+        record[aggr_param->offset] |= (val << aggr_param->shift) & aggr_param->mask;
+        keymem += aggr_param->size;
+        aggr_param++;
+    }  // while
+
+}  // End of RestoreHashKey
+
 static master_record_t *SetAggregateMask(void) {
     master_record_t *aggr_record_mask;
 
@@ -511,8 +557,8 @@ static master_record_t *SetAggregateMask(void) {
 static SortElement_t *GetSortList(size_t *size) {
     SortElement_t *list;
 
-    size_t hashSize = kh_size(FlowHash);
-    if (hashSize) {  // aggregated flows in khash
+    size_t hashSize = swiss_size(FlowHash);
+    if (hashSize) {  // aggregated flows in the flow hash
         list = (SortElement_t *)calloc(hashSize, sizeof(SortElement_t));
         if (!list) {
             LogError("malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
@@ -521,9 +567,9 @@ static SortElement_t *GetSortList(size_t *size) {
         }
 
         int c = 0;
-        for (khiter_t k = kh_begin(FlowHash); k != kh_end(FlowHash); ++k) {  // traverse
-            if (kh_exist(FlowHash, k)) {
-                FlowHashRecord_t *r = &kh_key(FlowHash, k);
+        for (size_t k = 0; k != swiss_end(FlowHash); ++k) {  // traverse
+            if (swiss_exist(FlowHash, k)) {
+                FlowHashRecord_t *r = &swiss_entry(FlowHash, k);
                 list[c++].record = (void *)r;
             }
         }
@@ -554,12 +600,26 @@ static SortElement_t *GetSortList(size_t *size) {
 
 }  // End of GetSortList
 
+// flows are mostly time ordered, if not aggregated - merge the natural runs
+static void SortFlowList(SortElement_t *SortList, size_t maxindex) {
+    if (order_mode[PrintOrder].record_function == tstart_record || order_mode[PrintOrder].record_function == tend_record)
+        runsort((SortRecord_t *)SortList, maxindex);
+    else
+        blocksort((SortRecord_t *)SortList, maxindex);
+
+}  // End of SortFlowList
+
 int Init_FlowCache(void) {
     if (!nfalloc_Init(0)) return 0;
 
     if (!hashKeyLen) hashKeyLen = sizeof(FlowKey_t);
+    aggrBudget = SpillBudget();
 
-    FlowHash = kh_init(FlowHash);
+    FlowHash = swiss_init_FlowHash();
+    if (!FlowHash) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
 
     FlowList.head = NULL;
     FlowList.tail = &FlowList.head;
@@ -569,7 +629,259 @@ int Init_FlowCache(void) {
 
 }  // End of Init_FlowCache
 
-void Dispose_FlowTable(void) { nfalloc_free(); }  // End of Dispose_FlowTable
+void Dispose_FlowTable(void) {
+    CloseSpill(flowSpill);
+    flowSpill = NULL;
+    nfalloc_free();
+
+}  // End of Dispose_FlowTable
+
+// print the memory usage of the flow cache arena
+void PrintFlowCacheStat(FILE *stream) {
+    size_t peak, mapped;
+    unsigned numChunks, numArenas;
+    int hugePages;
+
+    nfalloc_Stat(&peak, &mapped, &numChunks, &numArenas, &hugePages);
+    if (peak == 0) return;
+
+    fprintf(stream, "Flow cache arena: peak %.1f MB, mapped %.1f MB in %u chunks, threads: %u, hugepages: %s\n",
+            (double)peak / (1024.0 * 1024.0), (double)mapped / (1024.0 * 1024.0), numChunks, numArenas,
+            hugePages == 0 ? "no" : (hugePages == 1 ? "transparent" : (hugePages == 2 ? "2MB" : "1GB")));
+
+}  // End of PrintFlowCacheStat
+
+// load and probe lengths of the flow cache and the peak memory of its arena
+void FlowCacheHashStat(swiss_stat_t *stat, size_t *arenaPeak) {
+    size_t mapped;
+    unsigned numChunks, numArenas;
+    int hugePages;
+
+    *arenaPeak = 0;
+    if (!FlowHash) return;
+    swiss_stat_FlowHash(FlowHash, stat);
+    nfalloc_Stat(arenaPeak, &mapped, &numChunks, &numArenas, &hugePages);
+
+}  // End of FlowCacheHashStat
+
+// drop all entries of the flow cache
+static void ResetFlowCache(void) {
+    swiss_destroy_FlowHash(FlowHash);
+    nfalloc_Reset();
+    keymem = NULL;
+
+    FlowHash = swiss_init_FlowHash();
+    if (!FlowHash) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
+
+}  // End of ResetFlowCache
+
+// memory used by the flow cache - a table about to grow needs the old and the new table
+static inline size_t FlowCacheMemory(void) {
+    size_t table = swiss_end(FlowHash) * (sizeof(FlowHashRecord_t) + 1);
+    if (swiss_grows(FlowHash)) table *= 3;
+    return nfalloc_Size() + table;
+
+}  // End of FlowCacheMemory
+
+static inline int FlowCacheFull(void) {
+    return aggrBudget && swiss_size(FlowHash) >= SPILLMINENTRIES && FlowCacheMemory() > aggrBudget;
+
+}  // End of FlowCacheFull
+
+// pack a flow cache entry into buff as spill record - returns the size of the record
+static uint32_t PackSpillRecord(FlowHashRecord_t *r, void **buff, size_t *buffSize) {
+    uint32_t recordSize = compactAggregation ? 0 : r->flowrecord->size;
+    size_t size = sizeof(spillRecord_t) + hashKeyLen + recordSize;
+    if (size > *buffSize) {
+        void *p = realloc(*buff, size);
+        if (!p) {
+            LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            exit(255);
+        }
+        *buff = p;
+        *buffSize = size;
+    }
+
+    spillRecord_t *spillRecord = (spillRecord_t *)*buff;
+    memset((void *)spillRecord, 0, sizeof(spillRecord_t));
+    memcpy((void *)spillRecord->counter, (void *)r->counter, sizeof(r->counter));
+    spillRecord->msecFirst = r->msecFirst;
+    spillRecord->msecLast = r->msecLast;
+    spillRecord->hash = r->hash;
+    spillRecord->size = recordSize;
+    spillRecord->inFlags = r->inFlags;
+    spillRecord->outFlags = r->outFlags;
+    spillRecord->swapped = r->swapped;
+
+    void *p = *buff + sizeof(spillRecord_t);
+    memcpy(p, (void *)r->hashkey, hashKeyLen);
+    if (recordSize)
+        memcpy(p + hashKeyLen, (void *)r->flowrecord, recordSize);
+    else
+        spillRecord->recordHead = r->recordHead;
+
+    return size;
+
+}  // End of PackSpillRecord
+
+// map a spill record to a flow cache entry - key and flow record point into data
+static void UnpackSpillRecord(void *data, FlowHashRecord_t *r) {
+    spillRecord_t *spillRecord = (spillRecord_t *)data;
+
+    memcpy((void *)r->counter, (void *)spillRecord->counter, sizeof(r->counter));
+    r->msecFirst = spillRecord->msecFirst;
+    r->msecLast = spillRecord->msecLast;
+    r->hash = spillRecord->hash;
+    r->inFlags = spillRecord->inFlags;
+    r->outFlags = spillRecord->outFlags;
+    r->swapped = spillRecord->swapped;
+    r->hashkey = data + sizeof(spillRecord_t);
+    if (spillRecord->size)
+        r->flowrecord = data + sizeof(spillRecord_t) + hashKeyLen;
+    else
+        r->recordHead = spillRecord->recordHead;
+
+}  // End of UnpackSpillRecord
+
+// write all entries of the flow cache into the partitions of spill and reset the cache
+static int SpillFlowCache(spill_t *spill) {
+    size_t buffSize = 0;
+    void *buff = NULL;
+
+    dbg_printf("Spill %zu flows at level %d\n", swiss_size(FlowHash), SpillLevel(spill));
+    for (size_t k = 0; k != swiss_end(FlowHash); ++k) {
+        if (!swiss_exist(FlowHash, k)) continue;
+        FlowHashRecord_t *r = &swiss_entry(FlowHash, k);
+        uint32_t size = PackSpillRecord(r, &buff, &buffSize);
+        if (!WriteSpill(spill, r->hash, buff, size)) {
+            free(buff);
+            return 0;
+        }
+    }
+    free(buff);
+    ResetFlowCache();
+
+    return 1;
+
+}  // End of SpillFlowCache
+
+// check the memory budget after a new entry
+static inline void CheckFlowCache(void) {
+    if (!FlowCacheFull()) return;
+
+    if (!flowSpill) {
+        flowSpill = OpenSpill(0);
+        if (!flowSpill) exit(255);
+        LogVerbose("Flow cache exceeds memory budget of %zu MB - spill to disk", aggrBudget / (1024 * 1024));
+    }
+    if (!SpillFlowCache(flowSpill)) exit(255);
+
+}  // End of CheckFlowCache
+
+// merge the counters of a flow into an entry - reverse, if the endpoints are swapped
+static inline void MergeFlowCounter(FlowHashRecord_t *record, FlowHashRecord_t *r) {
+    if (record->swapped != r->swapped) {
+        record->counter[INBYTES] += r->counter[OUTBYTES];
+        record->counter[INPACKETS] += r->counter[OUTPACKETS];
+        record->counter[OUTBYTES] += r->counter[INBYTES];
+        record->counter[OUTPACKETS] += r->counter[INPACKETS];
+        record->inFlags |= r->outFlags;
+        record->outFlags |= r->inFlags;
+    } else {
+        record->counter[INBYTES] += r->counter[INBYTES];
+        record->counter[INPACKETS] += r->counter[INPACKETS];
+        record->counter[OUTBYTES] += r->counter[OUTBYTES];
+        record->counter[OUTPACKETS] += r->counter[OUTPACKETS];
+        record->inFlags |= r->inFlags;
+        record->outFlags |= r->outFlags;
+    }
+    record->counter[FLOWS] += r->counter[FLOWS];
+
+    if (r->msecFirst < record->msecFirst) {
+        record->msecFirst = r->msecFirst;
+    }
+    if (r->msecLast > record->msecLast) {
+        record->msecLast = r->msecLast;
+    }
+
+}  // End of MergeFlowCounter
+
+typedef struct spillMerge_s {
+    int level;
+    spill_t *sub;  // spill set of the next level, if the partition exceeds the budget
+} spillMerge_t;
+
+// merge a spill record into the flow cache
+static int MergeSpillRecord(void *data, uint32_t size, void *arg) {
+    spillMerge_t *spillMerge = (spillMerge_t *)arg;
+
+    FlowHashRecord_t r;
+    UnpackSpillRecord(data, &r);
+
+    int ret;
+    size_t k = swiss_put_FlowHash(FlowHash, &r, r.hash, &ret);
+    if (ret < 0) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    FlowHashRecord_t *record = &swiss_entry(FlowHash, k);
+    if (ret == 0) {
+        MergeFlowCounter(record, &r);
+        return 1;
+    }
+
+    *record = r;
+    record->hashkey = nfmalloc(hashKeyLen);
+    memcpy((void *)record->hashkey, (void *)r.hashkey, hashKeyLen);
+    if (!compactAggregation) {
+        void *p = nfmalloc(r.flowrecord->size);
+        memcpy(p, (void *)r.flowrecord, r.flowrecord->size);
+        record->flowrecord = p;
+    }
+
+    if (spillMerge->level + 1 < SPILLMAXLEVEL && FlowCacheFull()) {
+        if (!spillMerge->sub) spillMerge->sub = OpenSpill(spillMerge->level + 1);
+        if (!spillMerge->sub || !SpillFlowCache(spillMerge->sub)) return 0;
+    }
+
+    return 1;
+
+}  // End of MergeSpillRecord
+
+// aggregate the partitions of a spill set one by one and call func for each of them
+static int ProcessFlowSpill(spill_t *spill, partitionFunc_t func, void *arg) {
+    for (int p = 0; p < SPILLPARTITIONS; p++) {
+        ResetFlowCache();
+
+        spillMerge_t spillMerge = {.level = SpillLevel(spill), .sub = NULL};
+        int ok = ReadSpill(spill, p, MergeSpillRecord, &spillMerge);
+        if (ok && spillMerge.sub) {
+            // partition too large - split it by the next level
+            ok = SpillFlowCache(spillMerge.sub) && ProcessFlowSpill(spillMerge.sub, func, arg);
+        } else if (ok && swiss_size(FlowHash)) {
+            ok = func(arg);
+        }
+        CloseSpill(spillMerge.sub);
+        if (!ok) return 0;
+    }
+    ResetFlowCache();
+
+    return 1;
+
+}  // End of ProcessFlowSpill
+
+// process the spilled flow cache - the remaining entries are spilled first
+static int ProcessSpilledFlows(partitionFunc_t func, void *arg) {
+    int ok = SpillFlowCache(flowSpill) && ProcessFlowSpill(flowSpill, func, arg);
+    CloseSpill(flowSpill);
+    flowSpill = NULL;
+
+    return ok;
+
+}  // End of ProcessSpilledFlows
 
 // Parse flow cache print order -O
 int Parse_PrintOrder(char *order) {
@@ -812,6 +1124,39 @@ char *ParseAggregateMask(char *arg, int hasGeoDB) {
     return aggr_fmt;
 }  // End of ParseAggregateMask
 
+// aggregated flows need not to keep a copy of the first flow record, if the output
+// is reconstructed from the aggregation key and the counters only. This requires a
+// custom aggregation and an output format, which prints aggregated fields only.
+int SetCompactAggregation(void) {
+    if (!aggregate_info.stack || bidir_flows || doGeoLookup) return 0;
+
+    int numTokens = 0;
+    while (counterTokens[numTokens]) numTokens++;
+    for (int i = 0; aggregate_table[i].aggregate_token != NULL; i++) {
+        if (aggregate_table[i].active && aggregate_table[i].fmt) numTokens++;
+    }
+
+    char **tokens = calloc(numTokens + 1, sizeof(char *));
+    if (!tokens) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    int j = 0;
+    for (int i = 0; counterTokens[i]; i++) tokens[j++] = counterTokens[i];
+    for (int i = 0; aggregate_table[i].aggregate_token != NULL; i++) {
+        if (aggregate_table[i].active && aggregate_table[i].fmt) tokens[j++] = aggregate_table[i].fmt;
+    }
+    tokens[j] = NULL;
+
+    compactAggregation = FormatUsesOnly(tokens);
+    free(tokens);
+
+    dbg_printf("Compact aggregation: %u\n", compactAggregation);
+    return compactAggregation;
+
+}  // End of SetCompactAggregation
+
 int SetBidirAggregation(void) {
     if (aggregate_info.stack) {
         LogError("Can not set bidir mode with custom aggregation mask");
@@ -841,6 +1186,7 @@ void InsertFlow(void *raw_record, master_record_t *flow_record) {
     record->counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
     record->inFlags = flow_record->tcp_flags;
     record->outFlags = 0;
+    record->swapped = 0;
     FlowList.NumRecords++;
 
     record->next = NULL;
@@ -851,126 +1197,76 @@ void InsertFlow(void *raw_record, master_record_t *flow_record) {
 
 static void AddBidirFlow(void *raw_record, master_record_t *flow_record) {
     recordHeaderV3_t *record = (recordHeaderV3_t *)raw_record;
-    static void *keymem = NULL;
-    static void *bidirkeymem = NULL;
-    FlowHashRecord_t r;
 
-    if (keymem == NULL) {
-        keymem = nfmalloc(hashKeyLen);
-    }
-    New_HashKey(keymem, flow_record, 0);
-    uint32_t forwardHash = SuperFastHash(keymem, hashKeyLen);
-    r.hashkey = keymem;
-    r.hash = forwardHash;
+    // the key lives on the stack for the lookup - one hash and one probe for both directions
+    FlowKey_t key;
+    int swapped = New_BidirKey(&key, flow_record);
+
+    FlowHashRecord_t r;
+    r.hashkey = (uint8_t *)&key;
+    r.hash = FlowKeyHash(&key, sizeof(FlowKey_t));
 
     int ret;
-    khiter_t k = kh_get(FlowHash, FlowHash, r);
-    if (k != kh_end(FlowHash)) {
-        // flow record found - best case! update all fields
-        kh_key(FlowHash, k).counter[INBYTES] += flow_record->inBytes;
-        kh_key(FlowHash, k).counter[INPACKETS] += flow_record->inPackets;
-        kh_key(FlowHash, k).counter[OUTBYTES] += flow_record->out_bytes;
-        kh_key(FlowHash, k).counter[OUTPACKETS] += flow_record->out_pkts;
-        kh_key(FlowHash, k).inFlags |= flow_record->tcp_flags;
-
-        if (flow_record->msecFirst < kh_key(FlowHash, k).msecFirst) {
-            kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
-        }
-        if (flow_record->msecLast > kh_key(FlowHash, k).msecLast) {
-            kh_key(FlowHash, k).msecLast = flow_record->msecLast;
+    size_t k = swiss_put_FlowHash(FlowHash, &r, r.hash, &ret);
+    if (ret < 0) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
+    FlowHashRecord_t *entry = &swiss_entry(FlowHash, k);
+    if (ret == 0) {
+        if (entry->swapped == swapped) {
+            // flow record found in the same direction - update all fields
+            entry->counter[INBYTES] += flow_record->inBytes;
+            entry->counter[INPACKETS] += flow_record->inPackets;
+            entry->counter[OUTBYTES] += flow_record->out_bytes;
+            entry->counter[OUTPACKETS] += flow_record->out_pkts;
+            entry->inFlags |= flow_record->tcp_flags;
+        } else {
+            // flow record found in reverse direction - update all fields in reverse direction
+            entry->counter[OUTBYTES] += flow_record->inBytes;
+            entry->counter[OUTPACKETS] += flow_record->inPackets;
+            entry->counter[INBYTES] += flow_record->out_bytes;
+            entry->counter[INPACKETS] += flow_record->out_pkts;
+            entry->outFlags |= flow_record->tcp_flags;
         }
 
-        kh_key(FlowHash, k).counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-    } else if (flow_record->proto != IPPROTO_TCP && flow_record->proto != IPPROTO_UDP) {
-        // no flow record found and no TCP/UDP bidir flows. Insert flow record into hash
-        k = kh_put(FlowHash, FlowHash, r, &ret);
-        kh_key(FlowHash, k).counter[INBYTES] = flow_record->inBytes;
-        kh_key(FlowHash, k).counter[INPACKETS] = flow_record->inPackets;
-        kh_key(FlowHash, k).counter[OUTBYTES] = flow_record->out_bytes;
-        kh_key(FlowHash, k).counter[OUTPACKETS] = flow_record->out_pkts;
-        kh_key(FlowHash, k).counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-        kh_key(FlowHash, k).inFlags = flow_record->tcp_flags;
-        kh_key(FlowHash, k).outFlags = 0;
-
-        kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
-        kh_key(FlowHash, k).msecLast = flow_record->msecLast;
-
-        void *p = malloc(record->size);
-        if (!p) {
-            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
-            exit(255);
+        if (flow_record->msecFirst < entry->msecFirst) {
+            entry->msecFirst = flow_record->msecFirst;
         }
-        memcpy((void *)p, raw_record, record->size);
-        kh_key(FlowHash, k).flowrecord = p;
-
-        // keymen got part of the cache
-        keymem = NULL;
-    } else {
-        // for bidir flows do
-
-        // generate reverse hash key to search for bidir flow
-        // we need it only to lookup
-        if (bidirkeymem == NULL) {
-            bidirkeymem = nfmalloc(hashKeyLen);
+        if (flow_record->msecLast > entry->msecLast) {
+            entry->msecLast = flow_record->msecLast;
         }
 
-        // generate the hash key for reverse record (bidir)
-        New_HashKey(bidirkeymem, flow_record, 1);
-        r.hashkey = bidirkeymem;
-        r.hash = SuperFastHash(bidirkeymem, hashKeyLen);
-
-        k = kh_get(FlowHash, FlowHash, r);
-        if (k != kh_end(FlowHash)) {
-            // we found a corresponding flow - so update all fields in reverse direction
-            kh_key(FlowHash, k).counter[OUTBYTES] += flow_record->inBytes;
-            kh_key(FlowHash, k).counter[OUTPACKETS] += flow_record->inPackets;
-            kh_key(FlowHash, k).counter[INBYTES] += flow_record->out_bytes;
-            kh_key(FlowHash, k).counter[INPACKETS] += flow_record->out_pkts;
-            kh_key(FlowHash, k).outFlags |= flow_record->tcp_flags;
-
-            if (flow_record->msecFirst < kh_key(FlowHash, k).msecFirst) {
-                kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
-            }
-            if (flow_record->msecLast > kh_key(FlowHash, k).msecLast) {
-                kh_key(FlowHash, k).msecLast = flow_record->msecLast;
-            }
+        entry->counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+    } else {
+        // new flow - the cache needs its own copy of the key
+        entry->hashkey = nfmalloc(sizeof(FlowKey_t));
+        memcpy((void *)entry->hashkey, (void *)&key, sizeof(FlowKey_t));
+        entry->hash = r.hash;
+
+        entry->counter[INBYTES] = flow_record->inBytes;
+        entry->counter[INPACKETS] = flow_record->inPackets;
+        entry->counter[OUTBYTES] = flow_record->out_bytes;
+        entry->counter[OUTPACKETS] = flow_record->out_pkts;
+        entry->counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+        entry->inFlags = flow_record->tcp_flags;
+        entry->outFlags = 0;
+        entry->swapped = swapped;
+
+        entry->msecFirst = flow_record->msecFirst;
+        entry->msecLast = flow_record->msecLast;
 
-            kh_key(FlowHash, k).counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-        } else {
-            // no bidir flow found
-            // insert original flow into the cache
-            r.hashkey = keymem;
-            r.hash = forwardHash;
-            k = kh_put(FlowHash, FlowHash, r, &ret);
-            kh_key(FlowHash, k).counter[INBYTES] = flow_record->inBytes;
-            kh_key(FlowHash, k).counter[INPACKETS] = flow_record->inPackets;
-            kh_key(FlowHash, k).counter[OUTBYTES] = flow_record->out_bytes;
-            kh_key(FlowHash, k).counter[OUTPACKETS] = flow_record->out_pkts;
-            kh_key(FlowHash, k).counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-            kh_key(FlowHash, k).inFlags = flow_record->tcp_flags;
-            kh_key(FlowHash, k).outFlags = 0;
-
-            kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
-            kh_key(FlowHash, k).msecLast = flow_record->msecLast;
-
-            void *p = malloc(record->size);
-            if (!p) {
-                LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
-                exit(255);
-            }
-            memcpy((void *)p, raw_record, record->size);
-            kh_key(FlowHash, k).flowrecord = p;
+        void *p = nfmalloc(record->size);
+        memcpy((void *)p, raw_record, record->size);
+        entry->flowrecord = p;
 
-            // keymen got part of the cache
-            keymem = NULL;
-        }
+        CheckFlowCache();
     }
 
 }  // End of AddBidirFlow
 
 void AddFlowCache(void *raw_record, master_record_t *flow_record) {
     recordHeaderV3_t *record = (recordHeaderV3_t *)raw_record;
-    static void *keymem = NULL;
     FlowHashRecord_t r;
 
     if (doGeoLookup && TestFlag(flow_record->mflags, V3_FLAG_ENRICHED) == 0) {
@@ -985,57 +1281,255 @@ void AddFlowCache(void *raw_record, master_record_t *flow_record) {
     if (keymem == NULL) {
         keymem = nfmalloc(hashKeyLen);
     }
-    New_HashKey(keymem, flow_record, 0);
+    New_HashKey(keymem, flow_record);
     r.hashkey = keymem;
-    r.hash = SuperFastHash(keymem, hashKeyLen);
-    // r.hash = (uint32_t)flow_record->dstPort << 16 | flow_record->srcPort;
+    r.hash = FlowKeyHash(keymem, hashKeyLen);
 
     int ret;
-    khiter_t k = kh_put(FlowHash, FlowHash, r, &ret);
+    size_t k = swiss_put_FlowHash(FlowHash, &r, r.hash, &ret);
+    if (ret < 0) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
     if (ret == 0) {
         // flow record found - best case! update all fields
-        kh_key(FlowHash, k).counter[INBYTES] += flow_record->inBytes;
-        kh_key(FlowHash, k).counter[INPACKETS] += flow_record->inPackets;
-        kh_key(FlowHash, k).counter[OUTBYTES] += flow_record->out_bytes;
-        kh_key(FlowHash, k).counter[OUTPACKETS] += flow_record->out_pkts;
-        kh_key(FlowHash, k).inFlags |= flow_record->tcp_flags;
-
-        if (flow_record->msecFirst < kh_key(FlowHash, k).msecFirst) {
-            kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
+        swiss_entry(FlowHash, k).counter[INBYTES] += flow_record->inBytes;
+        swiss_entry(FlowHash, k).counter[INPACKETS] += flow_record->inPackets;
+        swiss_entry(FlowHash, k).counter[OUTBYTES] += flow_record->out_bytes;
+        swiss_entry(FlowHash, k).counter[OUTPACKETS] += flow_record->out_pkts;
+        swiss_entry(FlowHash, k).inFlags |= flow_record->tcp_flags;
+
+        if (flow_record->msecFirst < swiss_entry(FlowHash, k).msecFirst) {
+            swiss_entry(FlowHash, k).msecFirst = flow_record->msecFirst;
         }
-        if (flow_record->msecLast > kh_key(FlowHash, k).msecLast) {
-            kh_key(FlowHash, k).msecLast = flow_record->msecLast;
+        if (flow_record->msecLast > swiss_entry(FlowHash, k).msecLast) {
+            swiss_entry(FlowHash, k).msecLast = flow_record->msecLast;
         }
 
-        kh_key(FlowHash, k).counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+        swiss_entry(FlowHash, k).counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
     } else {
         // no flow record found and no TCP/UDP bidir flows. Insert flow record into hash
-        kh_key(FlowHash, k).counter[INBYTES] = flow_record->inBytes;
-        kh_key(FlowHash, k).counter[INPACKETS] = flow_record->inPackets;
-        kh_key(FlowHash, k).counter[OUTBYTES] = flow_record->out_bytes;
-        kh_key(FlowHash, k).counter[OUTPACKETS] = flow_record->out_pkts;
-        kh_key(FlowHash, k).counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-        kh_key(FlowHash, k).inFlags = flow_record->tcp_flags;
-        kh_key(FlowHash, k).outFlags = 0;
+        swiss_entry(FlowHash, k) = r;
+        swiss_entry(FlowHash, k).counter[INBYTES] = flow_record->inBytes;
+        swiss_entry(FlowHash, k).counter[INPACKETS] = flow_record->inPackets;
+        swiss_entry(FlowHash, k).counter[OUTBYTES] = flow_record->out_bytes;
+        swiss_entry(FlowHash, k).counter[OUTPACKETS] = flow_record->out_pkts;
+        swiss_entry(FlowHash, k).counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+        swiss_entry(FlowHash, k).inFlags = flow_record->tcp_flags;
+        swiss_entry(FlowHash, k).outFlags = 0;
+        swiss_entry(FlowHash, k).swapped = 0;
+
+        swiss_entry(FlowHash, k).msecFirst = flow_record->msecFirst;
+        swiss_entry(FlowHash, k).msecLast = flow_record->msecLast;
+
+        if (compactAggregation) {
+            // flags and version - all other fields are restored from the key
+            swiss_entry(FlowHash, k).recordHead = ((uint64_t *)flow_record)[0];
+        } else {
+            void *p = nfmalloc(record->size);
+            memcpy((void *)p, raw_record, record->size);
+            swiss_entry(FlowHash, k).flowrecord = p;
+        }
 
-        kh_key(FlowHash, k).msecFirst = flow_record->msecFirst;
-        kh_key(FlowHash, k).msecLast = flow_record->msecLast;
+        // keymen got part of the cache
+        keymem = NULL;
 
-        void *p = nfmalloc(record->size);
-        memcpy((void *)p, raw_record, record->size);
-        kh_key(FlowHash, k).flowrecord = p;
+        CheckFlowCache();
+    }
+
+}  // End of AddFlow
+
+// write all flow cache entries as partial aggregation records
+static int ExportFlowPartial(void *arg) {
+    FILE *fp = (FILE *)arg;
+    size_t buffSize = 4096;
+    void *buff = malloc(buffSize);
+    if (!buff) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    for (size_t k = 0; k != swiss_end(FlowHash); ++k) {
+        if (!swiss_exist(FlowHash, k)) continue;
+        FlowHashRecord_t *r = &swiss_entry(FlowHash, k);
+
+        size_t size = sizeof(flowCounter_t) + r->flowrecord->size;
+        if (size > buffSize) {
+            buffSize = size;
+            void *p = realloc(buff, buffSize);
+            if (!p) {
+                LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                free(buff);
+                return 0;
+            }
+            buff = p;
+        }
+
+        flowCounter_t *flowCounter = (flowCounter_t *)buff;
+        memcpy((void *)flowCounter->counter, (void *)r->counter, sizeof(r->counter));
+        flowCounter->msecFirst = r->msecFirst;
+        flowCounter->msecLast = r->msecLast;
+        flowCounter->inFlags = r->inFlags;
+        flowCounter->outFlags = r->outFlags;
+        flowCounter->fill = 0;
+        memcpy(buff + sizeof(flowCounter_t), (void *)r->flowrecord, r->flowrecord->size);
+
+        if (!WritePartial(fp, PARTIAL_FLOW, 0, buff, size)) {
+            free(buff);
+            return 0;
+        }
+    }
+    free(buff);
+
+    return 1;
+
+}  // End of ExportFlowPartial
+
+int ExportFlowCache(FILE *fp) {
+    if (flowSpill) return ProcessSpilledFlows(ExportFlowPartial, fp);
+    return ExportFlowPartial(fp);
+
+}  // End of ExportFlowCache
+
+// merge a partial aggregation record into the flow cache
+int ImportFlowCache(void *data, uint32_t size) {
+    flowCounter_t *flowCounter = (flowCounter_t *)data;
+    recordHeaderV3_t *raw_record = (recordHeaderV3_t *)(data + sizeof(flowCounter_t));
+    if (size < (sizeof(flowCounter_t) + sizeof(recordHeaderV3_t)) || size != (sizeof(flowCounter_t) + raw_record->size)) {
+        LogError("Corrupt partial flow record");
+        return 0;
+    }
+
+    master_record_t flow_record;
+    memset((void *)&flow_record, 0, sizeof(master_record_t));
+    ExpandRecord_v3(raw_record, &flow_record);
+    if (doGeoLookup) {
+        LookupCountry(flow_record.V6.srcaddr, flow_record.src_geo);
+        LookupCountry(flow_record.V6.dstaddr, flow_record.dst_geo);
+        if (flow_record.srcas == 0) flow_record.srcas = LookupAS(flow_record.V6.srcaddr);
+        if (flow_record.dstas == 0) flow_record.dstas = LookupAS(flow_record.V6.dstaddr);
+        SetFlag(flow_record.mflags, V3_FLAG_ENRICHED);
+    }
+
+    if (keymem == NULL) {
+        keymem = nfmalloc(hashKeyLen);
+    }
+    // the reverse flow may have been aggregated by another worker - the canonical key finds both
+    int swapped = 0;
+    if (bidir_flows)
+        swapped = New_BidirKey((FlowKey_t *)keymem, &flow_record);
+    else
+        New_HashKey(keymem, &flow_record);
+
+    FlowHashRecord_t r;
+    r.hashkey = keymem;
+    r.hash = FlowKeyHash(keymem, hashKeyLen);
+
+    int ret;
+    size_t k = swiss_put_FlowHash(FlowHash, &r, r.hash, &ret);
+    if (ret < 0) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    FlowHashRecord_t *record = &swiss_entry(FlowHash, k);
+    if (ret == 0) {
+        if (record->swapped != swapped) {
+            record->counter[INBYTES] += flowCounter->counter[OUTBYTES];
+            record->counter[INPACKETS] += flowCounter->counter[OUTPACKETS];
+            record->counter[OUTBYTES] += flowCounter->counter[INBYTES];
+            record->counter[OUTPACKETS] += flowCounter->counter[INPACKETS];
+            record->inFlags |= flowCounter->outFlags;
+            record->outFlags |= flowCounter->inFlags;
+        } else {
+            record->counter[INBYTES] += flowCounter->counter[INBYTES];
+            record->counter[INPACKETS] += flowCounter->counter[INPACKETS];
+            record->counter[OUTBYTES] += flowCounter->counter[OUTBYTES];
+            record->counter[OUTPACKETS] += flowCounter->counter[OUTPACKETS];
+            record->inFlags |= flowCounter->inFlags;
+            record->outFlags |= flowCounter->outFlags;
+        }
+        record->counter[FLOWS] += flowCounter->counter[FLOWS];
+
+        if (flowCounter->msecFirst < record->msecFirst) {
+            record->msecFirst = flowCounter->msecFirst;
+        }
+        if (flowCounter->msecLast > record->msecLast) {
+            record->msecLast = flowCounter->msecLast;
+        }
+    } else {
+        *record = r;
+        memcpy((void *)record->counter, (void *)flowCounter->counter, sizeof(record->counter));
+        record->inFlags = flowCounter->inFlags;
+        record->outFlags = flowCounter->outFlags;
+        record->swapped = swapped;
+        record->msecFirst = flowCounter->msecFirst;
+        record->msecLast = flowCounter->msecLast;
+
+        void *p = nfmalloc(raw_record->size);
+        memcpy(p, (void *)raw_record, raw_record->size);
+        record->flowrecord = p;
 
         // keymen got part of the cache
         keymem = NULL;
+
+        CheckFlowCache();
     }
 
-}  // End of AddFlow
+    return 1;
 
-// print SortList - apply possible aggregation mask to zero out aggregated fields
-static inline void PrintSortList(SortElement_t *SortList, uint32_t maxindex, outputParams_t *outputParams, int GuessFlowDirection,
-                                 RecordPrinter_t print_record, int ascending) {
+}  // End of ImportFlowCache
+
+// print a flow cache entry - apply possible aggregation mask to zero out aggregated fields
+static void PrintFlowRecord(FlowHashRecord_t *r, outputParams_t *outputParams, int GuessFlowDirection, RecordPrinter_t print_record) {
     master_record_t *aggr_record_mask = aggregate_info.mask;
 
+    master_record_t flow_record;
+    memset((void *)&flow_record, 0, sizeof(master_record_t));
+    if (compactAggregation) {
+        RestoreHashKey(&flow_record, r);
+    } else {
+        ExpandRecord_v3(r->flowrecord, &flow_record);
+    }
+
+    if (doGeoLookup) {
+        LookupCountry(flow_record.V6.srcaddr, flow_record.src_geo);
+        LookupCountry(flow_record.V6.dstaddr, flow_record.dst_geo);
+        if (flow_record.srcas == 0) flow_record.srcas = LookupAS(flow_record.V6.srcaddr);
+        if (flow_record.dstas == 0) flow_record.dstas = LookupAS(flow_record.V6.dstaddr);
+        SetFlag(flow_record.mflags, V3_FLAG_ENRICHED);
+    }
+    flow_record.inPackets = r->counter[INPACKETS];
+    flow_record.inBytes = r->counter[INBYTES];
+    flow_record.out_pkts = r->counter[OUTPACKETS];
+    flow_record.out_bytes = r->counter[OUTBYTES];
+    flow_record.aggr_flows = r->counter[FLOWS];
+    flow_record.msecFirst = r->msecFirst;
+    flow_record.msecLast = r->msecLast;
+    flow_record.tcp_flags = r->inFlags;
+    flow_record.revTcpFlags = r->outFlags;
+
+    // apply IP mask from aggregation, to provide a pretty output
+    // a restored key has all masks already applied
+    if (aggregate_info.has_masks && !compactAggregation) {
+        flow_record.V6.srcaddr[0] &= aggregate_info.IPmask[0];
+        flow_record.V6.srcaddr[1] &= aggregate_info.IPmask[1];
+        flow_record.V6.dstaddr[0] &= aggregate_info.IPmask[2];
+        flow_record.V6.dstaddr[1] &= aggregate_info.IPmask[3];
+    }
+
+    if (aggregate_info.apply_netbits && !compactAggregation) ApplyNetMaskBits(&flow_record, aggregate_info.apply_netbits);
+
+    if (aggr_record_mask) ApplyAggrMask(&flow_record, aggr_record_mask);
+
+    if (NeedSwap(GuessFlowDirection, &flow_record)) SwapFlow(&flow_record);
+
+    print_record(stdout, &flow_record, outputParams->doTag);
+
+}  // End of PrintFlowRecord
+
+// print SortList
+static inline void PrintSortList(SortElement_t *SortList, uint32_t maxindex, outputParams_t *outputParams, int GuessFlowDirection,
+                                 RecordPrinter_t print_record, int ascending) {
     int max = maxindex;
     if (outputParams->topN && outputParams->topN < maxindex) max = outputParams->topN;
     for (int i = 0; i < max; i++) {
@@ -1046,53 +1540,111 @@ static inline void PrintSortList(SortElement_t *SortList, uint32_t maxindex, out
         else
             j = maxindex - 1 - i;
 
-        FlowHashRecord_t *r = (FlowHashRecord_t *)(SortList[j].record);
-        recordHeaderV3_t *_raw_record = (r->flowrecord);
+        PrintFlowRecord((FlowHashRecord_t *)(SortList[j].record), outputParams, GuessFlowDirection, print_record);
+    }
 
-        master_record_t flow_record;
-        memset((void *)&flow_record, 0, sizeof(master_record_t));
-        ExpandRecord_v3(_raw_record, &flow_record);
+}  // End of PrintSortList
 
-        if (doGeoLookup) {
-            LookupCountry(flow_record.V6.srcaddr, flow_record.src_geo);
-            LookupCountry(flow_record.V6.dstaddr, flow_record.dst_geo);
-            if (flow_record.srcas == 0) flow_record.srcas = LookupAS(flow_record.V6.srcaddr);
-            if (flow_record.dstas == 0) flow_record.dstas = LookupAS(flow_record.V6.dstaddr);
-            SetFlag(flow_record.mflags, V3_FLAG_ENRICHED);
-        }
-        flow_record.inPackets = r->counter[INPACKETS];
-        flow_record.inBytes = r->counter[INBYTES];
-        flow_record.out_pkts = r->counter[OUTPACKETS];
-        flow_record.out_bytes = r->counter[OUTBYTES];
-        flow_record.aggr_flows = r->counter[FLOWS];
-        flow_record.msecFirst = r->msecFirst;
-        flow_record.msecLast = r->msecLast;
-        flow_record.tcp_flags = r->inFlags;
-        flow_record.revTcpFlags = r->outFlags;
-
-        // apply IP mask from aggregation, to provide a pretty output
-        if (aggregate_info.has_masks) {
-            flow_record.V6.srcaddr[0] &= aggregate_info.IPmask[0];
-            flow_record.V6.srcaddr[1] &= aggregate_info.IPmask[1];
-            flow_record.V6.dstaddr[0] &= aggregate_info.IPmask[2];
-            flow_record.V6.dstaddr[1] &= aggregate_info.IPmask[3];
-        }
+// export a flow cache entry - apply possible aggregation mask to zero out aggregated fields
+static int ExportFlowRecord(FlowHashRecord_t *r, nffile_t *nffile, int GuessFlowDirection) {
+    void *extensionList[MAXEXTENSIONS] = {0};
+
+    recordHeaderV3_t *recordHeaderV3 = (r->flowrecord);
+    elementHeader_t *elementHeader = (elementHeader_t *)((void *)recordHeaderV3 + sizeof(recordHeaderV3_t));
+    // map all extensions
+    for (int i = 0; i < recordHeaderV3->numElements; i++) {
+        extensionList[elementHeader->type] = (void *)elementHeader + sizeof(elementHeader_t);
+        elementHeader = (elementHeader_t *)((void *)elementHeader + elementHeader->length);
+    }
+
+    // check if cntFlowID exists
+    int needSwap = 0;
+    EXgenericFlow_t *genericFlow = (EXgenericFlow_t *)extensionList[EXgenericFlowID];
+    if (genericFlow != NULL) {
+        needSwap = NeedSwap(GuessFlowDirection, genericFlow);
+    }
 
-        if (aggregate_info.apply_netbits) ApplyNetMaskBits(&flow_record, aggregate_info.apply_netbits);
+    int exCntSize = 0;
+    EXcntFlow_t *cntFlow = (EXcntFlow_t *)extensionList[EXcntFlowID];
+    if ((r->counter[OUTPACKETS] || r->counter[OUTBYTES] || r->counter[FLOWS] != 1) && cntFlow == NULL) {
+        exCntSize = EXcntFlowSize;
+    }
 
-        if (aggr_record_mask) ApplyAggrMask(&flow_record, aggr_record_mask);
+    if (!CheckBufferSpace(nffile, recordHeaderV3->size + exCntSize)) {
+        return 0;
+    }
 
-        if (NeedSwap(GuessFlowDirection, &flow_record)) SwapFlow(&flow_record);
+    // write record
+    memcpy(nffile->buff_ptr, (void *)recordHeaderV3, recordHeaderV3->size);
+    recordHeaderV3 = nffile->buff_ptr;
 
-        print_record(stdout, &flow_record, outputParams->doTag);
+    if (exCntSize) {
+        PushExtension(recordHeaderV3, EXcntFlow, cntFlow);
+        nffile->buff_ptr += recordHeaderV3->size;
+        nffile->block_header->size += recordHeaderV3->size;
+    } else {
+        nffile->buff_ptr += recordHeaderV3->size;
+        nffile->block_header->size += recordHeaderV3->size;
+    }
+    nffile->block_header->NumRecords++;
+
+    memset((void *)extensionList, 0, sizeof(extensionList));
+    // remap extension od written record
+    elementHeader = (elementHeader_t *)((void *)recordHeaderV3 + sizeof(recordHeaderV3_t));
+    for (int i = 0; i < recordHeaderV3->numElements; i++) {
+        extensionList[elementHeader->type] = (void *)elementHeader + sizeof(elementHeader_t);
+        elementHeader = (elementHeader_t *)((void *)elementHeader + elementHeader->length);
     }
 
-}  // End of PrintSortList
+    genericFlow = (EXgenericFlow_t *)extensionList[EXgenericFlowID];
+    cntFlow = (EXcntFlow_t *)extensionList[EXcntFlowID];
 
-// export SortList - apply possible aggregation mask to zero out aggregated fields
-static inline void ExportSortList(SortElement_t *SortList, uint32_t maxindex, nffile_t *nffile, int GuessFlowDirection, int ascending) {
-    // master_record_t	*aggr_record_mask = aggregate_info.mask;
+    if (genericFlow && cntFlow) {
+        genericFlow->inPackets = r->counter[INPACKETS];
+        genericFlow->inBytes = r->counter[INBYTES];
+        cntFlow->outPackets = r->counter[OUTPACKETS];
+        cntFlow->outBytes = r->counter[OUTBYTES];
+        cntFlow->flows = r->counter[FLOWS];
+
+        genericFlow->msecFirst = r->msecFirst;
+        genericFlow->msecLast = r->msecLast;
+        genericFlow->tcpFlags = r->inFlags;
+    }
+
+    EXipv4Flow_t *ipv4Flow = (EXipv4Flow_t *)extensionList[EXipv4FlowID];
+    EXipv6Flow_t *ipv6Flow = (EXipv6Flow_t *)extensionList[EXipv6FlowID];
+    // apply IP mask from aggregation, to provide a pretty output
+    if (aggregate_info.has_masks) {
+        if (ipv4Flow) {
+            ipv4Flow->srcAddr &= aggregate_info.IPmask[1];
+            ipv4Flow->dstAddr &= aggregate_info.IPmask[3];
+        } else if (ipv6Flow) {
+            ipv6Flow->srcAddr[0] &= aggregate_info.IPmask[0];
+            ipv6Flow->srcAddr[1] &= aggregate_info.IPmask[1];
+            ipv6Flow->dstAddr[0] &= aggregate_info.IPmask[2];
+            ipv6Flow->dstAddr[1] &= aggregate_info.IPmask[3];
+        }
+    }
+
+    EXflowMisc_t *flowMisc = (EXflowMisc_t *)extensionList[EXflowMiscID];
+    if (flowMisc) {
+        flowMisc->revTcpFlags = r->outFlags;
+        if (aggregate_info.apply_netbits) SetNetMaskBits(ipv4Flow, ipv6Flow, flowMisc, aggregate_info.apply_netbits);
+    }
+    EXasRouting_t *asRouting = (EXasRouting_t *)extensionList[EXasRoutingID];
+    if (genericFlow && needSwap) {
+        SwapRawFlow(genericFlow, ipv4Flow, ipv6Flow, flowMisc, cntFlow, asRouting);
+    }
+
+    // Update statistics
+    UpdateRawStat(nffile->stat_record, genericFlow, cntFlow);
 
+    return 1;
+
+}  // End of ExportFlowRecord
+
+// export SortList
+static inline void ExportSortList(SortElement_t *SortList, uint32_t maxindex, nffile_t *nffile, int GuessFlowDirection, int ascending) {
     for (int i = 0; i < maxindex; i++) {
         int j;
 
@@ -1101,106 +1653,162 @@ static inline void ExportSortList(SortElement_t *SortList, uint32_t maxindex, nf
         else
             j = maxindex - 1 - i;
 
-        void *extensionList[MAXEXTENSIONS] = {0};
-        FlowHashRecord_t *r = (FlowHashRecord_t *)(SortList[j].record);
+        if (!ExportFlowRecord((FlowHashRecord_t *)(SortList[j].record), nffile, GuessFlowDirection)) return;
+    }
 
-        recordHeaderV3_t *recordHeaderV3 = (r->flowrecord);
-        elementHeader_t *elementHeader = (elementHeader_t *)((void *)recordHeaderV3 + sizeof(recordHeaderV3_t));
-        // map all extensions
-        for (int i = 0; i < recordHeaderV3->numElements; i++) {
-            extensionList[elementHeader->type] = (void *)elementHeader + sizeof(elementHeader_t);
-            elementHeader = (elementHeader_t *)((void *)elementHeader + elementHeader->length);
-        }
+}  // End of ExportSortList
 
-        // check if cntFlowID exists
-        int needSwap = 0;
-        EXgenericFlow_t *genericFlow = (EXgenericFlow_t *)extensionList[EXgenericFlowID];
-        if (genericFlow != NULL) {
-            needSwap = NeedSwap(GuessFlowDirection, genericFlow);
-        }
+// output of a spilled flow cache
+#define MAXORDERS 32
+typedef struct flowOutput_s {
+    outputParams_t *outputParams;
+    RecordPrinter_t print_record;
+    nffile_t *nffile;
+    int GuessFlowDirection;
+    int topN;
+    uint64_t count;  // entries printed so far
+
+    // one sorted run per partition for each print order
+    uint32_t orders;
+    spillRuns_t *runs[MAXORDERS];
+    void *buff;
+    size_t buffSize;
+} flowOutput_t;
+
+static int PrintFlowPartition(void *arg) {
+    flowOutput_t *flowOutput = (flowOutput_t *)arg;
+
+    for (size_t k = 0; k != swiss_end(FlowHash); ++k) {
+        if (!swiss_exist(FlowHash, k)) continue;
+        if (flowOutput->topN && flowOutput->count >= flowOutput->topN) break;
+        PrintFlowRecord(&swiss_entry(FlowHash, k), flowOutput->outputParams, flowOutput->GuessFlowDirection, flowOutput->print_record);
+        flowOutput->count++;
+    }
 
-        int exCntSize = 0;
-        EXcntFlow_t *cntFlow = (EXcntFlow_t *)extensionList[EXcntFlowID];
-        if ((r->counter[OUTPACKETS] || r->counter[OUTBYTES] || r->counter[FLOWS] != 1) && cntFlow == NULL) {
-            exCntSize = EXcntFlowSize;
-        }
+    return 1;
 
-        if (!CheckBufferSpace(nffile, recordHeaderV3->size + exCntSize)) {
-            return;
-        }
+}  // End of PrintFlowPartition
 
-        // write record
-        memcpy(nffile->buff_ptr, (void *)recordHeaderV3, recordHeaderV3->size);
-        recordHeaderV3 = nffile->buff_ptr;
+static int ExportFlowPartition(void *arg) {
+    flowOutput_t *flowOutput = (flowOutput_t *)arg;
 
-        if (exCntSize) {
-            PushExtension(recordHeaderV3, EXcntFlow, cntFlow);
-            nffile->buff_ptr += recordHeaderV3->size;
-            nffile->block_header->size += recordHeaderV3->size;
-        } else {
-            nffile->buff_ptr += recordHeaderV3->size;
-            nffile->block_header->size += recordHeaderV3->size;
-        }
-        nffile->block_header->NumRecords++;
-
-        memset((void *)extensionList, 0, sizeof(extensionList));
-        // remap extension od written record
-        elementHeader = (elementHeader_t *)((void *)recordHeaderV3 + sizeof(recordHeaderV3_t));
-        for (int i = 0; i < recordHeaderV3->numElements; i++) {
-            extensionList[elementHeader->type] = (void *)elementHeader + sizeof(elementHeader_t);
-            elementHeader = (elementHeader_t *)((void *)elementHeader + elementHeader->length);
-        }
+    for (size_t k = 0; k != swiss_end(FlowHash); ++k) {
+        if (!swiss_exist(FlowHash, k)) continue;
+        if (!ExportFlowRecord(&swiss_entry(FlowHash, k), flowOutput->nffile, flowOutput->GuessFlowDirection)) return 0;
+    }
 
-        genericFlow = (EXgenericFlow_t *)extensionList[EXgenericFlowID];
-        cntFlow = (EXcntFlow_t *)extensionList[EXcntFlowID];
+    return 1;
 
-        if (genericFlow && cntFlow) {
-            genericFlow->inPackets = r->counter[INPACKETS];
-            genericFlow->inBytes = r->counter[INBYTES];
-            cntFlow->outPackets = r->counter[OUTPACKETS];
-            cntFlow->outBytes = r->counter[OUTBYTES];
-            cntFlow->flows = r->counter[FLOWS];
+}  // End of ExportFlowPartition
 
-            genericFlow->msecFirst = r->msecFirst;
-            genericFlow->msecLast = r->msecLast;
-            genericFlow->tcpFlags = r->inFlags;
-        }
+// sort a partition by all print orders and write the top N entries as sorted run
+static int RunFlowPartition(void *arg) {
+    flowOutput_t *flowOutput = (flowOutput_t *)arg;
 
-        EXipv4Flow_t *ipv4Flow = (EXipv4Flow_t *)extensionList[EXipv4FlowID];
-        EXipv6Flow_t *ipv6Flow = (EXipv6Flow_t *)extensionList[EXipv6FlowID];
-        // apply IP mask from aggregation, to provide a pretty output
-        if (aggregate_info.has_masks) {
-            if (ipv4Flow) {
-                ipv4Flow->srcAddr &= aggregate_info.IPmask[1];
-                ipv4Flow->dstAddr &= aggregate_info.IPmask[3];
-            } else if (ipv6Flow) {
-                ipv6Flow->srcAddr[0] &= aggregate_info.IPmask[0];
-                ipv6Flow->srcAddr[1] &= aggregate_info.IPmask[1];
-                ipv6Flow->dstAddr[0] &= aggregate_info.IPmask[2];
-                ipv6Flow->dstAddr[1] &= aggregate_info.IPmask[3];
-            }
+    size_t maxindex;
+    SortElement_t *SortList = GetSortList(&maxindex);
+    if (!SortList) return 0;
+
+    for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+        if ((flowOutput->orders & (1 << order_index)) == 0) continue;
+
+        for (int i = 0; i < maxindex; i++) {
+            FlowHashRecord_t *r = (FlowHashRecord_t *)(SortList[i].record);
+            SortList[i].count = order_mode[order_index].record_function(r, order_mode[order_index].inout);
         }
+        if (maxindex >= 2) blocksort((SortRecord_t *)SortList, maxindex);
 
-        EXflowMisc_t *flowMisc = (EXflowMisc_t *)extensionList[EXflowMiscID];
-        if (flowMisc) {
-            flowMisc->revTcpFlags = r->outFlags;
-            if (aggregate_info.apply_netbits) SetNetMaskBits(ipv4Flow, ipv6Flow, flowMisc, aggregate_info.apply_netbits);
+        if (!NewRun(flowOutput->runs[order_index])) {
+            free(SortList);
+            return 0;
         }
-        EXasRouting_t *asRouting = (EXasRouting_t *)extensionList[EXasRoutingID];
-        if (genericFlow && needSwap) {
-            SwapRawFlow(genericFlow, ipv4Flow, ipv6Flow, flowMisc, cntFlow, asRouting);
+        size_t max = maxindex;
+        if (flowOutput->topN && flowOutput->topN < maxindex) max = flowOutput->topN;
+        for (size_t i = 0; i < max; i++) {
+            size_t j = PrintDirection ? i : maxindex - 1 - i;
+            uint32_t size = PackSpillRecord((FlowHashRecord_t *)(SortList[j].record), &flowOutput->buff, &flowOutput->buffSize);
+            if (!WriteRun(flowOutput->runs[order_index], SortList[j].count, flowOutput->buff, size)) {
+                free(SortList);
+                return 0;
+            }
         }
+    }
+    free(SortList);
+
+    return 1;
+
+}  // End of RunFlowPartition
+
+static int PrintSpillRecord(void *data, uint32_t size, void *arg) {
+    flowOutput_t *flowOutput = (flowOutput_t *)arg;
+
+    FlowHashRecord_t r;
+    UnpackSpillRecord(data, &r);
+    PrintFlowRecord(&r, flowOutput->outputParams, flowOutput->GuessFlowDirection, flowOutput->print_record);
+
+    return 1;
 
-        // Update statistics
-        UpdateRawStat(nffile->stat_record, genericFlow, cntFlow);
+}  // End of PrintSpillRecord
+
+static int ExportSpillRecord(void *data, uint32_t size, void *arg) {
+    flowOutput_t *flowOutput = (flowOutput_t *)arg;
+
+    FlowHashRecord_t r;
+    UnpackSpillRecord(data, &r);
+
+    return ExportFlowRecord(&r, flowOutput->nffile, flowOutput->GuessFlowDirection);
+
+}  // End of ExportSpillRecord
+
+// aggregate all spilled partitions into sorted runs for the requested print orders
+static int SortSpilledFlows(flowOutput_t *flowOutput) {
+    for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+        if ((flowOutput->orders & (1 << order_index)) == 0) continue;
+        flowOutput->runs[order_index] = OpenRuns();
+        if (!flowOutput->runs[order_index]) return 0;
     }
 
-}  // End of ExportSortList
+    return ProcessSpilledFlows(RunFlowPartition, flowOutput);
+
+}  // End of SortSpilledFlows
+
+static void CloseFlowOutput(flowOutput_t *flowOutput) {
+    for (int i = 0; i < MAXORDERS; i++) CloseRuns(flowOutput->runs[i]);
+    free(flowOutput->buff);
+
+}  // End of CloseFlowOutput
+
+static void PrintFlowStatHeader(outputParams_t *outputParams, int order_index) {
+    if (!outputParams->quiet) {
+        if (outputParams->mode == MODE_PLAIN) {
+            if (outputParams->topN != 0)
+                printf("Top %i flows ordered by %s:\n", outputParams->topN, order_mode[order_index].string);
+            else
+                printf("Top flows ordered by %s:\n", order_mode[order_index].string);
+        }
+    }
+    PrintProlog(outputParams);
+
+}  // End of PrintFlowStatHeader
 
 // print -s record/xx statistics with as many print orders as required
 void PrintFlowStat(RecordPrinter_t print_record, outputParams_t *outputParams) {
     size_t maxindex;
 
+    if (flowSpill) {
+        flowOutput_t flowOutput = {
+            .outputParams = outputParams, .print_record = print_record, .topN = outputParams->topN, .orders = FlowStat_order};
+        if (SortSpilledFlows(&flowOutput)) {
+            for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+                if ((FlowStat_order & (1 << order_index)) == 0) continue;
+                PrintFlowStatHeader(outputParams, order_index);
+                MergeRuns(flowOutput.runs[order_index], PrintDirection, outputParams->topN, PrintSpillRecord, &flowOutput);
+            }
+        }
+        CloseFlowOutput(&flowOutput);
+        return;
+    }
+
     // Get sort array
     SortElement_t *SortList = GetSortList(&maxindex);
     if (!SortList) {
@@ -1228,15 +1836,7 @@ void PrintFlowStat(RecordPrinter_t print_record, outputParams_t *outputParams) {
                     blocksort((SortRecord_t *)SortList, maxindex);
                 }
             }
-            if (!outputParams->quiet) {
-                if (outputParams->mode == MODE_PLAIN) {
-                    if (outputParams->topN != 0)
-                        printf("Top %i flows ordered by %s:\n", outputParams->topN, order_mode[order_index].string);
-                    else
-                        printf("Top flows ordered by %s:\n", order_mode[order_index].string);
-                }
-            }
-            PrintProlog(outputParams);
+            PrintFlowStatHeader(outputParams, order_index);
             PrintSortList(SortList, maxindex, outputParams, 0, print_record, direction);
         }
     }
@@ -1247,6 +1847,20 @@ void PrintFlowStat(RecordPrinter_t print_record, outputParams_t *outputParams) {
 void PrintFlowTable(RecordPrinter_t print_record, outputParams_t *outputParams, int GuessDir) {
     GuessDirection = GuessDir;
 
+    if (flowSpill) {
+        flowOutput_t flowOutput = {
+            .outputParams = outputParams, .print_record = print_record, .GuessFlowDirection = GuessDir, .topN = outputParams->topN};
+        if (PrintOrder) {
+            flowOutput.orders = 1 << PrintOrder;
+            if (SortSpilledFlows(&flowOutput))
+                MergeRuns(flowOutput.runs[PrintOrder], PrintDirection, outputParams->topN, PrintSpillRecord, &flowOutput);
+            CloseFlowOutput(&flowOutput);
+        } else {
+            ProcessSpilledFlows(PrintFlowPartition, &flowOutput);
+        }
+        return;
+    }
+
     size_t maxindex;
     SortElement_t *SortList = GetSortList(&maxindex);
     if (!SortList) return;
@@ -1263,7 +1877,7 @@ void PrintFlowTable(RecordPrinter_t print_record, outputParams_t *outputParams,
                 heapSort(SortList, maxindex, 0, PrintDirection);
                 PrintDirection = 0;
             } else {
-                blocksort((SortRecord_t *)SortList, maxindex);
+                SortFlowList(SortList, maxindex);
             }
         }
 
@@ -1279,29 +1893,42 @@ int ExportFlowTable(nffile_t *nffile, int aggregate, int bidir, int GuessDir) {
 
     ExportExporterList(nffile);
 
-    size_t maxindex;
-    SortElement_t *SortList = GetSortList(&maxindex);
-    if (!SortList) return 0;
-
-    if (PrintOrder) {
-        // for any -O print mode
-        for (int i = 0; i < maxindex; i++) {
-            FlowHashRecord_t *r = (FlowHashRecord_t *)(SortList[i].record);
-            SortList[i].count = order_mode[PrintOrder].record_function(r, order_mode[PrintOrder].inout);
+    if (flowSpill) {
+        flowOutput_t flowOutput = {.nffile = nffile, .GuessFlowDirection = GuessDir};
+        int ok;
+        if (PrintOrder) {
+            flowOutput.orders = 1 << PrintOrder;
+            ok = SortSpilledFlows(&flowOutput) && MergeRuns(flowOutput.runs[PrintOrder], PrintDirection, 0, ExportSpillRecord, &flowOutput);
+            CloseFlowOutput(&flowOutput);
+        } else {
+            ok = ProcessSpilledFlows(ExportFlowPartition, &flowOutput);
         }
+        if (!ok) return 0;
+    } else {
+        size_t maxindex;
+        SortElement_t *SortList = GetSortList(&maxindex);
+        if (!SortList) return 0;
 
-        if (maxindex >= 2) {
-            if (maxindex < 100) {
-                heapSort(SortList, maxindex, 0, PrintDirection);
-                PrintDirection = 0;
-            } else {
-                blocksort((SortRecord_t *)SortList, maxindex);
+        if (PrintOrder) {
+            // for any -O print mode
+            for (int i = 0; i < maxindex; i++) {
+                FlowHashRecord_t *r = (FlowHashRecord_t *)(SortList[i].record);
+                SortList[i].count = order_mode[PrintOrder].record_function(r, order_mode[PrintOrder].inout);
             }
-        }
 
-        ExportSortList(SortList, maxindex, nffile, GuessDir, PrintDirection);
-    } else {
-        ExportSortList(SortList, maxindex, nffile, GuessDir, PrintDirection);
+            if (maxindex >= 2) {
+                if (maxindex < 100) {
+                    heapSort(SortList, maxindex, 0, PrintDirection);
+                    PrintDirection = 0;
+                } else {
+                    SortFlowList(SortList, maxindex);
+                }
+            }
+
+            ExportSortList(SortList, maxindex, nffile, GuessDir, PrintDirection);
+        } else {
+            ExportSortList(SortList, maxindex, nffile, GuessDir, PrintDirection);
+        }
     }
 
     if (nffile->block_header->NumRecords) {
@@ -32,6 +32,7 @@
 #ifndef _NFLOWCACHE_H
 #define _NFLOWCACHE_H 1
 
+#include <stdio.h>
 #include <sys/types.h>
 
 #include "config.h"
@@ -41,6 +42,7 @@
 
 #include "nffile.h"
 #include "output.h"
+#include "swisstable.h"
 
 #define NeedSwap(GuessDir, r)                                                                                     \
     (GuessDir && ((r)->proto == IPPROTO_TCP || (r)->proto == IPPROTO_UDP) &&                                      \
@@ -133,10 +135,16 @@ int Init_FlowCache(void);
 
 void Dispose_FlowTable(void);
 
+void PrintFlowCacheStat(FILE *stream);
+
+void FlowCacheHashStat(swiss_stat_t *stat, size_t *arenaPeak);
+
 int Parse_PrintOrder(char *order);
 
 char *ParseAggregateMask(char *arg, int hasGeoDB);
 
+int SetCompactAggregation(void);
+
 int SetBidirAggregation(void);
 
 void Add_FlowStatOrder(uint32_t order, uint32_t direction);
@@ -147,6 +155,10 @@ void InsertFlow(void *raw_record, master_record_t *flow_record);
 
 void AddFlowCache(void *raw_record, master_record_t *flow_record);
 
+int ExportFlowCache(FILE *fp);
+
+int ImportFlowCache(void *data, uint32_t size);
+
 void PrintFlowTable(RecordPrinter_t print_record, outputParams_t *outputParams, int GuessDir);
 
 void PrintFlowStat(RecordPrinter_t print_record, outputParams_t *outputParams);
@@ -0,0 +1,334 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "nfpartial.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "dnsparse.h"
+#include "nffile.h"
+#include "nflowcache.h"
+#include "nfstat.h"
+#include "queryserver.h"
+#include "util.h"
+
+#define UNIXPREFIX "unix:"
+
+typedef struct worker_s {
+    char *name;
+    FILE *fp;
+    pid_t pid;
+} worker_t;
+
+void InitPartialStat(partialStat_t *partialStat) {
+    memset((void *)partialStat, 0, sizeof(partialStat_t));
+    partialStat->stat_record.firstseen = 0x7fffffffffffffffLL;
+
+}  // End of InitPartialStat
+
+int WritePartial(FILE *fp, uint16_t type, uint16_t index, const void *data, uint32_t size) {
+    partialRecord_t partialRecord = {.type = type, .index = index, .size = size};
+
+    if (fwrite(&partialRecord, sizeof(partialRecord_t), 1, fp) != 1 || (size && fwrite(data, size, 1, fp) != 1)) {
+        LogError("fwrite() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    return 1;
+
+}  // End of WritePartial
+
+int ExportPartial(FILE *fp, partialStat_t *partialStat, int element_stat, int flow_stat) {
+    uint32_t byteOrder = PARTIAL_BYTEORDER;
+
+    fflush(stderr);
+    if (fputs(PARTIAL_MAGIC, fp) == EOF || fwrite(&byteOrder, sizeof(byteOrder), 1, fp) != 1) {
+        LogError("fwrite() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    if (!WritePartial(fp, PARTIAL_STAT, 0, partialStat, sizeof(partialStat_t))) return 0;
+    if (flow_stat && !ExportFlowCache(fp)) return 0;
+    if (element_stat && !ExportElementStat(fp)) return 0;
+    if (!WritePartial(fp, PARTIAL_END, 0, NULL, 0)) return 0;
+
+    return fflush(fp) == 0;
+
+}  // End of ExportPartial
+
+// quote an argument for /bin/sh
+static char *ShellQuote(char *arg) {
+    char *quoted = malloc(4 * strlen(arg) + 3);
+    if (!quoted) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+
+    char *q = quoted;
+    *q++ = '\'';
+    for (char *p = arg; *p; p++) {
+        if (*p == '\'') {
+            memcpy(q, "'\\''", 4);
+            q += 4;
+        } else {
+            *q++ = *p;
+        }
+    }
+    *q++ = '\'';
+    *q = '\0';
+    return quoted;
+
+}  // End of ShellQuote
+
+// spawn worker command with the query arguments appended
+static FILE *SpawnWorker(char *command, int argc, char **argv, pid_t *pid) {
+    size_t len = strlen(command) + 1;
+    char **quoted = calloc(argc + 1, sizeof(char *));
+    if (!quoted) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    for (int i = 0; i < argc; i++) {
+        quoted[i] = ShellQuote(argv[i]);
+        if (!quoted[i]) return NULL;
+        len += strlen(quoted[i]) + 1;
+    }
+
+    char *cmdline = malloc(len);
+    if (!cmdline) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    strcpy(cmdline, command);
+    for (int i = 0; i < argc; i++) {
+        strcat(cmdline, " ");
+        strcat(cmdline, quoted[i]);
+        free(quoted[i]);
+    }
+    free(quoted);
+
+    int pfd[2];
+    if (pipe(pfd) < 0) {
+        LogError("pipe() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        free(cmdline);
+        return NULL;
+    }
+
+    *pid = fork();
+    if (*pid == 0) {
+        // child
+        close(pfd[0]);
+        if (dup2(pfd[1], STDOUT_FILENO) < 0) exit(255);
+        close(pfd[1]);
+        execl("/bin/sh", "sh", "-c", cmdline, (char *)NULL);
+        LogError("execl() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
+    free(cmdline);
+    close(pfd[1]);
+
+    if (*pid < 0) {
+        LogError("fork() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        close(pfd[0]);
+        return NULL;
+    }
+
+    return fdopen(pfd[0], "r");
+
+}  // End of SpawnWorker
+
+// merge the partial aggregation stream of fp
+int ImportPartial(FILE *fp, char *name, partialStat_t *partialStat) {
+    // pass any log messages of the worker to stderr
+    char *line = NULL;
+    size_t linecap = 0;
+    int found = 0;
+    while (getline(&line, &linecap, fp) > 0) {
+        if (strcmp(line, PARTIAL_MAGIC) == 0) {
+            found = 1;
+            break;
+        }
+        fprintf(stderr, "%s: %s", name, line);
+    }
+    free(line);
+
+    if (!found) {
+        LogError("No partial result from %s", name);
+        return 0;
+    }
+
+    uint32_t byteOrder;
+    if (fread(&byteOrder, sizeof(byteOrder), 1, fp) != 1 || byteOrder != PARTIAL_BYTEORDER) {
+        LogError("Incompatible byte order of %s", name);
+        return 0;
+    }
+
+    size_t buffSize = 4096;
+    void *data = malloc(buffSize);
+    if (!data) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    int done = 0;
+    int ok = 1;
+    while (!done && ok) {
+        partialRecord_t partialRecord;
+        if (fread(&partialRecord, sizeof(partialRecord_t), 1, fp) != 1) {
+            LogError("Unexpected end of partial result from %s", name);
+            ok = 0;
+            break;
+        }
+
+        if (partialRecord.size > buffSize) {
+            buffSize = partialRecord.size;
+            void *p = realloc(data, buffSize);
+            if (!p) {
+                LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                ok = 0;
+                break;
+            }
+            data = p;
+        }
+        if (partialRecord.size && fread(data, partialRecord.size, 1, fp) != 1) {
+            LogError("Unexpected end of partial result from %s", name);
+            ok = 0;
+            break;
+        }
+
+        switch (partialRecord.type) {
+            case PARTIAL_STAT: {
+                if (partialRecord.size != sizeof(partialStat_t)) {
+                    ok = 0;
+                    break;
+                }
+                partialStat_t *stat = (partialStat_t *)data;
+                SumStatRecords(&partialStat->stat_record, &stat->stat_record);
+                partialStat->processed += stat->processed;
+                partialStat->passed += stat->passed;
+                partialStat->skippedBlocks += stat->skippedBlocks;
+                partialStat->totalBytes += stat->totalBytes;
+                if (stat->msecFirst && (partialStat->msecFirst == 0 || stat->msecFirst < partialStat->msecFirst))
+                    partialStat->msecFirst = stat->msecFirst;
+                if (stat->msecLast > partialStat->msecLast) partialStat->msecLast = stat->msecLast;
+            } break;
+            case PARTIAL_ELEMENT:
+                ok = ImportElementStat(partialRecord.index, data, partialRecord.size);
+                break;
+            case PARTIAL_FLOW:
+                ok = ImportFlowCache(data, partialRecord.size);
+                break;
+            case PARTIAL_NAME:
+                // interned dns name of the following element - ids are the hash of the name
+                if (partialRecord.size == 0 || partialRecord.size >= MAXDNSNAME) {
+                    ok = 0;
+                    break;
+                }
+                dnsNameIntern((char *)data, partialRecord.size);
+                break;
+            case PARTIAL_END:
+                done = 1;
+                break;
+            default:
+                LogError("Unknown partial record type %u from %s", partialRecord.type, name);
+                ok = 0;
+        }
+    }
+    free(data);
+
+    if (!ok) {
+        LogError("Corrupt partial result from %s", name);
+        return 0;
+    }
+
+    return 1;
+
+}  // End of ImportPartial
+
+/*
+ * send the query to all workers and merge their partial results. All workers
+ * are started first, so they process their data in parallel. The results are
+ * merged in the order of the workers.
+ */
+int GatherPartial(char **workers, int numWorkers, int argc, char **argv, partialStat_t *partialStat) {
+    worker_t worker[MAXPARTIALWORKERS];
+
+    InitPartialStat(partialStat);
+
+    // query args for the workers
+    char **queryArgv = calloc(argc + 2, sizeof(char *));
+    if (!queryArgv) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    queryArgv[0] = "-p";
+    for (int i = 0; i < argc; i++) queryArgv[i + 1] = argv[i];
+    int queryArgc = argc + 1;
+
+    int ok = 1;
+    for (int i = 0; i < numWorkers; i++) {
+        worker[i].name = workers[i];
+        worker[i].pid = 0;
+        if (strncmp(workers[i], UNIXPREFIX, strlen(UNIXPREFIX)) == 0) {
+            int fd = QueryConnect(workers[i] + strlen(UNIXPREFIX), queryArgc, queryArgv);
+            worker[i].fp = fd < 0 ? NULL : fdopen(fd, "r");
+        } else {
+            worker[i].fp = SpawnWorker(workers[i], queryArgc, queryArgv, &worker[i].pid);
+        }
+        if (!worker[i].fp) {
+            LogError("Failed to start worker %s", workers[i]);
+            ok = 0;
+        }
+    }
+    free(queryArgv);
+
+    for (int i = 0; i < numWorkers; i++) {
+        if (!worker[i].fp) continue;
+        if (ok && !ImportPartial(worker[i].fp, worker[i].name, partialStat)) ok = 0;
+        fclose(worker[i].fp);
+        if (worker[i].pid > 0) {
+            int status;
+            if (waitpid(worker[i].pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                LogError("Worker %s failed", worker[i].name);
+                ok = 0;
+            }
+        }
+    }
+
+    return ok;
+
+}  // End of GatherPartial
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _NFPARTIAL_H
+#define _NFPARTIAL_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "nfdump.h"
+
+/*
+ * Partial aggregation state of a worker query. A worker started with -p
+ * writes its FlowHash and ElementHash tables to stdout, the coordinator
+ * started with -P merges the tables of all workers and prints the result.
+ * The stream starts with the magic line, followed by a byte order word and
+ * partialRecord_t records. Text before the magic line is worker log output.
+ * Workers and coordinator must have the same byte order.
+ */
+#define PARTIAL_MAGIC "NFPARTIAL1\n"
+#define PARTIAL_BYTEORDER 0x01020304
+
+typedef struct partialRecord_s {
+    uint16_t type;
+#define PARTIAL_STAT 1
+#define PARTIAL_ELEMENT 2
+#define PARTIAL_FLOW 3
+#define PARTIAL_END 4
+#define PARTIAL_NAME 5
+    uint16_t index;  // index of stat for PARTIAL_ELEMENT and PARTIAL_NAME
+    uint32_t size;   // size of data following this header
+} partialRecord_t;
+
+// processing summary of a worker query
+typedef struct partialStat_s {
+    stat_record_t stat_record;
+    uint64_t processed;
+    uint64_t passed;
+    uint64_t skippedBlocks;
+    uint64_t totalBytes;
+    uint64_t msecFirst;
+    uint64_t msecLast;
+} partialStat_t;
+
+#define MAXPARTIALWORKERS 64
+
+void InitPartialStat(partialStat_t *partialStat);
+
+int WritePartial(FILE *fp, uint16_t type, uint16_t index, const void *data, uint32_t size);
+
+int ExportPartial(FILE *fp, partialStat_t *partialStat, int element_stat, int flow_stat);
+
+int ImportPartial(FILE *fp, char *name, partialStat_t *partialStat);
+
+int GatherPartial(char **workers, int numWorkers, int argc, char **argv, partialStat_t *partialStat);
+
+#endif  //_NFPARTIAL_H
@@ -0,0 +1,407 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "nfspill.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "swisstable.h"
+#include "util.h"
+
+#define SPILLBUFFSIZE (64 * 1024)
+#define RUNBUFFSIZE (32 * 1024)
+
+struct spill_s {
+    int level;
+    FILE *partition[SPILLPARTITIONS];
+};
+
+// sorted run in the runs file and its head record while merging
+typedef struct run_s {
+    off_t offset;  // next read position
+    off_t end;     // end of run
+    uint8_t *buff;
+    size_t buffPos;
+    size_t buffLen;
+    uint64_t count;  // head record
+    uint32_t size;
+    uint32_t dataSize;
+    void *data;
+} run_t;
+
+struct spillRuns_s {
+    FILE *fp;
+    off_t offset;  // bytes written so far
+    run_t *run;
+    int numRuns;
+    int maxRuns;
+};
+
+// header of a record in a sorted run
+typedef struct runRecord_s {
+    uint64_t count;
+    uint32_t size;
+    uint32_t fill;
+} runRecord_t;
+
+static long long spillBudget = -1;
+static char *spillDir = NULL;
+
+// memory budget in bytes for aggregation hash tables - 0 no limit
+size_t SpillBudget(void) {
+    if (spillBudget < 0) {
+        int maxMem = ConfGetValue("aggr.maxmem");
+        spillBudget = maxMem > 0 ? (long long)maxMem * 1024 * 1024 : 0;
+        spillDir = ConfGetString("aggr.tmpdir");
+        if (spillDir == NULL) spillDir = getenv("TMPDIR");
+        if (spillDir == NULL) spillDir = "/tmp";
+    }
+    return (size_t)spillBudget;
+
+}  // End of SpillBudget
+
+// create an anonymous temporary file - it vanishes with the last close
+static FILE *OpenSpillFile(void) {
+    char path[MAXPATHLEN];
+
+    SpillBudget();
+    snprintf(path, MAXPATHLEN, "%s/nfdump.spill.XXXXXX", spillDir);
+    path[MAXPATHLEN - 1] = '\0';
+
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        LogError("mkstemp() spill file '%s' failed: %s", path, strerror(errno));
+        return NULL;
+    }
+    unlink(path);
+
+    FILE *fp = fdopen(fd, "w+");
+    if (!fp) {
+        LogError("fdopen() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    setvbuf(fp, NULL, _IOFBF, SPILLBUFFSIZE);
+
+    return fp;
+
+}  // End of OpenSpillFile
+
+spill_t *OpenSpill(int level) {
+    spill_t *spill = calloc(1, sizeof(spill_t));
+    if (!spill) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    spill->level = level;
+
+    return spill;
+
+}  // End of OpenSpill
+
+int SpillLevel(spill_t *spill) { return spill->level; }  // End of SpillLevel
+
+// each level selects the partition by an independent remix of the hash
+static inline int SpillPartition(spill_t *spill, uint64_t hash) {
+    return (swiss_hash64(hash + (spill->level + 1) * 0x9E3779B97F4A7C15ULL) >> 32) % SPILLPARTITIONS;
+
+}  // End of SpillPartition
+
+int WriteSpill(spill_t *spill, uint64_t hash, void *data, uint32_t size) {
+    int p = SpillPartition(spill, hash);
+
+    if (spill->partition[p] == NULL) {
+        spill->partition[p] = OpenSpillFile();
+        if (!spill->partition[p]) return 0;
+    }
+
+    FILE *fp = spill->partition[p];
+    if (fwrite(&size, sizeof(uint32_t), 1, fp) != 1 || fwrite(data, size, 1, fp) != 1) {
+        LogError("fwrite() spill file error: %s", strerror(errno));
+        return 0;
+    }
+
+    return 1;
+
+}  // End of WriteSpill
+
+// read all records of a partition - a partition is consumed and removed
+int ReadSpill(spill_t *spill, int partition, spillFunc_t func, void *arg) {
+    FILE *fp = spill->partition[partition];
+    if (fp == NULL) return 1;
+
+    if (fflush(fp) != 0 || fseeko(fp, 0, SEEK_SET) != 0) {
+        LogError("Spill file error: %s", strerror(errno));
+        return 0;
+    }
+
+    uint32_t buffSize = 4096;
+    void *data = malloc(buffSize);
+    if (!data) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    int ok = 1;
+    uint32_t size;
+    while (ok && fread(&size, sizeof(uint32_t), 1, fp) == 1) {
+        if (size > buffSize) {
+            buffSize = size;
+            void *p = realloc(data, buffSize);
+            if (!p) {
+                LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                ok = 0;
+                break;
+            }
+            data = p;
+        }
+        if (fread(data, size, 1, fp) != 1) {
+            LogError("fread() spill file error: %s", strerror(errno));
+            ok = 0;
+            break;
+        }
+        ok = func(data, size, arg);
+    }
+    if (ok && ferror(fp)) {
+        LogError("fread() spill file error: %s", strerror(errno));
+        ok = 0;
+    }
+
+    free(data);
+    fclose(fp);
+    spill->partition[partition] = NULL;
+
+    return ok;
+
+}  // End of ReadSpill
+
+void CloseSpill(spill_t *spill) {
+    if (!spill) return;
+
+    for (int i = 0; i < SPILLPARTITIONS; i++) {
+        if (spill->partition[i]) fclose(spill->partition[i]);
+    }
+    free(spill);
+
+}  // End of CloseSpill
+
+spillRuns_t *OpenRuns(void) {
+    spillRuns_t *runs = calloc(1, sizeof(spillRuns_t));
+    if (!runs) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+
+    runs->fp = OpenSpillFile();
+    if (!runs->fp) {
+        free(runs);
+        return NULL;
+    }
+
+    return runs;
+
+}  // End of OpenRuns
+
+// start a new sorted run - records are written in merge order
+int NewRun(spillRuns_t *runs) {
+    if (runs->numRuns == runs->maxRuns) {
+        runs->maxRuns += SPILLPARTITIONS;
+        run_t *p = realloc(runs->run, runs->maxRuns * sizeof(run_t));
+        if (!p) {
+            LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        runs->run = p;
+    }
+
+    run_t *run = &runs->run[runs->numRuns++];
+    memset((void *)run, 0, sizeof(run_t));
+    run->offset = runs->offset;
+    run->end = runs->offset;
+
+    return 1;
+
+}  // End of NewRun
+
+int WriteRun(spillRuns_t *runs, uint64_t count, void *data, uint32_t size) {
+    runRecord_t runRecord = {.count = count, .size = size};
+
+    if (fwrite(&runRecord, sizeof(runRecord_t), 1, runs->fp) != 1 || fwrite(data, size, 1, runs->fp) != 1) {
+        LogError("fwrite() spill file error: %s", strerror(errno));
+        return 0;
+    }
+    runs->offset += sizeof(runRecord_t) + size;
+    runs->run[runs->numRuns - 1].end = runs->offset;
+
+    return 1;
+
+}  // End of WriteRun
+
+// copy len bytes of the run into dst - refill the run buffer as needed
+static int RunRead(int fd, run_t *run, void *dst, size_t len) {
+    uint8_t *d = (uint8_t *)dst;
+
+    while (len) {
+        if (run->buffPos == run->buffLen) {
+            size_t want = run->end - run->offset;
+            if (want == 0) return 0;
+            if (want > RUNBUFFSIZE) want = RUNBUFFSIZE;
+            ssize_t ret = pread(fd, run->buff, want, run->offset);
+            if (ret <= 0) {
+                LogError("pread() spill file error: %s", ret < 0 ? strerror(errno) : "short read");
+                return 0;
+            }
+            run->offset += ret;
+            run->buffLen = ret;
+            run->buffPos = 0;
+        }
+        size_t n = run->buffLen - run->buffPos;
+        if (n > len) n = len;
+        memcpy(d, run->buff + run->buffPos, n);
+        run->buffPos += n;
+        d += n;
+        len -= n;
+    }
+
+    return 1;
+
+}  // End of RunRead
+
+// load the next record of a run - returns 0 at the end of the run
+static int RunNext(int fd, run_t *run) {
+    if (run->offset == run->end && run->buffPos == run->buffLen) return 0;
+
+    runRecord_t runRecord;
+    if (!RunRead(fd, run, &runRecord, sizeof(runRecord_t))) return 0;
+
+    if (runRecord.size > run->dataSize) {
+        void *p = realloc(run->data, runRecord.size);
+        if (!p) {
+            LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        run->data = p;
+        run->dataSize = runRecord.size;
+    }
+    if (!RunRead(fd, run, run->data, runRecord.size)) return 0;
+
+    run->count = runRecord.count;
+    run->size = runRecord.size;
+
+    return 1;
+
+}  // End of RunNext
+
+// heap order of two runs
+static inline int RunBefore(run_t *a, run_t *b, int ascending) { return ascending ? a->count < b->count : a->count > b->count; }
+
+static void SiftDown(run_t **heap, int num, int i, int ascending) {
+    while (1) {
+        int best = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < num && RunBefore(heap[l], heap[best], ascending)) best = l;
+        if (r < num && RunBefore(heap[r], heap[best], ascending)) best = r;
+        if (best == i) return;
+        run_t *tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+
+}  // End of SiftDown
+
+// merge all sorted runs and call func for at most max records - 0 for all
+int MergeRuns(spillRuns_t *runs, int ascending, uint64_t max, spillFunc_t func, void *arg) {
+    if (fflush(runs->fp) != 0) {
+        LogError("fflush() spill file error: %s", strerror(errno));
+        return 0;
+    }
+    int fd = fileno(runs->fp);
+
+    run_t **heap = calloc(runs->numRuns + 1, sizeof(run_t *));
+    if (!heap) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+
+    int ok = 1;
+    int num = 0;
+    for (int i = 0; i < runs->numRuns; i++) {
+        run_t *run = &runs->run[i];
+        run->buff = malloc(RUNBUFFSIZE);
+        if (!run->buff) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            ok = 0;
+            break;
+        }
+        if (RunNext(fd, run)) heap[num++] = run;
+    }
+    for (int i = num / 2 - 1; i >= 0; i--) SiftDown(heap, num, i, ascending);
+
+    uint64_t cnt = 0;
+    while (ok && num && (max == 0 || cnt < max)) {
+        run_t *run = heap[0];
+        ok = func(run->data, run->size, arg);
+        cnt++;
+        if (!RunNext(fd, run)) heap[0] = heap[--num];
+        SiftDown(heap, num, 0, ascending);
+    }
+
+    for (int i = 0; i < runs->numRuns; i++) {
+        free(runs->run[i].buff);
+        free(runs->run[i].data);
+        runs->run[i].buff = NULL;
+        runs->run[i].data = NULL;
+        runs->run[i].dataSize = 0;
+    }
+    free(heap);
+
+    return ok;
+
+}  // End of MergeRuns
+
+void CloseRuns(spillRuns_t *runs) {
+    if (!runs) return;
+
+    fclose(runs->fp);
+    free(runs->run);
+    free(runs);
+
+}  // End of CloseRuns
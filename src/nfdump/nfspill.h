@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _NFSPILL_H
+#define _NFSPILL_H 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "config.h"
+
+/*
+ * Spill files for aggregations, which exceed the memory budget aggr.maxmem.
+ * A spill set hash-partitions records into SPILLPARTITIONS temporary files.
+ * Each partition holds a disjoint subset of the keys and is aggregated
+ * independently later. A partition, which exceeds the budget again, is split
+ * into a new spill set of the next level, which uses other bits of the hash.
+ * Sorted runs hold the aggregated result of each partition in print order
+ * and are merged for the final top N output.
+ */
+#define SPILLPARTITIONS 64
+#define SPILLMAXLEVEL 4
+
+// no spill below this number of table entries
+#define SPILLMINENTRIES 4096
+
+typedef struct spill_s spill_t;
+typedef struct spillRuns_s spillRuns_t;
+
+// callback for each record read from a spill partition or merged from the runs
+typedef int (*spillFunc_t)(void *data, uint32_t size, void *arg);
+
+// callback for each aggregated partition of a spill set
+typedef int (*partitionFunc_t)(void *arg);
+
+size_t SpillBudget(void);
+
+spill_t *OpenSpill(int level);
+
+int SpillLevel(spill_t *spill);
+
+int WriteSpill(spill_t *spill, uint64_t hash, void *data, uint32_t size);
+
+int ReadSpill(spill_t *spill, int partition, spillFunc_t func, void *arg);
+
+void CloseSpill(spill_t *spill);
+
+spillRuns_t *OpenRuns(void);
+
+int NewRun(spillRuns_t *runs);
+
+int WriteRun(spillRuns_t *runs, uint64_t count, void *data, uint32_t size);
+
+int MergeRuns(spillRuns_t *runs, int ascending, uint64_t max, spillFunc_t func, void *arg);
+
+void CloseRuns(spillRuns_t *runs);
+
+#endif  //_NFSPILL_H
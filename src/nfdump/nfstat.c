@@ -36,6 +36,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -45,22 +46,28 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "affinity.h"
 #include "blocksort.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "config.h"
-#include "khash.h"
+#include "dnsparse.h"
 #include "maxmind.h"
 #include "nfdump.h"
 #include "nffile.h"
+#include "nfconf.h"
 #include "nflowcache.h"
+#include "nfpartial.h"
+#include "nfspill.h"
 #include "nfxV3.h"
 #include "output_fmt.h"
 #include "output_util.h"
+#include "swisstable.h"
 #include "util.h"
 
-enum { IS_NUMBER = 1, IS_HEXNUMBER, IS_IPADDR, IS_MACADDR, IS_MPLS_LBL, IS_LATENCY, IS_EVENT, IS_HEX, IS_NBAR, IS_JA3, IS_GEO };
+enum { IS_NUMBER = 1, IS_HEXNUMBER, IS_IPADDR, IS_MACADDR, IS_MPLS_LBL, IS_LATENCY, IS_EVENT, IS_HEX, IS_NBAR, IS_JA3, IS_GEO, IS_DNSNAME, IS_DNSTYPE, IS_DNSRCODE };
 
 struct flow_element_s {
     uint32_t offset0;
@@ -189,6 +196,12 @@ struct StatParameter_s {
 
     {"ja3", "                             ja3", {{OffsetJA3, OffsetJA3 + 1, MaskJA3, 0}, {0, 0, 0, 0}}, 1, IS_JA3},
 
+    {"dnsqname", "        DNS query name", {{0, OffsetDNSQname, MaskDNSQname, 0}, {0, 0, 0, 0}}, 1, IS_DNSNAME},
+
+    {"dnsqtype", "DNS qtype", {{0, OffsetDNSInfo, MaskDNSQtype, ShiftDNSQtype}, {0, 0, 0, 0}}, 1, IS_DNSTYPE},
+
+    {"dnsrcode", "DNS rcode", {{0, OffsetDNSInfo, MaskDNSRcode, ShiftDNSRcode}, {0, 0, 0, 0}}, 1, IS_DNSRCODE},
+
     {"odid", "obs domainID", {{0, OffsetObservationDomainID, MaskObservationDomainID, 0}, {0, 0, 0, 0}}, 1, IS_HEXNUMBER},
 
     {"opid", " obs PointID", {{0, OffsetObservationPointID, MaskObservationPointID, 0}, {0, 0, 0, 0}}, 1, IS_HEXNUMBER},
@@ -239,12 +252,12 @@ struct StatParameter_s {
 
 // key for element stat
 typedef struct hashkey_s {
-    khint64_t v0;
-    khint64_t v1;
+    uint64_t v0;
+    uint64_t v1;
     uint8_t proto;
 } hashkey_t;
 
-// khash record for element stat
+// hash record for element stat
 typedef struct StatRecord {
     uint64_t counter[5];  // flows ipkg ibyte opkg obyte
     uint64_t msecFirst;
@@ -294,7 +307,7 @@ static struct order_mode_s {
                   {"obpp", OUT, bpp_element},
                   {NULL, 0, NULL}};
 
-#define MaxStats 8
+#define MaxStats 16
 struct StatRequest_s {
     uint32_t order_bits;  // bit field for multiple print orders
     int16_t StatType;     // index into StatParameters
@@ -304,12 +317,72 @@ struct StatRequest_s {
 
 static uint32_t NumStats = 0;  // number of stats in StatRequest
 
-// definitions for khash element stat
-#define kh_key_hash_func(key) (khint32_t)((key.v1) >> 33 ^ (key.v1) ^ (key.v1) << 11)
-#define kh_key_hash_equal(a, b) (((a).v1 == (b).v1) && ((a).v0 == (b).v0) && (a).proto == (b).proto)
-KHASH_INIT(ElementHash, hashkey_t, StatRecord_t, 1, kh_key_hash_func, kh_key_hash_equal)
+// definitions for element stat hash - the hash covers the full key
+static inline uint64_t ElementKeyHash(hashkey_t *key) {
+    return swiss_hash64(key->v1 ^ ((key->v0 + key->proto) * 0x9E3779B97F4A7C15ULL));
+}
+#define ElementEntryHash(e) ElementKeyHash(&(e)->hashkey)
+#define ElementEntryEqual(e, k) ((e)->hashkey.v1 == (k)->v1 && (e)->hashkey.v0 == (k)->v0 && (e)->hashkey.proto == (k)->proto)
+SWISS_INIT(ElementHash, StatRecord_t, hashkey_t, ElementEntryHash, ElementEntryEqual)
+
+static swiss_ElementHash_t *ElementKHash[MaxStats];
+
+// spill the element stat tables to disk, if they exceed the memory budget aggr.maxmem
+typedef struct statSpillRecord_s {
+    uint32_t hash_num;
+    uint32_t fill;
+    StatRecord_t statRecord;
+} statSpillRecord_t;
+
+static size_t aggrBudget = 0;
+static spill_t *statSpill = NULL;
+
+/*
+ * multi stat engine: the keys of all stats are extracted from a record in a single pass.
+ * Records are collected in batches and each batch is added table by table with the
+ * hash slots of the following keys prefetched. Optionally the tables are distributed
+ * over stat.workers threads, which process the same batch.
+ */
+#define STATBATCH 256
+#define STATPREFETCH 8
 
-static khash_t(ElementHash) * ElementKHash[MaxStats];
+typedef struct statKey_s {
+    uint32_t offset0;
+    uint32_t offset1;
+    uint64_t mask;
+    uint32_t shift;
+    uint8_t hash_num;
+    uint8_t order_proto;
+} statKey_t;
+
+typedef struct statCounter_s {
+    uint64_t counter[5];
+    uint64_t msecFirst;
+    uint64_t msecLast;
+} statCounter_t;
+
+static statKey_t statKeys[2 * MaxStats];
+static int numStatKeys = 0;
+
+static hashkey_t *batchKeys = NULL;
+static statCounter_t *batchCounter = NULL;
+static int batchSize = 0;
+
+// the calling thread is worker 0
+static int numStatWorkers = 1;
+static int statWorkersRunning = 0;
+static pid_t statWorkersPid = 0;
+static pthread_t statWorker[MaxStats];
+static pthread_mutex_t statMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t statCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t statDone = PTHREAD_COND_INITIALIZER;
+static unsigned statGeneration = 0;
+static int statPending = 0;
+static int statTerminate = 0;
+
+// rollup table -> bit map of requested stats, which are merged from this table
+static uint32_t rollupMap[MaxStats];
+static int rollupMapped = 0;
 
 static uint32_t LoadedGeoDB = 0;
 static uint64_t byte_limit, packet_limit;
@@ -329,9 +402,12 @@ static void PrintCvsStatLine(stat_record_t *stat, int printPlain, StatRecord_t *
 
 static SortElement_t *StatTopN(int topN, uint32_t *count, int hash_num, int order, int direction);
 
+static void FlushStatBatch(void);
+
+static void CheckStatTables(void);
+
 #include "applybits_inline.c"
 #include "heapsort_inline.c"
-#include "memhandle.c"
 
 static uint64_t null_element(StatRecord_t *record, int inout) { return 0; }
 
@@ -504,19 +580,67 @@ void SetLimits(int stat, char *packet_limit_string, char *byte_limit_string) {
 }  // End of SetLimits
 
 int Init_StatTable(void) {
-    if (!nfalloc_Init(8 * 1024 * 1024)) return 0;
-
+    numStatKeys = 0;
     for (int i = 0; i < NumStats; i++) {
-        ElementKHash[i] = kh_init(ElementHash);
+        ElementKHash[i] = swiss_init_ElementHash();
+        if (!ElementKHash[i]) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+
+        int stat = StatRequest[i].StatType;
+        for (int e = 0; e < StatParameters[stat].num_elem; e++) {
+            statKeys[numStatKeys++] = (statKey_t){.offset0 = StatParameters[stat].element[e].offset0,
+                                                  .offset1 = StatParameters[stat].element[e].offset1,
+                                                  .mask = StatParameters[stat].element[e].mask,
+                                                  .shift = StatParameters[stat].element[e].shift,
+                                                  .hash_num = i,
+                                                  .order_proto = StatRequest[i].order_proto};
+        }
+    }
+
+    if (numStatKeys) {
+        batchKeys = malloc(STATBATCH * numStatKeys * sizeof(hashkey_t));
+        batchCounter = malloc(STATBATCH * sizeof(statCounter_t));
+        if (!batchKeys || !batchCounter) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
     }
+    batchSize = 0;
+
+    // optional worker threads for the stat tables - no more than tables and cores
+    numStatWorkers = ConfGetValue("stat.workers");
+    long CoresOnline = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numStatWorkers > CoresOnline) numStatWorkers = CoresOnline;
+    if (numStatWorkers > NumStats) numStatWorkers = NumStats;
+    if (numStatWorkers < 1) numStatWorkers = 1;
 
     LoadedGeoDB = Loaded_MaxMind();
+    aggrBudget = SpillBudget();
 
     return 1;
 
 }  // End of Init_StatTable
 
-void Dispose_StatTable(void) { nfalloc_free(); }  // End of Dispose_Tables
+void Dispose_StatTable(void) {
+    if (statWorkersRunning && statWorkersPid == getpid()) {
+        pthread_mutex_lock(&statMutex);
+        statTerminate = 1;
+        pthread_cond_broadcast(&statCond);
+        pthread_mutex_unlock(&statMutex);
+        for (int i = 1; i < numStatWorkers; i++) pthread_join(statWorker[i], NULL);
+    }
+    statWorkersRunning = 0;
+
+    free(batchKeys);
+    free(batchCounter);
+    batchKeys = NULL;
+    batchCounter = NULL;
+    CloseSpill(statSpill);
+    statSpill = NULL;
+
+}  // End of Dispose_StatTable
 
 int SetStat(char *str, int *element_stat, int *flow_stat) {
     if (NumStats == MaxStats) {
@@ -542,6 +666,9 @@ int SetStat(char *str, int *element_stat, int *flow_stat) {
             SetFlag(*element_stat, FLAG_STAT);
             if (StatParameters[StatType].type == IS_JA3) SetFlag(*element_stat, FLAG_JA3);
             if (StatParameters[StatType].type == IS_GEO) SetFlag(*element_stat, FLAG_GEO);
+            if (StatParameters[StatType].type == IS_DNSNAME || StatParameters[StatType].type == IS_DNSTYPE ||
+                StatParameters[StatType].type == IS_DNSRCODE)
+                SetFlag(*element_stat, FLAG_DNS);
             char *statArg = StatParameters[StatType].statname;
             size_t len = strlen(statArg);
             if (statArg[len - 2] == 'a' && statArg[len - 1] == 's') SetFlag(*element_stat, FLAG_GEO);
@@ -604,6 +731,15 @@ static int ParseListOrder(char *s, uint32_t *order_bits, uint32_t *direction) {
 
 }  // End of ParseListOrder
 
+// index of stat name in StatParameters or -1
+static int StatTypeByName(char *name) {
+    for (int i = 0; StatParameters[i].statname; i++) {
+        if (strncasecmp(name, StatParameters[i].statname, 16) == 0) return i;
+    }
+    return -1;
+
+}  // End of StatTypeByName
+
 static int ParseStatString(char *str, int16_t *StatType, int *flow_stat, uint16_t *order_proto, uint32_t *order_bits, uint32_t *direction) {
     char *s, *p, *q, *r;
     int i = 0;
@@ -621,19 +757,13 @@ static int ParseStatString(char *str, int16_t *StatType, int *flow_stat, uint16_
         *order_proto = 1;
     }
 
-    i = 0;
     // check for a valid stat name
-    while (StatParameters[i].statname) {
-        if (strncasecmp(s, StatParameters[i].statname, 16) == 0) {
-            // set flag if it's the flow record stat request
-            *flow_stat = strncasecmp(s, "record", 16) == 0;
-            break;
-        }
-        i++;
-    }
+    i = StatTypeByName(s);
 
     // if so - initialize type and order_bits
-    if (StatParameters[i].statname) {
+    if (i >= 0) {
+        // set flag if it's the flow record stat request
+        *flow_stat = i == 0;
         *StatType = i;
         if (strncasecmp(StatParameters[i].statname, "proto", 16) == 0) *order_proto = 1;
     } else {
@@ -658,57 +788,420 @@ static int ParseStatString(char *str, int16_t *StatType, int *flow_stat, uint16_
 
 }  // End of ParseStatString
 
-void AddElementStat(master_record_t *flow_record) {
-    int j, i;
+// add all keys of a stat table of the current batch
+static void ProcessStatTable(int hash_num) {
+    swiss_ElementHash_t *hash = ElementKHash[hash_num];
+    uint64_t keyHash[STATBATCH];
 
-    // for every requested -s stat do
-    for (j = 0; j < NumStats; j++) {
-        int stat = StatRequest[j].StatType;
-        int order_proto = StatRequest[j].order_proto;
-        // for the number of elements in this stat type
-        for (i = 0; i < StatParameters[stat].num_elem; i++) {
-            uint32_t offset = StatParameters[stat].element[i].offset1;
-            uint64_t mask = StatParameters[stat].element[i].mask;
-            uint32_t shift = StatParameters[stat].element[i].shift;
-
-            hashkey_t hashkey;
-            hashkey.v1 = (((uint64_t *)flow_record)[offset] & mask) >> shift;
-            offset = StatParameters[stat].element[i].offset0;
-            hashkey.v0 = offset ? ((uint64_t *)flow_record)[offset] : 0;
-            hashkey.proto = order_proto ? flow_record->proto : 0;
+    for (int q = 0; q < numStatKeys; q++) {
+        if (statKeys[q].hash_num != hash_num) continue;
+
+        for (int i = 0; i < batchSize; i++) keyHash[i] = ElementKeyHash(&batchKeys[i * numStatKeys + q]);
+
+        for (int i = 0; i < batchSize; i++) {
+            // prefetch the group of a following key - a hint only, which may be stale after a resize
+            if ((i + STATPREFETCH) < batchSize) swiss_prefetch_ElementHash(hash, keyHash[i + STATPREFETCH]);
+
+            statCounter_t *statCounter = &batchCounter[i];
+            hashkey_t hashkey = batchKeys[i * numStatKeys + q];
 
             int ret;
-            khiter_t k = kh_put(ElementHash, ElementKHash[j], hashkey, &ret);
+            size_t k = swiss_put_ElementHash(hash, &hashkey, keyHash[i], &ret);
+            if (ret < 0) {
+                LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                exit(255);
+            }
+            StatRecord_t *record = &swiss_entry(hash, k);
             if (ret == 0) {
-                kh_value(ElementKHash[j], k).counter[INBYTES] += flow_record->inBytes;
-                kh_value(ElementKHash[j], k).counter[INPACKETS] += flow_record->inPackets;
-                kh_value(ElementKHash[j], k).counter[OUTBYTES] += flow_record->out_bytes;
-                kh_value(ElementKHash[j], k).counter[OUTPACKETS] += flow_record->out_pkts;
+                record->counter[INBYTES] += statCounter->counter[INBYTES];
+                record->counter[INPACKETS] += statCounter->counter[INPACKETS];
+                record->counter[OUTBYTES] += statCounter->counter[OUTBYTES];
+                record->counter[OUTPACKETS] += statCounter->counter[OUTPACKETS];
 
-                if (flow_record->msecFirst < kh_value(ElementKHash[j], k).msecFirst) {
-                    kh_value(ElementKHash[j], k).msecFirst = flow_record->msecFirst;
+                if (statCounter->msecFirst < record->msecFirst) {
+                    record->msecFirst = statCounter->msecFirst;
                 }
-                if (flow_record->msecLast > kh_value(ElementKHash[j], k).msecLast) {
-                    kh_value(ElementKHash[j], k).msecLast = flow_record->msecLast;
+                if (statCounter->msecLast > record->msecLast) {
+                    record->msecLast = statCounter->msecLast;
                 }
-                kh_value(ElementKHash[j], k).counter[FLOWS] += flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+                record->counter[FLOWS] += statCounter->counter[FLOWS];
 
             } else {
-                kh_value(ElementKHash[j], k).counter[INBYTES] = flow_record->inBytes;
-                kh_value(ElementKHash[j], k).counter[INPACKETS] = flow_record->inPackets;
-                kh_value(ElementKHash[j], k).counter[OUTBYTES] = flow_record->out_bytes;
-                kh_value(ElementKHash[j], k).counter[OUTPACKETS] = flow_record->out_pkts;
-                kh_value(ElementKHash[j], k).msecFirst = flow_record->msecFirst;
-                kh_value(ElementKHash[j], k).msecLast = flow_record->msecLast;
-                kh_value(ElementKHash[j], k).counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
-                kh_value(ElementKHash[j], k).hashkey = hashkey;
+                memcpy((void *)record->counter, (void *)statCounter->counter, sizeof(record->counter));
+                record->msecFirst = statCounter->msecFirst;
+                record->msecLast = statCounter->msecLast;
+                record->hashkey = hashkey;
             }
-        }  // for the number of elements in this stat type
-    }      // for every requested -s stat
-}  // AddElementStat
+        }
+    }
+
+}  // End of ProcessStatTable
+
+// process the stat tables of this worker
+static void ProcessStatTables(int worker) {
+    for (int hash_num = worker; hash_num < NumStats; hash_num += numStatWorkers) {
+        ProcessStatTable(hash_num);
+    }
+
+}  // End of ProcessStatTables
+
+static void *StatWorker(void *arg) {
+    int worker = (int)(long)arg;
+    unsigned generation = 0;
+
+    PinThread(AFFINITY_WORKER);
+
+    pthread_mutex_lock(&statMutex);
+    while (1) {
+        while (generation == statGeneration && !statTerminate) pthread_cond_wait(&statCond, &statMutex);
+        if (statTerminate) break;
+        generation = statGeneration;
+        pthread_mutex_unlock(&statMutex);
+
+        ProcessStatTables(worker);
+
+        pthread_mutex_lock(&statMutex);
+        if (--statPending == 0) pthread_cond_signal(&statDone);
+    }
+    pthread_mutex_unlock(&statMutex);
+
+    return NULL;
+
+}  // End of StatWorker
+
+static int StartStatWorkers(void) {
+    // threads do not survive a fork() - a forked child starts its own workers
+    pthread_mutex_init(&statMutex, NULL);
+    pthread_cond_init(&statCond, NULL);
+    pthread_cond_init(&statDone, NULL);
+    statGeneration = 0;
+    statPending = 0;
+    statTerminate = 0;
+
+    for (int i = 1; i < numStatWorkers; i++) {
+        int err = pthread_create(&statWorker[i], NULL, StatWorker, (void *)(long)i);
+        if (err) {
+            LogError("pthread_create() error in %s line %d: %s", __FILE__, __LINE__, strerror(err));
+            // stop the workers started so far and continue single threaded
+            pthread_mutex_lock(&statMutex);
+            statTerminate = 1;
+            pthread_cond_broadcast(&statCond);
+            pthread_mutex_unlock(&statMutex);
+            for (int j = 1; j < i; j++) pthread_join(statWorker[j], NULL);
+            numStatWorkers = 1;
+            return 0;
+        }
+    }
+    statWorkersRunning = 1;
+    statWorkersPid = getpid();
+
+    return 1;
+
+}  // End of StartStatWorkers
+
+static void FlushStatBatch(void) {
+    if (batchSize == 0) return;
+
+    if (numStatWorkers > 1 && (statWorkersRunning == 0 || statWorkersPid != getpid())) StartStatWorkers();
+
+    if (numStatWorkers > 1) {
+        pthread_mutex_lock(&statMutex);
+        statPending = numStatWorkers - 1;
+        statGeneration++;
+        pthread_cond_broadcast(&statCond);
+        pthread_mutex_unlock(&statMutex);
+
+        ProcessStatTables(0);
+
+        pthread_mutex_lock(&statMutex);
+        while (statPending) pthread_cond_wait(&statDone, &statMutex);
+        pthread_mutex_unlock(&statMutex);
+    } else {
+        ProcessStatTables(0);
+    }
+    batchSize = 0;
+
+    CheckStatTables();
+
+}  // End of FlushStatBatch
+
+void AddElementStat(master_record_t *flow_record) {
+    uint64_t *record = (uint64_t *)flow_record;
+
+    // extract the keys of all requested -s stats
+    hashkey_t *hashkey = &batchKeys[batchSize * numStatKeys];
+    for (int q = 0; q < numStatKeys; q++) {
+        statKey_t *statKey = &statKeys[q];
+        hashkey[q].v1 = (record[statKey->offset1] & statKey->mask) >> statKey->shift;
+        hashkey[q].v0 = statKey->offset0 ? record[statKey->offset0] : 0;
+        hashkey[q].proto = statKey->order_proto ? flow_record->proto : 0;
+    }
+
+    statCounter_t *statCounter = &batchCounter[batchSize];
+    statCounter->counter[INBYTES] = flow_record->inBytes;
+    statCounter->counter[INPACKETS] = flow_record->inPackets;
+    statCounter->counter[OUTBYTES] = flow_record->out_bytes;
+    statCounter->counter[OUTPACKETS] = flow_record->out_pkts;
+    statCounter->counter[FLOWS] = flow_record->aggr_flows ? flow_record->aggr_flows : 1;
+    statCounter->msecFirst = flow_record->msecFirst;
+    statCounter->msecLast = flow_record->msecLast;
+
+    if (++batchSize == STATBATCH) FlushStatBatch();
+
+}  // End of AddElementStat
+
+// drop all entries of the element stat tables
+static void ResetStatTables(void) {
+    for (int i = 0; i < NumStats; i++) {
+        swiss_destroy_ElementHash(ElementKHash[i]);
+        ElementKHash[i] = swiss_init_ElementHash();
+        if (!ElementKHash[i]) {
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            exit(255);
+        }
+    }
+
+}  // End of ResetStatTables
+
+// memory used by the stat tables - a table about to grow needs the old and the new table
+static int StatTablesFull(void) {
+    if (!aggrBudget) return 0;
+
+    size_t entries = 0;
+    size_t memory = 0;
+    for (int i = 0; i < NumStats; i++) {
+        size_t table = swiss_end(ElementKHash[i]) * (sizeof(StatRecord_t) + 1);
+        if (swiss_grows(ElementKHash[i])) table *= 3;
+        memory += table;
+        entries += swiss_size(ElementKHash[i]);
+    }
+
+    return entries >= SPILLMINENTRIES && memory > aggrBudget;
+
+}  // End of StatTablesFull
+
+// write all entries of the stat tables into the partitions of spill and reset the tables
+static int SpillStatTables(spill_t *spill) {
+    dbg_printf("Spill stat tables at level %d\n", SpillLevel(spill));
+    for (int hash_num = 0; hash_num < NumStats; hash_num++) {
+        for (size_t k = 0; k != swiss_end(ElementKHash[hash_num]); ++k) {
+            if (!swiss_exist(ElementKHash[hash_num], k)) continue;
+            statSpillRecord_t spillRecord = {.hash_num = hash_num, .statRecord = swiss_entry(ElementKHash[hash_num], k)};
+            if (!WriteSpill(spill, ElementKeyHash(&spillRecord.statRecord.hashkey), &spillRecord, sizeof(spillRecord))) return 0;
+        }
+    }
+    ResetStatTables();
+
+    return 1;
+
+}  // End of SpillStatTables
+
+// check the memory budget after a batch of records
+static void CheckStatTables(void) {
+    if (!StatTablesFull()) return;
+
+    if (!statSpill) {
+        statSpill = OpenSpill(0);
+        if (!statSpill) exit(255);
+        LogVerbose("Stat tables exceed memory budget of %zu MB - spill to disk", aggrBudget / (1024 * 1024));
+    }
+    if (!SpillStatTables(statSpill)) exit(255);
+
+}  // End of CheckStatTables
+
+static void MergeElementStat(int hash_num, StatRecord_t *statRecord);
+
+typedef struct statMerge_s {
+    int level;
+    spill_t *sub;  // spill set of the next level, if the partition exceeds the budget
+} statMerge_t;
+
+// merge a spill record into the stat tables
+static int MergeStatSpillRecord(void *data, uint32_t size, void *arg) {
+    statMerge_t *statMerge = (statMerge_t *)arg;
+    statSpillRecord_t *spillRecord = (statSpillRecord_t *)data;
+
+    MergeElementStat(spillRecord->hash_num, &spillRecord->statRecord);
+
+    if (statMerge->level + 1 < SPILLMAXLEVEL && StatTablesFull()) {
+        if (!statMerge->sub) statMerge->sub = OpenSpill(statMerge->level + 1);
+        if (!statMerge->sub || !SpillStatTables(statMerge->sub)) return 0;
+    }
+
+    return 1;
+
+}  // End of MergeStatSpillRecord
+
+// aggregate the partitions of a spill set one by one and call func for each of them
+static int ProcessStatSpill(spill_t *spill, partitionFunc_t func, void *arg) {
+    for (int p = 0; p < SPILLPARTITIONS; p++) {
+        ResetStatTables();
+
+        statMerge_t statMerge = {.level = SpillLevel(spill), .sub = NULL};
+        int ok = ReadSpill(spill, p, MergeStatSpillRecord, &statMerge);
+        if (ok && statMerge.sub) {
+            // partition too large - split it by the next level
+            ok = SpillStatTables(statMerge.sub) && ProcessStatSpill(statMerge.sub, func, arg);
+        } else if (ok) {
+            ok = func(arg);
+        }
+        CloseSpill(statMerge.sub);
+        if (!ok) return 0;
+    }
+    ResetStatTables();
+
+    return 1;
+
+}  // End of ProcessStatSpill
+
+// process the spilled stat tables - the remaining entries are spilled first
+static int ProcessSpilledStat(partitionFunc_t func, void *arg) {
+    int ok = SpillStatTables(statSpill) && ProcessStatSpill(statSpill, func, arg);
+    CloseSpill(statSpill);
+    statSpill = NULL;
+
+    return ok;
+
+}  // End of ProcessSpilledStat
+
+static int ExportStatTables(void *arg) {
+    FILE *fp = (FILE *)arg;
+
+    for (int hash_num = 0; hash_num < NumStats; hash_num++) {
+        int dnsName = StatParameters[StatRequest[hash_num].StatType].type == IS_DNSNAME;
+        for (size_t k = 0; k != swiss_end(ElementKHash[hash_num]); ++k) {
+            if (!swiss_exist(ElementKHash[hash_num], k)) continue;
+            StatRecord_t *entry = &swiss_entry(ElementKHash[hash_num], k);
+            // the key holds the id of an interned name - send the name along
+            const char *name = dnsName && entry->hashkey.v1 ? dnsNameString(entry->hashkey.v1) : NULL;
+            if (name && !WritePartial(fp, PARTIAL_NAME, hash_num, name, strlen(name))) return 0;
+            if (!WritePartial(fp, PARTIAL_ELEMENT, hash_num, entry, sizeof(StatRecord_t))) return 0;
+        }
+    }
+
+    return 1;
+
+}  // End of ExportStatTables
+
+// write all element stat entries as partial aggregation records
+int ExportElementStat(FILE *fp) {
+    FlushStatBatch();
+
+    if (statSpill) return ProcessSpilledStat(ExportStatTables, fp);
+
+    return ExportStatTables(fp);
+
+}  // End of ExportElementStat
+
+static int SameElement(struct flow_element_s *e1, struct flow_element_s *e2) {
+    return e1->offset0 == e2->offset0 && e1->offset1 == e2->offset1 && e1->mask == e2->mask && e1->shift == e2->shift;
+
+}  // End of SameElement
+
+/*
+ * map the tables of a rollup to the requested stats. A requested stat is either
+ * found in the rollup, or combined from the tables of its src and dst elements,
+ * such as ip from srcip and dstip. Returns 1, if all requested stats are covered.
+ */
+int MapRollupStat(char **rollupStats, int numRollup) {
+    int16_t rollupType[MaxStats];
+    uint8_t rollupProto[MaxStats];
+
+    rollupMapped = 0;
+    if (numRollup > MaxStats || NumStats == 0) return 0;
+
+    for (int r = 0; r < numRollup; r++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s", rollupStats[r]);
+        char *q = strchr(name, '/');
+        if (q) *q = '\0';
+        q = strchr(name, ':');
+        rollupProto[r] = q != NULL;
+        if (q) *q = '\0';
+        rollupType[r] = StatTypeByName(name);
+        if (rollupType[r] < 0) return 0;
+        if (strcasecmp(name, "proto") == 0) rollupProto[r] = 1;
+        rollupMap[r] = 0;
+    }
+
+    for (int j = 0; j < NumStats; j++) {
+        int stat = StatRequest[j].StatType;
+        int order_proto = StatRequest[j].order_proto;
+
+        int covered = 0;
+        for (int r = 0; r < numRollup && !covered; r++) {
+            if (rollupType[r] == stat && rollupProto[r] == order_proto) {
+                rollupMap[r] |= 1 << j;
+                covered = 1;
+            }
+        }
+        if (covered) continue;
+
+        // combine src and dst tables
+        int component[2] = {-1, -1};
+        for (int i = 0; i < StatParameters[stat].num_elem; i++) {
+            for (int r = 0; r < numRollup; r++) {
+                int rollup = rollupType[r];
+                if (rollupProto[r] == order_proto && StatParameters[rollup].num_elem == 1 &&
+                    SameElement(&StatParameters[rollup].element[0], &StatParameters[stat].element[i])) {
+                    component[i] = r;
+                    break;
+                }
+            }
+        }
+        if (StatParameters[stat].num_elem != 2 || component[0] < 0 || component[1] < 0) return 0;
+        rollupMap[component[0]] |= 1 << j;
+        rollupMap[component[1]] |= 1 << j;
+    }
+
+    rollupMapped = 1;
+    return 1;
+
+}  // End of MapRollupStat
+
+static void MergeElementStat(int hash_num, StatRecord_t *statRecord) {
+    int ret;
+    size_t k = swiss_put_ElementHash(ElementKHash[hash_num], &statRecord->hashkey, ElementKeyHash(&statRecord->hashkey), &ret);
+    if (ret < 0) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(255);
+    }
+    if (ret == 0) {
+        StatRecord_t *record = &swiss_entry(ElementKHash[hash_num], k);
+        for (int i = 0; i < 5; i++) record->counter[i] += statRecord->counter[i];
+        if (statRecord->msecFirst < record->msecFirst) record->msecFirst = statRecord->msecFirst;
+        if (statRecord->msecLast > record->msecLast) record->msecLast = statRecord->msecLast;
+    } else {
+        swiss_entry(ElementKHash[hash_num], k) = *statRecord;
+    }
+
+}  // End of MergeElementStat
+
+// merge a partial aggregation record into the element stat
+int ImportElementStat(uint16_t hash_num, void *data, uint32_t size) {
+    if (hash_num >= (rollupMapped ? MaxStats : NumStats) || size != sizeof(StatRecord_t)) {
+        LogError("Partial element stat does not match the requested stats");
+        return 0;
+    }
+
+    FlushStatBatch();
+
+    StatRecord_t *statRecord = (StatRecord_t *)data;
+    if (rollupMapped) {
+        for (int j = 0; j < NumStats; j++) {
+            if (rollupMap[hash_num] & (1 << j)) MergeElementStat(j, statRecord);
+        }
+    } else {
+        MergeElementStat(hash_num, statRecord);
+    }
+    CheckStatTables();
+
+    return 1;
+
+}  // End of ImportElementStat
 
 static void PrintStatLine(stat_record_t *stat, outputParams_t *outputParams, StatRecord_t *StatData, int type, int order_proto, int inout) {
-    char valstr[64];
+    char valstr[MAXDNSNAME];
     char tag_string[2];
 
     tag_string[0] = '\0';
@@ -828,9 +1321,22 @@ static void PrintStatLine(stat_record_t *stat, outputParams_t *outputParams, Sta
         } break;
         case IS_GEO: {
             snprintf(valstr, 64, "%s", (char *)&(StatData->hashkey.v1));
-        }
+        } break;
+        case IS_DNSNAME: {
+            const char *name = StatData->hashkey.v1 ? dnsNameString(StatData->hashkey.v1) : "-";
+            if (name)
+                snprintf(valstr, sizeof(valstr), "%s", name);
+            else
+                snprintf(valstr, sizeof(valstr), "0x%llx", (unsigned long long)StatData->hashkey.v1);
+        } break;
+        case IS_DNSTYPE: {
+            dnsTypeString(StatData->hashkey.v1, valstr, sizeof(valstr));
+        } break;
+        case IS_DNSRCODE: {
+            dnsRcodeString(StatData->hashkey.v1, valstr, sizeof(valstr));
+        } break;
     }
-    valstr[63] = 0;
+    valstr[sizeof(valstr) - 1] = 0;
 
     uint64_t count_flows = StatData->counter[FLOWS];
     uint64_t count_packets = packets_element(StatData, inout);
@@ -968,7 +1474,7 @@ static void PrintPipeStatLine(StatRecord_t *StatData, int type, int order_proto,
 }  // End of PrintPipeStatLine
 
 static void PrintCvsStatLine(stat_record_t *stat, int printPlain, StatRecord_t *StatData, int type, int order_proto, int tag, int inout) {
-    char valstr[40], datestr1[64], datestr2[64];
+    char valstr[MAXDNSNAME], datestr1[64], datestr2[64];
     uint64_t count_flows, count_packets, count_bytes;
     double flows_percent, packets_percent, bytes_percent;
     uint32_t bpp;
@@ -1008,9 +1514,22 @@ static void PrintCvsStatLine(stat_record_t *stat, int printPlain, StatRecord_t *
             snprintf(valstr, 40, "%8llu-%1llu-%1llu", (unsigned long long)StatData->hashkey.v1 >> 4,
                      ((unsigned long long)StatData->hashkey.v1 & 0xF) >> 1, (unsigned long long)StatData->hashkey.v1 & 1);
         } break;
+        case IS_DNSNAME: {
+            const char *name = StatData->hashkey.v1 ? dnsNameString(StatData->hashkey.v1) : "";
+            if (name)
+                snprintf(valstr, sizeof(valstr), "%s", name);
+            else
+                snprintf(valstr, sizeof(valstr), "0x%llx", (unsigned long long)StatData->hashkey.v1);
+        } break;
+        case IS_DNSTYPE: {
+            dnsTypeString(StatData->hashkey.v1, valstr, sizeof(valstr));
+        } break;
+        case IS_DNSRCODE: {
+            dnsRcodeString(StatData->hashkey.v1, valstr, sizeof(valstr));
+        } break;
     }
 
-    valstr[39] = 0;
+    valstr[sizeof(valstr) - 1] = 0;
 
     count_flows = StatData->counter[FLOWS];
     count_packets = packets_element(StatData, inout);
@@ -1058,80 +1577,196 @@ static void PrintCvsStatLine(stat_record_t *stat, int printPlain, StatRecord_t *
 
 }  // End of PrintCvsStatLine
 
+static void PrintStatHeader(outputParams_t *outputParams, int stat, int order_index) {
+    int type = StatParameters[stat].type;
+
+    // this output formatting is pretty ugly - and needs to be cleaned up - improved
+    if (outputParams->mode == MODE_PLAIN && !outputParams->quiet) {
+        if (outputParams->topN != 0) {
+            printf("Top %i %s ordered by %s:\n", outputParams->topN, StatParameters[stat].HeaderInfo, order_mode[order_index].string);
+        } else {
+            printf("Top %s ordered by %s:\n", StatParameters[stat].HeaderInfo, order_mode[order_index].string);
+        }
+        if (Getv6Mode() && (type == IS_IPADDR)) {
+            printf(
+                "Date first seen                 Duration Proto %39s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   "
+                "bpp\n",
+                StatParameters[stat].HeaderInfo);
+        } else {
+            if (LoadedGeoDB) {
+                printf(
+                    "Date first seen                 Duration Proto %21s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      "
+                    "bps   "
+                    "bpp\n",
+                    StatParameters[stat].HeaderInfo);
+            } else {
+                printf(
+                    "Date first seen                 Duration Proto %17s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      "
+                    "bps   "
+                    "bpp\n",
+                    StatParameters[stat].HeaderInfo);
+            }
+        }
+    }
+
+    if (outputParams->mode == MODE_CSV) {
+        if (order_mode[order_index].inout == IN)
+            printf("ts,te,td,pr,val,fl,flP,ipkt,ipktP,ibyt,ibytP,ipps,ibps,ibpp\n");
+        else if (order_mode[order_index].inout == OUT)
+            printf("ts,te,td,pr,val,fl,flP,opkt,opktP,obyt,obytP,opps,obps,obpp\n");
+        else
+            printf("ts,te,td,pr,val,fl,flP,pkt,pktP,byt,bytP,pps,bps,bpp\n");
+    }
+
+}  // End of PrintStatHeader
+
+static void PrintStatRecord(stat_record_t *sum_stat, outputParams_t *outputParams, StatRecord_t *statRecord, int hash_num, int order_index) {
+    int type = StatParameters[StatRequest[hash_num].StatType].type;
+
+    switch (outputParams->mode) {
+        case MODE_PLAIN:
+            PrintStatLine(sum_stat, outputParams, statRecord, type, StatRequest[hash_num].order_proto, order_mode[order_index].inout);
+            break;
+        case MODE_PIPE:
+            PrintPipeStatLine(statRecord, type, StatRequest[hash_num].order_proto, outputParams->doTag, order_mode[order_index].inout);
+            break;
+        case MODE_CSV:
+            PrintCvsStatLine(sum_stat, outputParams->printPlain, statRecord, type, StatRequest[hash_num].order_proto, outputParams->doTag,
+                             order_mode[order_index].inout);
+            break;
+        case MODE_JSON:
+            printf("Not yet implemented output format\n");
+            break;
+    }
+
+}  // End of PrintStatRecord
+
+// output of spilled stat tables
+#define MAXORDERS 32
+typedef struct statOutput_s {
+    stat_record_t *sum_stat;
+    outputParams_t *outputParams;
+    int hash_num;     // stat and order of the current merge
+    int order_index;  // stat and order of the current merge
+
+    // one sorted run per partition for each stat and print order
+    spillRuns_t *runs[MaxStats][MAXORDERS];
+} statOutput_t;
+
+// sort a partition by all print orders of each stat and write the top N entries as sorted run
+static int RunStatPartition(void *arg) {
+    statOutput_t *statOutput = (statOutput_t *)arg;
+    int topN = statOutput->outputParams->topN;
+
+    for (int hash_num = 0; hash_num < NumStats; hash_num++) {
+        int direction = StatRequest[hash_num].direction;
+        for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+            if ((StatRequest[hash_num].order_bits & (1 << order_index)) == 0) continue;
+
+            uint32_t numflows;
+            SortElement_t *topN_element_list = StatTopN(0, &numflows, hash_num, order_index, direction);
+            if (!topN_element_list || !NewRun(statOutput->runs[hash_num][order_index])) {
+                free((void *)topN_element_list);
+                return 0;
+            }
+
+            // write the run in print order - the list may be sorted either way
+            int ascending = numflows < 2 || topN_element_list[0].count <= topN_element_list[numflows - 1].count;
+            int fromEnd = (direction == ASCENDING) != ascending;
+            uint32_t max = numflows;
+            if (topN && topN < numflows) max = topN;
+            for (uint32_t i = 0; i < max; i++) {
+                SortElement_t *element = &topN_element_list[fromEnd ? numflows - 1 - i : i];
+                if (!WriteRun(statOutput->runs[hash_num][order_index], element->count, element->record, sizeof(StatRecord_t))) {
+                    free((void *)topN_element_list);
+                    return 0;
+                }
+            }
+            free((void *)topN_element_list);
+        }
+    }
+
+    return 1;
+
+}  // End of RunStatPartition
+
+static int PrintStatSpillRecord(void *data, uint32_t size, void *arg) {
+    statOutput_t *statOutput = (statOutput_t *)arg;
+
+    PrintStatRecord(statOutput->sum_stat, statOutput->outputParams, (StatRecord_t *)data, statOutput->hash_num, statOutput->order_index);
+
+    return 1;
+
+}  // End of PrintStatSpillRecord
+
+// print the spilled stat tables - partitions are sorted into runs, which are merged for the top N
+static void PrintSpilledStat(stat_record_t *sum_stat, outputParams_t *outputParams) {
+    statOutput_t *statOutput = (statOutput_t *)calloc(1, sizeof(statOutput_t));
+    if (!statOutput) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return;
+    }
+    statOutput->sum_stat = sum_stat;
+    statOutput->outputParams = outputParams;
+
+    int ok = 1;
+    for (int hash_num = 0; hash_num < NumStats && ok; hash_num++) {
+        for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+            if ((StatRequest[hash_num].order_bits & (1 << order_index)) == 0) continue;
+            statOutput->runs[hash_num][order_index] = OpenRuns();
+            if (!statOutput->runs[hash_num][order_index]) ok = 0;
+        }
+    }
+
+    if (ok && ProcessSpilledStat(RunStatPartition, statOutput)) {
+        for (int hash_num = 0; hash_num < NumStats; hash_num++) {
+            for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
+                if ((StatRequest[hash_num].order_bits & (1 << order_index)) == 0) continue;
+                PrintStatHeader(outputParams, StatRequest[hash_num].StatType, order_index);
+                statOutput->hash_num = hash_num;
+                statOutput->order_index = order_index;
+                MergeRuns(statOutput->runs[hash_num][order_index], StatRequest[hash_num].direction == ASCENDING, outputParams->topN,
+                          PrintStatSpillRecord, statOutput);
+                printf("\n");
+            }
+        }
+    }
+
+    for (int hash_num = 0; hash_num < NumStats; hash_num++) {
+        for (int i = 0; i < MAXORDERS; i++) CloseRuns(statOutput->runs[hash_num][i]);
+    }
+    free(statOutput);
+
+}  // End of PrintSpilledStat
+
 void PrintElementStat(stat_record_t *sum_stat, outputParams_t *outputParams, RecordPrinter_t print_record) {
     uint32_t numflows;
 
+    FlushStatBatch();
+
+    if (statSpill) {
+        PrintSpilledStat(sum_stat, outputParams);
+        return;
+    }
+
     numflows = 0;
     // for every requested -s stat do
     for (int hash_num = 0; hash_num < NumStats; hash_num++) {
         int stat = StatRequest[hash_num].StatType;
         int order = StatRequest[hash_num].order_bits;
         int direction = StatRequest[hash_num].direction;
-        int type = StatParameters[stat].type;
         for (int order_index = 0; order_mode[order_index].string != NULL; order_index++) {
             unsigned int order_bit = (1 << order_index);
             if (order & order_bit) {
                 SortElement_t *topN_element_list = StatTopN(outputParams->topN, &numflows, hash_num, order_index, direction);
 
-                // this output formatting is pretty ugly - and needs to be cleaned up - improved
-                if (outputParams->mode == MODE_PLAIN && !outputParams->quiet) {
-                    if (outputParams->topN != 0) {
-                        printf("Top %i %s ordered by %s:\n", outputParams->topN, StatParameters[stat].HeaderInfo, order_mode[order_index].string);
-                    } else {
-                        printf("Top %s ordered by %s:\n", StatParameters[stat].HeaderInfo, order_mode[order_index].string);
-                    }
-                    if (Getv6Mode() && (type == IS_IPADDR)) {
-                        printf(
-                            "Date first seen                 Duration Proto %39s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      bps   "
-                            "bpp\n",
-                            StatParameters[stat].HeaderInfo);
-                    } else {
-                        if (LoadedGeoDB) {
-                            printf(
-                                "Date first seen                 Duration Proto %21s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      "
-                                "bps   "
-                                "bpp\n",
-                                StatParameters[stat].HeaderInfo);
-                        } else {
-                            printf(
-                                "Date first seen                 Duration Proto %17s    Flows(%%)     Packets(%%)       Bytes(%%)         pps      "
-                                "bps   "
-                                "bpp\n",
-                                StatParameters[stat].HeaderInfo);
-                        }
-                    }
-                }
-
-                if (outputParams->mode == MODE_CSV) {
-                    if (order_mode[order_index].inout == IN)
-                        printf("ts,te,td,pr,val,fl,flP,ipkt,ipktP,ibyt,ibytP,ipps,ibps,ibpp\n");
-                    else if (order_mode[order_index].inout == OUT)
-                        printf("ts,te,td,pr,val,fl,flP,opkt,opktP,obyt,obytP,opps,obps,obpp\n");
-                    else
-                        printf("ts,te,td,pr,val,fl,flP,pkt,pktP,byt,bytP,pps,bps,bpp\n");
-                }
+                PrintStatHeader(outputParams, stat, order_index);
 
                 int j = numflows - outputParams->topN;
                 j = j < 0 ? 0 : j;
                 if (outputParams->topN == 0) j = 0;
                 for (int i = numflows - 1; i >= j; i--) {
-                    switch (outputParams->mode) {
-                        case MODE_PLAIN:
-                            PrintStatLine(sum_stat, outputParams, (StatRecord_t *)topN_element_list[i].record, type,
-                                          StatRequest[hash_num].order_proto, order_mode[order_index].inout);
-                            break;
-                        case MODE_PIPE:
-                            PrintPipeStatLine((StatRecord_t *)topN_element_list[i].record, type, StatRequest[hash_num].order_proto,
-                                              outputParams->doTag, order_mode[order_index].inout);
-                            break;
-                        case MODE_CSV:
-                            PrintCvsStatLine(sum_stat, outputParams->printPlain, (StatRecord_t *)topN_element_list[i].record, type,
-                                             StatRequest[hash_num].order_proto, outputParams->doTag, order_mode[order_index].inout);
-                            break;
-                        case MODE_JSON:
-                            printf("Not yet implemented output format\n");
-                            break;
-                    }
+                    PrintStatRecord(sum_stat, outputParams, (StatRecord_t *)topN_element_list[i].record, hash_num, order_index);
                 }
                 free((void *)topN_element_list);
                 printf("\n");
@@ -1140,11 +1775,20 @@ void PrintElementStat(stat_record_t *sum_stat, outputParams_t *outputParams, Rec
     }      // for every requested -s stat do
 }  // End of PrintElementStat
 
+// load and probe lengths of all element stat tables
+void ElementHashStat(swiss_stat_t *stat) {
+    FlushStatBatch();
+    for (int i = 0; i < NumStats; i++) {
+        if (ElementKHash[i]) swiss_stat_ElementHash(ElementKHash[i], stat);
+    }
+
+}  // End of ElementHashStat
+
 static SortElement_t *StatTopN(int topN, uint32_t *count, int hash_num, int order, int direction) {
     SortElement_t *topN_list;
     uint32_t c, maxindex;
 
-    maxindex = kh_size(ElementKHash[hash_num]);
+    maxindex = swiss_size(ElementKHash[hash_num]);
     dbg_printf("StatTopN sort %u records\n", maxindex);
     topN_list = (SortElement_t *)calloc(maxindex, sizeof(SortElement_t));
 
@@ -1156,9 +1800,9 @@ static SortElement_t *StatTopN(int topN, uint32_t *count, int hash_num, int orde
     // preset topN_list table - still unsorted
     c = 0;
     // Iterate through all buckets
-    for (khiter_t k = kh_begin(ElementKHash[hash_num]); k != kh_end(ElementKHash[hash_num]); ++k) {  // traverse
-        if (kh_exist(ElementKHash[hash_num], k)) {
-            StatRecord_t *r = &kh_value(ElementKHash[hash_num], k);
+    for (size_t k = 0; k != swiss_end(ElementKHash[hash_num]); ++k) {  // traverse
+        if (swiss_exist(ElementKHash[hash_num], k)) {
+            StatRecord_t *r = &swiss_entry(ElementKHash[hash_num], k);
 
             // we want to sort only those flows which pass the packet or byte limits
             if (byte_limit) {
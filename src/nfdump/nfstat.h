@@ -33,11 +33,13 @@
 #define _NFSTAT_H 1
 
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 
 #include "config.h"
 #include "nfdump.h"
 #include "output.h"
+#include "swisstable.h"
 
 #define ASCENDING 1
 #define DESCENDING 0
@@ -45,6 +47,7 @@
 #define FLAG_STAT 0x1
 #define FLAG_JA3 0x2
 #define FLAG_GEO 0x4
+#define FLAG_DNS 0x8
 
 /* Function prototypes */
 void SetLimits(int stat, char *packet_limit_string, char *byte_limit_string);
@@ -57,8 +60,16 @@ int SetStat(char *str, int *element_stat, int *flow_stat);
 
 void AddElementStat(master_record_t *flow_record);
 
+int ExportElementStat(FILE *fp);
+
+int ImportElementStat(uint16_t hash_num, void *data, uint32_t size);
+
+int MapRollupStat(char **rollupStats, int numRollup);
+
 void PrintElementStat(stat_record_t *sum_stat, outputParams_t *outputParams, RecordPrinter_t print_record);
 
+void ElementHashStat(swiss_stat_t *stat);
+
 void ListPrintOrder(void);
 
 void ListStatTypes(void);
@@ -0,0 +1,298 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * On-disk cache of per file partial aggregations. An entry is identified by
+ * the flow file (path, inode, size and mtime) and the query spec (filter,
+ * aggregation and statistics). Entries of replaced or modified flow files are
+ * no longer found and age out. The cache is limited in size and the least
+ * recently used entries are removed first.
+ */
+
+#include "querycache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "nfpartial.h"
+#include "util.h"
+
+#define CACHE_MAGIC "NFCACHE1\n"
+#define CACHE_SUFFIX ".nfc"
+#define DEFAULTCACHESIZE 1024
+
+static char *cacheDir = NULL;
+static char *cacheSpec = NULL;
+static uint64_t maxCacheSize = 0;
+
+typedef struct cacheFile_s {
+    char *name;
+    time_t mtime;
+    off_t size;
+} cacheFile_t;
+
+// 64bit FNV-1a hash
+static uint64_t HashKey(const char *key, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+
+}  // End of HashKey
+
+/*
+ * open the cache store with the config keys <store>.path and <store>.maxsize.
+ * The query cache and the rollups use the same store format.
+ */
+int InitQueryCache(char *store, char *spec) {
+    char key[64];
+    snprintf(key, sizeof(key), "%s.path", store);
+    cacheDir = ConfGetString(key);
+    if (!cacheDir) return 0;
+
+    if (!CheckPath(cacheDir, S_IFDIR)) {
+        LogError("Cache store %s disabled", store);
+        free(cacheDir);
+        cacheDir = NULL;
+        return 0;
+    }
+
+    snprintf(key, sizeof(key), "%s.maxsize", store);
+    int maxSize = ConfGetValue(key);
+    if (maxSize <= 0) maxSize = DEFAULTCACHESIZE;
+    maxCacheSize = (uint64_t)maxSize * 1024 * 1024;
+
+    // normalize white space of the spec
+    cacheSpec = strdup(spec);
+    if (!cacheSpec) {
+        LogError("strdup() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    char *q = cacheSpec;
+    int space = 0;
+    for (char *p = spec; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            space = 1;
+            continue;
+        }
+        if (space && q != cacheSpec) *q++ = ' ';
+        space = 0;
+        *q++ = *p;
+    }
+    *q = '\0';
+
+    return 1;
+
+}  // End of InitQueryCache
+
+cacheEntry_t *QueryCacheEntry(char *fileName) {
+    if (!cacheDir) return NULL;
+
+    // files still written by the collector are not cached
+    char *base = strrchr(fileName, '/');
+    base = base ? base + 1 : fileName;
+    if (strstr(base, ".current.")) return NULL;
+
+    char path[MAXPATHLEN];
+    struct stat stat_buf;
+    if (realpath(fileName, path) == NULL || stat(path, &stat_buf) < 0 || access(path, R_OK) < 0) return NULL;
+
+    size_t len = strlen(path) + strlen(cacheSpec) + 64;
+    cacheEntry_t *entry = calloc(1, sizeof(cacheEntry_t));
+    char *key = malloc(len);
+    char *entryPath = malloc(strlen(cacheDir) + 24);
+    if (!entry || !key || !entryPath) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        free(entry);
+        free(key);
+        free(entryPath);
+        return NULL;
+    }
+    size_t keyLen = snprintf(key, len, "%s %llu %llu %llu %s", path, (unsigned long long)stat_buf.st_ino, (unsigned long long)stat_buf.st_size,
+                             (unsigned long long)stat_buf.st_mtime, cacheSpec);
+    sprintf(entryPath, "%s/%016llx%s", cacheDir, (unsigned long long)HashKey(key, keyLen), CACHE_SUFFIX);
+
+    entry->path = entryPath;
+    entry->key = key;
+    return entry;
+
+}  // End of QueryCacheEntry
+
+// read and verify the key of a cache entry - returns open file positioned at the partial data
+static FILE *OpenEntry(char *entry, char *key) {
+    FILE *fp = fopen(entry, "r");
+    if (!fp) return NULL;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t keyLen;
+    if (fread(magic, sizeof(CACHE_MAGIC) - 1, 1, fp) != 1 || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1) != 0 ||
+        fread(&keyLen, sizeof(keyLen), 1, fp) != 1 || keyLen != strlen(key)) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *k = malloc(keyLen);
+    if (!k || fread(k, keyLen, 1, fp) != 1 || memcmp(k, key, keyLen) != 0) {
+        free(k);
+        fclose(fp);
+        return NULL;
+    }
+    free(k);
+
+    return fp;
+
+}  // End of OpenEntry
+
+// merge cached partial aggregation. Returns 0, if no valid entry exists
+int LoadQueryCache(cacheEntry_t *entry, partialStat_t *partialStat) {
+    FILE *fp = OpenEntry(entry->path, entry->key);
+    if (!fp) return 0;
+
+    if (!ImportPartial(fp, entry->path, partialStat)) {
+        // the tables may be partially merged already - the result would be wrong
+        LogError("Corrupt query cache entry %s removed. Please repeat the query", entry->path);
+        fclose(fp);
+        unlink(entry->path);
+        exit(255);
+    }
+    fclose(fp);
+
+    // mark entry as recently used
+    utimes(entry->path, NULL);
+
+    return 1;
+
+}  // End of LoadQueryCache
+
+int StoreQueryCache(cacheEntry_t *entry, partialStat_t *partialStat, int element_stat, int flow_stat) {
+    char tmpEntry[MAXPATHLEN];
+    snprintf(tmpEntry, MAXPATHLEN, "%s.%d", entry->path, (int)getpid());
+
+    FILE *fp = fopen(tmpEntry, "w");
+    if (!fp) {
+        LogError("fopen() query cache entry %s failed: %s", tmpEntry, strerror(errno));
+        return 0;
+    }
+
+    uint32_t keyLen = strlen(entry->key);
+    int ok = fwrite(CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1, 1, fp) == 1 && fwrite(&keyLen, sizeof(keyLen), 1, fp) == 1 &&
+             fwrite(entry->key, keyLen, 1, fp) == 1 && ExportPartial(fp, partialStat, element_stat, flow_stat);
+    if (fclose(fp) != 0) ok = 0;
+
+    // rename is atomic - readers see either no entry or the complete entry
+    if (!ok || rename(tmpEntry, entry->path) < 0) {
+        LogError("Failed to write query cache entry %s: %s", entry->path, strerror(errno));
+        unlink(tmpEntry);
+        return 0;
+    }
+
+    return 1;
+
+}  // End of StoreQueryCache
+
+static int CompareMtime(const void *p1, const void *p2) {
+    const cacheFile_t *f1 = (const cacheFile_t *)p1;
+    const cacheFile_t *f2 = (const cacheFile_t *)p2;
+    if (f1->mtime == f2->mtime) return 0;
+    return f1->mtime < f2->mtime ? -1 : 1;
+
+}  // End of CompareMtime
+
+// remove least recently used entries, until the cache fits into its size limit
+void ExpireQueryCache(void) {
+    if (!cacheDir) return;
+
+    DIR *dir = opendir(cacheDir);
+    if (!dir) {
+        LogError("opendir() %s failed: %s", cacheDir, strerror(errno));
+        return;
+    }
+
+    size_t numFiles = 0;
+    size_t maxFiles = 256;
+    cacheFile_t *files = malloc(maxFiles * sizeof(cacheFile_t));
+    if (!files) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        closedir(dir);
+        return;
+    }
+
+    uint64_t cacheSize = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        size_t len = strlen(de->d_name);
+        if (len <= strlen(CACHE_SUFFIX) || strcmp(de->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0) continue;
+
+        char path[MAXPATHLEN];
+        struct stat stat_buf;
+        snprintf(path, MAXPATHLEN, "%s/%s", cacheDir, de->d_name);
+        if (stat(path, &stat_buf) < 0) continue;
+
+        if (numFiles == maxFiles) {
+            maxFiles *= 2;
+            cacheFile_t *p = realloc(files, maxFiles * sizeof(cacheFile_t));
+            if (!p) {
+                LogError("realloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+                break;
+            }
+            files = p;
+        }
+        files[numFiles].name = strdup(path);
+        files[numFiles].mtime = stat_buf.st_mtime;
+        files[numFiles].size = stat_buf.st_size;
+        cacheSize += stat_buf.st_size;
+        numFiles++;
+    }
+    closedir(dir);
+
+    if (cacheSize > maxCacheSize) {
+        qsort(files, numFiles, sizeof(cacheFile_t), CompareMtime);
+        for (size_t i = 0; i < numFiles && cacheSize > maxCacheSize; i++) {
+            if (unlink(files[i].name) == 0) cacheSize -= files[i].size;
+        }
+    }
+
+    for (size_t i = 0; i < numFiles; i++) free(files[i].name);
+    free(files);
+
+}  // End of ExpireQueryCache
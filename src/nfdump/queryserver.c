@@ -0,0 +1,464 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "queryserver.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "nftree.h"
+#include "util.h"
+
+#define MAXREQUESTSIZE 65536
+#define MAXQUERYARGS 256
+#define MAXFILTERCACHE 32
+#define DEFAULTQUERYWORKERS 4
+#define REQUESTTIMEOUT 5
+
+// compiled filters are kept resident in the server and inherited by
+// each forked query process
+typedef struct filterCache_s {
+    char *filter;
+    FilterEngine_t *engine;
+} filterCache_t;
+
+static filterCache_t filterCache[MAXFILTERCACHE];
+static int numFilters = 0;
+
+// filter engine of the query currently processed
+static filterCache_t warmFilter = {NULL, NULL};
+
+static volatile sig_atomic_t done = 0;
+
+static void IntHandler(int signal) { done = 1; }  // End of IntHandler
+
+static char *QueryFilter(int argc, char **argv, const char *optString) {
+    // skip all options and collect the filter the same way nfdump does
+    opterr = 0;
+    optind = 1;
+    while (getopt(argc, argv, optString) != EOF)
+        ;
+    opterr = 1;
+
+    size_t len = 0;
+    for (int i = optind; i < argc; i++) len += strlen(argv[i]) + 1;
+    if (len == 0) {
+        optind = 1;
+        return strdup("any");
+    }
+
+    char *filter = calloc(1, len);
+    if (!filter) {
+        LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        optind = 1;
+        return NULL;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (i > optind) strcat(filter, " ");
+        strcat(filter, argv[i]);
+    }
+    optind = 1;
+    return filter;
+
+}  // End of QueryFilter
+
+// lookup a compiled filter in the cache
+static filterCache_t *FindFilter(char *filter) {
+    for (int i = 0; i < numFilters; i++) {
+        if (strcmp(filterCache[i].filter, filter) == 0) return &filterCache[i];
+    }
+    return NULL;
+
+}  // End of FindFilter
+
+// compile a filter received from a query process into the cache - takes ownership of filter
+static void CacheFilter(char *filter) {
+    // include files may change between queries - do not cache them
+    if (FindFilter(filter) || numFilters == MAXFILTERCACHE || strstr(filter, "@include")) {
+        free(filter);
+        return;
+    }
+
+    // a syntax error is reported again by the query process
+    FilterEngine_t *engine = CompileFilter(filter);
+    if (!engine) {
+        free(filter);
+        return;
+    }
+
+    filterCache[numFilters].filter = filter;
+    filterCache[numFilters].engine = engine;
+    numFilters++;
+
+}  // End of CacheFilter
+
+FilterEngine_t *GetWarmFilter(char *filter) {
+    if (warmFilter.filter && strcmp(warmFilter.filter, filter) == 0) return warmFilter.engine;
+    return NULL;
+
+}  // End of GetWarmFilter
+
+// read the request: a sequence of '\0' terminated arguments, terminated by an empty argument
+// the whole request must arrive within REQUESTTIMEOUT seconds
+static int ReadRequest(int fd, char *buff, char **argv) {
+    uint64_t deadline = nsecTime(CLOCK_MONOTONIC) + REQUESTTIMEOUT * 1000000000LL;
+    size_t size = 0;
+    while (size < MAXREQUESTSIZE) {
+        uint64_t now = nsecTime(CLOCK_MONOTONIC);
+        if (now >= deadline) {
+            LogError("Query request timeout");
+            return 0;
+        }
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int ret = poll(&pfd, 1, (int)((deadline - now) / 1000000) + 1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LogError("poll() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        if (ret == 0) continue;
+
+        ssize_t len = read(fd, buff + size, MAXREQUESTSIZE - size);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            LogError("read() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        if (len == 0) break;
+        size += len;
+        if (size >= 2 && buff[size - 1] == '\0' && buff[size - 2] == '\0') break;
+    }
+
+    if (size < 2 || buff[size - 1] != '\0' || buff[size - 2] != '\0') {
+        LogError("Incomplete or oversized query request");
+        return 0;
+    }
+
+    int argc = 1;
+    char *p = buff;
+    while (*p && argc < MAXQUERYARGS) {
+        argv[argc++] = p;
+        p += strlen(p) + 1;
+    }
+    if (*p) {
+        LogError("Too many arguments in query request");
+        return 0;
+    }
+    argv[argc] = NULL;
+    return argc;
+
+}  // End of ReadRequest
+
+static int OpenServerSocket(char *socketPath) {
+    struct sockaddr_un addr;
+
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        LogError("Socket path too long: %s", socketPath);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LogError("socket() failed on %s: %s", socketPath, strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+    // remove a stale socket of a previous run
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LogError("bind() failed on %s: %s", socketPath, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, 16) < 0) {
+        LogError("listen() failed on %s: %s", socketPath, strerror(errno));
+        close(fd);
+        unlink(socketPath);
+        return -1;
+    }
+
+    return fd;
+
+}  // End of OpenServerSocket
+
+static void RunQuery(int fd, int argc, char **argv, size_t maxMem, queryFunc_t queryFunc) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    if (maxMem) {
+        struct rlimit limit = {.rlim_cur = maxMem, .rlim_max = maxMem};
+        if (setrlimit(RLIMIT_AS, &limit) < 0) {
+            LogError("setrlimit() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        }
+    }
+
+    // stream all output back to the client
+    if (dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0) {
+        LogError("dup2() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    optind = 1;
+    exit(queryFunc(argc, argv));
+
+}  // End of RunQuery
+
+// query process: read the request, pass its filter to the server for the cache and run it
+static void ServeQuery(int fd, int filterfd, char *request, char **queryArgv, const char *optString, size_t maxMem, queryFunc_t queryFunc) {
+    int argc = ReadRequest(fd, request, queryArgv);
+    if (argc == 0) exit(EXIT_FAILURE);
+
+    warmFilter.filter = NULL;
+    warmFilter.engine = NULL;
+    char *filter = QueryFilter(argc, queryArgv, optString);
+    if (filter) {
+        filterCache_t *cached = FindFilter(filter);
+        if (cached) {
+            warmFilter = *cached;
+        } else if (filterfd >= 0 && strlen(filter) < PIPE_BUF) {
+            // a write up to PIPE_BUF is atomic and does not block on the empty pipe
+            if (write(filterfd, filter, strlen(filter) + 1) < 0) LogError("write() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        }
+        free(filter);
+    }
+    if (filterfd >= 0) close(filterfd);
+
+    RunQuery(fd, argc, queryArgv, maxMem, queryFunc);
+
+}  // End of ServeQuery
+
+// read the filter of a query process and compile it into the cache
+static void ReadFilter(int filterfd) {
+    char buff[PIPE_BUF];
+    ssize_t len;
+    do {
+        len = read(filterfd, buff, sizeof(buff));
+    } while (len < 0 && errno == EINTR);
+
+    // no filter, if the query process failed or the filter is already cached
+    if (len > 0 && buff[len - 1] == '\0') {
+        char *filter = strdup(buff);
+        if (filter) CacheFilter(filter);
+    }
+    close(filterfd);
+
+}  // End of ReadFilter
+
+int QueryServer(char *socketPath, const char *optString, queryFunc_t queryFunc) {
+    int maxWorkers = ConfGetValue("daemon.workers");
+    if (maxWorkers <= 0) maxWorkers = DEFAULTQUERYWORKERS;
+    size_t maxMem = (size_t)ConfGetValue("daemon.maxmem") * 1024 * 1024;
+
+    int listenfd = OpenServerSocket(socketPath);
+    if (listenfd < 0) return EXIT_FAILURE;
+
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = IntHandler;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    char *request = malloc(MAXREQUESTSIZE);
+    char *queryArgv[MAXQUERYARGS + 1];
+    // filter pipes of the query processes and the listen socket
+    int maxPipes = 2 * maxWorkers;
+    int *filterPipe = calloc(maxPipes, sizeof(int));
+    struct pollfd *pfd = calloc(maxPipes + 1, sizeof(struct pollfd));
+    if (!request || !filterPipe || !pfd) {
+        LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+        free(request);
+        free(filterPipe);
+        free(pfd);
+        close(listenfd);
+        unlink(socketPath);
+        return EXIT_FAILURE;
+    }
+    queryArgv[0] = "nfdump";
+
+    LogInfo("Query server listening on %s, workers: %d, memory limit: %zu MB", socketPath, maxWorkers, maxMem / (1024 * 1024));
+
+    int numWorkers = 0;
+    int numPipes = 0;
+    while (!done) {
+        // reap finished queries
+        while (numWorkers > 0 && waitpid(-1, NULL, WNOHANG) > 0) numWorkers--;
+
+        // all workers busy - wait for one to finish
+        if (numWorkers >= maxWorkers) {
+            if (waitpid(-1, NULL, 0) > 0) numWorkers--;
+            continue;
+        }
+
+        pfd[0].fd = listenfd;
+        pfd[0].events = POLLIN;
+        for (int i = 0; i < numPipes; i++) {
+            pfd[i + 1].fd = filterPipe[i];
+            pfd[i + 1].events = POLLIN;
+        }
+        if (poll(pfd, numPipes + 1, -1) < 0) {
+            if (errno != EINTR) LogError("poll() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            continue;
+        }
+
+        // filters of the query processes - the requests are read by the query processes,
+        // so a stalled client does not block the server
+        for (int i = numPipes - 1; i >= 0; i--) {
+            if (pfd[i + 1].revents == 0) continue;
+            ReadFilter(filterPipe[i]);
+            filterPipe[i] = filterPipe[--numPipes];
+        }
+
+        if ((pfd[0].revents & POLLIN) == 0) continue;
+        int fd = accept(listenfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) LogError("accept() failed on %s: %s", socketPath, strerror(errno));
+            continue;
+        }
+
+        // without a free pipe the query runs without passing its filter to the cache
+        int pipefd[2] = {-1, -1};
+        if (numPipes < maxPipes && pipe(pipefd) < 0) {
+            LogError("pipe() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            pipefd[0] = pipefd[1] = -1;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            // child
+            close(listenfd);
+            for (int i = 0; i < numPipes; i++) close(filterPipe[i]);
+            if (pipefd[0] >= 0) close(pipefd[0]);
+            ServeQuery(fd, pipefd[1], request, queryArgv, optString, maxMem, queryFunc);
+        } else if (pid < 0) {
+            LogError("fork() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            if (pipefd[0] >= 0) close(pipefd[0]);
+        } else {
+            numWorkers++;
+            if (pipefd[0] >= 0) filterPipe[numPipes++] = pipefd[0];
+        }
+        if (pipefd[1] >= 0) close(pipefd[1]);
+        close(fd);
+    }
+
+    for (int i = 0; i < numPipes; i++) close(filterPipe[i]);
+    LogInfo("Query server terminating - wait for %d running queries", numWorkers);
+    while (numWorkers > 0 && waitpid(-1, NULL, 0) > 0) numWorkers--;
+
+    close(listenfd);
+    unlink(socketPath);
+    free(request);
+    free(filterPipe);
+    free(pfd);
+
+    return EXIT_SUCCESS;
+
+}  // End of QueryServer
+
+int QueryConnect(char *socketPath, int argc, char **argv) {
+    struct sockaddr_un addr;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LogError("socket() failed on %s: %s", socketPath, strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LogError("connect() failed on %s: %s", socketPath, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        // empty arguments would terminate the request
+        if (argv[i][0] == '\0') continue;
+        if (write(fd, argv[i], strlen(argv[i]) + 1) < 0) {
+            LogError("write() failed on %s: %s", socketPath, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    if (write(fd, "", 1) < 0 || (argc == 0 && write(fd, "", 1) < 0)) {
+        LogError("write() failed on %s: %s", socketPath, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    return fd;
+
+}  // End of QueryConnect
+
+int QueryClient(char *socketPath, int argc, char **argv) {
+    int fd = QueryConnect(socketPath, argc, argv);
+    if (fd < 0) return EXIT_FAILURE;
+
+    char buff[65536];
+    ssize_t ret;
+    while ((ret = read(fd, buff, sizeof(buff))) > 0) {
+        if (fwrite(buff, 1, ret, stdout) != (size_t)ret) break;
+    }
+    fflush(stdout);
+    close(fd);
+
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}  // End of QueryClient
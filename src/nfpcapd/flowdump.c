@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "config.h"
@@ -361,6 +362,7 @@ static inline int CloseFlowFile(flowParam_t *flowParam, time_t timestamp) {
 __attribute__((noreturn)) void *flow_thread(void *thread_data) {
     // argument dispatching
     flowParam_t *flowParam = (flowParam_t *)thread_data;
+    PinThread(AFFINITY_WORKER);
     int compress = flowParam->compress;
     FlowSource_t *fs = flowParam->fs;
 
@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "config.h"
@@ -224,6 +225,7 @@ static inline int CloseSender(flowParam_t *flowParam, time_t timestamp) {
 __attribute__((noreturn)) void *sendflow_thread(void *thread_data) {
     // argument dispatching
     flowParam_t *flowParam = (flowParam_t *)thread_data;
+    PinThread(AFFINITY_WORKER);
 
     sendBuffer = malloc(65535);
     nfd_header_t *pcapd_header = (nfd_header_t *)sendBuffer;
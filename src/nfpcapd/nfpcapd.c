@@ -63,6 +63,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "config.h"
@@ -145,6 +146,7 @@ static void usage(char *name) {
         "-I Ident\tset the ident string for stat file. (default 'none')\n"
         "-P pidfile\tset the PID file\n"
         "-t time frame\tset the time window to rotate pcap/nfcapd file\n"
+        "-k class:cpus\tPin receiver, writer or worker threads to cpus.\n"
         "-z=lzo\t\tLZO compress flows in output file.\n"
         "-z=bz2\t\tBZIP2 compress flows in output file.\n"
         "-z=lz4[:level]\tLZ4 compress flows in output file.\n"
@@ -319,7 +321,7 @@ int main(int argc, char *argv[]) {
     inactiveTimeout = 0;
     workers = 0;
 
-    while ((c = getopt(argc, argv, "b:B:C:De:g:hH:I:i:j:l:m:o:p:P:r:s:S:T:t:u:vVw:yz::")) != EOF) {
+    while ((c = getopt(argc, argv, "b:B:C:De:g:hH:I:i:j:k:l:m:o:p:P:r:s:S:T:t:u:vVw:yz::")) != EOF) {
         switch (c) {
             struct stat fstat;
             case 'h':
@@ -407,6 +409,10 @@ int main(int argc, char *argv[]) {
                     break;
                 }
                 break;
+            case 'k':
+                CheckArgLen(optarg, 256);
+                if (!SetAffinity(optarg)) exit(EXIT_FAILURE);
+                break;
             case 'o':
                 if (strlen(optarg) > 64) {
                     LogError("ERROR:, option string size error");
@@ -660,6 +666,11 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    if (!InitAffinity(verbose)) {
+        pcap_close(packetParam.pcap_dev);
+        exit(EXIT_FAILURE);
+    }
+
     if (do_daemonize) {
         daemonize();
     }
@@ -53,6 +53,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "packet_pcap.h"
 #include "pcaproc.h"
 #include "queue.h"
@@ -243,6 +244,7 @@ static inline void PcapDump(packetBuffer_t *packetBuffer, struct bpf_hdr *hdr, c
 
 void __attribute__((noreturn)) * bpf_packet_thread(void *args) {
     packetParam_t *packetParam = (packetParam_t *)args;
+    PinThread(AFFINITY_RECEIVER);
 
     time_t t_win = packetParam->t_win;
     time_t now = time(NULL);
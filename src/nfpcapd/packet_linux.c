@@ -51,6 +51,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "packet_pcap.h"
 #include "pcaproc.h"
 #include "queue.h"
@@ -249,6 +250,7 @@ static inline void PcapDump(packetBuffer_t *packetBuffer, struct tpacket3_hdr *p
 
 void __attribute__((noreturn)) * linux_packet_thread(void *args) {
     packetParam_t *packetParam = (packetParam_t *)args;
+    PinThread(AFFINITY_RECEIVER);
 
     time_t t_win = packetParam->t_win;
     time_t now = time(NULL);
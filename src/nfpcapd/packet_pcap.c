@@ -45,6 +45,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "pcaproc.h"
 #include "queue.h"
 #include "util.h"
@@ -230,6 +231,7 @@ static inline void PcapDump(packetBuffer_t *packetBuffer, struct pcap_pkthdr *hd
 
 void __attribute__((noreturn)) * pcap_packet_thread(void *args) {
     packetParam_t *packetParam = (packetParam_t *)args;
+    PinThread(AFFINITY_RECEIVER);
 
     time_t t_win = packetParam->t_win;
     time_t now = 0;
@@ -44,6 +44,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "affinity.h"
 #include "flist.h"
 #include "nffile.h"
 #include "packet_pcap.h"
@@ -235,6 +236,7 @@ int InitBufferQueues(flushParam_t *flushParam) {
 
 void __attribute__((noreturn)) * flush_thread(void *args) {
     flushParam_t *flushParam = (flushParam_t *)args;
+    PinThread(AFFINITY_WRITER);
 
     snprintf(pcap_dumpfile, MAXPATHLEN, "%s/%s-%i", flushParam->archivedir, PCAP_TMP, getpid());
     pcap_dumpfile[MAXPATHLEN - 1] = '\0';
@@ -39,42 +39,57 @@
 
 #include "config.h"
 #include "md5.h"
+#include "swisstable.h"
 #include "util.h"
 
-// array handling
+// array handling - the arrays are part of ja3_t
 
-#define arrayMask 0x1F
+#define NewArray(a) a.numElements = 0;
 
-#define NewArray(a)        \
-    {                      \
-        a.numElements = 0; \
-        a.array = NULL;    \
-    }
-
-#define AppendArray(a, v)                                                                               \
-    if ((a.numElements & arrayMask) == 0) {                                                             \
-        a.array = realloc(a.array, sizeof(uint16_t) * (a.numElements + (arrayMask + 1)));               \
-        if (!a.array) {                                                                                 \
-            fprintf(stderr, "malloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno)); \
-            exit(255);                                                                                  \
-        }                                                                                               \
-    }                                                                                                   \
+#define AppendArray(a, v)                                                   \
+    if (a.numElements == MAXJA3ELEMENTS) {                                  \
+        dbg_printf("ja3 list exceeds %u elements\n", MAXJA3ELEMENTS);       \
+        return 0;                                                           \
+    }                                                                       \
     a.array[a.numElements++] = (v);
 
-#define FreeArray(a)                \
-    if (a.numElements && a.array) { \
-        free(a.array);              \
-        a.numElements = 0;          \
-        a.array = NULL;             \
-    }
-
 #define LenArray(a) a.numElements
 
+/*
+ * ja3 fingerprint cache. Identical ClientHellos differ in the random and
+ * session ID and often in the key share, therefore the cache is keyed by
+ * the parsed ja3 elements, which skips the ja3 string and md5. An entry
+ * keeps a copy of the elements, which is compared on a hash match.
+ * The cache is 4-way set associative with LRU replacement in each set
+ * and exists per thread.
+ */
+#define JA3CACHESETS 256
+#define JA3CACHEWAYS 4
+
+// max uint16_t elements of a cache key: type, version, 4 list lengths and the lists
+#define MAXJA3KEY (6 + 4 * MAXJA3ELEMENTS)
+
+typedef struct ja3CacheEntry_s {
+    uint64_t hash;
+    uint32_t md5Hash[4];
+    uint32_t stamp;      // last use - 0 empty
+    uint32_t keyLength;  // uint16_t elements in key
+    uint32_t keySize;    // allocated uint16_t elements of key
+    uint16_t *key;
+} ja3CacheEntry_t;
+
+typedef struct ja3Cache_s {
+    uint32_t stamp;
+    ja3CacheEntry_t entry[JA3CACHESETS][JA3CACHEWAYS];
+} ja3Cache_t;
+
+static _Thread_local ja3Cache_t *ja3Cache = NULL;
+
 static int ja3ParseExtensions(ja3_t *ja3, uint8_t *data, size_t len);
 
 static int ja3ParseClientHandshake(ja3_t *ja3, uint8_t *data, size_t len);
 
-static char *ja3Hash(ja3_t *ja3);
+static int ja3Hash(ja3_t *ja3);
 
 static int checkGREASE(uint16_t val);
 
@@ -104,77 +119,124 @@ static int checkGREASE(uint16_t val) {
         (s) -= (n);                                              \
     }
 
-#define CheckStringSize(s, l)                                                   \
-    {                                                                           \
-        if ((s) < (l)) {                                                        \
-            LogError("sLen error in %s line %d: %s\n", __FILE__, __LINE__, ""); \
-            abort();                                                            \
-            return NULL;                                                        \
-        } else {                                                                \
-            (s) -= (l);                                                         \
-        }                                                                       \
+// append a ja3 list as dash separated decimal numbers
+static char *ja3AppendList(char *s, uint16Array_t *a) {
+    for (int i = 0; i < LenArray((*a)); i++) {
+        char digits[6];
+        int n = 0;
+        uint32_t val = a->array[i];
+        do {
+            digits[n++] = '0' + (val % 10);
+            val /= 10;
+        } while (val);
+        while (n) *s++ = digits[--n];
+        *s++ = '-';
     }
+    if (LenArray((*a))) --s;
+    return s;
 
-char *ja3Hash(ja3_t *ja3) {
-    size_t sLen = 6 * (1 + 1 + LenArray(ja3->cipherSuites) + 1 + LenArray(ja3->extensions) + 1 + LenArray(ja3->ellipticCurves) + 1 +
-                       LenArray(ja3->ellipticCurvesPF) + 1) +
-                  1;  // +1 '\0'
+}  // End of ja3AppendList
 
-    ja3->ja3String = calloc(1, sLen);
-    if (!ja3->ja3String) {
-        LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
-        return NULL;
-    }
-    char *s = ja3->ja3String;
-    snprintf(s, sLen, "%u,", ja3->version);
-    size_t len = strlen(s);
-    s += len;
-    sLen = sLen - 1 - len;
-    for (int i = 0; i < LenArray(ja3->cipherSuites); i++) {
-        len = snprintf(s, sLen, "%u-", ja3->cipherSuites.array[i]);
-        s += len;
-        CheckStringSize(sLen, len);
-    }
-    if (LenArray(ja3->cipherSuites)) --s;
-    *s++ = ',';
+// max length of a ja3 string: 4 lists of 5 digits and a separator per element
+#define MAXJA3STRING (6 + 4 * 6 * MAXJA3ELEMENTS + 4 + 1)
 
-    for (int i = 0; i < LenArray(ja3->extensions); i++) {
-        len = snprintf(s, sLen, "%u-", ja3->extensions.array[i]);
-        s += len;
-        CheckStringSize(sLen, len);
-    }
-    if (LenArray(ja3->extensions)) --s;
+// create the ja3 string in s - s must be at least MAXJA3STRING bytes
+static size_t ja3String(ja3_t *ja3, char *s) {
+    char *start = s;
+    s += snprintf(s, 7, "%u", ja3->version);
+    *s++ = ',';
+    s = ja3AppendList(s, &ja3->cipherSuites);
+    *s++ = ',';
+    s = ja3AppendList(s, &ja3->extensions);
 
     // SERVERja3s stops here
     if (ja3->type == CLIENTja3) {
-        // CLIENTja3
         *s++ = ',';
-
-        for (int i = 0; i < LenArray(ja3->ellipticCurves); i++) {
-            len = snprintf(s, sLen, "%u-", ja3->ellipticCurves.array[i]);
-            s += len;
-            CheckStringSize(sLen, len);
-        }
-        if (LenArray(ja3->ellipticCurves)) --s;
+        s = ja3AppendList(s, &ja3->ellipticCurves);
         *s++ = ',';
-
-        for (int i = 0; i < LenArray(ja3->ellipticCurvesPF); i++) {
-            len = snprintf(s, sLen, "%u-", ja3->ellipticCurvesPF.array[i]);
-            s += len;
-            CheckStringSize(sLen, len);
+        s = ja3AppendList(s, &ja3->ellipticCurvesPF);
+    }
+    *s = '\0';
+
+    return s - start;
+
+}  // End of ja3String
+
+// append a ja3 list to a cache key
+static uint32_t ja3AppendKey(uint16_t *key, uint32_t len, uint16Array_t *a) {
+    memcpy((void *)(key + len), (void *)a->array, LenArray((*a)) * sizeof(uint16_t));
+    return len + LenArray((*a));
+
+}  // End of ja3AppendKey
+
+// serialize the ja3 elements as cache key - returns the number of uint16_t elements
+static uint32_t ja3Key(ja3_t *ja3, uint16_t *key) {
+    key[0] = ja3->type;
+    key[1] = ja3->version;
+    key[2] = LenArray(ja3->cipherSuites);
+    key[3] = LenArray(ja3->extensions);
+    key[4] = LenArray(ja3->ellipticCurves);
+    key[5] = LenArray(ja3->ellipticCurvesPF);
+    uint32_t len = 6;
+    len = ja3AppendKey(key, len, &ja3->cipherSuites);
+    len = ja3AppendKey(key, len, &ja3->extensions);
+    len = ja3AppendKey(key, len, &ja3->ellipticCurves);
+    len = ja3AppendKey(key, len, &ja3->ellipticCurvesPF);
+    return len;
+
+}  // End of ja3Key
+
+// set md5 hash of ja3 - use cached hash, if the same elements were seen before
+static int ja3Hash(ja3_t *ja3) {
+    if (ja3Cache == NULL) {
+        // one cache for the lifetime of the thread
+        ja3Cache = calloc(1, sizeof(ja3Cache_t));
+        if (!ja3Cache) {
+            LogError("calloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 0;
         }
-        if (LenArray(ja3->ellipticCurvesPF)) --s;
     }
 
-    if (sLen == 0) {
-        LogError("sLen error in %s line %d: %s\n", __FILE__, __LINE__, "Size == 0");
-        return NULL;
+    uint16_t key[MAXJA3KEY];
+    uint32_t keyLength = ja3Key(ja3, key);
+    uint64_t hash = swiss_hash_bytes(key, keyLength * sizeof(uint16_t));
+    ja3CacheEntry_t *set = ja3Cache->entry[hash % JA3CACHESETS];
+    uint32_t stamp = ++ja3Cache->stamp;
+    int lru = 0;
+    for (int i = 0; i < JA3CACHEWAYS; i++) {
+        if (set[i].stamp && set[i].hash == hash && set[i].keyLength == keyLength &&
+            memcmp((void *)set[i].key, (void *)key, keyLength * sizeof(uint16_t)) == 0) {
+            set[i].stamp = stamp;
+            memcpy((void *)ja3->md5Hash, (void *)set[i].md5Hash, sizeof(ja3->md5Hash));
+            return 1;
+        }
+        if (set[i].stamp < set[lru].stamp) lru = i;
     }
 
-    *s++ = '\0';
-    md5_hash((uint8_t *)ja3->ja3String, strlen(ja3->ja3String), ja3->md5Hash);
+    char s[MAXJA3STRING];
+    size_t len = ja3String(ja3, s);
+    md5_hash((uint8_t *)s, len, ja3->md5Hash);
+
+    ja3CacheEntry_t *entry = &set[lru];
+    if (entry->keySize < keyLength) {
+        free(entry->key);
+        entry->stamp = 0;
+        entry->keySize = 0;
+        entry->key = malloc(keyLength * sizeof(uint16_t));
+        if (!entry->key) {
+            // not cached - the md5 hash is valid anyway
+            LogError("malloc() error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
+            return 1;
+        }
+        entry->keySize = keyLength;
+    }
+    memcpy((void *)entry->key, (void *)key, keyLength * sizeof(uint16_t));
+    entry->keyLength = keyLength;
+    entry->hash = hash;
+    entry->stamp = stamp;
+    memcpy((void *)entry->md5Hash, (void *)ja3->md5Hash, sizeof(ja3->md5Hash));
 
-    return ja3->ja3String;
+    return 1;
 
 }  // End of ja3Hash
 
@@ -402,7 +464,9 @@ void ja3Print(ja3_t *ja3) {
         printf("\n");
     }
 
-    if (ja3->ja3String) printf("string    : %s\n", ja3->ja3String);
+    char s[MAXJA3STRING];
+    ja3String(ja3, s);
+    printf("string    : %s\n", s);
 
     uint8_t *u8 = (uint8_t *)ja3->md5Hash;
     char out[33];
@@ -423,39 +487,28 @@ void ja3Print(ja3_t *ja3) {
 
 }  // End of ja3Print
 
-void ja3Free(ja3_t *ja3) {
-    FreeArray(ja3->cipherSuites);
-    FreeArray(ja3->extensions);
-    FreeArray(ja3->ellipticCurves);
-    FreeArray(ja3->ellipticCurvesPF);
-
-    if (ja3->ja3String) free(ja3->ja3String);
-
-    free(ja3);
-
-}  // End of ja3Free
-
-ja3_t *ja3Process(uint8_t *data, size_t len) {
-    dbg_printf("\nja3Process new packet. size: %zu\n", len);
+// parse a ClientHello or ServerHello into ja3 - returns 0, if not a valid handshake
+int ja3Parse(ja3_t *ja3, uint8_t *data, size_t len) {
+    dbg_printf("\nja3Parse new packet. size: %zu\n", len);
     // Check for
     // - ssl header length (5)
     // - message type/length (4)
     // - and handshake content type (22)
     if (len < 9 || data[0] != 22) {
         dbg_printf("Not an ssl handshake packet\n");
-        return NULL;
+        return 0;
     }
 
     // skip tlsVersion = data[1]<<8 | data[2];
     if (data[1] != 3 && data[2] > 4) {  // major version and SSL 3.0 - TLS1.3
         dbg_printf("Not an SSL 3.0 - TLS 1.3 \n");
-        return NULL;
+        return 0;
     }
 
     uint16_t sslLength = data[3] << 8 | data[4];
     if ((sslLength + 5) > len) {
         dbg_printf("Short ssl packet -  size: %zu, sslLength: %u\n", len, sslLength);
-        return NULL;
+        return 0;
     }
 
     uint8_t messageType = data[5];
@@ -465,41 +518,37 @@ ja3_t *ja3Process(uint8_t *data, size_t len) {
     len -= 9;
     if (messageLength > len) {
         dbg_printf("Message length error: %u > %zu\n", messageLength, len);
-        return NULL;
+        return 0;
     }
 
-    ja3_t *ja3 = calloc(1, sizeof(ja3_t));
-    if (!ja3) {
-        LogError("calloc() error in %s line %d: %s\n", __FILE__, __LINE__, strerror(errno));
-        return NULL;
-    }
+    ja3->sniName[0] = '\0';
+    NewArray(ja3->cipherSuites);
+    NewArray(ja3->extensions);
+    NewArray(ja3->ellipticCurves);
+    NewArray(ja3->ellipticCurvesPF);
 
     int ok = 0;
     switch (messageType) {
         case 1:  // ClientHello
             ja3->type = CLIENTja3;
             ok = ja3ParseClientHandshake(ja3, data + 9, messageLength);
-            if (ok) ja3Hash(ja3);
+            if (ok) ok = ja3Hash(ja3);
             break;
         case 2:  // ServerHello
             ja3->type = SERVERja3s;
             ok = ja3ParseServerHandshake(ja3, data + 9, messageLength);
-            if (ok) ja3Hash(ja3);
+            if (ok) ok = ja3Hash(ja3);
             break;
         default:
             dbg_printf("ja3 process: Message type not ClientHello or ServerHello: %u\n", messageType);
-            ja3Free(ja3);
-            return NULL;
+            return 0;
     }
 
-    if (!ok) {
-        ja3Free(ja3);
-        return NULL;
-    }
+    if (!ok) return 0;
 
     dbg_printf("ja3 process message: %u, Length: %u\n", messageType, messageLength);
     // ja3Print(ja3);
 
-    return ja3;
+    return 1;
 
-}  // End of ja3Process
+}  // End of ja3Parse
@@ -36,9 +36,12 @@
 
 #include "config.h"
 
+// max elements of a ja3 list - a larger ClientHello is rejected
+#define MAXJA3ELEMENTS 256
+
 typedef struct uint16Array_s {
     uint32_t numElements;
-    uint16_t *array;
+    uint16_t array[MAXJA3ELEMENTS];
 } uint16Array_t;
 
 typedef struct ja3_s {
@@ -51,14 +54,11 @@ typedef struct ja3_s {
     uint16Array_t ellipticCurves;
     uint16Array_t ellipticCurvesPF;
     char sniName[256];
-    char *ja3String;
     uint32_t md5Hash[4];
 } ja3_t;
 
 void ja3Print(ja3_t *ja3);
 
-void ja3Free(ja3_t *ja3);
-
-ja3_t *ja3Process(uint8_t *data, size_t len);
+int ja3Parse(ja3_t *ja3, uint8_t *data, size_t len);
 
 #endif
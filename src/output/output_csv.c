@@ -67,7 +67,6 @@ void csv_record(FILE *stream, void *record, int tag) {
     char datestr1[64], datestr2[64], datestr3[64];
     char s_snet[IP_STRING_LEN], s_dnet[IP_STRING_LEN];
     time_t when;
-    struct tm *ts;
     master_record_t *r = (master_record_t *)record;
 
     // if this flow is a tunnel, add a flow line with the tunnel IPs
@@ -92,8 +91,8 @@ void csv_record(FILE *stream, void *record, int tag) {
         snet[1] = htonll(r->V6.srcaddr[1]);
         dnet[0] = htonll(r->V6.dstaddr[0]);
         dnet[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, snet, as, sizeof(as));
-        inet_ntop(AF_INET6, dnet, ds, sizeof(ds));
+        nf_inet_ntop(AF_INET6, snet, as, sizeof(as));
+        nf_inet_ntop(AF_INET6, dnet, ds, sizeof(ds));
 
         inet6_ntop_mask(r->V6.srcaddr, r->src_mask, s_snet, sizeof(s_snet));
         inet6_ntop_mask(r->V6.dstaddr, r->dst_mask, s_dnet, sizeof(s_dnet));
@@ -102,8 +101,8 @@ void csv_record(FILE *stream, void *record, int tag) {
         uint32_t snet, dnet;
         snet = htonl(r->V4.srcaddr);
         dnet = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &snet, as, sizeof(as));
-        inet_ntop(AF_INET, &dnet, ds, sizeof(ds));
+        nf_inet_ntop(AF_INET, &snet, as, sizeof(as));
+        nf_inet_ntop(AF_INET, &dnet, ds, sizeof(ds));
 
         inet_ntop_mask(r->V4.srcaddr, r->src_mask, s_snet, sizeof(s_snet));
         inet_ntop_mask(r->V4.dstaddr, r->dst_mask, s_dnet, sizeof(s_dnet));
@@ -112,12 +111,10 @@ void csv_record(FILE *stream, void *record, int tag) {
     ds[IP_STRING_LEN - 1] = 0;
 
     when = r->msecFirst / 1000LL;
-    ts = localtime(&when);
-    strftime(datestr1, 63, "%Y-%m-%d %H:%M:%S", ts);
+    LocalTimeString(when, datestr1);
 
     when = r->msecLast / 1000LL;
-    ts = localtime(&when);
-    strftime(datestr2, 63, "%Y-%m-%d %H:%M:%S", ts);
+    LocalTimeString(when, datestr2);
 
     double duration = (double)(r->msecLast - r->msecFirst) / 1000.0;
 
@@ -140,14 +137,14 @@ void csv_record(FILE *stream, void *record, int tag) {
         as[0] = 0;
         r->ip_nexthop.V6[0] = htonll(r->ip_nexthop.V6[0]);
         r->ip_nexthop.V6[1] = htonll(r->ip_nexthop.V6[1]);
-        inet_ntop(AF_INET6, r->ip_nexthop.V6, as, sizeof(as));
+        nf_inet_ntop(AF_INET6, r->ip_nexthop.V6, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     } else {
         // EX_NEXT_HOP_v4:
         as[0] = 0;
         r->ip_nexthop.V4 = htonl(r->ip_nexthop.V4);
-        inet_ntop(AF_INET, &r->ip_nexthop.V4, as, sizeof(as));
+        nf_inet_ntop(AF_INET, &r->ip_nexthop.V4, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     }
@@ -157,14 +154,14 @@ void csv_record(FILE *stream, void *record, int tag) {
         as[0] = 0;
         r->bgp_nexthop.V6[0] = htonll(r->bgp_nexthop.V6[0]);
         r->bgp_nexthop.V6[1] = htonll(r->bgp_nexthop.V6[1]);
-        inet_ntop(AF_INET6, r->ip_nexthop.V6, as, sizeof(as));
+        nf_inet_ntop(AF_INET6, r->ip_nexthop.V6, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     } else {
         // 	EX_NEXT_HOP_BGP_v4:
         as[0] = 0;
         r->bgp_nexthop.V4 = htonl(r->bgp_nexthop.V4);
-        inet_ntop(AF_INET, &r->bgp_nexthop.V4, as, sizeof(as));
+        nf_inet_ntop(AF_INET, &r->bgp_nexthop.V4, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     }
@@ -214,14 +211,14 @@ void csv_record(FILE *stream, void *record, int tag) {
         as[0] = 0;
         r->ip_router.V6[0] = htonll(r->ip_router.V6[0]);
         r->ip_router.V6[1] = htonll(r->ip_router.V6[1]);
-        inet_ntop(AF_INET6, r->ip_router.V6, as, sizeof(as));
+        nf_inet_ntop(AF_INET6, r->ip_router.V6, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     } else {
         // EX_NEXT_HOP_v4:
         as[0] = 0;
         r->ip_router.V4 = htonl(r->ip_router.V4);
-        inet_ntop(AF_INET, &r->ip_router.V4, as, sizeof(as));
+        nf_inet_ntop(AF_INET, &r->ip_router.V4, as, sizeof(as));
         as[IP_STRING_LEN - 1] = 0;
         fprintf(stream, ",%s", as);
     }
@@ -234,9 +231,8 @@ void csv_record(FILE *stream, void *record, int tag) {
 
     // Date flow received
     when = r->msecReceived / 1000LL;
-    ts = localtime(&when);
-    strftime(datestr3, 63, ",%Y-%m-%d %H:%M:%S", ts);
+    LocalTimeString(when, datestr3);
 
-    fprintf(stream, "%s.%03llu\n", datestr3, (long long unsigned)r->msecReceived % 1000LL);
+    fprintf(stream, ",%s.%03llu\n", datestr3, (long long unsigned)r->msecReceived % 1000LL);
 
 }  // End of csv_record
@@ -552,6 +552,27 @@ void fmt_epilog(void) {
     // empty
 }  // End of fmt_epilog
 
+// check, if the parsed output format uses only tokens of the NULL terminated list tokens
+int FormatUsesOnly(char **tokens) {
+    for (int i = 0; i < token_index; i++) {
+        if (token_list[i].string_function == NULL) continue;  // static string
+
+        int found = 0;
+        for (int j = 0; tokens[j] && !found; j++) {
+            for (int k = 0; format_token_list[k].token; k++) {
+                if (strcmp(format_token_list[k].token, tokens[j]) == 0) {
+                    found = format_token_list[k].string_function == token_list[i].string_function;
+                    break;
+                }
+            }
+        }
+        if (!found) return 0;
+    }
+
+    return 1;
+
+}  // End of FormatUsesOnly
+
 static void InitFormatParser(void) {
     max_format_index = max_token_index = BLOCK_SIZE;
     format_list = (char **)calloc(1, max_format_index * sizeof(char *));
@@ -746,39 +767,30 @@ static void String_FlowCount(FILE *stream, master_record_t *r) { fprintf(stream,
 
 static void String_FirstSeen(FILE *stream, master_record_t *r) {
     time_t tt;
-    struct tm *ts;
     char s[128];
 
     tt = r->msecFirst / 1000LL;
-    ts = localtime(&tt);
-    strftime(s, 128, "%Y-%m-%d %H:%M:%S", ts);
-    s[127] = '\0';
+    LocalTimeString(tt, s);
     fprintf(stream, "%s.%03u", s, (unsigned)(r->msecFirst % 1000LL));
 
 }  // End of String_FirstSeen
 
 static void String_LastSeen(FILE *stream, master_record_t *r) {
     time_t tt;
-    struct tm *ts;
     char s[128];
 
     tt = r->msecLast / 1000LL;
-    ts = localtime(&tt);
-    strftime(s, 128, "%Y-%m-%d %H:%M:%S", ts);
-    s[127] = '\0';
+    LocalTimeString(tt, s);
     fprintf(stream, "%s.%03u", s, (unsigned)(r->msecLast % 1000LL));
 
 }  // End of String_LastSeen
 
 static void String_Received(FILE *stream, master_record_t *r) {
     time_t tt;
-    struct tm *ts;
     char s[128];
 
     tt = r->msecReceived / 1000LL;
-    ts = localtime(&tt);
-    strftime(s, 128, "%Y-%m-%d %H:%M:%S", ts);
-    s[127] = '\0';
+    LocalTimeString(tt, s);
     fprintf(stream, "%s.%03llu", s, r->msecReceived % 1000LL);
 
 }  // End of String_Received
@@ -890,10 +902,9 @@ static void String_ja3(FILE *stream, master_record_t *r) {
             fprintf(stream, "%32s", "");
             return;
         } else {
-            ja3_t *ja3 = ja3Process((uint8_t *)r->inPayload, r->inPayloadLength);
-            if (ja3) {
-                memcpy((void *)r->ja3, ja3->md5Hash, 16);
-                ja3Free(ja3);
+            ja3_t ja3;
+            if (ja3Parse(&ja3, (uint8_t *)r->inPayload, r->inPayloadLength)) {
+                memcpy((void *)r->ja3, ja3.md5Hash, 16);
             } else {
                 fprintf(stream, "%32s", "ja3 error");
                 return;
@@ -919,10 +930,9 @@ static void String_sniName(FILE *stream, master_record_t *r) {
         fprintf(stream, "%6s", "");
         return;
     } else {
-        ja3_t *ja3 = ja3Process((uint8_t *)r->inPayload, r->inPayloadLength);
-        if (ja3) {
-            fprintf(stream, "%6s", ja3->sniName);
-            ja3Free(ja3);
+        ja3_t ja3;
+        if (ja3Parse(&ja3, (uint8_t *)r->inPayload, r->inPayloadLength)) {
+            fprintf(stream, "%6s", ja3.sniName);
         } else {
             fprintf(stream, "%6s", "");
         }
@@ -942,13 +952,10 @@ static void String_NewLine(FILE *stream, master_record_t *r) { fprintf(stream, "
 #ifdef NSEL
 static void String_EventTime(FILE *stream, master_record_t *r) {
     time_t tt;
-    struct tm *ts;
     char s[128];
 
     tt = r->msecEvent / 1000LL;
-    ts = localtime(&tt);
-    strftime(s, 128, "%Y-%m-%d %H:%M:%S", ts);
-    s[127] = '\0';
+    LocalTimeString(tt, s);
     fprintf(stream, "%s.%03llu", s, r->msecEvent % 1000LL);
 
 }  // End of String_EventTime
@@ -978,14 +985,14 @@ static void String_SrcAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.srcaddr[0]);
         ip[1] = htonll(r->V6.srcaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.srcaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1004,14 +1011,14 @@ static void String_SrcGeoAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.srcaddr[0]);
         ip[1] = htonll(r->V6.srcaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.srcaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (TestFlag(r->mflags, V3_FLAG_ENRICHED) == 0) LookupCountry(r->V6.srcaddr, r->src_geo);
@@ -1032,7 +1039,7 @@ static void String_SrcAddrPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.srcaddr[0]);
         ip[1] = htonll(r->V6.srcaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1040,7 +1047,7 @@ static void String_SrcAddrPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.srcaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
         portchar = ':';
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
@@ -1061,7 +1068,7 @@ static void String_SrcAddrGeoPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.srcaddr[0]);
         ip[1] = htonll(r->V6.srcaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1069,7 +1076,7 @@ static void String_SrcAddrGeoPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.srcaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
         portchar = ':';
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
@@ -1091,14 +1098,14 @@ static void String_DstAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.dstaddr[0]);
         ip[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1117,14 +1124,14 @@ static void String_DstGeoAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.dstaddr[0]);
         ip[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (TestFlag(r->mflags, V3_FLAG_ENRICHED) == 0) LookupCountry(r->V6.dstaddr, r->dst_geo);
@@ -1145,14 +1152,14 @@ static void String_NextHop(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->ip_nexthop.V6[0]);
         ip[1] = htonll(r->ip_nexthop.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->ip_nexthop.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1171,14 +1178,14 @@ static void String_BGPNextHop(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->bgp_nexthop.V6[0]);
         ip[1] = htonll(r->bgp_nexthop.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->bgp_nexthop.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1197,14 +1204,14 @@ static void String_RouterIP(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->ip_router.V6[0]);
         ip[1] = htonll(r->ip_router.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->ip_router.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1223,7 +1230,7 @@ static void String_DstAddrPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.dstaddr[0]);
         ip[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1231,7 +1238,7 @@ static void String_DstAddrPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
         portchar = ':';
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
@@ -1252,7 +1259,7 @@ static void String_DstAddrGeoPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.dstaddr[0]);
         ip[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1260,7 +1267,7 @@ static void String_DstAddrGeoPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
         portchar = ':';
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
@@ -1284,14 +1291,14 @@ static void String_SrcNet(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.srcaddr[0]);
         ip[1] = htonll(r->V6.srcaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.srcaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1312,14 +1319,14 @@ static void String_DstNet(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->V6.dstaddr[0]);
         ip[1] = htonll(r->V6.dstaddr[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->V4.dstaddr);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1735,14 +1742,14 @@ static void String_xlateSrcAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->xlate_src_ip.V6[0]);
         ip[1] = htonll(r->xlate_src_ip.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->xlate_src_ip.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1761,14 +1768,14 @@ static void String_xlateDstAddr(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->xlate_dst_ip.V6[0]);
         ip[1] = htonll(r->xlate_dst_ip.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->xlate_dst_ip.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
     }
     tmp_str[IP_STRING_LEN - 1] = 0;
     if (long_v6)
@@ -1791,7 +1798,7 @@ static void String_xlateSrcAddrPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->xlate_src_ip.V6[0]);
         ip[1] = htonll(r->xlate_src_ip.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1800,7 +1807,7 @@ static void String_xlateSrcAddrPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->xlate_src_ip.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
 
         portchar = ':';
     }
@@ -1822,7 +1829,7 @@ static void String_xlateDstAddrPort(FILE *stream, master_record_t *r) {
 
         ip[0] = htonll(r->xlate_dst_ip.V6[0]);
         ip[1] = htonll(r->xlate_dst_ip.V6[1]);
-        inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET6, ip, tmp_str, sizeof(tmp_str));
         if (!long_v6) {
             CondenseV6(tmp_str);
         }
@@ -1831,7 +1838,7 @@ static void String_xlateDstAddrPort(FILE *stream, master_record_t *r) {
     } else {  // IPv4
         uint32_t ip;
         ip = htonl(r->xlate_dst_ip.V4);
-        inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
+        nf_inet_ntop(AF_INET, &ip, tmp_str, sizeof(tmp_str));
 
         portchar = ':';
     }
@@ -79,6 +79,8 @@ int ParseOutputFormat(char *format, int printPlain, printmap_t *printmap);
 
 void fmt_record(FILE *stream, void *record, int tag);
 
+int FormatUsesOnly(char **tokens);
+
 #define TAG_CHAR ''
 
 #endif  //_OUTPUT_FMT_H
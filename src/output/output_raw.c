@@ -62,7 +62,6 @@ static uint32_t recordCount;
 static void stringEXgenericFlow(FILE *stream, master_record_t *r) {
     char datestr1[64], datestr2[64], datestr3[64];
 
-    struct tm *ts;
     time_t when;
 
     if (TestFlag(r->flags, V3_FLAG_EVENT)) {
@@ -74,8 +73,7 @@ static void stringEXgenericFlow(FILE *stream, master_record_t *r) {
         if (when == 0) {
             strncpy(datestr1, "<unknown>", 63);
         } else {
-            ts = localtime(&when);
-            strftime(datestr1, 63, "%Y-%m-%d %H:%M:%S", ts);
+            LocalTimeString(when, datestr1);
         }
         fprintf(stream, "  Event time   =     %13llu [%s.%03llu]\n", (long long unsigned)eventTime, datestr1, eventTime % 1000LL);
 
@@ -84,16 +82,14 @@ static void stringEXgenericFlow(FILE *stream, master_record_t *r) {
         if (when == 0) {
             strncpy(datestr1, "<unknown>", 63);
         } else {
-            ts = localtime(&when);
-            strftime(datestr1, 63, "%Y-%m-%d %H:%M:%S", ts);
+            LocalTimeString(when, datestr1);
         }
 
         when = r->msecLast / 1000LL;
         if (when == 0) {
             strncpy(datestr2, "<unknown>", 63);
         } else {
-            ts = localtime(&when);
-            strftime(datestr2, 63, "%Y-%m-%d %H:%M:%S", ts);
+            LocalTimeString(when, datestr2);
         }
 
         fprintf(stream,
@@ -104,8 +100,7 @@ static void stringEXgenericFlow(FILE *stream, master_record_t *r) {
 
     if (r->msecReceived) {
         when = r->msecReceived / 1000LL;
-        ts = localtime(&when);
-        strftime(datestr3, 63, "%Y-%m-%d %H:%M:%S", ts);
+        LocalTimeString(when, datestr3);
     } else {
         datestr3[0] = '0';
         datestr3[1] = '\0';
@@ -147,8 +142,8 @@ static void stringEXtunIPv4(FILE *stream, master_record_t *r) {
 
     uint32_t src = htonl(r->tun_src_ip.V4);
     uint32_t dst = htonl(r->tun_dst_ip.V4);
-    inet_ntop(AF_INET, &src, as, sizeof(as));
-    inet_ntop(AF_INET, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET, &dst, ds, sizeof(ds));
 
     LookupLocation(r->tun_src_ip.V6, sloc, 128);
     LookupLocation(r->tun_dst_ip.V6, dloc, 128);
@@ -169,8 +164,8 @@ static void stringEXtunIPv6(FILE *stream, master_record_t *r) {
     src[1] = htonll(r->tun_src_ip.V6[1]);
     dst[0] = htonll(r->tun_dst_ip.V6[0]);
     dst[1] = htonll(r->tun_dst_ip.V6[1]);
-    inet_ntop(AF_INET6, &src, as, sizeof(as));
-    inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET6, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
 
     LookupLocation(r->tun_src_ip.V6, sloc, 128);
     LookupLocation(r->tun_dst_ip.V6, dloc, 128);
@@ -193,8 +188,8 @@ static void stringsEXipv4Flow(FILE *stream, master_record_t *r) {
 
     uint32_t src = htonl(r->V4.srcaddr);
     uint32_t dst = htonl(r->V4.dstaddr);
-    inet_ntop(AF_INET, &src, as, sizeof(as));
-    inet_ntop(AF_INET, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET, &dst, ds, sizeof(ds));
 
     LookupLocation(r->V6.srcaddr, sloc, 128);
     LookupLocation(r->V6.dstaddr, dloc, 128);
@@ -219,8 +214,8 @@ static void stringsEXipv6Flow(FILE *stream, master_record_t *r) {
     src[1] = htonll(r->V6.srcaddr[1]);
     dst[0] = htonll(r->V6.dstaddr[0]);
     dst[1] = htonll(r->V6.dstaddr[1]);
-    inet_ntop(AF_INET6, &src, as, sizeof(as));
-    inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET6, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
 
     LookupLocation(r->V6.srcaddr, sloc, 128);
     LookupLocation(r->V6.dstaddr, dloc, 128);
@@ -296,7 +291,7 @@ static void stringsEXbgpNextHopV4(FILE *stream, master_record_t *r) {
 
     ip[0] = 0;
     uint32_t i = htonl(r->bgp_nexthop.V4);
-    inet_ntop(AF_INET, &i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET, &i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  bgp next hop =  %16s\n", ip);
@@ -309,7 +304,7 @@ static void stringsEXbgpNextHopV6(FILE *stream, master_record_t *r) {
 
     i[0] = htonll(r->bgp_nexthop.V6[0]);
     i[1] = htonll(r->bgp_nexthop.V6[1]);
-    inet_ntop(AF_INET6, i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET6, i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  bgp next hop =  %16s\n", ip);
@@ -321,7 +316,7 @@ static void stringsEXipNextHopV4(FILE *stream, master_record_t *r) {
 
     ip[0] = 0;
     uint32_t i = htonl(r->ip_nexthop.V4);
-    inet_ntop(AF_INET, &i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET, &i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  ip next hop  =  %16s\n", ip);
@@ -334,7 +329,7 @@ static void stringsEXipNextHopV6(FILE *stream, master_record_t *r) {
 
     i[0] = htonll(r->ip_nexthop.V6[0]);
     i[1] = htonll(r->ip_nexthop.V6[1]);
-    inet_ntop(AF_INET6, i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET6, i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  ip next hop  =  %16s\n", ip);
@@ -346,7 +341,7 @@ static void stringsEXipReceivedV4(FILE *stream, master_record_t *r) {
 
     ip[0] = 0;
     uint32_t i = htonl(r->ip_router.V4);
-    inet_ntop(AF_INET, &i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET, &i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  ip exporter  =  %16s\n", ip);
@@ -359,7 +354,7 @@ static void stringsEXipReceivedV6(FILE *stream, master_record_t *r) {
 
     i[0] = htonll(r->ip_router.V6[0]);
     i[1] = htonll(r->ip_router.V6[1]);
-    inet_ntop(AF_INET6, i, ip, sizeof(ip));
+    nf_inet_ntop(AF_INET6, i, ip, sizeof(ip));
     ip[IP_STRING_LEN - 1] = 0;
 
     fprintf(stream, "  ip exporter  =  %16s\n", ip);
@@ -473,8 +468,7 @@ static void stringsEXnselCommon(FILE *stream, master_record_t *r) {
     if (when == 0) {
         strncpy(datestr, "<unknown>", 63);
     } else {
-        struct tm *ts = localtime(&when);
-        strftime(datestr, 63, "%Y-%m-%d %H:%M:%S", ts);
+        LocalTimeString(when, datestr);
     }
     fprintf(stream,
             "  connect ID   =        %10u\n"
@@ -491,8 +485,8 @@ static void stringsEXnselXlateIPv4(FILE *stream, master_record_t *r) {
 
     uint32_t src = htonl(r->xlate_src_ip.V4);
     uint32_t dst = htonl(r->xlate_dst_ip.V4);
-    inet_ntop(AF_INET, &src, as, sizeof(as));
-    inet_ntop(AF_INET, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET, &dst, ds, sizeof(ds));
 
     fprintf(stream,
             "  src xlt ip   =  %16s\n"
@@ -510,8 +504,8 @@ static void stringsEXnselXlateIPv6(FILE *stream, master_record_t *r) {
     src[1] = htonll(r->xlate_src_ip.V6[1]);
     dst[0] = htonll(r->xlate_dst_ip.V6[0]);
     dst[1] = htonll(r->xlate_dst_ip.V6[1]);
-    inet_ntop(AF_INET6, &src, as, sizeof(as));
-    inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
+    nf_inet_ntop(AF_INET6, &src, as, sizeof(as));
+    nf_inet_ntop(AF_INET6, &dst, ds, sizeof(ds));
 
     fprintf(stream,
             "  src xlt ip   =  %16s\n"
@@ -621,9 +615,9 @@ static void inoutPayload(FILE *stream, master_record_t *r, char *payload, uint32
     if (ascii) {
         fprintf(stream, "%.*s\n", max, payload);
     }
-    ja3_t *ja3 = ja3Process((uint8_t *)payload, length);
-    if (ja3 != NULL) {
-        uint8_t *u8 = (uint8_t *)ja3->md5Hash;
+    ja3_t ja3;
+    if (ja3Parse(&ja3, (uint8_t *)payload, length)) {
+        uint8_t *u8 = (uint8_t *)ja3.md5Hash;
         char out[33];
         int i, j;
         for (i = 0, j = 0; i < 16; i++, j += 2) {
@@ -633,14 +627,12 @@ static void inoutPayload(FILE *stream, master_record_t *r, char *payload, uint32
             out[j] = hn <= 9 ? hn + '0' : hn + 'a' - 10;
         }
         out[32] = '\0';
-        if (ja3->type == CLIENTja3) {
+        if (ja3.type == CLIENTja3) {
             fprintf(stream, "  ja3 hash     = %s\n", out);
         } else {
             fprintf(stream, "  ja3s hash    = %s\n", out);
         }
-        if (ja3->sniName[0]) fprintf(stream, "  sni name     = %s\n", ja3->sniName);
-
-        ja3Free(ja3);
+        if (ja3.sniName[0]) fprintf(stream, "  sni name     = %s\n", ja3.sniName);
     }
     DumpHex(stream, payload, max);
 }  // End of stringsEXoutPayload
@@ -56,6 +56,7 @@
 #include "pcap_reader.h"
 #endif
 
+#include "affinity.h"
 #include "bookkeeper.h"
 #include "collector.h"
 #include "daemon.h"
@@ -99,6 +100,8 @@ typedef ssize_t (*packet_function_t)(int, void *, size_t, int, struct sockaddr *
 static FlowSource_t *FlowSource;
 
 static int done = 0;
+// rotate files by the packet time stamps, when reading a pcap file
+static int usePacketTime = 0;
 static int gotSIGCHLD = 0;
 static int periodic_trigger;
 
@@ -126,7 +129,7 @@ static void usage(char *name) {
         "-J mcastgroup\tJoin multicast group <mcastgroup>\n"
         "-p portnum\tlisten on port portnum\n"
 #ifdef PCAP
-        "-f pcapfile\tRead network data from pcap file.\n"
+        "-f pcapfile\tRead network data from pcap file. Files rotate by packet time.\n"
         "-d device\tRead network data from device (interface).\n"
 #endif
         "-w flowdir \tset the output directory to store the flows.\n"
@@ -142,6 +145,7 @@ static void usage(char *name) {
         "-A\t\tEnable source address spoofing for packet repeater -R.\n"
         "-x process\tlaunch process after a new file becomes available\n"
         "-W workers\toptionally set the number of workers to compress flows\n"
+        "-k class:cpus\tPin receiver, reader, writer or worker threads to cpus.\n"
         "-z=lzo\t\tLZO compress flows in output file.\n"
         "-z=bz2\t\tBZIP2 compress flows in output file.\n"
         "-z=lz4[:level]\tLZ4 compress flows in output file.\n"
@@ -281,6 +285,8 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
     ssize_t cnt;
     void *in_buff;
 
+    // pin the receive loop before allocating its buffer, so it is placed on the local numa node
+    PinThread(AFFINITY_RECEIVER);
     in_buff = malloc(NETWORK_INPUT_BUFF_SIZE);
     if (!in_buff) {
         LogError("malloc() allocation error in %s line %d: %s", __FILE__, __LINE__, strerror(errno));
@@ -311,9 +317,12 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
     cnt = 0;
     periodic_trigger = 0;
     ignored_packets = 0;
+#ifdef PCAP
+    int firstPacket = 1;
+#endif
 
     // wake up at least at next time slot (twin) + 1s
-    alarm(t_start + twin + 1 - time(NULL));
+    if (!usePacketTime) alarm(t_start + twin + 1 - time(NULL));
     /*
      * Main processing loop:
      * this loop, continues until done = 1, set by the signal handler
@@ -343,7 +352,19 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
 
         /* Periodic file renaming, if time limit reached or if we are done.  */
         // t_now = time(NULL);
-        gettimeofday(&tv, NULL);
+#ifdef PCAP
+        if (usePacketTime) {
+            // the clock runs with the packet time stamps
+            if (PcapPacketTime(&tv)) {
+                if (firstPacket) t_start = tv.tv_sec - (tv.tv_sec % twin);
+                firstPacket = 0;
+            } else {
+                tv.tv_sec = t_start;
+                tv.tv_usec = 0;
+            }
+        } else
+#endif
+            gettimeofday(&tv, NULL);
         t_now = tv.tv_sec;
 
         if (((t_now - t_start) >= twin) || done) {
@@ -469,12 +490,14 @@ static void run(packet_function_t receive_packet, int socket, int pfd, int rfd,
 
             // update alarm for next cycle
             t_start += twin;
+            // skip gaps in the packet capture
+            if (usePacketTime && (t_now - t_start) >= twin) t_start = t_now - (t_now % twin);
             /* t_start = filename time stamp: begin of slot
              * + twin = end of next time interval
              * + 1 = act at least 1s after time window expired
              * - t_now = difference value to now
              */
-            alarm(t_start + twin + 1 - t_now);
+            if (!usePacketTime) alarm(t_start + twin + 1 - t_now);
         }
 
         /* check for error condition or done . errno may only be EINTR */
@@ -601,7 +624,7 @@ int main(int argc, char **argv) {
     workers = 0;
 
     int c;
-    while ((c = getopt(argc, argv, "46AB:b:C:d:DeEf:g:hI:i:jJ:l:m:M:n:p:P:R:S:T:t:u:vVw:x:X:yz::Z")) != EOF) {
+    while ((c = getopt(argc, argv, "46AB:b:C:d:DeEf:g:hI:i:jJ:k:l:m:M:n:p:P:R:S:T:t:u:vVw:x:X:yz::Z")) != EOF) {
         switch (c) {
             case 'h':
                 usage(argv[0]);
@@ -789,6 +812,10 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'k':
+                CheckArgLen(optarg, 256);
+                if (!SetAffinity(optarg)) exit(EXIT_FAILURE);
+                break;
             case 'j':
                 if (compress) {
                     LogError("Use one compression: -z for LZO, -j for BZ2 or -y for LZ4 compression");
@@ -857,7 +884,7 @@ int main(int argc, char **argv) {
         if (strcmp(argv[optind], "privsep") == 0) {
             if (strcmp(argv[optind + 1], "launcher") == 0) {
                 dbg_printf("sfcapd privsep launched\n");
-                int ret = StartupLauncher(launch_process, expire);
+                int ret = StartupLauncher(launch_process, NULL, expire);
                 exit(ret);
             } else if (strcmp(argv[optind + 1], "repeater") == 0) {
                 dbg_printf("sfcapd repeater launched\n");
@@ -875,6 +902,8 @@ int main(int argc, char **argv) {
 
     if (ConfOpen(configFile, "sfcapd") < 0) exit(EXIT_FAILURE);
 
+    if (!InitAffinity(verbose)) exit(EXIT_FAILURE);
+
     if (datadir && !AddFlowSource(&FlowSource, Ident, ANYIP, datadir)) {
         LogError("Failed to add default data collector directory");
         exit(EXIT_FAILURE);
@@ -912,6 +941,7 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
         receive_packet = NextPacket;
+        usePacketTime = 1;
     } else if (pcap_device) {
         printf("Setup pcap device reader\n");
         if (!setup_pcap_live(pcap_device, NULL, bufflen)) {
@@ -0,0 +1,287 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark of the page cache settings file.* in nfdump.conf
+ * cachebench [-d dir] [-a archiveMB] [-c collectorMB] [-r rotateMB]
+ * scans an archive file, while a collector thread writes and rotates files concurrently.
+ * Each setting runs in its own process and reports the scan and collector throughput,
+ * the max rotation time of the collector and the page cache residency of the archive
+ * and the last collector file.
+ * default: dir ., 512MB archive, 256MB collector data, rotated every 64MB
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "nfconf.h"
+#include "nfdump.h"
+#include "nffile.h"
+#include "nffileV2.h"
+
+#define BLOCKSIZE ONEMB
+
+typedef struct setting_s {
+    char *name;
+    char *conf;
+} setting_t;
+
+static setting_t settings[] = {{"default", ""},
+                               {"readahead", "file.readahead = 1\n"},
+                               {"dropcache", "file.readahead = 1\nfile.dropcache = 1\n"},
+                               {"prealloc+syncrange", "file.prealloc = 16\nfile.syncrange = 4\n"},
+                               {"all", "file.readahead = 1\nfile.dropcache = 1\nfile.prealloc = 16\nfile.syncrange = 4\n"},
+                               {NULL, NULL}};
+
+typedef struct collector_s {
+    char *dir;
+    size_t size;
+    size_t rotate;
+    double duration;
+    double maxRotate;
+    char lastFile[MAXPATHLEN];
+} collector_t;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+
+}  // End of now
+
+// percentage of file pages in the page cache
+static double Resident(char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0 || stat_buf.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (stat_buf.st_size + pageSize - 1) / pageSize;
+    unsigned char *vec = malloc(pages);
+    size_t resident = 0;
+    if (vec && mincore(map, stat_buf.st_size, vec) == 0) {
+        for (size_t i = 0; i < pages; i++) resident += vec[i] & 1;
+    }
+    free(vec);
+    munmap(map, stat_buf.st_size);
+
+    return 100.0 * resident / pages;
+
+}  // End of Resident
+
+// evict a file from the page cache for a cold start
+static void Evict(char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+#ifdef HAVE_POSIX_FADVISE
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
+
+}  // End of Evict
+
+// fill the current block with dummy records
+static int WriteData(nffile_t *nffile, size_t size) {
+    uint32_t seed = 0x12345678;
+    for (size_t written = 0; written < size; written += BLOCKSIZE) {
+        uint32_t *p = (uint32_t *)nffile->buff_ptr;
+        for (size_t i = 0; i < BLOCKSIZE / sizeof(uint32_t); i++) {
+            seed = seed * 1103515245 + 12345;
+            p[i] = seed;
+        }
+        nffile->block_header->size = BLOCKSIZE;
+        nffile->block_header->NumRecords = BLOCKSIZE / 64;
+        if (WriteBlock(nffile) <= 0) return 0;
+    }
+    return 1;
+
+}  // End of WriteData
+
+static int CreateArchive(char *fileName, size_t size) {
+    nffile_t *nffile = OpenNewFile(fileName, NULL, CREATOR_UNKNOWN, NOT_COMPRESSED, NOT_ENCRYPTED);
+    if (!nffile) return 0;
+
+    int ok = WriteData(nffile, size);
+    CloseUpdateFile(nffile);
+    DisposeFile(nffile);
+    return ok;
+
+}  // End of CreateArchive
+
+static void *collector(void *arg) {
+    collector_t *collector = (collector_t *)arg;
+
+    double start = now();
+    unsigned num = 0;
+    for (size_t written = 0; written < collector->size; written += collector->rotate) {
+        snprintf(collector->lastFile, MAXPATHLEN, "%s/cachebench.nfcapd.%u", collector->dir, num++);
+        nffile_t *nffile = OpenNewFile(collector->lastFile, NULL, CREATOR_UNKNOWN, NOT_COMPRESSED, NOT_ENCRYPTED);
+        if (!nffile) break;
+        WriteData(nffile, collector->rotate);
+
+        double rotateStart = now();
+        CloseUpdateFile(nffile);
+        double rotate = now() - rotateStart;
+        if (rotate > collector->maxRotate) collector->maxRotate = rotate;
+        DisposeFile(nffile);
+    }
+    collector->duration = now() - start;
+
+    pthread_exit(NULL);
+
+}  // End of collector
+
+// run the benchmark with one setting - must be a separate process, as nffile reads the settings once
+static int RunSetting(setting_t *setting, char *dir, char *archive, size_t archiveSize, size_t collectorSize, size_t rotateSize) {
+    char confFile[MAXPATHLEN];
+    snprintf(confFile, MAXPATHLEN, "%s/cachebench.conf", dir);
+    FILE *fp = fopen(confFile, "w");
+    if (!fp) {
+        fprintf(stderr, "fopen() %s failed: %s\n", confFile, strerror(errno));
+        return 0;
+    }
+    fprintf(fp, "[nfdump]\n%s", setting->conf);
+    fclose(fp);
+
+    if (ConfOpen(confFile, "nfdump") < 0 || !Init_nffile(1, NULL)) return 0;
+
+    collector_t collectorStat = {.dir = dir, .size = collectorSize * ONEMB, .rotate = rotateSize * ONEMB};
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, collector, (void *)&collectorStat)) return 0;
+
+    double start = now();
+    nffile_t *nffile = OpenFile(archive, NULL);
+    if (!nffile) return 0;
+    size_t scanned = 0;
+    while (ReadBlock(nffile) > 0) scanned += nffile->block_header->size;
+    CloseFile(nffile);
+    DisposeFile(nffile);
+    double scan = now() - start;
+
+    pthread_join(tid, NULL);
+
+    printf("%-20s %8.2f %10.1f %12.1f %11.1f %9.1f %11.1f\n", setting->name, scan, (double)scanned / ONEMB / scan,
+           (double)collectorSize / collectorStat.duration, 1000.0 * collectorStat.maxRotate, Resident(archive),
+           Resident(collectorStat.lastFile));
+
+    unlink(confFile);
+    for (unsigned i = 0; i < collectorSize / rotateSize; i++) {
+        char fileName[MAXPATHLEN];
+        snprintf(fileName, MAXPATHLEN, "%s/cachebench.nfcapd.%u", dir, i);
+        unlink(fileName);
+    }
+    return scanned == archiveSize * ONEMB;
+
+}  // End of RunSetting
+
+int main(int argc, char **argv) {
+    char *dir = ".";
+    size_t archiveSize = 512;
+    size_t collectorSize = 256;
+    size_t rotateSize = 64;
+
+    int c;
+    while ((c = getopt(argc, argv, "d:a:c:r:")) != EOF) {
+        switch (c) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'a':
+                archiveSize = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                collectorSize = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rotateSize = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d dir] [-a archiveMB] [-c collectorMB] [-r rotateMB]\n", argv[0]);
+                exit(255);
+        }
+    }
+    if (archiveSize == 0 || collectorSize == 0 || rotateSize == 0 || rotateSize > collectorSize) {
+        fprintf(stderr, "Invalid sizes\n");
+        exit(255);
+    }
+
+    char archive[MAXPATHLEN];
+    snprintf(archive, MAXPATHLEN, "%s/cachebench.archive", dir);
+    if (!Init_nffile(1, NULL) || !CreateArchive(archive, archiveSize * ONEMB)) {
+        fprintf(stderr, "Failed to create archive %s\n", archive);
+        exit(255);
+    }
+
+    printf("archive %zuMB, collector %zuMB rotated every %zuMB\n", archiveSize, collectorSize, rotateSize);
+    printf("%-20s %8s %10s %12s %11s %9s %11s\n", "setting", "scan s", "scan MB/s", "collect MB/s", "rotate ms", "archive %",
+           "collector %");
+
+    int ok = 1;
+    for (int i = 0; settings[i].name; i++) {
+        Evict(archive);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(RunSetting(&settings[i], dir, archive, archiveSize, collectorSize, rotateSize) ? 0 : 1);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Setting %s failed\n", settings[i].name);
+            ok = 0;
+        }
+    }
+
+    unlink(archive);
+    return ok ? 0 : 1;
+
+}  // End of main
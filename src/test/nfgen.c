@@ -71,6 +71,10 @@ static void UpdateRecord(master_record_t *record);
 
 static void PackRecordV3(master_record_t *master_record, nffile_t *nffile);
 
+static void GenDNSFlows(char *fileName);
+
+static void GenSpillFlows(char *fileName, int numFlows);
+
 static void SetIPaddress(master_record_t *record, int af, char *src_ip, char *dst_ip) {
     if (af == PF_INET6) {
         SetFlag(record->mflags, V3_FLAG_IPV6_ADDR);
@@ -340,6 +344,11 @@ static void PackRecordV3(master_record_t *master_record, nffile_t *nffile) {
                 PushVarLengthPointer(v3Record, EXnbarApp, nbarApp, 4);
                 memcpy(nbarApp, master_record->nbarAppID, 4);
             } break;
+            case EXinPayloadID: {
+                uint32_t payloadSize = (master_record->inPayloadLength + 3) & ~3;
+                PushVarLengthPointer(v3Record, EXinPayload, inPayload, payloadSize);
+                memcpy(inPayload, master_record->inPayload, master_record->inPayloadLength);
+            } break;
             default:
                 fprintf(stderr, "PackRecordV3(): Unknown extension '%u'\n", master_record->exElementList[i]);
         }
@@ -358,6 +367,112 @@ static void PackRecordV3(master_record_t *master_record, nffile_t *nffile) {
 
 }  // End of PackRecordV3
 
+// build a dns query for name into msg - returns the message length
+static uint32_t DNSQuery(uint8_t *msg, uint16_t id, char *name, uint16_t qtype) {
+    uint8_t header[] = {id >> 8, id & 0xFF, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    memcpy(msg, header, sizeof(header));
+    uint32_t len = sizeof(header);
+
+    char *label = name;
+    while (*label) {
+        char *dot = strchr(label, '.');
+        size_t labelLen = dot ? (size_t)(dot - label) : strlen(label);
+        msg[len++] = labelLen;
+        memcpy(msg + len, label, labelLen);
+        len += labelLen;
+        label += dot ? labelLen + 1 : labelLen;
+    }
+    msg[len++] = 0;
+    msg[len++] = qtype >> 8;
+    msg[len++] = qtype & 0xFF;
+    msg[len++] = 0x00;
+    msg[len++] = 0x01;
+
+    return len;
+
+}  // End of DNSQuery
+
+// flows with dns queries in the payload for the dns stat tests
+static void GenDNSFlows(char *fileName) {
+    static struct dnsFlow_s {
+        char *srcIP;
+        char *name;
+        uint16_t qtype;
+    } dnsFlows[] = {{"172.16.20.1", "www.example.com", 1},   {"172.16.20.2", "www.example.com", 28},  {"172.16.20.3", "Mail.Example.ORG", 15},
+                    {"172.16.20.1", "www.example.com", 1},   {"172.16.20.4", "ns1.example.net", 1},   {"172.16.20.2", "mail.example.org", 1},
+                    {"172.16.20.5", "www.example.com", 16},  {"172.16.20.3", "_ldap._tcp.example.net", 33}};
+    master_record_t record;
+    uint8_t msg[512];
+
+    nffile_t *nffile = OpenNewFile(fileName, NULL, CREATOR_UNKNOWN, NOT_COMPRESSED, 0);
+    if (!nffile) {
+        exit(255);
+    }
+
+    memset((void *)&record, 0, sizeof(record));
+    record.exElementList[0] = EXgenericFlowID;
+    record.exElementList[1] = EXipv4FlowID;
+    record.exElementList[2] = EXinPayloadID;
+    record.numElements = 3;
+    record.proto = IPPROTO_UDP;
+    record.inPayload = (char *)msg;
+
+    for (int i = 0; i < (int)(sizeof(dnsFlows) / sizeof(struct dnsFlow_s)); i++) {
+        SetIPaddress(&record, PF_INET, dnsFlows[i].srcIP, "192.168.170.53");
+        record.inPayloadLength = DNSQuery(msg, i + 1, dnsFlows[i].name, dnsFlows[i].qtype);
+        record.size = V3HeaderRecordSize + EXgenericFlowSize + EXipv4FlowSize + EXinPayloadSize + ((record.inPayloadLength + 3) & ~3);
+        UpdateRecord(&record);
+        // UpdateRecord() moves the ports
+        record.srcPort = 40000 + i;
+        record.dstPort = 53;
+        PackRecordV3(&record, nffile);
+    }
+
+    if (nffile->block_header->NumRecords) {
+        if (WriteBlock(nffile) <= 0) {
+            fprintf(stderr, "Failed to write output buffer to disk: '%s'", strerror(errno));
+        }
+    }
+    CloseUpdateFile(nffile);
+
+}  // End of GenDNSFlows
+
+// many distinct flows to exceed a small aggregation memory budget
+static void GenSpillFlows(char *fileName, int numFlows) {
+    master_record_t record;
+
+    nffile_t *nffile = OpenNewFile(fileName, NULL, CREATOR_UNKNOWN, LZ4_COMPRESSED, 0);
+    if (!nffile) {
+        exit(255);
+    }
+
+    memset((void *)&record, 0, sizeof(record));
+    record.exElementList[0] = EXgenericFlowID;
+    record.exElementList[1] = EXipv4FlowID;
+    record.numElements = 2;
+    record.size = V3HeaderRecordSize + EXgenericFlowSize + EXipv4FlowSize;
+
+    for (int i = 0; i < numFlows; i++) {
+        UpdateRecord(&record);
+        record.V4.srcaddr = 0xac110000 + (i % 40000);
+        record.V4.dstaddr = 0xc0a80000 + (i % 1000);
+        record.srcPort = 1024 + (i % 30000);
+        record.dstPort = i % 5000;
+        record.proto = i % 3 ? IPPROTO_TCP : IPPROTO_UDP;
+        record.inPackets = 1 + (i % 100);
+        record.inBytes = 64 * record.inPackets;
+        PackRecordV3(&record, nffile);
+    }
+
+    if (nffile->block_header->NumRecords) {
+        if (WriteBlock(nffile) <= 0) {
+            fprintf(stderr, "Failed to write output buffer to disk: '%s'", strerror(errno));
+        }
+    }
+    CloseUpdateFile(nffile);
+
+}  // End of GenSpillFlows
+
 int main(int argc, char **argv) {
     int i, c;
     master_record_t record;
@@ -760,5 +875,8 @@ int main(int argc, char **argv) {
         }
     }
     CloseUpdateFile(nffile);
+
+    GenDNSFlows("test.dns.nf");
+    GenSpillFlows("test.spill.nf", 100000);
     return 0;
 }
@@ -31,7 +31,11 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -42,6 +46,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "config.h"
@@ -59,10 +64,18 @@
          y) -            \
      1)
 
+#include "dnsparse.h"
 #include "filter.h"
+#include "ja3.h"
+#include "nfconf.h"
 #include "nfdump.h"
 #include "nffile.h"
 #include "nftree.h"
+#include "nfxV3.h"
+#ifdef PCAP
+#include "pcap_reader.h"
+#endif
+#include "streamstat.h"
 #include "util.h"
 
 typedef struct value64_s {
@@ -81,6 +94,16 @@ static int check_filter_block(char *filter, master_record_t *flow_record, int ex
 
 static void check_offset(char *text, pointer_addr_t offset, pointer_addr_t expect);
 
+static void check_ja3(char *text, uint8_t *data, size_t len, char *expect);
+
+static void check_stream_stat(void);
+
+static void check_list_bitmap(char *filter);
+
+#ifdef PCAP
+static void check_pcap_reader(char *text, int swapped, int nsec);
+#endif
+
 static int check_filter_block(char *filter, master_record_t *flow_record, int expect) {
     uint64_t *block = (uint64_t *)flow_record;
 
@@ -122,6 +145,244 @@ static void check_offset(char *text, pointer_addr_t offset, pointer_addr_t expec
     }
 }
 
+static void check_ja3(char *text, uint8_t *data, size_t len, char *expect) {
+    ja3_t ja3;
+    if (!ja3Parse(&ja3, data, len)) {
+        printf("**** FAILED **** %s: ja3 parse error\n", text);
+        exit(255);
+    }
+
+    char hash[33];
+    uint8_t *u8 = (uint8_t *)ja3.md5Hash;
+    for (int i = 0; i < 16; i++) snprintf(hash + (i << 1), 3, "%02x", u8[i]);
+    if (strcmp(hash, expect) == 0) {
+        printf("Success: %s: %s\n", text, hash);
+    } else {
+        printf("**** FAILED **** %s: ja3 expected %s, found %s\n", text, expect, hash);
+        exit(255);
+    }
+}
+
+// all port lists of the filter must be compiled into a bitmap
+static void check_list_bitmap(char *filter) {
+    FilterEngine_t *engine = CompileFilter(filter);
+    if (!engine) {
+        printf("Compile filter: %s failed.\n", filter);
+        exit(254);
+    }
+
+    int lists = 0;
+    for (int i = 1; i <= engine->numBlocks; i++) {
+        if (engine->filter[i].comp != CMP_ULLIST) continue;
+        lists++;
+        if (!((ULongList_t *)engine->filter[i].data)->bitmap) {
+            printf("**** FAILED **** Filter: '%s' list block %d not compiled into a bitmap\n", filter, i);
+            exit(255);
+        }
+    }
+    if (lists == 0) {
+        printf("**** FAILED **** Filter: '%s' no list block\n", filter);
+        exit(255);
+    }
+    printf("Success: bitmap lists: %d Filter: '%s'\n", lists, filter);
+}
+
+// send a request to the stream stat socket and return the answer
+static char *stream_request(char *path, char *request) {
+    static char answer[4096];
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || write(fd, request, strlen(request)) < 0) {
+        printf("**** FAILED **** stream stat request '%s': %s\n", request, strerror(errno));
+        exit(255);
+    }
+
+    size_t len = 0;
+    ssize_t ret;
+    while (len < sizeof(answer) - 1 && (ret = read(fd, answer + len, sizeof(answer) - 1 - len)) > 0) len += ret;
+    answer[len] = '\0';
+    close(fd);
+
+    return answer;
+}
+
+static void stream_flow(uint16_t dstPort, uint8_t proto, uint64_t packets, uint64_t bytes) {
+    char buff[256];
+
+    AddV3Header(buff, recordHeader);
+    PushExtension(recordHeader, EXgenericFlow, genericFlow);
+    genericFlow->msecReceived = time(NULL) * 1000LL;
+    genericFlow->dstPort = dstPort;
+    genericFlow->proto = proto;
+    genericFlow->inPackets = packets;
+    genericFlow->inBytes = bytes;
+    PushExtension(recordHeader, EXipv4Flow, ipv4Flow);
+    ipv4Flow->srcAddr = 0xac100142;
+    ipv4Flow->dstAddr = 0xc0a8aa64;
+    AddStreamStat(recordHeader);
+}
+
+static void check_stream_stat(void) {
+    char *path = "test.stream.sock";
+
+    FILE *fp = fopen("test.stream.conf", "w");
+    if (!fp) {
+        printf("**** FAILED **** stream stat config: %s\n", strerror(errno));
+        exit(255);
+    }
+    fprintf(fp, "[nfcapd]\nstream.socket = \"%s\"\nstream.keys = \"dstport proto\"\nstream.bucket = 10\nstream.window = 60\n", path);
+    fclose(fp);
+
+    if (ConfOpen("test.stream.conf", "nfcapd") != 1 || !OpenStreamStat() || !streamStatEnabled) {
+        printf("**** FAILED **** stream stat open\n");
+        exit(255);
+    }
+    unlink("test.stream.conf");
+
+    // the listen socket must be closed on exec
+    int cloexec = -1;
+    for (int fd = 3; fd < 256; fd++) {
+        struct sockaddr_un addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(fd, (struct sockaddr *)&addr, &len) < 0 || addr.sun_family != AF_UNIX) continue;
+        if (strcmp(addr.sun_path, path) == 0) {
+            cloexec = (fcntl(fd, F_GETFD) & FD_CLOEXEC) != 0;
+            break;
+        }
+    }
+    if (cloexec != 1) {
+        printf("**** FAILED **** stream stat socket not close on exec\n");
+        exit(255);
+    }
+
+    stream_flow(443, IPPROTO_TCP, 10, 1000);
+    stream_flow(443, IPPROTO_TCP, 10, 1000);
+    stream_flow(443, IPPROTO_TCP, 10, 1000);
+    stream_flow(80, IPPROTO_TCP, 5, 500);
+    stream_flow(53, IPPROTO_UDP, 1, 100);
+    stream_flow(53, IPPROTO_UDP, 1, 100);
+
+    char *answer = stream_request(path, "total 60\n");
+    if (strcmp(answer, "flows: 6, packets: 37, bytes: 3700\n") != 0) {
+        printf("**** FAILED **** stream stat total: %s\n", answer);
+        exit(255);
+    }
+    printf("Success: stream stat total\n");
+
+    // header and the top 2 ports by bytes
+    char expect[512];
+    snprintf(expect, sizeof(expect), "%-39s %20s %16s %12s %20s\n%-39s %20u %16u %12u %20u\n%-39s %20u %16u %12u %20u\n", "dstport", "bytes",
+             "packets", "flows", "max error", "443", 3000, 30, 3, 0, "80", 500, 5, 1, 0);
+    answer = stream_request(path, "top dstport 60 2\n");
+    if (strcmp(answer, expect) != 0) {
+        printf("**** FAILED **** stream stat top dstport:\n%s", answer);
+        exit(255);
+    }
+    printf("Success: stream stat top dstport\n");
+
+    answer = stream_request(path, "top srcip\n");
+    if (strncmp(answer, "ERR key srcip not configured", 28) != 0) {
+        printf("**** FAILED **** stream stat unknown key: %s\n", answer);
+        exit(255);
+    }
+    printf("Success: stream stat unknown key\n");
+
+    CloseStreamStat();
+    if (access(path, F_OK) == 0) {
+        printf("**** FAILED **** stream stat socket not removed\n");
+        exit(255);
+    }
+}
+
+#ifdef PCAP
+static uint32_t pcap32(uint32_t val, int swapped) { return swapped ? __builtin_bswap32(val) : val; }
+
+// write a classic pcap file with 2 raw IPv4/UDP packets and read it back
+static void check_pcap_reader(char *text, int swapped, int nsec) {
+    char *path = "test.pcap";
+    uint8_t payload[] = "netflow-test";
+    uint32_t ts[2][2] = {{1700000000, 250000}, {1700000300, 500000}};
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        printf("**** FAILED **** pcap reader %s: %s\n", text, strerror(errno));
+        exit(255);
+    }
+    // magic, version 2.4, thiszone, sigfigs, snaplen, LINKTYPE_RAW
+    uint32_t magic = pcap32(nsec ? 0xa1b23c4d : 0xa1b2c3d4, swapped);
+    uint16_t version[2] = {swapped ? __builtin_bswap16(2) : 2, swapped ? __builtin_bswap16(4) : 4};
+    uint32_t fileHeader[4] = {0, 0, pcap32(65535, swapped), pcap32(101, swapped)};
+    fwrite(&magic, sizeof(magic), 1, fp);
+    fwrite(version, sizeof(version), 1, fp);
+    fwrite(fileHeader, sizeof(fileHeader), 1, fp);
+    for (int i = 0; i < 2; i++) {
+        uint8_t packet[28 + sizeof(payload)];
+        memset(packet, 0, sizeof(packet));
+        struct ip *ip = (struct ip *)packet;
+        ip->ip_v = 4;
+        ip->ip_hl = 5;
+        ip->ip_len = htons(sizeof(packet));
+        ip->ip_p = IPPROTO_UDP;
+        ip->ip_src.s_addr = htonl(0x0a000001 + i);
+        ip->ip_dst.s_addr = htonl(0x0a0000fe);
+        struct udphdr *udp = (struct udphdr *)(packet + 20);
+        udp->uh_sport = htons(2055 + i);
+        udp->uh_dport = htons(9995);
+        udp->uh_ulen = htons(8 + sizeof(payload));
+        memcpy(packet + 28, payload, sizeof(payload));
+
+        uint32_t recordHeader[4] = {pcap32(ts[i][0], swapped), pcap32(nsec ? ts[i][1] * 1000 : ts[i][1], swapped), pcap32(sizeof(packet), swapped),
+                                    pcap32(sizeof(packet), swapped)};
+        fwrite(recordHeader, sizeof(recordHeader), 1, fp);
+        fwrite(packet, sizeof(packet), 1, fp);
+    }
+    fclose(fp);
+
+    if (!setup_pcap_offline(path, NULL)) {
+        printf("**** FAILED **** pcap reader %s: open\n", text);
+        exit(255);
+    }
+    unlink(path);
+
+    struct timeval tv;
+    if (PcapPacketTime(&tv)) {
+        printf("**** FAILED **** pcap reader %s: packet time before first packet\n", text);
+        exit(255);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        uint8_t buffer[2048];
+        struct sockaddr_storage sock;
+        socklen_t size;
+        struct sockaddr_in *in_sock = (struct sockaddr_in *)&sock;
+        ssize_t len = NextPacket(0, buffer, sizeof(buffer), 0, (struct sockaddr *)&sock, &size);
+        if (len != sizeof(payload) || memcmp(buffer, payload, sizeof(payload)) != 0 || in_sock->sin_family != AF_INET ||
+            ntohl(in_sock->sin_addr.s_addr) != (0x0a000001 + i) || ntohs(in_sock->sin_port) != (2055 + i)) {
+            printf("**** FAILED **** pcap reader %s: packet %d, len: %zd\n", text, i, len);
+            exit(255);
+        }
+        if (!PcapPacketTime(&tv) || tv.tv_sec != ts[i][0] || tv.tv_usec != ts[i][1]) {
+            printf("**** FAILED **** pcap reader %s: packet %d time\n", text, i);
+            exit(255);
+        }
+    }
+
+    uint8_t buffer[2048];
+    struct sockaddr_storage sock;
+    socklen_t size;
+    if (NextPacket(0, buffer, sizeof(buffer), 0, (struct sockaddr *)&sock, &size) != -2) {
+        printf("**** FAILED **** pcap reader %s: end of file\n", text);
+        exit(255);
+    }
+    printf("Success: pcap reader %s\n", text);
+}
+#endif
+
 int main(int argc, char **argv) {
     master_record_t flow_record;
     uint64_t *blocks, l;
@@ -409,6 +670,9 @@ int main(int argc, char **argv) {
     ret = check_filter_block("port in [ 62 63 64 254 256 ]", &flow_record, 1);
     ret = check_filter_block("port in [ 62 64 254 256 ]", &flow_record, 0);
     ret = check_filter_block("not port in [ 62 64 254 256 ]", &flow_record, 1);
+    check_list_bitmap("src port in [ 22 80 443 ]");
+    check_list_bitmap("dst port in [ 22 80 443 ]");
+    check_list_bitmap("port in [ 22 80 443 65535 ]");
 
     flow_record.srcas = 123;
     flow_record.dstas = 456;
@@ -448,6 +712,10 @@ int main(int argc, char **argv) {
     ret = check_filter_block("as in [ 122 124 455 456 457]", &flow_record, 1);
     ret = check_filter_block("as in [ 122 124 455 457]", &flow_record, 0);
     ret = check_filter_block("not as in [ 122 124 455 457]", &flow_record, 1);
+    ret = check_filter_block("src as in [ 1 123 70000 4200000000 ]", &flow_record, 1);
+    ret = check_filter_block("src as in [ 1 122 124 70000 4200000000 ]", &flow_record, 0);
+    ret = check_filter_block("as in [ 456 65536 ]", &flow_record, 1);
+    ret = check_filter_block("as in [ 65536 4200000000 ]", &flow_record, 0);
 
     ret = check_filter_block("src net 172.32/16", &flow_record, 1);
     ret = check_filter_block("src net 172.32.7/24", &flow_record, 1);
@@ -921,6 +1189,13 @@ int main(int argc, char **argv) {
     ret = check_filter_block("payload content 'GET /index'", &flow_record, 1);
     ret = check_filter_block("payload content 'POST'", &flow_record, 0);
     ret = check_filter_block("payload regex 'gET' i and sysid 44", &flow_record, 1);
+    ret = check_filter_block("payload regex 'index\\.html HTTP'", &flow_record, 1);
+    ret = check_filter_block("payload regex 'index\\.htm HTTP'", &flow_record, 0);
+    ret = check_filter_block("payload regex '^GET /[a-z]+'", &flow_record, 1);
+    ret = check_filter_block("payload regex '^HTTP'", &flow_record, 0);
+    ret = check_filter_block("payload regex 'http/1\\.1$' im", &flow_record, 1);
+    ret = check_filter_block("payload regex '(T)\\1P/'", &flow_record, 1);
+    ret = check_filter_block("payload regex '(T)\\1T'", &flow_record, 0);
 
     char *ja3s = "123456789abcdef0123456789abcdef0";
     char *pos = ja3s;
@@ -937,6 +1212,69 @@ int main(int argc, char **argv) {
     memset((void *)flow_record.ja3, 0, 16);
     ret = check_filter_block("payload ja3 defined", &flow_record, 0);
 
+    // ClientHello with GREASE values - ja3 string 771,4865-49199,0-10-11-35,29-23,0
+    uint8_t clientHello[] = {
+        0x16, 0x03, 0x01, 0x00, 0x5f, 0x01, 0x00, 0x00, 0x5b, 0x03, 0x03, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+        0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c,
+        0x1d, 0x1e, 0x1f, 0x00, 0x00, 0x06, 0x0a, 0x0a, 0x13, 0x01, 0xc0, 0x2f, 0x01, 0x00, 0x00, 0x2c, 0x0a, 0x0a, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x10, 0x00, 0x0e, 0x00, 0x00, 0x0b, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e, 0x63, 0x6f, 0x6d,
+        0x00, 0x0a, 0x00, 0x06, 0x00, 0x04, 0x00, 0x1d, 0x00, 0x17, 0x00, 0x0b, 0x00, 0x02, 0x01, 0x00, 0x00, 0x23, 0x00, 0x00};
+    check_ja3("ja3 ClientHello", clientHello, sizeof(clientHello), "0f375cda5fca92c20fe61d8590c24346");
+    // same elements with a different random hit the ja3 cache
+    clientHello[11] = 0xff;
+    check_ja3("ja3 ClientHello cached", clientHello, sizeof(clientHello), "0f375cda5fca92c20fe61d8590c24346");
+    // swapped ciphers - 771,49199-4865,0-10-11-35,29-23,0
+    clientHello[48] = 0xc0;
+    clientHello[49] = 0x2f;
+    clientHello[50] = 0x13;
+    clientHello[51] = 0x01;
+    check_ja3("ja3 ClientHello swapped ciphers", clientHello, sizeof(clientHello), "39e4e7844469e51367818064c2ed2fd4");
+    clientHello[48] = 0x13;
+    clientHello[49] = 0x01;
+    clientHello[50] = 0xc0;
+    clientHello[51] = 0x2f;
+    check_ja3("ja3 ClientHello again", clientHello, sizeof(clientHello), "0f375cda5fca92c20fe61d8590c24346");
+
+    // DNS response www.example.com AAAA NXDOMAIN
+    uint8_t dnsMsg[] = {0x12, 0x34, 0x81, 0x83, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 3,   'W', 'W', 'W', 7,   'E',
+                        'x',  'a',  'm',  'p',  'l',  'e',  3,    'c',  'o',  'm',  0,    0x00, 0x1c, 0x00, 0x01};
+    uint16_t srcPort = flow_record.srcPort;
+    uint8_t proto = flow_record.proto;
+    flow_record.srcPort = 53;
+    flow_record.proto = IPPROTO_UDP;
+    flow_record.inPayload = (char *)dnsMsg;
+    flow_record.inPayloadLength = sizeof(dnsMsg);
+    flow_record.dnsFlags = 0;
+    AddDNSInfo(&flow_record);
+    ret = check_filter_block("payload dns defined", &flow_record, 1);
+    ret = check_filter_block("payload dns response", &flow_record, 1);
+    ret = check_filter_block("payload dns qname www.example.com", &flow_record, 1);
+    ret = check_filter_block("payload dns qname WWW.Example.COM.", &flow_record, 1);
+    ret = check_filter_block("payload dns qname example.com", &flow_record, 0);
+    ret = check_filter_block("payload dns qtype AAAA", &flow_record, 1);
+    ret = check_filter_block("payload dns qtype 28", &flow_record, 1);
+    ret = check_filter_block("payload dns qtype A", &flow_record, 0);
+    ret = check_filter_block("payload dns rcode nxdomain", &flow_record, 1);
+    ret = check_filter_block("payload dns rcode 3", &flow_record, 1);
+    ret = check_filter_block("payload dns rcode NOERROR", &flow_record, 0);
+    if (strcmp(dnsNameString(flow_record.dnsQname), "www.example.com") != 0) {
+        printf("**** FAILED **** dns name interning\n");
+        exit(255);
+    }
+
+    // the question name must not point forward or to itself
+    dnsMsg[12] = 0xC0;
+    dnsMsg[13] = 12;
+    flow_record.dnsQname = 0;
+    flow_record.dnsFlags = 0;
+    AddDNSInfo(&flow_record);
+    ret = check_filter_block("payload dns defined", &flow_record, 0);
+    flow_record.srcPort = srcPort;
+    flow_record.proto = proto;
+    flow_record.inPayload = NULL;
+    flow_record.inPayloadLength = 0;
+    flow_record.dnsFlags = 0;
+
     flow_record.tun_src_ip.V6[0] = 0;
     flow_record.tun_src_ip.V6[1] = 0;
     flow_record.tun_src_ip.V4 = 0xac200710;
@@ -1267,6 +1605,13 @@ int main(int argc, char **argv) {
     ret = check_filter_block("dst nip fe80::2110:abcd:1235:fffe", &flow_record, 1);
     ret = check_filter_block("dst nip fe80::2110:abcd:1235:fffc", &flow_record, 0);
 
+#endif
+
+    check_stream_stat();
+
+#ifdef PCAP
+    check_pcap_reader("native", 0, 0);
+    check_pcap_reader("swapped nsec", 1, 1);
 #endif
 
     return 0;
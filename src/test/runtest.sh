@@ -63,6 +63,166 @@ $NFDUMP -v test.5.flows.nf >/dev/null
 $NFDUMP -r test.5.flows.nf -q -o raw | grep -v RecordCount >test.5-2.out
 diff -u test.5.out test.5-2.out
 
+# test query server - output must match direct queries
+# stderr is streamed back as well - use -W 1 to prevent worker warnings
+rm -f test.sock
+$NFDUMP -d test.sock &
+QSPID=$!
+sleep 1
+$NFDUMP -U test.sock -W 1 -r test.flows.nf -q -o raw >test.10.out
+diff -u test.10.out nftest.1.out
+$NFDUMP -r test.flows.nf -q -s ip/bytes 'host 172.16.2.66' >test.11-1.out
+$NFDUMP -U test.sock -W 1 -r test.flows.nf -q -s ip/bytes 'host 172.16.2.66' >test.11-2.out
+diff -u test.11-1.out test.11-2.out
+# second query uses the cached filter
+$NFDUMP -U test.sock -W 1 -r test.flows.nf -q -s ip/bytes 'host 172.16.2.66' >test.11-3.out
+diff -u test.11-1.out test.11-3.out
+
+# test distributed query - merged partial results must match a single query
+$NFDUMP -r test.flows.nf -w test.12-1.flows.nf 'src ip 172.16.2.66'
+$NFDUMP -r test.flows.nf -w test.12-2.flows.nf 'not src ip 172.16.2.66'
+for args in "-s ip/bytes -s dstport -n 0" "-A srcip,dstport -O bytes" "-b"; do
+	$NFDUMP -r test.flows.nf -q $args | sort >test.12-1.out
+	$NFDUMP -P "$NFDUMP -W 1 -r test.12-1.flows.nf" -P "$NFDUMP -W 1 -r test.12-2.flows.nf" -q $args | sort >test.12-2.out
+	diff -u test.12-1.out test.12-2.out
+done
+# grouped and attached -P options
+$NFDUMP -r test.flows.nf -q -s ip/bytes -n 0 | sort >test.12-1.out
+$NFDUMP -qP "$NFDUMP -W 1 -r test.12-1.flows.nf" -P"$NFDUMP -W 1 -r test.12-2.flows.nf" -s ip/bytes -n0 | sort >test.12-2.out
+diff -u test.12-1.out test.12-2.out
+$NFDUMP -P unix:test.sock -W 1 -r test.flows.nf -q -s ip/bytes 'host 172.16.2.66' >test.12-3.out
+diff -u test.11-1.out test.12-3.out
+
+# test query cache - first run fills the cache, second run merges cached results
+rm -rf testcache
+mkdir testcache
+printf '[nfdump]\nquerycache.path = "testcache"\n' >test.cache.conf
+for args in "-s ip/bytes -s dstport -n 0" "-A srcip,dstport -O bytes" "-b"; do
+	$NFDUMP -r test.flows.nf -q $args 'host 172.16.2.66' | sort >test.13-1.out
+	$NFDUMP -C test.cache.conf -r test.flows.nf -q $args 'host 172.16.2.66' | sort >test.13-2.out
+	diff -u test.13-1.out test.13-2.out
+	$NFDUMP -C test.cache.conf -r test.flows.nf -q $args 'host 172.16.2.66' | sort >test.13-3.out
+	diff -u test.13-1.out test.13-3.out
+done
+if [ $(ls testcache | wc -l) -ne 3 ]; then
+	echo query cache entries missing
+	exit 1
+fi
+rm -rf testcache test.cache.conf
+
+# test rollups - stats answered from the rollup must match a full query
+rm -rf testrollup
+mkdir testrollup
+printf '[nfdump]\nrollup.path = "testrollup"\n' >test.rollup.conf
+$NFDUMP -C test.rollup.conf -r test.flows.nf -Y
+if [ $(ls testrollup | wc -l) -ne 1 ]; then
+	echo rollup missing
+	exit 1
+fi
+$NFDUMP -r test.flows.nf -q -s ip/bytes -s port -s proto -s srcas -n 0 | sort >test.14-1.out
+$NFDUMP -C test.rollup.conf -r test.flows.nf -q -s ip/bytes -s port -s proto -s srcas -n 0 | sort >test.14-2.out
+diff -u test.14-1.out test.14-2.out
+rm -rf testrollup test.rollup.conf
+
+# test explain - the query output must not change, the report goes to stderr
+$NFDUMP -r test.flows.nf -q -s ip/bytes 'host 172.16.2.66' >test.15-1.out
+$NFDUMP -r test.flows.nf -q -e=json -s ip/bytes 'host 172.16.2.66' >test.15-2.out 2>test.15-3.out
+diff -u test.15-1.out test.15-2.out
+if ! grep -q '"evaluations"' test.15-3.out; then
+	echo explain report missing
+	exit 1
+fi
+
+# test dns stats - names must survive partial results, the query cache and rollups
+$NFDUMP -r test.dns.nf -q -s dnsqname -s dnsqtype -n 0 | sort >test.16-1.out
+if ! grep -q 'www.example.com' test.16-1.out; then
+	echo dns names missing
+	exit 1
+fi
+$NFDUMP -P "$NFDUMP -W 1 -r test.dns.nf" -q -s dnsqname -s dnsqtype -n 0 | sort >test.16-2.out
+diff -u test.16-1.out test.16-2.out
+rm -rf testcache
+mkdir testcache
+printf '[nfdump]\nquerycache.path = "testcache"\n' >test.cache.conf
+$NFDUMP -r test.dns.nf -q -s dnsqname -n 0 'proto udp' | sort >test.16-3.out
+$NFDUMP -C test.cache.conf -r test.dns.nf -q -s dnsqname -n 0 'proto udp' | sort >test.16-4.out
+diff -u test.16-3.out test.16-4.out
+$NFDUMP -C test.cache.conf -r test.dns.nf -q -s dnsqname -n 0 'proto udp' | sort >test.16-4.out
+diff -u test.16-3.out test.16-4.out
+rm -rf testcache test.cache.conf
+rm -rf testrollup
+mkdir testrollup
+printf '[nfdump]\nrollup.path = "testrollup"\nrollup.stats = "dnsqname"\n' >test.rollup.conf
+$NFDUMP -C test.rollup.conf -r test.dns.nf -Y
+$NFDUMP -r test.dns.nf -q -s dnsqname -n 0 | sort >test.16-5.out
+$NFDUMP -C test.rollup.conf -r test.dns.nf -q -s dnsqname -n 0 | sort >test.16-6.out
+diff -u test.16-5.out test.16-6.out
+rm -rf testrollup test.rollup.conf
+
+# test migration of a nfdump 1.6 file - the flows must not change, only the record size
+cp nffile16.nf test.17.flows.nf
+chmod 640 test.17.flows.nf
+$NFDUMP -r test.17.flows.nf -q -o raw | grep -v ' size  ' >test.17-1.out
+$NFDUMP -r test.17.flows.nf -u >test.17-2.out
+if ! grep -q 'Migrated files: 1, current files: 0, failed: 0' test.17-2.out; then
+	echo migration failed
+	exit 1
+fi
+$NFDUMP -r test.17.flows.nf -q -o raw | grep -v ' size  ' >test.17-3.out
+diff -u test.17-1.out test.17-3.out
+if [ "$(ls -l test.17.flows.nf | cut -c1-10)" != "-rw-r-----" ]; then
+	echo migration did not keep the file mode
+	exit 1
+fi
+# a current file is not rewritten
+$NFDUMP -r test.17.flows.nf -u >test.17-2.out
+if ! grep -q 'Migrated files: 0, current files: 1, failed: 0' test.17-2.out || [ -f test.17.flows.nf-tmp ]; then
+	echo migration rewrites a current file
+	exit 1
+fi
+
+# test aggregation with a memory budget - the spilled result must match the in memory result
+printf '[nfdump]\naggr.maxmem = 1\n' >test.spill.conf
+for args in "-A srcip,dstport -O bytes" "-a -O tstart" "-s ip/bytes -s port -s proto -n 0"; do
+	$NFDUMP -r test.spill.nf -q $args | sort >test.18-1.out
+	$NFDUMP -C test.spill.conf -r test.spill.nf -q $args 2>test.18-3.out | sort >test.18-2.out
+	if ! grep -q 'spill to disk' test.18-3.out; then
+		echo aggregation did not spill
+		exit 1
+	fi
+	diff -u test.18-1.out test.18-2.out
+done
+rm -f test.spill.conf
+
+# test compact aggregation - a format with aggregated fields only must print the same as with full records.
+# The trailing non aggregated field forces full records and is cut off again
+FMT='%ts %td %sa %dp %pr %pkt %byt %fl %bps %bpp'
+for args in "-A srcip,dstport" "-A srcip4/24,proto -O bytes" "-a"; do
+	for file in test.flows.nf test.spill.nf; do
+		$NFDUMP -r $file -q $args -o "fmt:$FMT" >test.19-1.out
+		$NFDUMP -r $file -q $args -o "fmt:$FMT|%sp" | sed 's/|.*//' >test.19-2.out
+		diff -u test.19-1.out test.19-2.out
+	done
+done
+# srcnet/dstnet print the prefix length of the flow
+for args in "-A srcnet|%sn" "-A srcnet,dstnet,proto|%sn %dn %pr"; do
+	FMT="%ts %td ${args#*|} %pkt %byt %fl"
+	$NFDUMP -r test.flows.nf -q ${args%|*} -o "fmt:$FMT" >test.19-1.out
+	$NFDUMP -r test.flows.nf -q ${args%|*} -o "fmt:$FMT|%sp" | sed 's/|.*//' >test.19-2.out
+	diff -u test.19-1.out test.19-2.out
+	if ! grep -q '72.138.170.0/24 ' test.19-1.out; then
+		echo srcnet without prefix length
+		exit 1
+	fi
+done
+
+kill -TERM $QSPID
+wait $QSPID
+if [ -S test.sock ]; then
+	echo query server does not terminate
+	exit 1
+fi
+
 # create testdir dir for flow replay
 if [ -d testdir ]; then
 	rm -f testdir/*
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2023, Peter Haag
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *   * Neither the name of the author nor the names of its contributors may be
+ *     used to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark of the record sort algorithms of nfdump
+ * sortbench [-n num] [num ...]
+ * sorts num random records with quicksort and radix sort, num nearly time ordered
+ * records with blocksort and runsort and verifies the result
+ * default: 10^6 and 10^7 records
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "blocksort.h"
+#include "config.h"
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+
+}  // End of now
+
+// flow counts are mostly small with a long tail
+static void init(SortRecord_t *data, size_t len) {
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < len; i++) {
+        // xorshift64
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        data[i].count = x >> (24 + (x & 0x1f));
+        data[i].record = (void *)i;
+    }
+
+}  // End of init
+
+// time stamps of a few exporters, each in order, interleaved at block boundaries
+static void init_time(SortRecord_t *data, size_t len) {
+    uint64_t msec = 1562833830000ULL;
+    for (size_t i = 0; i < len; i++) {
+        uint64_t exporter = (i >> 10) & 0x3;
+        data[i].count = msec + (i >> 2) + exporter * 5000;
+        data[i].record = (void *)i;
+    }
+
+}  // End of init_time
+
+static int verify(SortRecord_t *data, size_t len) {
+    for (size_t i = 1; i < len; i++) {
+        if (data[i].count < data[i - 1].count) return 0;
+    }
+    return 1;
+
+}  // End of verify
+
+static int bench(size_t len) {
+    SortRecord_t *data = malloc(len * sizeof(SortRecord_t));
+    if (!data) {
+        perror("malloc() failed");
+        return 0;
+    }
+
+    init(data, len);
+    double t0 = now();
+    quicksort(data, len);
+    double quick = now() - t0;
+    if (!verify(data, len)) {
+        printf("quicksort failed for %zu records\n", len);
+        free(data);
+        return 0;
+    }
+
+    init(data, len);
+    t0 = now();
+    if (!radixsort(data, len)) {
+        printf("radixsort failed to allocate memory for %zu records\n", len);
+        free(data);
+        return 0;
+    }
+    double radix = now() - t0;
+    if (!verify(data, len)) {
+        printf("radixsort failed for %zu records\n", len);
+        free(data);
+        return 0;
+    }
+
+    printf("%12zu records: quicksort %8.3fs, radixsort %8.3fs, speedup %5.2f\n", len, quick, radix, radix > 0 ? quick / radix : 0);
+
+    init_time(data, len);
+    t0 = now();
+    blocksort(data, len);
+    double block = now() - t0;
+    if (!verify(data, len)) {
+        printf("blocksort failed for %zu records\n", len);
+        free(data);
+        return 0;
+    }
+
+    init_time(data, len);
+    t0 = now();
+    runsort(data, len);
+    double run = now() - t0;
+    if (!verify(data, len)) {
+        printf("runsort failed for %zu records\n", len);
+        free(data);
+        return 0;
+    }
+
+    printf("%12zu time ordered: blocksort %8.3fs, runsort   %8.3fs, speedup %5.2f\n", len, block, run, run > 0 ? block / run : 0);
+    free(data);
+    return 1;
+
+}  // End of bench
+
+int main(int argc, char **argv) {
+    printf("Sort benchmark with %ld cpus online\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+    if (argc == 1) {
+        return bench(1000000) && bench(10000000) ? 0 : 255;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        size_t len = strtoull(argv[i], NULL, 10);
+        if (len == 0) {
+            printf("Invalid number of records: %s\n", argv[i]);
+            exit(255);
+        }
+        if (!bench(len)) exit(255);
+    }
+    return 0;
+
+}  // End of main